@@ -1,4 +1,8 @@
 #include "camera.h"
+#include "camera_replay.h"
+#include "camera_ring.h"
+#include "camera_adapt.h"
+#include "monitor.h"
 #include "inference.h"
 #include "esp_log.h"
 #include "esp_camera.h"
@@ -6,12 +10,19 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "inference.h"
+#include "img_converters.h"
 #include <string.h>
 
 static const char *TAG = "CAMERA";
 
-// Queue per comunicazione con AI task
-static QueueHandle_t ai_task_queue = NULL;
+// Istanza unica della fotocamera (un solo driver per il sensore)
+camera_t g_camera;
+
+// Protegge i contatori di riferimento dei frame e l'ultima foto (rilasciati anche da executor e handler HTTP)
+static portMUX_TYPE camera_frames_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Un frame in background più vecchio di così non vale più un'inferenza
+#define CAMERA_BACKGROUND_FRAME_DEADLINE_MS 3000
 
 // Mappa delle risoluzioni disponibili
 static const camera_resolution_info_t resolution_map[] = {
@@ -37,6 +48,87 @@ static const camera_resolution_info_t resolution_map[] = {
     //FRAMESIZE_P_3MP,  // 864x1536, registrazione video 3MP per dispositivi mobili
 };
 
+#define CAMERA_RESOLUTION_COUNT ((int)(sizeof(resolution_map) / sizeof(resolution_map[0])))
+#define CAMERA_SWITCH_SETTLE_FRAMES 3 //frame scartati al massimo dopo un cambio di risoluzione sul sensore
+#define CAMERA_DEFAULT_RESOLUTION_INDEX 5 // QVGA
+#define CAMERA_JPEG_MIN_CAPACITY (16 * 1024) //buffer iniziale della codifica JPEG su richiesta (classe più piccola del slab)
+#define CAMERA_SLAB_MONITOR_NAME "camera_slab"
+
+static esp_err_t camera_apply_resolution(camera_t *camera, int index);
+static esp_err_t camera_driver_init(camera_t *camera);
+
+// Prende il mutex del driver misurando la contesa tra gli utilizzatori dell'istanza condivisa
+static bool camera_lock(camera_t *camera, TickType_t timeout)
+{
+    int64_t start_us = esp_timer_get_time();
+    bool contended = xSemaphoreTake(camera->camera_mutex, 0) != pdTRUE;
+    bool taken = !contended || xSemaphoreTake(camera->camera_mutex, timeout) == pdTRUE;
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    taskENTER_CRITICAL(&camera_frames_lock);
+    if (taken) {
+        camera->capture_stats.lock_acquired++;
+    } else {
+        camera->capture_stats.lock_timeouts++;
+    }
+    if (contended) {
+        camera->capture_stats.lock_contended++;
+        camera->capture_stats.lock_wait_us += wait_us;
+        if (wait_us > camera->capture_stats.max_lock_wait_us) {
+            camera->capture_stats.max_lock_wait_us = wait_us;
+        }
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    return taken;
+}
+
+// Sorgente del sensore reale: operazioni del driver esp32-camera
+static esp_err_t sensor_source_init(void *ctx, const camera_config_t *config)
+{
+    return esp_camera_init(config);
+}
+
+static esp_err_t sensor_source_deinit(void *ctx)
+{
+    return esp_camera_deinit();
+}
+
+static camera_fb_t *sensor_source_fb_get(void *ctx)
+{
+    return esp_camera_fb_get();
+}
+
+static void sensor_source_fb_return(void *ctx, camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+static bool sensor_source_set_framesize(void *ctx, framesize_t framesize)
+{
+    sensor_t *sensor = esp_camera_sensor_get();
+    return sensor && sensor->set_framesize && sensor->set_framesize(sensor, framesize) == 0;
+}
+
+const camera_source_t camera_sensor_source = {
+    .name = "sensore",
+    .raw_formats = true,
+    .init = sensor_source_init,
+    .deinit = sensor_source_deinit,
+    .fb_get = sensor_source_fb_get,
+    .fb_return = sensor_source_fb_return,
+    .set_framesize = sensor_source_set_framesize,
+};
+
+static inline camera_fb_t *camera_fb_get(camera_t *camera)
+{
+    return camera->source->fb_get(camera->source_ctx);
+}
+
+static inline void camera_fb_return(camera_t *camera, camera_fb_t *fb)
+{
+    camera->source->fb_return(camera->source_ctx, fb);
+}
+
 // Configurazione camera esp32-s3 ai camera
 static const camera_config_t default_camera_config = {
   .pin_pwdn      = -1,
@@ -61,7 +153,7 @@ static const camera_config_t default_camera_config = {
   .pixel_format  = PIXFORMAT_JPEG,
   .frame_size    = FRAMESIZE_QVGA, //Dimensione del frame della fotocamera
   .jpeg_quality  = 10, // più è alto, e più l'immagine è compressa
-  .fb_count      = 1,
+  .fb_count      = CAMERA_DRIVER_FB_COUNT, // più buffer: il sensore continua ad acquisire mentre un frame viene copiato
   .fb_location   = CAMERA_FB_IN_PSRAM, //Usa PSRAM per i buffer della fotocamera
   .grab_mode     = CAMERA_GRAB_LATEST, // Cambiato per gestire meglio risoluzioni basse
   .sccb_i2c_port = 0
@@ -69,47 +161,255 @@ static const camera_config_t default_camera_config = {
 
 esp_err_t camera_init(camera_t *camera)
 {
-    if (!camera) {
+#ifdef CAMERA_REPLAY_BY_DEFAULT
+    // Build senza sensore (QEMU, banco di prova): la catena viene alimentata dal corpus registrato
+    return camera_init_with_source(camera, &camera_replay_source, get_camera_replay_instance());
+#else
+    return camera_init_with_source(camera, &camera_sensor_source, NULL);
+#endif
+}
+
+// Frame più grande che il driver può consegnare: il buffer JPEG del driver alla risoluzione più alta,
+// oppure il frame grezzo più grande accettato se la sorgente produce anche RGB565
+static size_t camera_max_frame_bytes(const camera_source_t *source)
+{
+    size_t max_bytes = 0;
+    for (int i = 0; i < CAMERA_RESOLUTION_COUNT; i++) {
+        size_t pixels = (size_t)resolution_map[i].width * resolution_map[i].height;
+        size_t jpeg = pixels / CAMERA_DRIVER_JPEG_FB_DIVISOR;
+        size_t raw = pixels * 2;
+        if (jpeg > max_bytes) {
+            max_bytes = jpeg;
+        }
+        if (source->raw_formats && raw <= CAMERA_RAW_MAX_FRAME_BYTES && raw > max_bytes) {
+            max_bytes = raw;
+        }
+    }
+    return max_bytes;
+}
+
+// Init fallito: la regione dei frame, il provider del monitor e i mutex non restano allocati
+// (una nuova init ne crea altri)
+static void camera_init_release(camera_t *camera)
+{
+    if (camera->camera_mutex) {
+        vSemaphoreDelete(camera->camera_mutex);
+        camera->camera_mutex = NULL;
+    }
+    if (camera->jpeg_mutex) {
+        vSemaphoreDelete(camera->jpeg_mutex);
+        camera->jpeg_mutex = NULL;
+    }
+    monitor_unregister_provider(CAMERA_SLAB_MONITOR_NAME);
+    camera_slab_deinit(&camera->slab);
+}
+
+esp_err_t camera_init_with_source(camera_t *camera, const camera_source_t *source, void *source_ctx)
+{
+    if (!camera || !source) {
         ESP_LOGE(TAG, "Puntatore camera NULL");
         return ESP_ERR_INVALID_ARG;
     }
 
-    ESP_LOGI(TAG, "Inizializzazione fotocamera ESP32CAM...");
+    if (camera->initialized) {
+        if (camera->source == source && camera->source_ctx == source_ctx) {
+            return ESP_OK;
+        }
+        ESP_LOGE(TAG, "Fotocamera già inizializzata sulla sorgente %s", camera->source->name);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Driver perso in una reinizializzazione fallita: slab e mutex sono ancora allocati
+    if (camera->camera_mutex && camera_deinit(camera) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Inizializzazione fotocamera ESP32CAM (sorgente: %s)...", source->name);
 
     // Inizializza struttura camera
     memset(camera, 0, sizeof(camera_t));
+    camera->source = source;
+    camera->source_ctx = source_ctx;
     
     // Copia configurazione di default
     memcpy(&camera->camera_config, &default_camera_config, sizeof(camera_config_t));
     
     // Imposta risoluzione di default
-    camera->current_resolution_index = 5; // QVGA
+    camera->current_resolution_index = CAMERA_DEFAULT_RESOLUTION_INDEX;
     camera->current_framesize = resolution_map[camera->current_resolution_index].framesize;
     camera->camera_config.frame_size = camera->current_framesize;
+    camera->pixel_format = camera->camera_config.pixel_format;
+
+    // Buffer dei frame: un'unica regione PSRAM per tutta la vita della camera, mai l'heap generale
+    esp_err_t ret = camera_slab_init(&camera->slab, camera_max_frame_bytes(source), CAMERA_SLAB_PSRAM_BUDGET);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < CAMERA_FRAME_POOL_SIZE; i++) {
+        camera->frames[i].slab = &camera->slab;
+    }
+    camera_slab_register_monitor(&camera->slab, CAMERA_SLAB_MONITOR_NAME);
 
     // Crea un semaforo mutex (inizializzato ad 1) per l'accesso thread-safe sulla fotocamera
     camera->camera_mutex = xSemaphoreCreateMutex();
-    if (camera->camera_mutex == NULL)
+    camera->jpeg_mutex = xSemaphoreCreateMutex();
+    if (camera->camera_mutex == NULL || camera->jpeg_mutex == NULL)
     {
         ESP_LOGE(TAG, "Errore creazione mutex fotocamera");
+        camera_init_release(camera);
         return ESP_FAIL;
     }
 
-    // Inizializza la fotocamera
-    esp_err_t ret = esp_camera_init(&camera->camera_config);
+    ret = camera_driver_init(camera);
+    if (ret != ESP_OK) {
+        camera_init_release(camera);
+        return ret;
+    }
+    camera->initialized = true;
+    return ESP_OK;
+}
+
+// Risoluzione utilizzabile nel formato corrente: i frame grezzi sono limitati a CAMERA_RAW_MAX_FRAME_BYTES
+static bool camera_resolution_allowed(const camera_t *camera, int index)
+{
+    if (camera->pixel_format == PIXFORMAT_JPEG) {
+        return true;
+    }
+    return (size_t)resolution_map[index].width * resolution_map[index].height * 2 <= CAMERA_RAW_MAX_FRAME_BYTES;
+}
+
+// In JPEG il driver accetta frame più piccoli del buffer e la risoluzione cambia sul sensore.
+// Nei formati grezzi esp32-camera fissa all'init la dimensione di ricezione: un frame di dimensione
+// diversa viene scartato, quindi ogni cambio di risoluzione reinizializza il driver
+static bool camera_live_switch_supported(const camera_t *camera)
+{
+    return camera->pixel_format == PIXFORMAT_JPEG;
+}
+
+// Inizializza il driver: in JPEG alla risoluzione più grande, così i frame buffer sono dimensionati una
+// volta sola e i cambi di risoluzione successivi avvengono sul sensore (che viene poi portato alla
+// risoluzione corrente); nei formati grezzi direttamente alla risoluzione corrente
+static esp_err_t camera_driver_init(camera_t *camera)
+{
+    int max_index = camera->current_resolution_index;
+    if (camera_live_switch_supported(camera)) {
+        max_index = CAMERA_RESOLUTION_COUNT - 1;
+        while (max_index > 0 && !camera_resolution_allowed(camera, max_index)) {
+            max_index--;
+        }
+    }
+    camera->max_resolution_index = max_index;
+    camera->camera_config.frame_size = resolution_map[max_index].framesize;
+    esp_err_t ret = camera->source->init(camera->source_ctx, &camera->camera_config);
+    if (ret != ESP_OK && max_index != camera->current_resolution_index) {
+        ESP_LOGW(TAG, "Init alla risoluzione massima fallito (%s), init alla risoluzione corrente",
+                 esp_err_to_name(ret));
+        camera->max_resolution_index = camera->current_resolution_index;
+        camera->camera_config.frame_size = camera->current_framesize;
+        ret = camera->source->init(camera->source_ctx, &camera->camera_config);
+    }
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Camera init failed with error 0x%x: %s", ret, esp_err_to_name(ret));
         return ret;
     }
     else
     {
-        ESP_LOGI(TAG, "Camera inizializzata con successo");
+        ESP_LOGI(TAG, "Camera inizializzata con successo (%s, buffer per %dx%d)",
+                 camera->pixel_format == PIXFORMAT_JPEG ? "JPEG" : "RGB565",
+                 resolution_map[camera->max_resolution_index].width, resolution_map[camera->max_resolution_index].height);
     }
 
-    camera->initialized = true;
+    // Porta il sensore alla risoluzione corrente
+    if (camera->max_resolution_index != camera->current_resolution_index &&
+        camera_apply_resolution(camera, camera->current_resolution_index) != ESP_OK) {
+        ESP_LOGE(TAG, "Impossibile impostare la risoluzione corrente");
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
+// Reinizializzazione fallita (mutex della camera già acquisito): il driver torna alla risoluzione e al formato
+// precedenti. Se fallisce anche questo la camera non è più inizializzata e l'acquisizione continua si ferma;
+// slab, mutex e frame ancora in uso restano a camera_deinit
+static void camera_driver_restore(camera_t *camera, int index, pixformat_t format, bool model_window)
+{
+    // Il driver può essere rimasto a metà (init riuscito, risoluzione non applicata): l'errore di deinit
+    // su un driver già spento non conta
+    camera->source->deinit(camera->source_ctx);
+    camera->pixel_format = format;
+    camera->camera_config.pixel_format = format;
+    camera->current_resolution_index = index;
+    camera->current_framesize = resolution_map[index].framesize;
+    camera->camera_config.frame_size = camera->current_framesize;
+    camera->max_resolution_index = index;
+    camera->model_window = model_window;
+    esp_err_t ret = camera->source->init(camera->source_ctx, &camera->camera_config);
+    if (ret == ESP_OK) {
+        ESP_LOGW(TAG, "Driver ripristinato a %dx%d (%s)", resolution_map[index].width, resolution_map[index].height,
+                 format == PIXFORMAT_JPEG ? "JPEG" : "RGB565");
+        return;
+    }
+    ESP_LOGE(TAG, "Ripristino del driver fallito (%s): fotocamera non più disponibile", esp_err_to_name(ret));
+    camera->initialized = false;
+    camera->capture_running = false;
+}
+
+esp_err_t camera_set_pixel_format(camera_t *camera, pixformat_t format)
+{
+    if (!camera || !camera->initialized) {
+        ESP_LOGE(TAG, "Camera non inizializzata");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (format != PIXFORMAT_JPEG && format != PIXFORMAT_RGB565) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (format != PIXFORMAT_JPEG && !camera->source->raw_formats) {
+        ESP_LOGW(TAG, "La sorgente %s produce solo frame JPEG", camera->source->name);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (format == camera->pixel_format) {
+        return ESP_OK;
+    }
+
+    //attende 5 secondi e prendere il mutex, se non riesce dopo 5sec ritorna errore
+    if (!camera_lock(camera, pdMS_TO_TICKS(5000)))
+    {
+        ESP_LOGE(TAG, " Timeout acquisizione mutex fotocamera");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Il formato cambia la dimensione dei buffer del driver: serve una reinizializzazione.
+    // I frame già nel pool restano validi nel formato con cui sono stati acquisiti
+    int previous_index = camera->current_resolution_index;
+    pixformat_t previous_format = camera->pixel_format;
+    bool previous_model_window = camera->model_window;
+    esp_err_t ret = camera->source->deinit(camera->source_ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Errore deinit camera: %s", esp_err_to_name(ret));
+    }
+    camera->pixel_format = format;
+    camera->camera_config.pixel_format = format;
+    if (!camera_resolution_allowed(camera, camera->current_resolution_index)) {
+        ESP_LOGW(TAG, "Risoluzione %dx%d troppo grande per i frame grezzi, uso %dx%d",
+                 resolution_map[camera->current_resolution_index].width,
+                 resolution_map[camera->current_resolution_index].height,
+                 resolution_map[CAMERA_DEFAULT_RESOLUTION_INDEX].width,
+                 resolution_map[CAMERA_DEFAULT_RESOLUTION_INDEX].height);
+        camera->current_resolution_index = CAMERA_DEFAULT_RESOLUTION_INDEX;
+        camera->current_framesize = resolution_map[CAMERA_DEFAULT_RESOLUTION_INDEX].framesize;
+        camera->model_window = false;
+    }
+    ret = camera_driver_init(camera);
+    if (ret != ESP_OK) {
+        camera_driver_restore(camera, previous_index, previous_format, previous_model_window);
+    }
+    xSemaphoreGive(camera->camera_mutex);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Formato del sensore: %s", format == PIXFORMAT_JPEG ? "JPEG" : "RGB565 (JPEG solo su richiesta)");
+    }
+    return ret;
+}
+
 esp_err_t camera_deinit(camera_t *camera)
 {
     if (!camera) {
@@ -118,67 +418,441 @@ esp_err_t camera_deinit(camera_t *camera)
 
     ESP_LOGI(TAG, "Deinizializzazione fotocamera...");
 
-    // Libera memoria foto
-    if (camera->last_photo_buffer) {
-        free(camera->last_photo_buffer);
-        camera->last_photo_buffer = NULL;
-        camera->last_photo_size = 0;
+    // La task di acquisizione usa eventi, slab e mutex eliminati qui sotto
+    if (camera_stop_capture(camera) != ESP_OK) {
+        ESP_LOGE(TAG, "Acquisizione continua ancora attiva: deinit annullato");
+        return ESP_ERR_TIMEOUT;
     }
 
-    // Deinizializza camera
-    esp_err_t ret = esp_camera_deinit();
+    // Attende lo scatto in corso: dopo il mutex nessuno acquisisce più nuovi frame
+    if (camera->camera_mutex && !camera_lock(camera, pdMS_TO_TICKS(5000))) {
+        ESP_LOGE(TAG, "Timeout acquisizione mutex fotocamera: deinit annullato");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Rilascia l'ultima foto: i blocchi dei frame non più in uso tornano al slab
+    taskENTER_CRITICAL(&camera_frames_lock);
+    camera_frame_t *last = camera->last_frame;
+    camera->last_frame = NULL;
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    camera_frame_release(last);
+
+    // Un frame ancora referenziato punta nella regione dello slab: la fotocamera resta inizializzata
+    // (senza acquisizione continua) finché i consumatori non lo rilasciano
+    uint32_t in_use = 0;
+    taskENTER_CRITICAL(&camera_frames_lock);
+    for (int i = 0; i < CAMERA_FRAME_POOL_SIZE; i++) {
+        in_use += camera->frames[i].refcount != 0 ? 1 : 0;
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    if (in_use > 0) {
+        ESP_LOGE(TAG, "%lu frame ancora in uso: deinit annullato", in_use);
+        if (camera->camera_mutex) {
+            xSemaphoreGive(camera->camera_mutex);
+        }
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (camera->frame_events) {
+        vEventGroupDelete(camera->frame_events);
+        camera->frame_events = NULL;
+    }
+    monitor_unregister_provider(CAMERA_SLAB_MONITOR_NAME);
+    camera_slab_deinit(&camera->slab);
+
+    // Deinizializza camera (il driver è già spento se una reinizializzazione è fallita)
+    esp_err_t ret = camera->source && camera->initialized ? camera->source->deinit(camera->source_ctx) : ESP_OK;
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Errore deinit camera: %s", esp_err_to_name(ret));
     }
 
-    // Elimina mutex
+    // Elimina mutex (il mutex della fotocamera è ancora preso da questa task)
     if (camera->camera_mutex) {
+        xSemaphoreGive(camera->camera_mutex);
         vSemaphoreDelete(camera->camera_mutex);
         camera->camera_mutex = NULL;
     }
+    if (camera->jpeg_mutex) {
+        vSemaphoreDelete(camera->jpeg_mutex);
+        camera->jpeg_mutex = NULL;
+    }
 
     camera->initialized = false;
     return ret;
 }
 
-esp_err_t camera_capture_photo(camera_t *camera)
+void camera_frame_retain(camera_frame_t *frame)
+{
+    if (!frame) {
+        return;
+    }
+    taskENTER_CRITICAL(&camera_frames_lock);
+    frame->refcount++;
+    taskEXIT_CRITICAL(&camera_frames_lock);
+}
+
+void camera_frame_release(camera_frame_t *frame)
+{
+    if (!frame) {
+        return;
+    }
+    uint8_t *data = NULL;
+    size_t len = 0;
+    uint8_t *jpeg = NULL;
+    size_t jpeg_capacity = 0;
+    taskENTER_CRITICAL(&camera_frames_lock);
+    if (frame->refcount > 0) {
+        frame->refcount--;
+        // Ultimo consumatore: i buffer vengono staccati dallo slot e restituiti al slab fuori dal lock
+        if (frame->refcount == 0) {
+            data = frame->data;
+            len = frame->len;
+            jpeg = frame->jpeg;
+            jpeg_capacity = frame->jpeg_capacity;
+            frame->data = NULL;
+            frame->capacity = 0;
+            frame->jpeg = NULL;
+            frame->jpeg_capacity = 0;
+            frame->jpeg_len = 0;
+        }
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    camera_slab_free(frame->slab, data, len);
+    camera_slab_free(frame->slab, jpeg, jpeg_capacity);
+}
+
+// Prende uno slot libero dal pool (con un riferimento per il chiamante)
+static camera_frame_t *camera_frame_acquire(camera_t *camera)
+{
+    camera_frame_t *frame = NULL;
+    taskENTER_CRITICAL(&camera_frames_lock);
+    for (int i = 0; i < CAMERA_FRAME_POOL_SIZE; i++) {
+        if (camera->frames[i].refcount == 0) {
+            frame = &camera->frames[i];
+            frame->refcount = 1;
+            break;
+        }
+    }
+    if (!frame) {
+        camera->frame_pool_exhausted++;
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    return frame;
+}
+
+static void camera_frame_job_release(uint8_t *jpeg_data, void *release_ctx)
+{
+    camera_frame_release((camera_frame_t *)release_ctx);
+}
+
+void camera_frame_attach_job(camera_frame_t *frame, inference_job_t *job)
+{
+    if (!frame || !job) {
+        return;
+    }
+    job->jpeg_data = frame->data;
+    job->jpeg_size = frame->len;
+    job->format = frame->format == PIXFORMAT_RGB565 ? INFERENCE_PIXEL_RGB565 : INFERENCE_PIXEL_JPEG;
+    job->width = frame->width;
+    job->height = frame->height;
+    job->release = camera_frame_job_release;
+    job->release_ctx = frame;
+    job->capture_time_us = frame->timestamp_us;
+}
+
+// Uscita della codifica JPEG: scrive in un blocco del slab, sostituito con uno più grande
+// quando il JPEG non ci sta più (la capacità richiesta raddoppia a ogni sostituzione)
+static size_t camera_jpeg_write(void *arg, size_t index, const void *data, size_t len)
+{
+    camera_frame_t *frame = (camera_frame_t *)arg;
+    if (index + len > frame->jpeg_capacity) {
+        size_t capacity = frame->jpeg_capacity ? frame->jpeg_capacity * 2 : CAMERA_JPEG_MIN_CAPACITY;
+        while (capacity < index + len) {
+            capacity *= 2;
+        }
+        uint8_t *buffer = (uint8_t *)camera_slab_alloc(frame->slab, capacity, NULL);
+        if (!buffer) {
+            return 0;
+        }
+        if (frame->jpeg) {
+            memcpy(buffer, frame->jpeg, index);
+            camera_slab_free(frame->slab, frame->jpeg, frame->jpeg_capacity);
+        }
+        frame->jpeg = buffer;
+        frame->jpeg_capacity = capacity;
+    }
+    memcpy(frame->jpeg + index, data, len);
+    frame->jpeg_len = index + len;
+    return len;
+}
+
+esp_err_t camera_frame_get_jpeg(camera_t *camera, camera_frame_t *frame, const uint8_t **jpeg, size_t *jpeg_len)
+{
+    if (!camera || !frame || !jpeg || !jpeg_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (frame->format == PIXFORMAT_JPEG) {
+        *jpeg = frame->data;
+        *jpeg_len = frame->len;
+        return ESP_OK;
+    }
+
+    // Frame grezzo: la codifica avviene una sola volta per frame, al primo client che lo chiede
+    xSemaphoreTake(camera->jpeg_mutex, portMAX_DELAY);
+    esp_err_t ret = ESP_OK;
+    if (frame->jpeg_len == 0) {
+        int64_t start_us = esp_timer_get_time();
+        if (!fmt2jpg_cb(frame->data, frame->len, frame->width, frame->height, frame->format,
+                        CAMERA_ON_DEMAND_JPEG_QUALITY, camera_jpeg_write, frame)) {
+            ESP_LOGE(TAG, "Errore codifica JPEG del frame %lu", frame->sequence);
+            frame->jpeg_len = 0;
+            ret = ESP_FAIL;
+        } else {
+            uint32_t encode_us = (uint32_t)(esp_timer_get_time() - start_us);
+            taskENTER_CRITICAL(&camera_frames_lock);
+            camera->capture_stats.jpeg_encoded++;
+            camera->capture_stats.jpeg_encode_us += encode_us;
+            taskEXIT_CRITICAL(&camera_frames_lock);
+            ESP_LOGI(TAG, "Frame %lu codificato in JPEG su richiesta: %zu bytes in %lu ms",
+                     frame->sequence, frame->jpeg_len, encode_us / 1000);
+        }
+    }
+    xSemaphoreGive(camera->jpeg_mutex);
+
+    *jpeg = frame->jpeg;
+    *jpeg_len = frame->jpeg_len;
+    return ret;
+}
+
+// Copia il buffer del driver in uno slot libero del pool (l'unica copia del frame).
+// Il buffer del driver può così tornare subito alla camera invece di restare bloccato dai consumatori
+static esp_err_t camera_frame_from_fb(camera_t *camera, const camera_fb_t *fb, int64_t captured_us, camera_frame_t **out)
+{
+    camera_frame_t *frame = camera_frame_acquire(camera);
+    if (!frame)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Blocco della classe adatta alla dimensione del frame (restituito al slab con l'ultimo riferimento)
+    frame->data = (uint8_t *)camera_slab_alloc(frame->slab, fb->len, &frame->capacity);
+    if (!frame->data)
+    {
+        ESP_LOGE(TAG, "Nessun blocco libero nel slab per un frame da %zu bytes", fb->len);
+        camera_frame_release(frame);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(frame->data, fb->buf, fb->len);
+    frame->len = fb->len;
+    frame->format = fb->format;
+    frame->jpeg_len = 0;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    frame->timestamp_us = captured_us;
+    *out = frame;
+    return ESP_OK;
+}
+
+// Pubblica il frame come ultima foto: la camera tiene un riferimento, quello della foto precedente
+// viene rilasciato, e chi attende un frame più recente viene svegliato
+static void camera_publish_frame(camera_t *camera, camera_frame_t *frame)
+{
+    taskENTER_CRITICAL(&camera_frames_lock);
+    camera_frame_t *previous = camera->last_frame;
+    frame->sequence = ++camera->frame_sequence;
+    frame->refcount++;
+    camera->last_frame = frame;
+    camera->capture_stats.frames_captured++;
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    camera_frame_release(previous);
+
+    if (camera->frame_events) {
+        // I task in attesa vengono sbloccati al set; il bit viene subito ripulito per il frame successivo
+        xEventGroupSetBits(camera->frame_events, CAMERA_FRAME_EVENT_NEW);
+        xEventGroupClearBits(camera->frame_events, CAMERA_FRAME_EVENT_NEW);
+    }
+}
+
+// Latenza tra l'acquisizione e la consegna al consumatore
+static void camera_note_consumed(camera_t *camera, const camera_frame_t *frame)
+{
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - frame->timestamp_us);
+    taskENTER_CRITICAL(&camera_frames_lock);
+    camera_capture_stats_t *stats = &camera->capture_stats;
+    stats->frames_consumed++;
+    stats->total_latency_us += latency_us;
+    if (latency_us > stats->max_latency_us) {
+        stats->max_latency_us = latency_us;
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+}
+
+// Task di acquisizione continua: i buffer del driver ruotano e l'ultimo frame è sempre pubblicato
+static void camera_capture_task(void *pvParameters)
+{
+    camera_t *camera = (camera_t *)pvParameters;
+    ESP_LOGI(TAG, "Acquisizione continua avviata");
+
+    while (camera->capture_running) {
+        // Il mutex protegge solo il driver (cambio risoluzione), non i consumatori dei frame
+        if (!camera_lock(camera, pdMS_TO_TICKS(CAMERA_CAPTURE_LOCK_TIMEOUT_MS))) {
+            continue;
+        }
+        // Driver perso in una reinizializzazione fallita: la task esce al prossimo giro
+        if (!camera->initialized) {
+            xSemaphoreGive(camera->camera_mutex);
+            continue;
+        }
+        camera_fb_t *fb = camera_fb_get(camera);
+        int64_t captured_us = esp_timer_get_time();
+        if (!fb) {
+            xSemaphoreGive(camera->camera_mutex);
+            ESP_LOGW(TAG, "Frame non disponibile dal driver");
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        camera_frame_t *frame = NULL;
+        esp_err_t ret = camera_frame_from_fb(camera, fb, captured_us, &frame);
+        camera_fb_return(camera, fb);
+        xSemaphoreGive(camera->camera_mutex);
+
+        if (ret != ESP_OK) {
+            // Tutti i frame sono trattenuti dai consumatori: si salta questo frame
+            taskENTER_CRITICAL(&camera_frames_lock);
+            camera->capture_stats.frames_dropped++;
+            taskEXIT_CRITICAL(&camera_frames_lock);
+            vTaskDelay(pdMS_TO_TICKS(5));
+            continue;
+        }
+        camera_publish_frame(camera, frame);
+        // Il riferimento della task passa alla camera (ultima foto)
+        camera_frame_release(frame);
+    }
+
+    ESP_LOGI(TAG, "Acquisizione continua fermata");
+    camera->capture_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t camera_start_capture(camera_t *camera)
 {
     if (!camera || !camera->initialized) {
         ESP_LOGE(TAG, "Camera non inizializzata");
         return ESP_ERR_INVALID_STATE;
     }
+    if (camera->capture_task) {
+        return ESP_OK;
+    }
+    if (!camera->frame_events) {
+        camera->frame_events = xEventGroupCreate();
+        if (!camera->frame_events) {
+            ESP_LOGE(TAG, "Errore creazione eventi dei frame");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    camera->capture_running = true;
+    if (xTaskCreatePinnedToCore(camera_capture_task, "camera_capture", CAMERA_CAPTURE_STACK_SIZE, camera,
+                                CAMERA_CAPTURE_PRIORITY, &camera->capture_task, CAMERA_CAPTURE_CORE) != pdPASS) {
+        camera->capture_running = false;
+        ESP_LOGE(TAG, "Errore creazione task di acquisizione");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_stop_capture(camera_t *camera)
+{
+    if (!camera || !camera->capture_task) {
+        return ESP_OK;
+    }
+    camera->capture_running = false;
+    // La task esce al termine del frame corrente, che può attendere il mutex e poi il timeout del driver
+    for (int i = 0; i < CAMERA_CAPTURE_STOP_TIMEOUT_MS / 10 && camera->capture_task; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (camera->capture_task) {
+        ESP_LOGE(TAG, "La task di acquisizione non è uscita entro %d ms", CAMERA_CAPTURE_STOP_TIMEOUT_MS);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_wait_frame(camera_t *camera, uint32_t after_sequence, TickType_t timeout, camera_frame_t **out)
+{
+    if (!camera || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = NULL;
+    if (!camera->capture_task || !camera->frame_events) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        camera_frame_t *frame = camera_get_last_frame(camera);
+        if (frame && frame->sequence > after_sequence) {
+            camera_note_consumed(camera, frame);
+            *out = frame;
+            return ESP_OK;
+        }
+        camera_frame_release(frame);
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return ESP_ERR_TIMEOUT;
+        }
+        // Un frame pubblicato tra il controllo e l'attesa fa attendere al più il frame successivo
+        xEventGroupWaitBits(camera->frame_events, CAMERA_FRAME_EVENT_NEW, pdFALSE, pdFALSE, timeout - elapsed);
+    }
+}
+
+esp_err_t camera_capture_frame(camera_t *camera, camera_frame_t **out)
+{
+    if (!camera || !camera->initialized || !out) {
+        ESP_LOGE(TAG, "Camera non inizializzata");
+        return ESP_ERR_INVALID_STATE;
+    }
+    *out = NULL;
+
+    // Acquisizione continua attiva: nessuna attesa se l'ultimo frame è abbastanza recente,
+    // altrimenti il primo frame nuovo (al più un intervallo del sensore)
+    if (camera->capture_task) {
+        camera_frame_t *frame = camera_get_last_frame(camera);
+        if (frame && esp_timer_get_time() - frame->timestamp_us <= CAMERA_FRESH_FRAME_MAX_AGE_MS * 1000LL) {
+            camera_note_consumed(camera, frame);
+            *out = frame;
+            return ESP_OK;
+        }
+        uint32_t sequence = frame ? frame->sequence : 0;
+        camera_frame_release(frame);
+        return camera_wait_frame(camera, sequence, pdMS_TO_TICKS(1000), out);
+    }
 
     ESP_LOGI(TAG, "Acquisizione foto...");
 
     //attende 5 secondi e prendere il mutex, se non riesce dopo 5sec ritorna errore
-    if (xSemaphoreTake(camera->camera_mutex, pdMS_TO_TICKS(5000)) != pdTRUE)
+    if (!camera_lock(camera, pdMS_TO_TICKS(5000)))
     {
         ESP_LOGE(TAG, " Timeout acquisizione mutex fotocamera");
         return ESP_ERR_TIMEOUT;
     }
 
-    // Libera memoria foto precedente
-    if (camera->last_photo_buffer != NULL)
-    {
-        ESP_LOGI(TAG, "Liberazione memoria foto precedente");
-        free(camera->last_photo_buffer);
-        camera->last_photo_buffer = NULL;
-        camera->last_photo_size = 0;
-    }
-
     // Scarta il primo frame (potrebbe essere vecchio)
     ESP_LOGI(TAG, "Scarto primo frame (potrebbe essere vecchio)...");
-    camera_fb_t *fb_old = esp_camera_fb_get(); //acquisisce il frame 
+    camera_fb_t *fb_old = camera_fb_get(camera); //acquisisce il frame 
     if (fb_old) {
         ESP_LOGI(TAG, "Frame vecchio scartato: %d bytes", fb_old->len);
-        esp_camera_fb_return(fb_old); //riempie il buffer della fotocamera col frame 
+        camera_fb_return(camera, fb_old); //riempie il buffer della fotocamera col frame 
     }
 
     // Piccolo delay per permettere alla fotocamera di acquisire un nuovo frame
     vTaskDelay(pdMS_TO_TICKS(100));
 
     // Acquisisci il frame fresco
-    camera_fb_t *fb = esp_camera_fb_get();
+    camera_fb_t *fb = camera_fb_get(camera);
     if (!fb)
     {
         ESP_LOGE(TAG, "Errore acquisizione frame fotocamera");
@@ -188,45 +862,48 @@ esp_err_t camera_capture_photo(camera_t *camera)
 
     ESP_LOGI(TAG, "Frame fresco acquisito: %d bytes", fb->len);
 
-    // Alloca memoria per salvare la foto
-    camera->last_photo_buffer = (uint8_t *)malloc(fb->len);
-    if (camera->last_photo_buffer == NULL)
+    camera_frame_t *frame = NULL;
+    esp_err_t ret = camera_frame_from_fb(camera, fb, esp_timer_get_time(), &frame);
+
+    // Restituisci il frame buffer
+    camera_fb_return(camera, fb);
+
+    if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "Errore allocazione memoria per foto");
-        esp_camera_fb_return(fb);
+        ESP_LOGE(TAG, "Nessun frame libero nel pool (%d frame)", CAMERA_FRAME_POOL_SIZE);
         xSemaphoreGive(camera->camera_mutex);
-        return ESP_ERR_NO_MEM;
+        return ret;
     }
 
-    // Copia i dati
-    //sposta fb->len byte dal buffer fb->buf (memoria temporanea) al buffer last_photo_buffer (memoria permanente)
-    memcpy(camera->last_photo_buffer, fb->buf, fb->len);
-    camera->last_photo_size = fb->len;
-    camera->last_photo_timestamp = esp_timer_get_time() / 1000000;
-
-    // Restituisci il frame buffer
-    esp_camera_fb_return(fb);
-
-    ESP_LOGI(TAG, "Foto salvata: %d bytes", camera->last_photo_size);
+    camera_publish_frame(camera, frame);
+    ESP_LOGI(TAG, "Foto salvata: %d bytes (frame %lu)", frame->len, frame->sequence);
 
     xSemaphoreGive(camera->camera_mutex); // rilascia il mutex, permettendo a altri task di accedere alla fotocamera
+    *out = frame;
     return ESP_OK;
 }
 
-esp_err_t camera_get_last_photo(camera_t *camera, uint8_t **buffer, size_t *size)
+esp_err_t camera_capture_photo(camera_t *camera)
 {
-    if (!camera || !buffer || !size) {
-        return ESP_ERR_INVALID_ARG;
-    }
+    camera_frame_t *frame = NULL;
+    esp_err_t ret = camera_capture_frame(camera, &frame);
+    // La foto resta disponibile come ultima foto della camera
+    camera_frame_release(frame);
+    return ret;
+}
 
-    if (camera->last_photo_buffer == NULL || camera->last_photo_size == 0)
-    {
-        return ESP_ERR_NOT_FOUND;
+camera_frame_t* camera_get_last_frame(camera_t *camera)
+{
+    if (!camera) {
+        return NULL;
     }
-
-    *buffer = camera->last_photo_buffer;
-    *size = camera->last_photo_size;
-    return ESP_OK;
+    taskENTER_CRITICAL(&camera_frames_lock);
+    camera_frame_t *frame = camera->last_frame;
+    if (frame) {
+        frame->refcount++;
+    }
+    taskEXIT_CRITICAL(&camera_frames_lock);
+    return frame;
 }
 
 void camera_get_current_resolution(camera_t *camera, int *width, int *height)
@@ -245,79 +922,191 @@ void camera_get_current_resolution(camera_t *camera, int *width, int *height)
     }
 }
 
-esp_err_t camera_change_resolution(camera_t *camera, int direction)
+static bool camera_resolution_fits(int index, int max_index)
 {
-    if (!camera || !camera->initialized) {
-        ESP_LOGE(TAG, "Camera non inizializzata");
-        return ESP_ERR_INVALID_STATE;
-    }
+    return resolution_map[index].width <= resolution_map[max_index].width &&
+           resolution_map[index].height <= resolution_map[max_index].height;
+}
 
-    //attende 5 secondi e prendere il mutex, se non riesce dopo 5sec ritorna errore
-    if (xSemaphoreTake(camera->camera_mutex, pdMS_TO_TICKS(5000)) != pdTRUE)
-    {
-        ESP_LOGE(TAG, " Timeout acquisizione mutex fotocamera");
-        return ESP_ERR_TIMEOUT;
+// Applica la risoluzione (mutex della camera già acquisito dal chiamante). In JPEG sul sensore se i buffer
+// del driver la contengono; reinizializzazione completa per risoluzioni oltre quella di init e, nei formati
+// grezzi, per ogni cambio
+static esp_err_t camera_apply_resolution(camera_t *camera, int index)
+{
+    int64_t start_us = esp_timer_get_time();
+    framesize_t framesize = resolution_map[index].framesize;
+    bool live = false;
+
+    if (camera_live_switch_supported(camera) && camera_resolution_fits(index, camera->max_resolution_index)) {
+        live = camera->source->set_framesize(camera->source_ctx, framesize);
+        if (!live) {
+            ESP_LOGW(TAG, "Il sensore non accetta %dx%d al volo", resolution_map[index].width, resolution_map[index].height);
+        }
     }
-        
-    // Cambia l'indice in base alla direzione
-    if (direction == 0) {
-        // Decrementa
-        camera->current_resolution_index--;
-        if (camera->current_resolution_index < 0) {
-            camera->current_resolution_index = sizeof(resolution_map) / sizeof(resolution_map[0]) - 1;
+
+    if (live) {
+        // Scarta i frame già in coda nel driver alla risoluzione precedente
+        for (int i = 0; i < CAMERA_SWITCH_SETTLE_FRAMES; i++) {
+            camera_fb_t *fb = camera_fb_get(camera);
+            if (!fb) {
+                break;
+            }
+            bool settled = fb->width == (size_t)resolution_map[index].width &&
+                           fb->height == (size_t)resolution_map[index].height;
+            camera_fb_return(camera, fb);
+            if (settled) {
+                break;
+            }
         }
     } else {
-        // Incrementa
-        camera->current_resolution_index++;
-        if (camera->current_resolution_index >= sizeof(resolution_map) / sizeof(resolution_map[0])) {
-            camera->current_resolution_index = 0;
+        // Reinizializzazione completa: i nuovi buffer vengono dimensionati sulla nuova risoluzione
+        camera->camera_config.frame_size = framesize;
+        esp_err_t ret = camera->source->deinit(camera->source_ctx);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Errore deinit camera: %s", esp_err_to_name(ret));
+        }
+        ret = camera->source->init(camera->source_ctx, &camera->camera_config);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Errore riavvio camera: %s", esp_err_to_name(ret));
+            camera_driver_restore(camera, camera->current_resolution_index, camera->pixel_format,
+                                  camera->model_window);
+            return ret;
         }
+        camera->max_resolution_index = index;
     }
-    
-    // Imposta la nuova risoluzione
-    framesize_t new_framesize = resolution_map[camera->current_resolution_index].framesize;
-    camera->current_framesize = new_framesize; 
-    camera->camera_config.frame_size = new_framesize;
-    
-    ESP_LOGI(TAG, "Direction: %d, Current index: %d", direction, camera->current_resolution_index);
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+    camera->current_resolution_index = index;
+    camera->current_framesize = framesize;
 
-    //deinizializza la camera
-    esp_err_t ret1 = esp_camera_deinit();           // stop camera
-    if (ret1 != ESP_OK) {
-        ESP_LOGE(TAG, "Errore deinit camera: %s", esp_err_to_name(ret1));
+    uint32_t switch_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    camera_switch_stats_t *stats = &camera->switch_stats;
+    if (live) {
+        stats->live_switches++;
+    } else {
+        stats->reinit_switches++;
     }
-    else
-    {
-        ESP_LOGI(TAG, "Camera deinizializzata con successo");
+    stats->last_switch_ms = switch_ms;
+    if (switch_ms > stats->max_switch_ms) {
+        stats->max_switch_ms = switch_ms;
     }
+    ESP_LOGI(TAG, "Risoluzione %dx%d applicata in %lu ms (%s)", resolution_map[index].width,
+             resolution_map[index].height, switch_ms, live ? "sul sensore" : "reinit del driver");
+    return ESP_OK;
+}
 
-    vTaskDelay(pdMS_TO_TICKS(100));
-
-    //riavvia la camera con la nuova configurazione
-    esp_err_t ret2 = esp_camera_init(&camera->camera_config); // riavvio con nuova configurazione
-    if (ret2 != ESP_OK) {
-        ESP_LOGE(TAG, "Errore riavvio camera: %s", esp_err_to_name(ret2));
+esp_err_t camera_set_resolution(camera_t *camera, int index)
+{
+    if (!camera || !camera->initialized) {
+        ESP_LOGE(TAG, "Camera non inizializzata");
+        return ESP_ERR_INVALID_STATE;
     }
-    else
-    {
-        ESP_LOGI(TAG, "Camera riavviata con successo");
+    if (index < 0 || index >= CAMERA_RESOLUTION_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (index == camera->current_resolution_index) {
+        return ESP_OK;
+    }
+    if (!camera_resolution_allowed(camera, index)) {
+        ESP_LOGW(TAG, "Risoluzione %dx%d non disponibile per i frame grezzi", resolution_map[index].width,
+                 resolution_map[index].height);
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
+    //attende 5 secondi e prendere il mutex, se non riesce dopo 5sec ritorna errore
+    if (!camera_lock(camera, pdMS_TO_TICKS(5000)))
+    {
+        ESP_LOGE(TAG, " Timeout acquisizione mutex fotocamera");
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t ret = camera_apply_resolution(camera, index);
     xSemaphoreGive(camera->camera_mutex);
+    return ret;
+}
+
+esp_err_t camera_change_resolution(camera_t *camera, int direction)
+{
+    if (!camera || !camera->initialized) {
+        ESP_LOGE(TAG, "Camera non inizializzata");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Cambia l'indice in base alla direzione (saltando le risoluzioni non disponibili nel formato corrente)
+    int index = camera->current_resolution_index;
+    do {
+        if (direction == 0) {
+            // Decrementa
+            index--;
+            if (index < 0) {
+                index = CAMERA_RESOLUTION_COUNT - 1;
+            }
+        } else {
+            // Incrementa
+            index++;
+            if (index >= CAMERA_RESOLUTION_COUNT) {
+                index = 0;
+            }
+        }
+    } while (!camera_resolution_allowed(camera, index));
+
+    ESP_LOGI(TAG, "Direction: %d, Current index: %d", direction, index);
+
+    esp_err_t ret = camera_set_resolution(camera, index);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // Una scelta manuale della risoluzione esce dalla modalità finestra allineata al modello
+    camera->model_window = false;
 
     // Ottieni dimensioni della risoluzione corrente
     int width, height;
     camera_get_current_resolution(camera, &width, &height);
     printf("===========================\n");
-    printf("Risoluzione impostata: %dx%d\n", width, height);
+    printf("Risoluzione impostata: %dx%d (in %lu ms)\n", width, height, camera->switch_stats.last_switch_ms);
     printf("===========================\n");
 
-
     return ESP_OK;
 }
 
+esp_err_t camera_set_model_window(camera_t *camera, int width, int height)
+{
+    if (!camera || !camera->initialized) {
+        ESP_LOGE(TAG, "Camera non inizializzata");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Le voci quadrate della mappa (128x128, 240x240, 320x320) sono prodotte dal sensore con una
+    // finestra centrale 1:1 scalata dall'ISP: il frame arriva già alla dimensione del modello
+    for (int i = 0; i < CAMERA_RESOLUTION_COUNT; i++) {
+        if (resolution_map[i].width != width || resolution_map[i].height != height) {
+            continue;
+        }
+        int restore_index = camera->model_window ? camera->window_restore_index : camera->current_resolution_index;
+        esp_err_t ret = camera_set_resolution(camera, i);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        camera->window_restore_index = restore_index;
+        camera->model_window = true;
+        ESP_LOGI(TAG, "Finestra del sensore allineata al modello: %dx%d", width, height);
+        return ESP_OK;
+    }
+
+    ESP_LOGW(TAG, "Nessuna finestra del sensore %dx%d: il frame verrà ridimensionato dal preprocessing", width, height);
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t camera_clear_model_window(camera_t *camera)
+{
+    if (!camera || !camera->model_window) {
+        return ESP_OK;
+    }
+    esp_err_t ret = camera_set_resolution(camera, camera->window_restore_index);
+    if (ret == ESP_OK) {
+        camera->model_window = false;
+    }
+    return ret;
+}
+
 int camera_get_resolution_count(void)
 {
     return sizeof(resolution_map) / sizeof(resolution_map[0]);
@@ -331,6 +1120,15 @@ const camera_resolution_info_t* camera_get_resolution_info(int index)
     return NULL;
 }
 
+void camera_job_complete(inference_job_status_t status, const inference_result_t *result, void *user_ctx)
+{
+    // Una persona rilevata congela la storia recente in una clip (se l'anello è attivo)
+    camera_ring_job_complete(status, result, get_camera_ring_instance());
+    if (status == INFERENCE_JOB_DONE && result) {
+        camera_adapt_observe(get_camera_adapt_instance(), result);
+    }
+}
+
 esp_err_t camera_capture_and_inference(camera_t *camera, inference_result_t *result)
 {
     if (!camera || !camera->initialized) {
@@ -339,82 +1137,114 @@ esp_err_t camera_capture_and_inference(camera_t *camera, inference_result_t *res
     }
 
     ESP_LOGI(TAG, "Avvio scatto foto e invio alla AI task...");
-    
-    // Scatta una nuova foto
-    esp_err_t ret = camera_capture_photo(camera);
+
+    //cronometriamo il tempo di scatto foto
+    int64_t start_time = esp_timer_get_time();
+
+    // Scatta una nuova foto: il frame viene condiviso con l'executor senza copie
+    camera_frame_t *frame = NULL;
+    esp_err_t ret = camera_capture_frame(camera, &frame);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Errore durante lo scatto della foto");
         return ret;
     }
 
-    //cronometriamo il tempo di scatto foto
-    uint32_t start_time = esp_timer_get_time() / 1000000;
+    //calcoliamo il tempo di scatto foto
+    uint32_t photo_time = (uint32_t)((esp_timer_get_time() - start_time) / 1000);
+    ESP_LOGI(TAG, "Tempo di scatto foto: %lu ms", photo_time);
+
+    // Job YOLO in background: l'executor rilascia il frame quando ha finito
+    inference_job_t job = {};
+    job.type = INFERENCE_JOB_YOLO;
+    job.priority = INFERENCE_PRIORITY_BACKGROUND;
+    camera_frame_attach_job(frame, &job);
+    job.deadline_us = esp_timer_get_time() + CAMERA_BACKGROUND_FRAME_DEADLINE_MS * 1000LL;
+    job.on_complete = camera_job_complete;
+    job.user_ctx = camera;
+
+    inference_executor_t *exec = get_inference_executor_instance();
+    if (result == NULL) {
+        // Nessun risultato richiesto: il frame viene elaborato in modo asincrono
+        ret = inference_executor_submit(exec, &job, 0);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Errore invio frame all'executor di inferenza: %s", esp_err_to_name(ret));
+            camera_frame_release(frame);
+            return ret;
+        }
+        ESP_LOGI(TAG, "Frame inviato all'executor per inferenza");
+        return ESP_OK;
+    }
 
-    // Ottieni i dati della foto
-    uint8_t *photo_buffer;
-    size_t photo_size;
-    ret = camera_get_last_photo(camera, &photo_buffer, &photo_size);
+    // Risultato richiesto: attende la risposta dell'executor tramite l'handle
+    memset(result, 0, sizeof(inference_result_t));
+    inference_handle_t handle = NULL;
+    ret = inference_executor_submit_async(exec, &job, 0, &handle);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Nessuna foto disponibile per l'inferenza");
+        ESP_LOGE(TAG, "Errore invio frame all'executor di inferenza: %s", esp_err_to_name(ret));
+        camera_frame_release(frame);
         return ret;
     }
-    
-    // Alloca memoria per copiare il frame (la AI task lo libererà)
-    uint8_t *frame_copy = (uint8_t *)malloc(photo_size);
-    if (!frame_copy) {
-        ESP_LOGE(TAG, "Errore allocazione memoria per copia frame");
-        return ESP_ERR_NO_MEM;
-    }
-    
-    // Copia il frame
-    memcpy(frame_copy, photo_buffer, photo_size);
 
-    //calcoliamo il tempo di scatto foto
-    uint32_t end_time = esp_timer_get_time() / 1000000;
-    uint32_t photo_time = end_time - start_time;
-    ESP_LOGI(TAG, "Tempo di scatto foto: %d ms", photo_time);
-
-    // Prepara messaggio per AI task
-    ai_task_message_t message = {
-        .image_buffer = frame_copy,
-        .image_size = photo_size,
-        .timestamp = (uint32_t)(esp_timer_get_time() / 1000000)
-    };
-    
-    // Invia il messaggio alla AI task
-    if (xQueueSend(ai_task_queue, &message, pdMS_TO_TICKS(5000)) != pdTRUE) {
-        ESP_LOGE(TAG, "Timeout invio messaggio alla AI task");
-        free(frame_copy);
-        return ESP_ERR_TIMEOUT;
+    inference_job_status_t status = INFERENCE_JOB_FAILED;
+    ret = inference_executor_wait(exec, handle, pdMS_TO_TICKS(CAMERA_BACKGROUND_FRAME_DEADLINE_MS * 2), result, &status);
+    inference_executor_release(exec, handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Timeout in attesa del risultato dell'inferenza");
+        return ret;
     }
-    
-    ESP_LOGI(TAG, "Frame inviato alla AI task per inferenza");
-    
-    // Se il parametro result non è NULL, per ora restituiamo un risultato vuoto
-    // (in futuro potremmo implementare una queue di risposta)
-    if (result != NULL) {
-        memset(result, 0, sizeof(inference_result_t));
+    if (status != INFERENCE_JOB_DONE) {
+        ESP_LOGW(TAG, "Frame non elaborato (esito %d)", status);
+        return ESP_FAIL;
     }
-
     return ESP_OK;
-} 
+}
 
-esp_err_t camera_init_ai_queue(void)
+void camera_get_capture_stats(camera_t *camera, camera_capture_stats_t *stats)
 {
-    ESP_LOGI(TAG, "Inizializzazione queue per AI task...");
-    
-    // Crea la queue per i messaggi (max 5 messaggi in coda)
-    ai_task_queue = xQueueCreate(5, sizeof(ai_task_message_t));
-    if (ai_task_queue == NULL) {
-        ESP_LOGE(TAG, "Errore creazione queue per AI task");
-        return ESP_FAIL;
+    if (!camera || !stats) {
+        return;
+    }
+    taskENTER_CRITICAL(&camera_frames_lock);
+    memcpy(stats, &camera->capture_stats, sizeof(camera_capture_stats_t));
+    stats->pool_exhausted = camera->frame_pool_exhausted;
+    taskEXIT_CRITICAL(&camera_frames_lock);
+}
+
+void camera_print_capture_stats(camera_t *camera)
+{
+    if (!camera) {
+        return;
+    }
+    camera_capture_stats_t stats;
+    camera_get_capture_stats(camera, &stats);
+
+    printf("\n=== ACQUISIZIONE FOTOCAMERA ===\n");
+    printf("Sorgente: %s\n", camera->source ? camera->source->name : "-");
+    printf("Modalità: %s, formato del sensore: %s\n", camera->capture_task ? "continua" : "su richiesta",
+           camera->pixel_format == PIXFORMAT_JPEG ? "JPEG" : "RGB565 (doppio flusso)");
+    printf("Frame acquisiti: %lu, scartati (pool pieno): %lu, ultimo numero di sequenza: %lu\n",
+           stats.frames_captured, stats.frames_dropped, camera->frame_sequence);
+    printf("Frame consegnati: %lu, latenza acquisizione->consumatore media %lu ms, max %lu ms\n",
+           stats.frames_consumed,
+           stats.frames_consumed ? (uint32_t)(stats.total_latency_us / stats.frames_consumed / 1000) : 0,
+           stats.max_latency_us / 1000);
+    printf("Pool frame esaurito: %lu volte\n", stats.pool_exhausted);
+    printf("Codifiche JPEG su richiesta: %lu, media %lu ms\n", stats.jpeg_encoded,
+           stats.jpeg_encoded ? (uint32_t)(stats.jpeg_encode_us / stats.jpeg_encoded / 1000) : 0);
+    printf("Mutex del driver: %lu acquisizioni, %lu con attesa (media %lu us, max %lu us), %lu timeout\n",
+           stats.lock_acquired, stats.lock_contended,
+           stats.lock_contended ? (uint32_t)(stats.lock_wait_us / stats.lock_contended) : 0,
+           stats.max_lock_wait_us, stats.lock_timeouts);
+    printf("Cambi di risoluzione: %lu sul sensore, %lu con reinit, ultimo %lu ms, max %lu ms\n",
+           camera->switch_stats.live_switches, camera->switch_stats.reinit_switches,
+           camera->switch_stats.last_switch_ms, camera->switch_stats.max_switch_ms);
+    printf("===============================\n\n");
+    if (camera->source == &camera_replay_source) {
+        camera_replay_print_stats((camera_replay_t *)camera->source_ctx);
     }
-    
-    ESP_LOGI(TAG, "Queue per AI task creata con successo");
-    return ESP_OK;
 }
 
-QueueHandle_t camera_get_ai_queue(void)
+camera_t* get_camera_instance(void)
 {
-    return ai_task_queue;
-}
\ No newline at end of file
+    return &g_camera;
+}
@@ -6,7 +6,12 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "inference.h"
+#include "inference_executor.h"
+#include "camera_source.h"
+#include "camera_slab.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -22,19 +27,78 @@ typedef struct {
     const int height;
 } camera_resolution_info_t;
 
-// Struttura per i messaggi tra CLI e AI task
+#define CAMERA_FRAME_POOL_SIZE 48 //frame condivisi contemporaneamente (ultima foto, code di inferenza, client HTTP, anello e clip)
+#define CAMERA_DRIVER_FB_COUNT 2 //buffer del driver che ruotano durante l'acquisizione
+#define CAMERA_CAPTURE_STACK_SIZE 4096
+#define CAMERA_CAPTURE_PRIORITY 2 //sopra l'executor: la copia di un frame è breve
+#define CAMERA_CAPTURE_CORE 0 //il core 1 è riservato a model->run() nella pipeline YOLO
+#define CAMERA_CAPTURE_LOCK_TIMEOUT_MS 1000 //attesa del mutex del driver per ogni frame della task di acquisizione
+#define CAMERA_DRIVER_FB_TIMEOUT_MS 4000 //attesa massima di esp_camera_fb_get (FB_GET_TIMEOUT del driver)
+#define CAMERA_CAPTURE_STOP_TIMEOUT_MS (CAMERA_CAPTURE_LOCK_TIMEOUT_MS + CAMERA_DRIVER_FB_TIMEOUT_MS + 1000) //uscita della task di acquisizione
+#define CAMERA_FRESH_FRAME_MAX_AGE_MS 100 //un frame più vecchio non è considerato "appena scattato"
+#define CAMERA_FRAME_EVENT_NEW (1 << 0)
+#define CAMERA_RAW_MAX_FRAME_BYTES (480 * 320 * 2) //frame RGB565 più grande accettato (HVGA: deve entrare più volte nello slab)
+#define CAMERA_DRIVER_JPEG_FB_DIVISOR 5 //esp32-camera dimensiona il buffer JPEG del driver a larghezza * altezza / 5
+#define CAMERA_ON_DEMAND_JPEG_QUALITY 80 //qualità della codifica JPEG software dei frame grezzi (0-100)
+
+// Frame condiviso tra i consumatori (executor, /photo, stream): contato per riferimento e
+// restituito al pool quando l'ultimo consumatore chiama camera_frame_release.
+// In modalità grezza data contiene pixel RGB565 e il JPEG viene prodotto solo se un client lo chiede
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;        // dimensione del blocco del slab che contiene data
+    pixformat_t format;     // PIXFORMAT_JPEG o PIXFORMAT_RGB565
+    uint8_t *jpeg;          // JPEG codificato su richiesta da un frame grezzo
+    size_t jpeg_len;        // 0 = non ancora codificato
+    size_t jpeg_capacity;   // byte richiesti al slab per il buffer del JPEG
+    int width;
+    int height;
+    int64_t timestamp_us;   // istante di acquisizione
+    uint32_t sequence;      // numero progressivo del frame
+    uint32_t refcount;      // 0 = slot libero (i blocchi tornano al slab)
+    camera_slab_t *slab;    // slab da cui provengono data e jpeg
+} camera_frame_t;
+
+// Statistiche dell'acquisizione
+typedef struct {
+    uint32_t frames_captured;   // frame pubblicati come ultima foto
+    uint32_t frames_dropped;    // frame del sensore saltati perché il pool era pieno
+    uint32_t frames_consumed;   // frame consegnati dalle attese/acquisizioni
+    uint64_t total_latency_us;  // somma delle latenze acquisizione -> consumatore
+    uint32_t max_latency_us;
+    uint32_t pool_exhausted;
+    uint32_t jpeg_encoded;      // frame grezzi codificati in JPEG per un client HTTP
+    uint64_t jpeg_encode_us;    // tempo totale di codifica
+    uint32_t lock_acquired;     // acquisizioni del mutex del driver (CLI, task di acquisizione, webserver)
+    uint32_t lock_contended;    // acquisizioni che hanno dovuto attendere un altro utilizzatore
+    uint64_t lock_wait_us;      // attesa totale sul mutex
+    uint32_t max_lock_wait_us;
+    uint32_t lock_timeouts;
+} camera_capture_stats_t;
+
+// Statistiche dei cambi di risoluzione
 typedef struct {
-    uint8_t *image_buffer;
-    size_t image_size;
-    uint32_t timestamp;
-} ai_task_message_t;
+    uint32_t live_switches;     // applicati sul sensore, senza reinizializzare il driver
+    uint32_t reinit_switches;   // con esp_camera_deinit/esp_camera_init
+    uint32_t last_switch_ms;    // dal comando al primo frame alla nuova risoluzione
+    uint32_t max_switch_ms;
+} camera_switch_stats_t;
 
 // Classe Camera
 typedef struct {
-    // Buffer e stato foto
-    uint8_t *last_photo_buffer;
-    size_t last_photo_size;
-    uint32_t last_photo_timestamp;
+    // Pool dei frame e ultima foto scattata (la camera ne possiede un riferimento)
+    camera_frame_t frames[CAMERA_FRAME_POOL_SIZE];
+    camera_frame_t *last_frame;
+    uint32_t frame_sequence;
+    uint32_t frame_pool_exhausted;  // acquisizioni fallite perché tutti i frame erano in uso
+    camera_slab_t slab;             // buffer dei frame, ritagliati dalla PSRAM all'init
+
+    // Acquisizione continua
+    TaskHandle_t capture_task;
+    volatile bool capture_running;
+    EventGroupHandle_t frame_events;    // CAMERA_FRAME_EVENT_NEW a ogni frame pubblicato
+    camera_capture_stats_t capture_stats;
     
     // Mutex per thread safety
     SemaphoreHandle_t camera_mutex;
@@ -42,25 +106,48 @@ typedef struct {
     // Configurazione risoluzione
     framesize_t current_framesize;
     int current_resolution_index;
+    int max_resolution_index;           // risoluzione su cui sono dimensionati i buffer del driver
+    bool model_window;                  // risoluzione scelta per coincidere con l'input del modello
+    int window_restore_index;           // risoluzione da ripristinare all'uscita dalla modalità finestra
+    camera_switch_stats_t switch_stats;
     
+    // Sorgente dei frame (sensore reale o replay)
+    const camera_source_t *source;
+    void *source_ctx;
+
     // Configurazione camera
     camera_config_t camera_config;
+    pixformat_t pixel_format;           // JPEG dal sensore, oppure RGB565 per l'inferenza (doppio flusso)
+    SemaphoreHandle_t jpeg_mutex;       // serializza le codifiche JPEG su richiesta
     
     // Stato inizializzazione
     bool initialized;
 } camera_t;
 
 /**
- * @brief Inizializza la fotocamera
+ * @brief Inizializza la fotocamera sul sensore reale (sul replay se compilato con CAMERA_REPLAY_BY_DEFAULT).
+ *        Se la fotocamera è già inizializzata non fa nulla: CLI, executor e webserver condividono la stessa istanza
  * @param camera Puntatore alla struttura camera
  * @return ESP_OK se successo, errore altrimenti
  */
 esp_err_t camera_init(camera_t *camera);
 
 /**
- * @brief Deinizializza la fotocamera
+ * @brief Inizializza la fotocamera su una sorgente di frame specifica (es. camera_replay_source)
  * @param camera Puntatore alla struttura camera
- * @return ESP_OK se successo, errore altrimenti
+ * @param source Operazioni della sorgente
+ * @param source_ctx Contesto della sorgente (es. camera_replay_t configurato)
+ * @return ESP_OK se successo (o già inizializzata sulla stessa sorgente),
+ *         ESP_ERR_INVALID_STATE se già inizializzata su un'altra sorgente
+ */
+esp_err_t camera_init_with_source(camera_t *camera, const camera_source_t *source, void *source_ctx);
+
+/**
+ * @brief Deinizializza la fotocamera. I consumatori dei frame (controllo adattivo, ring, stream e
+ *        inferenze HTTP) vanno fermati prima: eventi e mutex che usano vengono eliminati
+ * @param camera Puntatore alla struttura camera
+ * @return ESP_OK se successo, ESP_ERR_INVALID_STATE se un frame è ancora referenziato
+ *         (la fotocamera resta inizializzata, senza acquisizione continua)
  */
 esp_err_t camera_deinit(camera_t *camera);
 
@@ -72,13 +159,86 @@ esp_err_t camera_deinit(camera_t *camera);
 esp_err_t camera_capture_photo(camera_t *camera);
 
 /**
- * @brief Ottiene l'ultima foto scattata
+ * @brief Scatta una foto, la rende l'ultima foto della camera e la restituisce al chiamante.
+ *        Con l'acquisizione continua attiva restituisce subito l'ultimo frame se è recente
+ *        (CAMERA_FRESH_FRAME_MAX_AGE_MS), altrimenti il primo frame successivo
  * @param camera Puntatore alla struttura camera
- * @param buffer Puntatore al buffer della foto
- * @param size Dimensione del buffer
- * @return ESP_OK se successo, errore altrimenti
+ * @param frame Frame acquisito (il chiamante ne possiede un riferimento da rilasciare)
+ * @return ESP_OK se successo, ESP_ERR_NO_MEM se tutti i frame del pool sono in uso
  */
-esp_err_t camera_get_last_photo(camera_t *camera, uint8_t **buffer, size_t *size);
+esp_err_t camera_capture_frame(camera_t *camera, camera_frame_t **frame);
+
+/**
+ * @brief Avvia l'acquisizione continua: una task pubblica ogni frame del sensore come ultima foto
+ * @param camera Puntatore alla struttura camera
+ * @return ESP_OK se la task è avviata
+ */
+esp_err_t camera_start_capture(camera_t *camera);
+
+/**
+ * @brief Ferma l'acquisizione continua (si torna agli scatti su richiesta) e attende l'uscita della task
+ * @param camera Puntatore alla struttura camera
+ * @return ESP_OK se la task è uscita, ESP_ERR_TIMEOUT se è ancora bloccata sul driver
+ */
+esp_err_t camera_stop_capture(camera_t *camera);
+
+/**
+ * @brief Attende un frame più recente di after_sequence (acquisizione continua)
+ * @param camera Puntatore alla struttura camera
+ * @param after_sequence Numero di sequenza dell'ultimo frame già visto (0 = qualsiasi frame)
+ * @param timeout Attesa massima
+ * @param frame Frame (il chiamante ne possiede un riferimento da rilasciare)
+ * @return ESP_OK, ESP_ERR_TIMEOUT, ESP_ERR_INVALID_STATE se l'acquisizione continua non è attiva
+ */
+esp_err_t camera_wait_frame(camera_t *camera, uint32_t after_sequence, TickType_t timeout, camera_frame_t **frame);
+
+/**
+ * @brief Ottiene un riferimento all'ultima foto scattata
+ * @param camera Puntatore alla struttura camera
+ * @return Frame (da rilasciare con camera_frame_release), NULL se nessuna foto disponibile
+ */
+camera_frame_t* camera_get_last_frame(camera_t *camera);
+
+/**
+ * @brief Aggiunge un riferimento a un frame
+ * @param frame Frame condiviso
+ */
+void camera_frame_retain(camera_frame_t *frame);
+
+/**
+ * @brief Rilascia un riferimento; all'ultimo rilascio il frame torna al pool
+ * @param frame Frame condiviso (può essere NULL)
+ */
+void camera_frame_release(camera_frame_t *frame);
+
+/**
+ * @brief Prepara un job di inferenza sul frame senza copiarlo: il riferimento del chiamante passa al job
+ *        e viene rilasciato dall'executor (se l'invio fallisce resta al chiamante)
+ * @param frame Frame condiviso
+ * @param job Job da completare con dati, dimensione e funzione di rilascio
+ */
+void camera_frame_attach_job(camera_frame_t *frame, inference_job_t *job);
+
+/**
+ * @brief Ottiene il frame in JPEG per un client HTTP: i frame JPEG sono restituiti così come sono,
+ *        quelli grezzi vengono codificati alla prima richiesta e la codifica resta nel frame
+ * @param camera Puntatore alla struttura camera
+ * @param frame Frame di cui il chiamante possiede un riferimento
+ * @param jpeg Dati JPEG (validi finché il chiamante mantiene il riferimento al frame)
+ * @param jpeg_len Dimensione dei dati JPEG
+ * @return ESP_OK se successo, ESP_FAIL se la codifica non è riuscita
+ */
+esp_err_t camera_frame_get_jpeg(camera_t *camera, camera_frame_t *frame, const uint8_t **jpeg, size_t *jpeg_len);
+
+/**
+ * @brief Cambia il formato di uscita del sensore (reinizializza il driver).
+ *        In RGB565 l'inferenza legge i pixel senza decodifica JPEG e il JPEG viene prodotto solo su richiesta;
+ *        le risoluzioni oltre CAMERA_RAW_MAX_FRAME_BYTES non sono disponibili
+ * @param camera Puntatore alla struttura camera
+ * @param format PIXFORMAT_JPEG o PIXFORMAT_RGB565
+ * @return ESP_OK se successo, ESP_ERR_NOT_SUPPORTED per altri formati, errore del driver altrimenti
+ */
+esp_err_t camera_set_pixel_format(camera_t *camera, pixformat_t format);
 
 /**
  * @brief Ottiene le dimensioni della risoluzione corrente
@@ -96,6 +256,31 @@ void camera_get_current_resolution(camera_t *camera, int *width, int *height);
  */
 esp_err_t camera_change_resolution(camera_t *camera, int direction);
 
+/**
+ * @brief Imposta una risoluzione della mappa, sul sensore se possibile (senza reinizializzare il driver)
+ * @param camera Puntatore alla struttura camera
+ * @param index Indice della risoluzione
+ * @return ESP_OK se successo, errore altrimenti
+ */
+esp_err_t camera_set_resolution(camera_t *camera, int index);
+
+/**
+ * @brief Imposta sul sensore una finestra che produce frame già alla dimensione dell'input del modello
+ *        (il preprocessing salta il resize)
+ * @param camera Puntatore alla struttura camera
+ * @param width Larghezza dell'input del modello
+ * @param height Altezza dell'input del modello
+ * @return ESP_OK se successo, ESP_ERR_NOT_SUPPORTED se il sensore non ha una finestra di quella dimensione
+ */
+esp_err_t camera_set_model_window(camera_t *camera, int width, int height);
+
+/**
+ * @brief Esce dalla modalità finestra e ripristina la risoluzione precedente
+ * @param camera Puntatore alla struttura camera
+ * @return ESP_OK se successo, errore altrimenti
+ */
+esp_err_t camera_clear_model_window(camera_t *camera);
+
 /**
  * @brief Ottiene il numero totale di risoluzioni disponibili
  * @return Numero di risoluzioni
@@ -110,24 +295,44 @@ int camera_get_resolution_count(void);
 const camera_resolution_info_t* camera_get_resolution_info(int index);
 
 /**
- * @brief Scatta una foto ed esegue l'inferenza di face detection
+ * @brief Copia le statistiche di acquisizione (frame, scarti, latenza acquisizione -> consumatore)
+ * @param camera Puntatore alla struttura camera
+ * @param stats Puntatore alla struttura statistiche
+ */
+void camera_get_capture_stats(camera_t *camera, camera_capture_stats_t *stats);
+
+/**
+ * @brief Stampa le statistiche di acquisizione
+ * @param camera Puntatore alla struttura camera
+ */
+void camera_print_capture_stats(camera_t *camera);
+
+/**
+ * @brief Scatta una foto e la invia all'executor di inferenza come job YOLO in background
  * @param camera Puntatore alla struttura camera
- * @param result Puntatore alla struttura risultato (può essere NULL se non serve il risultato)
+ * @param result Puntatore alla struttura risultato: se non NULL attende il risultato dell'inferenza,
+ *               altrimenti ritorna appena il frame è in coda
  * @return ESP_OK se successo, errore altrimenti
  */
 esp_err_t camera_capture_and_inference(camera_t *camera, inference_result_t *result);
 
 /**
- * @brief Inizializza la queue per la comunicazione con la AI task
- * @return ESP_OK se successo, errore altrimenti
+ * @brief Notifica di completamento per i job YOLO sui frame della camera (user_ctx = camera_t*):
+ *        alimenta l'anello dei frame recenti (clip su persona rilevata) e il controllo adattivo della risoluzione
+ */
+void camera_job_complete(inference_job_status_t status, const inference_result_t *result, void *user_ctx);
+
+/**
+ * @brief Ottiene l'istanza globale della fotocamera, condivisa da CLI, executor e webserver
+ *        (un solo driver, un solo pool di frame, un solo mutex)
+ * @return Puntatore all'istanza globale
  */
-esp_err_t camera_init_ai_queue(void);
+camera_t* get_camera_instance(void);
 
 /**
- * @brief Ottiene l'handle della queue per la AI task
- * @return Handle della queue, NULL se non inizializzata
+ * @brief Variabile globale della fotocamera
  */
-QueueHandle_t camera_get_ai_queue(void);
+extern camera_t g_camera;
 
 #ifdef __cplusplus
 }
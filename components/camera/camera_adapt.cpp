@@ -0,0 +1,390 @@
+#include "camera_adapt.h"
+#include "monitor.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "CAMERA_ADAPT";
+
+#define CAMERA_ADAPT_MONITOR_NAME "camera_adapt"
+
+camera_adapt_t g_camera_adapt;
+
+camera_adapt_t* get_camera_adapt_instance(void)
+{
+    return &g_camera_adapt;
+}
+
+static const camera_adapt_config_t camera_adapt_default_config = {
+    .latency_budget_ms = CAMERA_ADAPT_DEFAULT_LATENCY_BUDGET_MS,
+    .max_slab_failures = CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES,
+    .small_box_px = CAMERA_ADAPT_DEFAULT_SMALL_BOX_PX,
+    .large_box_px = CAMERA_ADAPT_DEFAULT_LARGE_BOX_PX,
+    .min_interval_ms = CAMERA_ADAPT_DEFAULT_MIN_INTERVAL_MS,
+    .memory_cooldown_windows = CAMERA_ADAPT_DEFAULT_MEMORY_COOLDOWN,
+};
+
+static const char *camera_adapt_reason_names[CAMERA_ADAPT_REASON_COUNT] = {
+    "nessun cambio",
+    "oggetti piccoli",
+    "oggetti grandi",
+    "latenza oltre il budget",
+    "buffer dei frame esauriti",
+};
+
+const char* camera_adapt_reason_name(camera_adapt_reason_t reason)
+{
+    return reason < CAMERA_ADAPT_REASON_COUNT ? camera_adapt_reason_names[reason] : "-";
+}
+
+// Riassunto della finestra (con il lock del controllore): latenza su tutti i risultati, lato del box
+// solo sui risultati con almeno una detection, allocazioni fallite tra il campione più vecchio e il più recente
+static void camera_adapt_window(const camera_adapt_t *ctl, camera_adapt_window_t *window)
+{
+    uint64_t latency_sum = 0;
+    uint64_t box_sum = 0;
+    uint32_t boxes = 0;
+    for (uint32_t i = 0; i < ctl->num_samples; i++) {
+        latency_sum += ctl->samples[i].latency_ms;
+        if (ctl->samples[i].box_px) {
+            box_sum += ctl->samples[i].box_px;
+            boxes++;
+        }
+    }
+    window->num_samples = ctl->num_samples;
+    window->latency_ms = ctl->num_samples ? (uint32_t)(latency_sum / ctl->num_samples) : 0;
+    window->box_px = boxes ? (uint32_t)(box_sum / boxes) : 0;
+    window->num_boxes = boxes;
+    window->slab_failures = 0;
+    if (ctl->num_samples > 1) {
+        uint32_t oldest = ctl->num_samples == CAMERA_ADAPT_WINDOW ? ctl->next_sample : 0;
+        uint32_t newest = (ctl->next_sample + CAMERA_ADAPT_WINDOW - 1) % CAMERA_ADAPT_WINDOW;
+        window->slab_failures = ctl->samples[newest].slab_failures - ctl->samples[oldest].slab_failures;
+    }
+    window->resolution_index = ctl->camera->current_resolution_index;
+    window->memory_limit_index = ctl->memory_limit_index;
+    window->clean_windows = ctl->clean_results / CAMERA_ADAPT_WINDOW;
+}
+
+// Le soglie di salita e discesa sono lontane (oggetti, headroom sulla latenza, nessuna allocazione fallita):
+// dopo un cambio la decisione opposta non scatta sugli stessi oggetti. Le allocazioni fallite dipendono dalla
+// risoluzione e a una risoluzione più bassa cessano subito: la voce in cui è scattata la regola della memoria
+// resta un limite per la salita finché non passano memory_cooldown_windows finestre pulite
+camera_adapt_reason_t camera_adapt_decide(const camera_adapt_config_t *config, const camera_adapt_window_t *window,
+                                          int *direction)
+{
+    *direction = 0;
+    if (!config || !window || window->num_samples < CAMERA_ADAPT_WINDOW) {
+        return CAMERA_ADAPT_HOLD;
+    }
+    bool objects_seen = window->num_boxes >= CAMERA_ADAPT_WINDOW / 2;
+    if (config->max_slab_failures > 0 && window->slab_failures >= config->max_slab_failures) {
+        *direction = -1;
+        return CAMERA_ADAPT_MEMORY;
+    }
+    if (window->latency_ms > config->latency_budget_ms) {
+        *direction = -1;
+        return CAMERA_ADAPT_LATENCY;
+    }
+    bool memory_limited = window->memory_limit_index >= 0 &&
+                          window->clean_windows < config->memory_cooldown_windows &&
+                          window->resolution_index + 1 >= window->memory_limit_index;
+    if (objects_seen && window->box_px < config->small_box_px &&
+        window->latency_ms * 100 < config->latency_budget_ms * CAMERA_ADAPT_HEADROOM_PCT &&
+        window->slab_failures == 0 && !memory_limited) {
+        *direction = 1;
+        return CAMERA_ADAPT_SMALL_OBJECTS;
+    }
+    if (objects_seen && window->box_px > config->large_box_px) {
+        *direction = -1;
+        return CAMERA_ADAPT_LARGE_OBJECTS;
+    }
+    return CAMERA_ADAPT_HOLD;
+}
+
+static bool camera_adapt_interval_elapsed(const camera_adapt_t *ctl, int64_t now_us)
+{
+    return now_us - ctl->last_change_us >= (int64_t)ctl->config.min_interval_ms * 1000;
+}
+
+void camera_adapt_observe(camera_adapt_t *ctl, const inference_result_t *result)
+{
+    if (!ctl || !result || !ctl->running) {
+        return;
+    }
+
+    // Oggetto più piccolo del frame: è quello che rischia di sparire a una risoluzione più bassa
+    uint32_t box_px = 0;
+    for (uint32_t i = 0; i < result->num_yolo_detections; i++) {
+        const uint32_t *box = result->yolo_detections[i].box;
+        uint32_t side = box[2] < box[3] ? box[2] : box[3];
+        if (side > 0 && (box_px == 0 || side < box_px)) {
+            box_px = side;
+        }
+    }
+    // Il slab ha il proprio lock: i contatori si leggono prima di prendere quello del controllore
+    camera_slab_stats_t slab_stats = {};
+    camera_slab_get_stats(&ctl->camera->slab, &slab_stats, NULL);
+    int64_t now_us = esp_timer_get_time();
+    bool notify = false;
+
+    taskENTER_CRITICAL(&ctl->lock);
+    camera_adapt_sample_t *sample = &ctl->samples[ctl->next_sample];
+    sample->latency_ms = result->end_to_end_ms ? result->end_to_end_ms : result->full_inference_time_ms;
+    sample->box_px = box_px;
+    sample->input_size = result->yolo_input_size;
+    sample->slab_failures = slab_stats.failures + slab_stats.oversize;
+    // Cooldown della regola della memoria: risultati consecutivi senza nuove allocazioni fallite
+    if (sample->slab_failures != ctl->last_slab_failures) {
+        ctl->clean_results = 0;
+    } else {
+        ctl->clean_results++;
+    }
+    ctl->last_slab_failures = sample->slab_failures;
+    if (ctl->memory_limit_index >= 0 &&
+        ctl->clean_results / CAMERA_ADAPT_WINDOW >= ctl->config.memory_cooldown_windows) {
+        ctl->memory_limit_index = -1;
+    }
+    ctl->next_sample = (ctl->next_sample + 1) % CAMERA_ADAPT_WINDOW;
+    if (ctl->num_samples < CAMERA_ADAPT_WINDOW) {
+        ctl->num_samples++;
+    }
+
+    if (ctl->pending_direction == 0 && ctl->num_samples == CAMERA_ADAPT_WINDOW &&
+        camera_adapt_interval_elapsed(ctl, now_us)) {
+        camera_adapt_window_t window;
+        camera_adapt_window(ctl, &window);
+        int direction;
+        camera_adapt_reason_t reason = camera_adapt_decide(&ctl->config, &window, &direction);
+        if (direction != 0) {
+            ctl->pending_direction = direction;
+            ctl->pending_reason = reason;
+            ctl->pending_latency_ms = window.latency_ms;
+            ctl->pending_box_px = window.box_px;
+            ctl->pending_slab_failures = window.slab_failures;
+            notify = true;
+        }
+    }
+    taskEXIT_CRITICAL(&ctl->lock);
+
+    if (notify && ctl->task) {
+        xTaskNotifyGive(ctl->task);
+    }
+}
+
+// Passa alla voce adiacente di resolution_map nella direzione indicata, saltando quelle non
+// disponibili nel formato corrente. In salita non si supera CAMERA_ADAPT_MAX_UPSCALE volte l'input del modello
+// né si raggiunge limit_index (voce che ha esaurito i buffer, -1 = nessun limite)
+static esp_err_t camera_adapt_step(camera_t *camera, int direction, uint32_t input_size, int limit_index)
+{
+    for (int index = camera->current_resolution_index + direction;
+         index >= 0 && index < camera_get_resolution_count(); index += direction) {
+        const camera_resolution_info_t *info = camera_get_resolution_info(index);
+        if (direction > 0 && input_size > 0 && (uint32_t)info->width > input_size * CAMERA_ADAPT_MAX_UPSCALE) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (direction > 0 && limit_index >= 0 && index >= limit_index) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        esp_err_t ret = camera_set_resolution(camera, index);
+        if (ret != ESP_ERR_NOT_SUPPORTED) {
+            return ret;
+        }
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static void camera_adapt_task(void *pvParameters)
+{
+    camera_adapt_t *ctl = (camera_adapt_t *)pvParameters;
+    ESP_LOGI(TAG, "Controllo adattivo della risoluzione avviato");
+
+    while (ctl->running) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        if (!ctl->running) {
+            break;
+        }
+        taskENTER_CRITICAL(&ctl->lock);
+        int direction = ctl->pending_direction;
+        camera_adapt_decision_t decision = {};
+        decision.reason = ctl->pending_reason;
+        decision.latency_ms = ctl->pending_latency_ms;
+        decision.box_px = ctl->pending_box_px;
+        decision.slab_failures = ctl->pending_slab_failures;
+        uint32_t input_size = ctl->samples[(ctl->next_sample + CAMERA_ADAPT_WINDOW - 1) % CAMERA_ADAPT_WINDOW].input_size;
+        int limit_index = ctl->memory_limit_index;
+        taskEXIT_CRITICAL(&ctl->lock);
+        if (direction == 0) {
+            continue;
+        }
+
+        camera_t *camera = ctl->camera;
+        decision.from_index = camera->current_resolution_index;
+        esp_err_t ret = ESP_ERR_INVALID_STATE;
+        // La finestra allineata al modello è una scelta esplicita: il controllore non la sovrascrive
+        if (camera->initialized && !camera->model_window) {
+            ret = camera_adapt_step(camera, direction, input_size, limit_index);
+        }
+        decision.time_us = esp_timer_get_time();
+        decision.to_index = camera->current_resolution_index;
+
+        taskENTER_CRITICAL(&ctl->lock);
+        if (ret == ESP_OK) {
+            ctl->history[ctl->num_decisions % CAMERA_ADAPT_HISTORY] = decision;
+            ctl->num_decisions++;
+            ctl->reasons[decision.reason]++;
+            ctl->last_reason = decision.reason;
+            if (decision.reason == CAMERA_ADAPT_MEMORY) {
+                ctl->memory_limit_index = decision.from_index;
+                ctl->clean_results = 0;
+            }
+            // Le osservazioni alla risoluzione precedente non descrivono più il sistema
+            ctl->num_samples = 0;
+            ctl->next_sample = 0;
+        } else {
+            ctl->blocked++;
+        }
+        ctl->last_change_us = decision.time_us;
+        ctl->pending_direction = 0;
+        taskEXIT_CRITICAL(&ctl->lock);
+
+        if (ret == ESP_OK) {
+            const camera_resolution_info_t *from = camera_get_resolution_info(decision.from_index);
+            const camera_resolution_info_t *to = camera_get_resolution_info(decision.to_index);
+            ESP_LOGI(TAG, "Risoluzione %dx%d -> %dx%d: %s (latenza %lu ms, box %lu px, allocazioni fallite %lu)",
+                     from->width, from->height, to->width, to->height, camera_adapt_reason_name(decision.reason),
+                     decision.latency_ms, decision.box_px, decision.slab_failures);
+        } else {
+            ESP_LOGI(TAG, "Decisione non applicata (%s): %s", camera_adapt_reason_name(decision.reason),
+                     esp_err_to_name(ret));
+        }
+    }
+
+    ESP_LOGI(TAG, "Controllo adattivo della risoluzione fermato");
+    ctl->task = NULL;
+    vTaskDelete(NULL);
+}
+
+// Metriche per il monitor: ingressi del controllore e cambi applicati per motivo
+static size_t camera_adapt_collect(void *ctx, monitor_metric_t *metrics, size_t max_metrics)
+{
+    camera_adapt_t *ctl = (camera_adapt_t *)ctx;
+    camera_adapt_window_t window;
+    taskENTER_CRITICAL(&ctl->lock);
+    camera_adapt_window(ctl, &window);
+    uint32_t reasons[CAMERA_ADAPT_REASON_COUNT];
+    memcpy(reasons, ctl->reasons, sizeof(reasons));
+    uint32_t blocked = ctl->blocked;
+    camera_adapt_reason_t last_reason = ctl->last_reason;
+    taskEXIT_CRITICAL(&ctl->lock);
+
+    const camera_resolution_info_t *info = camera_get_resolution_info(ctl->camera->current_resolution_index);
+    const monitor_metric_t values[] = {
+        {"adapt_indice_risoluzione", (uint32_t)ctl->camera->current_resolution_index},
+        {"adapt_larghezza", info ? (uint32_t)info->width : 0},
+        {"adapt_latenza_media_ms", window.latency_ms},
+        {"adapt_lato_box_medio_px", window.box_px},
+        {"adapt_allocazioni_fallite_finestra", window.slab_failures},
+        {"adapt_salite_oggetti_piccoli", reasons[CAMERA_ADAPT_SMALL_OBJECTS]},
+        {"adapt_discese_oggetti_grandi", reasons[CAMERA_ADAPT_LARGE_OBJECTS]},
+        {"adapt_discese_latenza", reasons[CAMERA_ADAPT_LATENCY]},
+        {"adapt_discese_memoria", reasons[CAMERA_ADAPT_MEMORY]},
+        {"adapt_decisioni_bloccate", blocked},
+        {"adapt_limite_memoria", (uint32_t)(window.memory_limit_index + 1)},
+        {"adapt_ultimo_motivo", (uint32_t)last_reason},
+    };
+    size_t n = sizeof(values) / sizeof(values[0]);
+    if (n > max_metrics) {
+        n = max_metrics;
+    }
+    memcpy(metrics, values, n * sizeof(monitor_metric_t));
+    return n;
+}
+
+esp_err_t camera_adapt_start(camera_adapt_t *ctl, camera_t *camera, const camera_adapt_config_t *config)
+{
+    if (!ctl || !camera) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!camera->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ctl->task) {
+        return ESP_OK;
+    }
+
+    memset(ctl, 0, sizeof(camera_adapt_t));
+    portMUX_INITIALIZE(&ctl->lock);
+    ctl->camera = camera;
+    ctl->config = config ? *config : camera_adapt_default_config;
+    ctl->memory_limit_index = -1;
+    camera_slab_stats_t slab_stats = {};
+    camera_slab_get_stats(&camera->slab, &slab_stats, NULL);
+    ctl->last_slab_failures = slab_stats.failures + slab_stats.oversize;
+    ctl->last_change_us = esp_timer_get_time();
+    ctl->running = true;
+    if (xTaskCreatePinnedToCore(camera_adapt_task, "camera_adapt", CAMERA_ADAPT_STACK_SIZE, ctl,
+                                CAMERA_ADAPT_PRIORITY, &ctl->task, CAMERA_ADAPT_CORE) != pdPASS) {
+        ctl->running = false;
+        ESP_LOGE(TAG, "Errore creazione task del controllore");
+        return ESP_ERR_NO_MEM;
+    }
+    monitor_register_provider(CAMERA_ADAPT_MONITOR_NAME, camera_adapt_collect, ctl);
+    return ESP_OK;
+}
+
+void camera_adapt_stop(camera_adapt_t *ctl)
+{
+    if (!ctl || !ctl->task) {
+        return;
+    }
+    ctl->running = false;
+    xTaskNotifyGive(ctl->task);
+    for (int i = 0; i < 100 && ctl->task; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    monitor_unregister_provider(CAMERA_ADAPT_MONITOR_NAME);
+}
+
+void camera_adapt_print_stats(camera_adapt_t *ctl)
+{
+    if (!ctl) {
+        return;
+    }
+    camera_adapt_window_t window;
+    camera_adapt_decision_t history[CAMERA_ADAPT_HISTORY];
+    taskENTER_CRITICAL(&ctl->lock);
+    camera_adapt_window(ctl, &window);
+    uint32_t num_decisions = ctl->num_decisions;
+    memcpy(history, ctl->history, sizeof(history));
+    taskEXIT_CRITICAL(&ctl->lock);
+
+    printf("\n=== CONTROLLO ADATTIVO RISOLUZIONE ===\n");
+    printf("Stato: %s\n", ctl->running ? "attivo" : "fermo");
+    printf("Budget latenza: %lu ms, allocazioni fallite max: %lu, box piccoli < %lu px, grandi > %lu px, intervallo %lu ms\n",
+           ctl->config.latency_budget_ms, ctl->config.max_slab_failures, ctl->config.small_box_px,
+           ctl->config.large_box_px, ctl->config.min_interval_ms);
+    if (window.memory_limit_index >= 0) {
+        const camera_resolution_info_t *limit = camera_get_resolution_info(window.memory_limit_index);
+        printf("Limite per memoria: %dx%d (finestre pulite %lu/%lu)\n", limit->width, limit->height,
+               window.clean_windows, ctl->config.memory_cooldown_windows);
+    }
+    printf("Finestra: %lu/%d risultati, latenza media %lu ms, box medio %lu px (%lu con detections), allocazioni fallite %lu\n",
+           window.num_samples, CAMERA_ADAPT_WINDOW, window.latency_ms, window.box_px, window.num_boxes,
+           window.slab_failures);
+    for (int r = CAMERA_ADAPT_SMALL_OBJECTS; r < CAMERA_ADAPT_REASON_COUNT; r++) {
+        printf("Cambi per %s: %lu\n", camera_adapt_reason_name((camera_adapt_reason_t)r), ctl->reasons[r]);
+    }
+    printf("Decisioni non applicate: %lu\n", ctl->blocked);
+    uint32_t first = num_decisions > CAMERA_ADAPT_HISTORY ? num_decisions - CAMERA_ADAPT_HISTORY : 0;
+    for (uint32_t i = first; i < num_decisions; i++) {
+        const camera_adapt_decision_t *d = &history[i % CAMERA_ADAPT_HISTORY];
+        const camera_resolution_info_t *from = camera_get_resolution_info(d->from_index);
+        const camera_resolution_info_t *to = camera_get_resolution_info(d->to_index);
+        printf("  [%lld ms] %dx%d -> %dx%d: %s (latenza %lu ms, box %lu px, allocazioni fallite %lu)\n",
+               d->time_us / 1000, from->width, from->height, to->width, to->height,
+               camera_adapt_reason_name(d->reason), d->latency_ms, d->box_px, d->slab_failures);
+    }
+    printf("======================================\n\n");
+}
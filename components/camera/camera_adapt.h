@@ -0,0 +1,174 @@
+#ifndef CAMERA_ADAPT_H
+#define CAMERA_ADAPT_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "camera.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAMERA_ADAPT_WINDOW 8 //risultati YOLO su cui si decide (dopo un cambio la finestra riparte da zero)
+#define CAMERA_ADAPT_HISTORY 8 //ultime decisioni conservate per la stampa
+#define CAMERA_ADAPT_DEFAULT_LATENCY_BUDGET_MS 1500 //latenza acquisizione -> risultato oltre cui si scende
+#define CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES 2 //allocazioni dei frame fallite nella finestra da cui si scende
+#define CAMERA_ADAPT_DEFAULT_SMALL_BOX_PX 24 //lato minore del box più piccolo (pixel del sensore) sotto cui si sale
+#define CAMERA_ADAPT_DEFAULT_LARGE_BOX_PX 160 //sopra questo lato gli oggetti sono visibili anche a una risoluzione inferiore
+#define CAMERA_ADAPT_DEFAULT_MIN_INTERVAL_MS 3000 //tempo minimo tra due cambi (isteresi)
+#define CAMERA_ADAPT_DEFAULT_MEMORY_COOLDOWN 4 //finestre senza allocazioni fallite prima di tornare alla risoluzione che le ha causate
+#define CAMERA_ADAPT_HEADROOM_PCT 60 //si sale solo se la latenza media è sotto questa frazione del budget
+#define CAMERA_ADAPT_MAX_UPSCALE 2 //oltre input_modello x 2 i pixel in più vengono persi nel resize
+#define CAMERA_ADAPT_STACK_SIZE 3072
+#define CAMERA_ADAPT_PRIORITY 1
+#define CAMERA_ADAPT_CORE 0
+
+// Motivo di una decisione del controllore
+typedef enum {
+    CAMERA_ADAPT_HOLD = 0,          // nessun cambio
+    CAMERA_ADAPT_SMALL_OBJECTS,     // oggetti troppo piccoli: si sale
+    CAMERA_ADAPT_LARGE_OBJECTS,     // oggetti grandi: si scende per risparmiare latenza
+    CAMERA_ADAPT_LATENCY,           // latenza oltre il budget: si scende
+    CAMERA_ADAPT_MEMORY,            // buffer dei frame esauriti (allocazioni del slab fallite): si scende
+    CAMERA_ADAPT_REASON_COUNT
+} camera_adapt_reason_t;
+
+// Configurazione del controllore
+typedef struct {
+    uint32_t latency_budget_ms;
+    uint32_t max_slab_failures;     // 0 = regola della memoria disattivata
+    uint32_t small_box_px;
+    uint32_t large_box_px;
+    uint32_t min_interval_ms;
+    uint32_t memory_cooldown_windows;   // finestre pulite dopo una discesa per memoria prima di poter risalire al limite
+} camera_adapt_config_t;
+
+// Osservazione di un risultato YOLO
+typedef struct {
+    uint32_t latency_ms;        // acquisizione -> risultato
+    uint32_t box_px;            // lato minore del box più piccolo, in pixel del sensore (0 = nessuna detection)
+    uint32_t input_size;        // lato dell'input del modello
+    uint32_t slab_failures;     // allocazioni dei frame fallite dall'avvio (contatore cumulativo del slab)
+} camera_adapt_sample_t;
+
+// Riassunto della finestra su cui decide il controllore
+typedef struct {
+    uint32_t num_samples;
+    uint32_t latency_ms;        // media su tutti i risultati
+    uint32_t box_px;            // media sui soli risultati con detections
+    uint32_t num_boxes;         // risultati con almeno una detection
+    uint32_t slab_failures;     // allocazioni dei frame fallite durante la finestra
+    int resolution_index;       // voce di resolution_map corrente
+    int memory_limit_index;     // voce in cui è scattata la regola della memoria (-1 = nessun limite)
+    uint32_t clean_windows;     // finestre consecutive senza allocazioni fallite dall'ultima discesa per memoria
+} camera_adapt_window_t;
+
+// Cambio di risoluzione applicato
+typedef struct {
+    int64_t time_us;
+    int from_index;
+    int to_index;
+    camera_adapt_reason_t reason;
+    uint32_t latency_ms;        // medie della finestra che ha portato alla decisione
+    uint32_t box_px;
+    uint32_t slab_failures;
+} camera_adapt_decision_t;
+
+// Controllore adattivo della risoluzione: sceglie la voce di resolution_map dalla geometria delle
+// detections, dalla latenza end-to-end e dalle allocazioni dei frame fallite nel slab. Le osservazioni arrivano dall'executor,
+// i cambi sono applicati dalla task del controllore (il cambio prende il mutex del driver)
+typedef struct {
+    camera_t *camera;
+    camera_adapt_config_t config;
+
+    camera_adapt_sample_t samples[CAMERA_ADAPT_WINDOW];
+    uint32_t num_samples;
+    uint32_t next_sample;
+
+    int pending_direction;                  // 1 = sali, -1 = scendi, 0 = nessuna decisione in attesa
+    camera_adapt_reason_t pending_reason;
+    uint32_t pending_latency_ms;
+    uint32_t pending_box_px;
+    uint32_t pending_slab_failures;
+    int64_t last_change_us;
+
+    int memory_limit_index;                 // da qui in su non si sale finché dura il cooldown (-1 = nessun limite)
+    uint32_t clean_results;                 // risultati consecutivi senza allocazioni fallite
+    uint32_t last_slab_failures;            // contatore cumulativo del slab all'ultimo risultato
+
+    camera_adapt_decision_t history[CAMERA_ADAPT_HISTORY];
+    uint32_t num_decisions;
+    uint32_t reasons[CAMERA_ADAPT_REASON_COUNT];    // cambi applicati per motivo
+    uint32_t blocked;                               // decisioni non applicate (finestra del modello, limiti)
+    camera_adapt_reason_t last_reason;
+
+    portMUX_TYPE lock;
+    TaskHandle_t task;
+    volatile bool running;
+} camera_adapt_t;
+
+/**
+ * @brief Avvia il controllore sulla camera
+ * @param ctl Puntatore al controllore
+ * @param camera Fotocamera condivisa
+ * @param config Configurazione (NULL = valori di default)
+ * @return ESP_OK se avviato
+ */
+esp_err_t camera_adapt_start(camera_adapt_t *ctl, camera_t *camera, const camera_adapt_config_t *config);
+
+/**
+ * @brief Ferma il controllore (la risoluzione corrente resta impostata)
+ * @param ctl Puntatore al controllore
+ */
+void camera_adapt_stop(camera_adapt_t *ctl);
+
+/**
+ * @brief Registra un risultato YOLO (chiamata dalla notifica di completamento dei job, non blocca)
+ * @param ctl Puntatore al controllore
+ * @param result Risultato dell'inferenza
+ */
+void camera_adapt_observe(camera_adapt_t *ctl, const inference_result_t *result);
+
+/**
+ * @brief Decisione su una finestra completa (senza stato né driver: la applica la task del controllore)
+ * @param config Configurazione
+ * @param window Riassunto della finestra
+ * @param direction 1 = sali, -1 = scendi, 0 = nessun cambio
+ * @return Motivo della decisione (CAMERA_ADAPT_HOLD se nessun cambio)
+ */
+camera_adapt_reason_t camera_adapt_decide(const camera_adapt_config_t *config, const camera_adapt_window_t *window,
+                                          int *direction);
+
+/**
+ * @brief Nome leggibile di un motivo
+ * @param reason Motivo
+ * @return Stringa costante
+ */
+const char* camera_adapt_reason_name(camera_adapt_reason_t reason);
+
+/**
+ * @brief Stampa configurazione, ultime decisioni e contatori per motivo
+ * @param ctl Puntatore al controllore
+ */
+void camera_adapt_print_stats(camera_adapt_t *ctl);
+
+/**
+ * @brief Ottiene l'istanza globale del controllore
+ * @return Puntatore all'istanza globale
+ */
+camera_adapt_t* get_camera_adapt_instance(void);
+
+/**
+ * @brief Variabile globale del controllore
+ */
+extern camera_adapt_t g_camera_adapt;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAMERA_ADAPT_H
@@ -0,0 +1,364 @@
+#include "camera_replay.h"
+#include "inference_jpeg.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdio.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static const char *TAG = "CAMERA_REPLAY";
+
+// Variabile globale del replay (singleton come g_inference)
+camera_replay_t g_camera_replay;
+
+#ifdef CAMERA_HAS_REPLAY_CORPUS
+extern const uint8_t replay_corpus_start[] asm("_binary_replay_corpus_bin_start");
+extern const uint8_t replay_corpus_end[] asm("_binary_replay_corpus_bin_end");
+#endif
+
+camera_replay_t* get_camera_replay_instance(void)
+{
+    if (!g_camera_replay.configured) {
+        camera_replay_configure(&g_camera_replay, CAMERA_REPLAY_PARTITION, NULL, CAMERA_REPLAY_DEFAULT_FPS);
+    }
+    return &g_camera_replay;
+}
+
+void camera_replay_configure(camera_replay_t *replay, camera_replay_backend_t backend, const char *directory, uint32_t fps)
+{
+    if (!replay) {
+        return;
+    }
+    memset(replay, 0, sizeof(camera_replay_t));
+    replay->backend = backend;
+    strncpy(replay->directory, directory ? directory : CAMERA_REPLAY_DEFAULT_DIRECTORY, sizeof(replay->directory) - 1);
+    replay->fps = fps;
+    replay->configured = true;
+}
+
+void camera_replay_set_fps(camera_replay_t *replay, uint32_t fps)
+{
+    if (replay) {
+        replay->fps = fps;
+        replay->next_frame_us = 0;
+    }
+}
+
+// Aggiunge un frame all'indice leggendo le dimensioni dal marker SOF
+static bool replay_add_entry(camera_replay_t *replay, const uint8_t *data, uint32_t len)
+{
+    int width = 0, height = 0;
+    if (replay->count >= CAMERA_REPLAY_MAX_FRAMES) {
+        return false;
+    }
+    if (!inference_jpeg_get_dimensions(data, len, &width, &height)) {
+        ESP_LOGW(TAG, "Frame %lu del corpus non è un JPEG valido, saltato", replay->count);
+        return true;
+    }
+    camera_replay_entry_t *entry = &replay->entries[replay->count++];
+    entry->data = data;
+    entry->len = len;
+    entry->width = (uint16_t)width;
+    entry->height = (uint16_t)height;
+    return true;
+}
+
+static uint32_t read_u32_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Indicizza un corpus CAMERA_REPLAY_MAGIC in memoria (partizione mappata o corpus incorporato)
+static esp_err_t replay_index_corpus(camera_replay_t *replay, const uint8_t *data, size_t size)
+{
+    if (size < 8 || memcmp(data, CAMERA_REPLAY_MAGIC, 4) != 0) {
+        ESP_LOGE(TAG, "Corpus non valido (magic %s mancante)", CAMERA_REPLAY_MAGIC);
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t frames = read_u32_le(data + 4);
+    size_t offset = 8;
+    for (uint32_t i = 0; i < frames; i++) {
+        if (offset + 4 > size) {
+            break;
+        }
+        uint32_t len = read_u32_le(data + offset);
+        offset += 4;
+        if (len == 0 || len > size - offset) {
+            ESP_LOGW(TAG, "Corpus troncato al frame %lu", i);
+            break;
+        }
+        if (!replay_add_entry(replay, data + offset, len)) {
+            ESP_LOGW(TAG, "Corpus oltre %d frame, i successivi sono ignorati", CAMERA_REPLAY_MAX_FRAMES);
+            break;
+        }
+        offset += (len + 3) & ~(size_t)3;
+    }
+    return replay->count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t replay_load_partition(camera_replay_t *replay)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CAMERA_REPLAY_PARTITION_LABEL);
+    if (!part) {
+        ESP_LOGW(TAG, "Partizione \"%s\" non trovata", CAMERA_REPLAY_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    // La partizione viene mappata: i frame sono letti dalla flash tramite cache, senza copie in RAM
+    const void *mapped = NULL;
+    esp_err_t ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &mapped, &replay->mmap_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Errore mappatura della partizione: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    replay->mapped = true;
+    return replay_index_corpus(replay, (const uint8_t *)mapped, part->size);
+}
+
+static esp_err_t replay_load_embedded(camera_replay_t *replay)
+{
+#ifdef CAMERA_HAS_REPLAY_CORPUS
+    return replay_index_corpus(replay, replay_corpus_start, (size_t)(replay_corpus_end - replay_corpus_start));
+#else
+    ESP_LOGW(TAG, "Nessun corpus incorporato nel firmware (replay_corpus.bin)");
+    return ESP_ERR_NOT_FOUND;
+#endif
+}
+
+static bool replay_is_jpeg_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    return ext && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+}
+
+// Carica i .jpg di una cartella in un unico buffer PSRAM (due passaggi: dimensioni, poi lettura)
+static esp_err_t replay_load_directory(camera_replay_t *replay)
+{
+    DIR *dir = opendir(replay->directory);
+    if (!dir) {
+        ESP_LOGW(TAG, "Cartella %s non accessibile", replay->directory);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char path[sizeof(replay->directory) + 260];
+    size_t total = 0;
+    uint32_t files = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL && files < CAMERA_REPLAY_MAX_FRAMES) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", replay->directory, de->d_name);
+        if (replay_is_jpeg_name(de->d_name) && stat(path, &st) == 0 && st.st_size > 0) {
+            total += ((size_t)st.st_size + 3) & ~(size_t)3;
+            files++;
+        }
+    }
+    if (files == 0) {
+        closedir(dir);
+        ESP_LOGW(TAG, "Nessun file .jpg in %s", replay->directory);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    replay->files = (uint8_t *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!replay->files) {
+        closedir(dir);
+        ESP_LOGE(TAG, "Errore allocazione di %zu bytes per i frame", total);
+        return ESP_ERR_NO_MEM;
+    }
+
+    rewinddir(dir);
+    size_t offset = 0;
+    while ((de = readdir(dir)) != NULL && replay->count < files) {
+        if (!replay_is_jpeg_name(de->d_name)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", replay->directory, de->d_name);
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            continue;
+        }
+        size_t len = fread(replay->files + offset, 1, total - offset, f);
+        fclose(f);
+        if (len > 0) {
+            replay_add_entry(replay, replay->files + offset, (uint32_t)len);
+            offset += (len + 3) & ~(size_t)3;
+        }
+    }
+    closedir(dir);
+    return replay->count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// Seleziona i frame alla risoluzione richiesta; senza corrispondenze vengono serviti tutti
+static void replay_select_framesize(camera_replay_t *replay, framesize_t framesize)
+{
+    replay->width = 0;
+    replay->height = 0;
+    if (framesize < FRAMESIZE_INVALID) {
+        replay->width = resolution[framesize].width;
+        replay->height = resolution[framesize].height;
+    }
+    replay->match_any = true;
+    for (uint32_t i = 0; i < replay->count; i++) {
+        if (replay->entries[i].width == replay->width && replay->entries[i].height == replay->height) {
+            replay->match_any = false;
+            break;
+        }
+    }
+    if (replay->match_any) {
+        ESP_LOGW(TAG, "Nessun frame %ux%u nel corpus: vengono serviti i frame alla loro risoluzione",
+                 replay->width, replay->height);
+    }
+}
+
+static esp_err_t replay_deinit(void *ctx)
+{
+    camera_replay_t *replay = (camera_replay_t *)ctx;
+    if (replay->mapped) {
+        esp_partition_munmap(replay->mmap_handle);
+        replay->mapped = false;
+    }
+    heap_caps_free(replay->files);
+    replay->files = NULL;
+    replay->count = 0;
+    return ESP_OK;
+}
+
+static esp_err_t replay_init(void *ctx, const camera_config_t *config)
+{
+    camera_replay_t *replay = (camera_replay_t *)ctx;
+    if (!replay || !replay->configured) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->pixel_format != PIXFORMAT_JPEG) {
+        ESP_LOGE(TAG, "Il replay serve solo frame JPEG");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    replay_deinit(replay);
+
+    esp_err_t ret;
+    replay->active_backend = replay->backend;
+    switch (replay->backend) {
+    case CAMERA_REPLAY_DIRECTORY:
+        ret = replay_load_directory(replay);
+        break;
+    case CAMERA_REPLAY_EMBEDDED:
+        ret = replay_load_embedded(replay);
+        break;
+    case CAMERA_REPLAY_PARTITION:
+    default:
+        ret = replay_load_partition(replay);
+        if (ret != ESP_OK) {
+            // Partizione vuota o assente: ripiega sul corpus incorporato, se presente
+            replay_deinit(replay);
+            replay->active_backend = CAMERA_REPLAY_EMBEDDED;
+            ret = replay_load_embedded(replay);
+        }
+        break;
+    }
+    if (ret != ESP_OK) {
+        replay_deinit(replay);
+        ESP_LOGE(TAG, "Nessun frame da riprodurre");
+        return ret;
+    }
+
+    replay_select_framesize(replay, config->frame_size);
+    replay->next = 0;
+    replay->next_frame_us = 0;
+    ESP_LOGI(TAG, "Replay pronto: %lu frame, %lu fps", replay->count, replay->fps);
+    return ESP_OK;
+}
+
+static camera_fb_t *replay_fb_get(void *ctx)
+{
+    camera_replay_t *replay = (camera_replay_t *)ctx;
+    if (replay->count == 0) {
+        return NULL;
+    }
+
+    // Cadenza del sensore simulato: attende l'istante del prossimo frame
+    if (replay->fps > 0) {
+        int64_t period_us = 1000000LL / replay->fps;
+        int64_t now = esp_timer_get_time();
+        if (replay->next_frame_us == 0) {
+            replay->next_frame_us = now;
+        }
+        if (replay->next_frame_us > now) {
+            vTaskDelay(pdMS_TO_TICKS((replay->next_frame_us - now + 999) / 1000) + 1);
+        } else if (now - replay->next_frame_us > period_us) {
+            // Consumatore più lento dell'FPS: si riparte da adesso invece di recuperare a raffica
+            replay->stats.late_frames++;
+            replay->next_frame_us = now;
+        }
+        replay->next_frame_us += period_us;
+    }
+
+    // Prossimo frame alla risoluzione richiesta (in ciclo sul corpus)
+    const camera_replay_entry_t *entry = NULL;
+    for (uint32_t i = 0; i < replay->count && !entry; i++) {
+        const camera_replay_entry_t *candidate = &replay->entries[replay->next];
+        if (++replay->next >= replay->count) {
+            replay->next = 0;
+            replay->stats.loops++;
+        }
+        if (replay->match_any || (candidate->width == replay->width && candidate->height == replay->height)) {
+            entry = candidate;
+        }
+    }
+    if (!entry) {
+        return NULL;
+    }
+
+    int64_t now = esp_timer_get_time();
+    camera_fb_t *fb = &replay->fb;
+    fb->buf = (uint8_t *)entry->data;
+    fb->len = entry->len;
+    fb->width = entry->width;
+    fb->height = entry->height;
+    fb->format = PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    replay->stats.frames_served++;
+    return fb;
+}
+
+static void replay_fb_return(void *ctx, camera_fb_t *fb)
+{
+    // I frame restano nel corpus: nulla da restituire
+}
+
+static bool replay_set_framesize(void *ctx, framesize_t framesize)
+{
+    replay_select_framesize((camera_replay_t *)ctx, framesize);
+    return true;
+}
+
+const camera_source_t camera_replay_source = {
+    .name = "replay",
+    .raw_formats = false,
+    .init = replay_init,
+    .deinit = replay_deinit,
+    .fb_get = replay_fb_get,
+    .fb_return = replay_fb_return,
+    .set_framesize = replay_set_framesize,
+};
+
+void camera_replay_print_stats(camera_replay_t *replay)
+{
+    if (!replay) {
+        return;
+    }
+    static const char *backends[] = {"partizione", "incorporato", "cartella"};
+    printf("\n=== REPLAY FOTOCAMERA ===\n");
+    printf("Corpus: %lu frame (%s%s%s)\n", replay->count, backends[replay->active_backend],
+           replay->active_backend == CAMERA_REPLAY_DIRECTORY ? " " : "",
+           replay->active_backend == CAMERA_REPLAY_DIRECTORY ? replay->directory : "");
+    printf("Risoluzione richiesta: %ux%u%s, fps: %lu\n", replay->width, replay->height,
+           replay->match_any ? " (nessun frame corrispondente, serviti tutti)" : "", replay->fps);
+    printf("Frame serviti: %lu, cicli completi: %lu, frame in ritardo: %lu\n",
+           replay->stats.frames_served, replay->stats.loops, replay->stats.late_frames);
+    printf("=========================\n\n");
+}
@@ -0,0 +1,113 @@
+#ifndef CAMERA_REPLAY_H
+#define CAMERA_REPLAY_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "esp_partition.h"
+#include "camera_source.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAMERA_REPLAY_MAX_FRAMES 256 //frame indicizzati al massimo in un corpus
+#define CAMERA_REPLAY_PARTITION_LABEL "frames" //partizione dati con il corpus (vedi partitions.csv)
+#define CAMERA_REPLAY_DEFAULT_FPS 10
+#define CAMERA_REPLAY_DEFAULT_DIRECTORY "/host/frames" //cartella dell'host (semihosting in QEMU)
+// Corpus: "CRPL", numero di frame (u32 LE), poi per ogni frame lunghezza (u32 LE) + JPEG allineato a 4 byte
+#define CAMERA_REPLAY_MAGIC "CRPL"
+
+// Provenienza dei JPEG riprodotti
+typedef enum {
+    CAMERA_REPLAY_PARTITION = 0,    // corpus nella partizione CAMERA_REPLAY_PARTITION_LABEL (mappato, senza copie)
+    CAMERA_REPLAY_EMBEDDED,         // corpus incorporato nel firmware (replay_corpus.bin accanto a camera.cpp)
+    CAMERA_REPLAY_DIRECTORY,        // file .jpg di una cartella del VFS (SD, SPIFFS, host via semihosting)
+} camera_replay_backend_t;
+
+// Frame del corpus
+typedef struct {
+    const uint8_t *data;
+    uint32_t len;
+    uint16_t width;
+    uint16_t height;
+} camera_replay_entry_t;
+
+// Statistiche del replay
+typedef struct {
+    uint32_t frames_served;
+    uint32_t loops;             // passaggi completi sul corpus
+    uint32_t late_frames;       // frame consegnati in ritardo rispetto all'FPS richiesto
+} camera_replay_stats_t;
+
+// Sorgente di replay: serve i JPEG del corpus in ciclo, all'FPS configurato, filtrati sulla risoluzione richiesta
+typedef struct {
+    // Configurazione (camera_replay_configure)
+    camera_replay_backend_t backend;
+    char directory[64];
+    uint32_t fps;               // 0 = il più veloce possibile (misura del throughput della catena)
+
+    // Corpus indicizzato all'init
+    camera_replay_backend_t active_backend;
+    camera_replay_entry_t entries[CAMERA_REPLAY_MAX_FRAMES];
+    uint32_t count;
+    esp_partition_mmap_handle_t mmap_handle;
+    bool mapped;
+    uint8_t *files;             // contenuto dei file della cartella (PSRAM)
+
+    // Riproduzione
+    uint16_t width;             // risoluzione richiesta (0 = qualsiasi frame)
+    uint16_t height;
+    bool match_any;             // nessun frame del corpus alla risoluzione richiesta: si servono tutti
+    uint32_t next;
+    int64_t next_frame_us;
+    camera_fb_t fb;
+    camera_replay_stats_t stats;
+    bool configured;
+} camera_replay_t;
+
+/**
+ * @brief Configura la sorgente di replay (da chiamare prima di camera_init_with_source)
+ * @param replay Puntatore alla sorgente
+ * @param backend Provenienza dei JPEG
+ * @param directory Cartella per CAMERA_REPLAY_DIRECTORY (NULL = CAMERA_REPLAY_DEFAULT_DIRECTORY)
+ * @param fps Frame al secondo (0 = senza limite)
+ */
+void camera_replay_configure(camera_replay_t *replay, camera_replay_backend_t backend, const char *directory, uint32_t fps);
+
+/**
+ * @brief Cambia l'FPS della riproduzione (anche durante l'acquisizione)
+ * @param replay Puntatore alla sorgente
+ * @param fps Frame al secondo (0 = senza limite)
+ */
+void camera_replay_set_fps(camera_replay_t *replay, uint32_t fps);
+
+/**
+ * @brief Stampa corpus e statistiche della riproduzione
+ * @param replay Puntatore alla sorgente
+ */
+void camera_replay_print_stats(camera_replay_t *replay);
+
+/**
+ * @brief Ottiene l'istanza globale del replay (configurata di default sulla partizione, CAMERA_REPLAY_DEFAULT_FPS)
+ * @return Puntatore all'istanza globale
+ */
+camera_replay_t* get_camera_replay_instance(void);
+
+/**
+ * @brief Operazioni della sorgente di replay (contesto: camera_replay_t)
+ */
+extern const camera_source_t camera_replay_source;
+
+/**
+ * @brief Variabile globale del replay
+ */
+extern camera_replay_t g_camera_replay;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAMERA_REPLAY_H
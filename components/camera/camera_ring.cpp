@@ -0,0 +1,356 @@
+#include "camera_ring.h"
+#include "monitor.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "CAMERA_RING";
+
+#define CAMERA_RING_MONITOR_NAME "camera_ring"
+
+camera_ring_t g_camera_ring;
+
+camera_ring_t* get_camera_ring_instance(void)
+{
+    return &g_camera_ring;
+}
+
+static const camera_ring_config_t camera_ring_default_config = {
+    .byte_budget = CAMERA_RING_DEFAULT_BUDGET,
+    .fps = CAMERA_RING_DEFAULT_FPS,
+    .pre_ms = CAMERA_RING_DEFAULT_PRE_MS,
+    .post_ms = CAMERA_RING_DEFAULT_POST_MS,
+};
+
+// Memoria trattenuta da un frame: il blocco del slab dei dati, fisso per tutta la vita del frame
+// (il JPEG di un frame grezzo viene codificato solo all'esportazione e non è contato)
+static size_t camera_ring_frame_bytes(const camera_frame_t *frame)
+{
+    return frame->capacity;
+}
+
+static void camera_ring_release_all(camera_frame_t **frames, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        camera_frame_release(frames[i]);
+    }
+}
+
+// Chiude la clip in registrazione se la finestra post è trascorsa (con il lock dell'anello)
+static void camera_ring_finish_clip_locked(camera_ring_t *ring, int64_t now_us)
+{
+    if (ring->clip_state == CAMERA_RING_CLIP_RECORDING &&
+        now_us > ring->trigger_us + (int64_t)ring->config.post_ms * 1000) {
+        ring->clip_state = CAMERA_RING_CLIP_READY;
+        ring->stats.clips++;
+    }
+}
+
+// Inserisce un frame nell'anello (consuma il riferimento del chiamante); i frame più vecchi
+// escono finché il nuovo frame rientra nel budget di byte
+static void camera_ring_push(camera_ring_t *ring, camera_frame_t *frame)
+{
+    camera_frame_t *evicted[CAMERA_RING_MAX_FRAMES];
+    uint32_t num_evicted = 0;
+    size_t frame_bytes = camera_ring_frame_bytes(frame);
+    bool kept = false;
+
+    taskENTER_CRITICAL(&ring->lock);
+    if (frame_bytes <= ring->config.byte_budget) {
+        while (ring->count > 0 &&
+               (ring->count == CAMERA_RING_MAX_FRAMES || ring->bytes + frame_bytes > ring->config.byte_budget)) {
+            camera_frame_t *oldest = ring->frames[ring->head];
+            if (ring->count == CAMERA_RING_MAX_FRAMES) {
+                ring->stats.evicted_count++;
+            } else {
+                ring->stats.evicted_budget++;
+            }
+            ring->bytes -= camera_ring_frame_bytes(oldest);
+            ring->head = (ring->head + 1) % CAMERA_RING_MAX_FRAMES;
+            ring->count--;
+            evicted[num_evicted++] = oldest;
+        }
+        ring->frames[(ring->head + ring->count) % CAMERA_RING_MAX_FRAMES] = frame;
+        ring->count++;
+        ring->bytes += frame_bytes;
+        ring->last_added_us = frame->timestamp_us;
+        ring->stats.frames_added++;
+        kept = true;
+
+        // Finestra post dell'evento in corso: la clip prende un riferimento in più sullo stesso frame
+        if (ring->clip_state == CAMERA_RING_CLIP_RECORDING) {
+            if (frame->timestamp_us <= ring->trigger_us + (int64_t)ring->config.post_ms * 1000 &&
+                ring->clip_count < CAMERA_RING_CLIP_MAX_FRAMES &&
+                ring->clip_bytes + frame_bytes <= ring->config.byte_budget) {
+                camera_frame_retain(frame);
+                ring->clip[ring->clip_count++] = frame;
+                ring->clip_bytes += frame_bytes;
+            } else {
+                ring->clip_state = CAMERA_RING_CLIP_READY;
+                ring->stats.clips++;
+            }
+        }
+    } else {
+        ring->stats.frames_skipped++;
+    }
+    taskEXIT_CRITICAL(&ring->lock);
+
+    camera_ring_release_all(evicted, num_evicted);
+    if (!kept) {
+        camera_frame_release(frame);
+    }
+}
+
+// Task dell'anello: segue l'acquisizione continua e tiene un frame ogni 1/fps secondi
+static void camera_ring_task(void *pvParameters)
+{
+    camera_ring_t *ring = (camera_ring_t *)pvParameters;
+    uint32_t sequence = 0;
+    ESP_LOGI(TAG, "Anello dei frame avviato");
+
+    while (ring->running) {
+        camera_frame_t *frame = NULL;
+        esp_err_t ret = camera_wait_frame(ring->camera, sequence, pdMS_TO_TICKS(500), &frame);
+        if (ret == ESP_ERR_INVALID_STATE) {
+            // Acquisizione continua fermata o camera reinizializzata: si riprova più tardi
+            vTaskDelay(pdMS_TO_TICKS(200));
+            continue;
+        }
+        if (ret != ESP_OK) {
+            taskENTER_CRITICAL(&ring->lock);
+            camera_ring_finish_clip_locked(ring, esp_timer_get_time());
+            taskEXIT_CRITICAL(&ring->lock);
+            continue;
+        }
+        sequence = frame->sequence;
+
+        int64_t interval_us = ring->config.fps ? 1000000LL / ring->config.fps : 0;
+        if (ring->count > 0 && frame->timestamp_us - ring->last_added_us < interval_us) {
+            taskENTER_CRITICAL(&ring->lock);
+            ring->stats.frames_skipped++;
+            taskEXIT_CRITICAL(&ring->lock);
+            camera_frame_release(frame);
+            continue;
+        }
+        camera_ring_push(ring, frame);
+
+        // Nessun risveglio per i frame che verrebbero comunque scartati
+        int64_t wait_us = ring->last_added_us + interval_us - esp_timer_get_time();
+        if (wait_us > 1000) {
+            vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+        }
+    }
+
+    ESP_LOGI(TAG, "Anello dei frame fermato");
+    ring->task = NULL;
+    vTaskDelete(NULL);
+}
+
+// Metriche per il monitor: occupazione rispetto al budget e contatori degli eventi
+static size_t camera_ring_collect(void *ctx, monitor_metric_t *metrics, size_t max_metrics)
+{
+    camera_ring_t *ring = (camera_ring_t *)ctx;
+    taskENTER_CRITICAL(&ring->lock);
+    camera_ring_stats_t stats = ring->stats;
+    uint32_t count = ring->count;
+    size_t bytes = ring->bytes;
+    uint32_t clip_count = ring->clip_count;
+    size_t clip_bytes = ring->clip_bytes;
+    taskEXIT_CRITICAL(&ring->lock);
+
+    const monitor_metric_t values[] = {
+        {"anello_frame", count},
+        {"anello_bytes", (uint32_t)bytes},
+        {"anello_budget_bytes", (uint32_t)ring->config.byte_budget},
+        {"anello_frame_aggiunti", stats.frames_added},
+        {"anello_uscite_per_budget", stats.evicted_budget},
+        {"anello_uscite_per_slot", stats.evicted_count},
+        {"clip_frame", clip_count},
+        {"clip_bytes", (uint32_t)clip_bytes},
+        {"clip_eventi", stats.triggers},
+        {"clip_completate", stats.clips},
+        {"clip_esportate", stats.clips_exported},
+    };
+    size_t n = sizeof(values) / sizeof(values[0]);
+    if (n > max_metrics) {
+        n = max_metrics;
+    }
+    memcpy(metrics, values, n * sizeof(monitor_metric_t));
+    return n;
+}
+
+esp_err_t camera_ring_start(camera_ring_t *ring, camera_t *camera, const camera_ring_config_t *config)
+{
+    if (!ring || !camera) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ring->task) {
+        return ESP_OK;
+    }
+
+    // L'anello segue l'ultimo frame pubblicato: serve l'acquisizione continua
+    esp_err_t ret = camera_start_capture(camera);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    memset(ring, 0, sizeof(camera_ring_t));
+    portMUX_INITIALIZE(&ring->lock);
+    ring->camera = camera;
+    ring->config = config ? *config : camera_ring_default_config;
+    ring->running = true;
+    if (xTaskCreatePinnedToCore(camera_ring_task, "camera_ring", CAMERA_RING_STACK_SIZE, ring,
+                                CAMERA_RING_PRIORITY, &ring->task, CAMERA_RING_CORE) != pdPASS) {
+        ring->running = false;
+        ESP_LOGE(TAG, "Errore creazione task dell'anello");
+        return ESP_ERR_NO_MEM;
+    }
+    monitor_register_provider(CAMERA_RING_MONITOR_NAME, camera_ring_collect, ring);
+    ESP_LOGI(TAG, "Anello: budget %zu KB, %lu fps, clip %lu ms prima e %lu ms dopo l'evento",
+             ring->config.byte_budget / 1024, ring->config.fps, ring->config.pre_ms, ring->config.post_ms);
+    return ESP_OK;
+}
+
+void camera_ring_stop(camera_ring_t *ring)
+{
+    if (!ring || !ring->task) {
+        return;
+    }
+    ring->running = false;
+    for (int i = 0; i < 100 && ring->task; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    monitor_unregister_provider(CAMERA_RING_MONITOR_NAME);
+
+    // Restituisce al pool della camera tutti i frame trattenuti
+    camera_frame_t *frames[CAMERA_RING_MAX_FRAMES];
+    camera_frame_t *clip[CAMERA_RING_CLIP_MAX_FRAMES];
+    taskENTER_CRITICAL(&ring->lock);
+    uint32_t count = ring->count;
+    for (uint32_t i = 0; i < count; i++) {
+        frames[i] = ring->frames[(ring->head + i) % CAMERA_RING_MAX_FRAMES];
+    }
+    uint32_t clip_count = ring->clip_count;
+    memcpy(clip, ring->clip, clip_count * sizeof(camera_frame_t *));
+    ring->count = 0;
+    ring->bytes = 0;
+    ring->clip_count = 0;
+    ring->clip_bytes = 0;
+    ring->clip_state = CAMERA_RING_CLIP_NONE;
+    taskEXIT_CRITICAL(&ring->lock);
+    camera_ring_release_all(frames, count);
+    camera_ring_release_all(clip, clip_count);
+}
+
+esp_err_t camera_ring_trigger(camera_ring_t *ring)
+{
+    if (!ring || !ring->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    camera_frame_t *previous[CAMERA_RING_CLIP_MAX_FRAMES];
+    uint32_t num_previous = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&ring->lock);
+    ring->stats.triggers++;
+    if (ring->clip_state == CAMERA_RING_CLIP_RECORDING) {
+        // Eventi ravvicinati (es. una persona in più frame consecutivi) cadono nella clip in corso
+        ring->stats.triggers_ignored++;
+        taskEXIT_CRITICAL(&ring->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // La clip precedente viene sostituita (chi la sta esportando ha i propri riferimenti)
+    num_previous = ring->clip_count;
+    memcpy(previous, ring->clip, num_previous * sizeof(camera_frame_t *));
+
+    // Finestra pre: i frame più recenti dell'anello entro pre_ms e nel budget della clip
+    int64_t start_us = now_us - (int64_t)ring->config.pre_ms * 1000;
+    uint32_t first = ring->count;
+    size_t bytes = 0;
+    while (first > 0) {
+        camera_frame_t *frame = ring->frames[(ring->head + first - 1) % CAMERA_RING_MAX_FRAMES];
+        size_t frame_bytes = camera_ring_frame_bytes(frame);
+        if (frame->timestamp_us < start_us || bytes + frame_bytes > ring->config.byte_budget) {
+            break;
+        }
+        bytes += frame_bytes;
+        first--;
+    }
+    ring->clip_count = 0;
+    for (uint32_t i = first; i < ring->count; i++) {
+        camera_frame_t *frame = ring->frames[(ring->head + i) % CAMERA_RING_MAX_FRAMES];
+        camera_frame_retain(frame);
+        ring->clip[ring->clip_count++] = frame;
+    }
+    ring->clip_bytes = bytes;
+    ring->trigger_us = now_us;
+    ring->clip_state = CAMERA_RING_CLIP_RECORDING;
+    uint32_t pre_frames = ring->clip_count;
+    taskEXIT_CRITICAL(&ring->lock);
+
+    camera_ring_release_all(previous, num_previous);
+    ESP_LOGI(TAG, "Evento: clip avviata con %lu frame precedenti (%zu KB)", pre_frames, bytes / 1024);
+    return ESP_OK;
+}
+
+void camera_ring_job_complete(inference_job_status_t status, const inference_result_t *result, void *user_ctx)
+{
+    if (status == INFERENCE_JOB_DONE && result && result->person_detected) {
+        camera_ring_trigger((camera_ring_t *)user_ctx);
+    }
+}
+
+esp_err_t camera_ring_get_clip(camera_ring_t *ring, camera_frame_t **frames, uint32_t *count)
+{
+    if (!ring || !frames || !count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *count = 0;
+    taskENTER_CRITICAL(&ring->lock);
+    camera_ring_finish_clip_locked(ring, esp_timer_get_time());
+    if (ring->clip_state != CAMERA_RING_CLIP_READY) {
+        taskEXIT_CRITICAL(&ring->lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (uint32_t i = 0; i < ring->clip_count; i++) {
+        camera_frame_retain(ring->clip[i]);
+        frames[i] = ring->clip[i];
+    }
+    *count = ring->clip_count;
+    ring->stats.clips_exported++;
+    taskEXIT_CRITICAL(&ring->lock);
+    return ESP_OK;
+}
+
+void camera_ring_get_stats(camera_ring_t *ring, camera_ring_stats_t *stats)
+{
+    if (!ring || !stats) {
+        return;
+    }
+    taskENTER_CRITICAL(&ring->lock);
+    memcpy(stats, &ring->stats, sizeof(camera_ring_stats_t));
+    taskEXIT_CRITICAL(&ring->lock);
+}
+
+void camera_ring_print_stats(camera_ring_t *ring)
+{
+    if (!ring) {
+        return;
+    }
+    static const char *clip_states[] = {"nessuna", "in registrazione", "pronta"};
+    camera_ring_stats_t stats;
+    camera_ring_get_stats(ring, &stats);
+
+    printf("\n=== ANELLO DEI FRAME ===\n");
+    printf("Stato: %s, %lu fps, budget %zu KB\n", ring->running ? "attivo" : "fermo", ring->config.fps,
+           ring->config.byte_budget / 1024);
+    printf("Frame nell'anello: %lu (%zu KB)\n", ring->count, ring->bytes / 1024);
+    printf("Frame aggiunti: %lu, saltati: %lu, usciti per il budget: %lu, per gli slot: %lu\n",
+           stats.frames_added, stats.frames_skipped, stats.evicted_budget, stats.evicted_count);
+    printf("Clip: %s, %lu frame (%zu KB)\n", clip_states[ring->clip_state], ring->clip_count, ring->clip_bytes / 1024);
+    printf("Eventi: %lu (ignorati durante una registrazione: %lu), clip completate: %lu, esportate: %lu\n",
+           stats.triggers, stats.triggers_ignored, stats.clips, stats.clips_exported);
+    printf("========================\n\n");
+}
@@ -0,0 +1,144 @@
+#ifndef CAMERA_RING_H
+#define CAMERA_RING_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "camera.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAMERA_RING_MAX_FRAMES 12 //frame trattenuti al massimo dall'anello (ognuno occupa uno slot del pool)
+#define CAMERA_RING_CLIP_MAX_FRAMES 24 //frame di una clip (finestra pre + post evento)
+#define CAMERA_RING_DEFAULT_BUDGET (512 * 1024) //byte dei blocchi del slab trattenuti dall'anello (e dalla clip)
+#define CAMERA_RING_DEFAULT_FPS 5
+#define CAMERA_RING_DEFAULT_PRE_MS 2000
+#define CAMERA_RING_DEFAULT_POST_MS 2000
+#define CAMERA_RING_STACK_SIZE 3072
+#define CAMERA_RING_PRIORITY 2
+#define CAMERA_RING_CORE 0
+
+// Stato della clip dell'ultimo evento
+typedef enum {
+    CAMERA_RING_CLIP_NONE = 0,
+    CAMERA_RING_CLIP_RECORDING,     // finestra pre congelata, in attesa dei frame della finestra post
+    CAMERA_RING_CLIP_READY,         // clip completa, esportabile (GET /clip)
+} camera_ring_clip_state_t;
+
+// Configurazione dell'anello
+typedef struct {
+    size_t byte_budget;     // memoria massima trattenuta dall'anello, e separatamente dalla clip
+    uint32_t fps;           // frequenza con cui i frame dell'acquisizione continua entrano nell'anello
+    uint32_t pre_ms;        // storia inclusa nella clip prima dell'evento
+    uint32_t post_ms;       // frame aggiunti alla clip dopo l'evento
+} camera_ring_config_t;
+
+// Statistiche dell'anello
+typedef struct {
+    uint32_t frames_added;
+    uint32_t frames_skipped;    // frame dell'acquisizione non inseriti (fps dell'anello, o più grandi del budget)
+    uint32_t evicted_budget;    // frame usciti dall'anello per restare nel budget di byte
+    uint32_t evicted_count;     // frame usciti perché l'anello era pieno (CAMERA_RING_MAX_FRAMES)
+    uint32_t triggers;          // eventi ricevuti (detections o richieste manuali)
+    uint32_t triggers_ignored;  // eventi arrivati mentre la clip precedente era ancora in registrazione
+    uint32_t clips;             // clip completate
+    uint32_t clips_exported;
+} camera_ring_stats_t;
+
+// Anello dei frame recenti: trattiene gli handle dei frame della camera (nessuna copia) entro un budget
+// di byte; un evento congela la finestra pre e la completa con la finestra post in una clip esportabile
+typedef struct {
+    camera_t *camera;
+    camera_ring_config_t config;
+
+    // Anello (il più vecchio in head)
+    camera_frame_t *frames[CAMERA_RING_MAX_FRAMES];
+    uint32_t head;
+    uint32_t count;
+    size_t bytes;
+
+    // Clip dell'ultimo evento
+    camera_ring_clip_state_t clip_state;
+    camera_frame_t *clip[CAMERA_RING_CLIP_MAX_FRAMES];
+    uint32_t clip_count;
+    size_t clip_bytes;
+    int64_t trigger_us;
+
+    int64_t last_added_us;
+    camera_ring_stats_t stats;
+    portMUX_TYPE lock;              // l'anello è letto dagli handler HTTP e aggiornato dall'executor (eventi)
+    TaskHandle_t task;
+    volatile bool running;
+} camera_ring_t;
+
+/**
+ * @brief Avvia l'anello sulla camera (avvia anche l'acquisizione continua se non è attiva)
+ * @param ring Puntatore all'anello
+ * @param camera Fotocamera condivisa
+ * @param config Configurazione (NULL = valori di default)
+ * @return ESP_OK se avviato
+ */
+esp_err_t camera_ring_start(camera_ring_t *ring, camera_t *camera, const camera_ring_config_t *config);
+
+/**
+ * @brief Ferma l'anello e rilascia i frame trattenuti (anello e clip)
+ * @param ring Puntatore all'anello
+ */
+void camera_ring_stop(camera_ring_t *ring);
+
+/**
+ * @brief Segnala un evento: congela la finestra pre e avvia la registrazione della finestra post
+ * @param ring Puntatore all'anello
+ * @return ESP_OK, ESP_ERR_INVALID_STATE se l'anello non è attivo o una clip è già in registrazione
+ */
+esp_err_t camera_ring_trigger(camera_ring_t *ring);
+
+/**
+ * @brief Notifica di completamento per i job YOLO (user_ctx = camera_ring_t*): una persona rilevata
+ *        attiva camera_ring_trigger
+ */
+void camera_ring_job_complete(inference_job_status_t status, const inference_result_t *result, void *user_ctx);
+
+/**
+ * @brief Ottiene i frame della clip pronta (il chiamante possiede un riferimento per ogni frame)
+ * @param ring Puntatore all'anello
+ * @param frames Frame della clip in ordine di acquisizione (CAMERA_RING_CLIP_MAX_FRAMES elementi)
+ * @param count Numero di frame
+ * @return ESP_OK, ESP_ERR_NOT_FOUND se nessuna clip è pronta
+ */
+esp_err_t camera_ring_get_clip(camera_ring_t *ring, camera_frame_t **frames, uint32_t *count);
+
+/**
+ * @brief Copia le statistiche dell'anello
+ * @param ring Puntatore all'anello
+ * @param stats Statistiche
+ */
+void camera_ring_get_stats(camera_ring_t *ring, camera_ring_stats_t *stats);
+
+/**
+ * @brief Stampa stato e statistiche dell'anello
+ * @param ring Puntatore all'anello
+ */
+void camera_ring_print_stats(camera_ring_t *ring);
+
+/**
+ * @brief Ottiene l'istanza globale dell'anello
+ * @return Puntatore all'istanza globale
+ */
+camera_ring_t* get_camera_ring_instance(void);
+
+/**
+ * @brief Variabile globale dell'anello
+ */
+extern camera_ring_t g_camera_ring;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAMERA_RING_H
@@ -0,0 +1,246 @@
+#include "camera_slab.h"
+#include "monitor.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "CAMERA_SLAB";
+
+// Classi di dimensione dei buffer dei frame, calcolate all'init dal frame più grande e dal budget di PSRAM.
+// La classe più grande contiene il frame più grande con CAMERA_SLAB_MAX_FRAME_BLOCKS blocchi: il nuovo frame
+// viene allocato prima che l'ultimo sia rilasciato e un altro può essere ancora in mano a un consumatore.
+// Le classi inferiori dimezzano la dimensione e si dividono in parti uguali il budget rimanente, quindi le
+// piccole sono le più numerose: l'anello dei frame recenti ne trattiene decine alle risoluzioni basse.
+// Una richiesta con la classe giusta piena viene servita dalla classe successiva
+static esp_err_t camera_slab_layout(camera_slab_t *slab, size_t max_frame_bytes, size_t budget)
+{
+    size_t largest = (max_frame_bytes + CAMERA_SLAB_BLOCK_ALIGN - 1) / CAMERA_SLAB_BLOCK_ALIGN * CAMERA_SLAB_BLOCK_ALIGN;
+    if (largest * 2 > budget) {
+        ESP_LOGE(TAG, "Budget di %zu KB insufficiente per due frame da %zu KB", budget / 1024, largest / 1024);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    camera_slab_class_t *top = &slab->classes[CAMERA_SLAB_CLASSES - 1];
+    top->block_size = largest;
+    top->blocks = CAMERA_SLAB_MAX_FRAME_BLOCKS;
+    while (top->blocks > 2 && top->block_size * top->blocks > budget) {
+        top->blocks--;
+    }
+    size_t remaining = budget - top->block_size * top->blocks;
+
+    for (int c = CAMERA_SLAB_CLASSES - 2; c >= 0; c--) {
+        camera_slab_class_t *cls = &slab->classes[c];
+        size_t half = slab->classes[c + 1].block_size / 2;
+        cls->block_size = (half + CAMERA_SLAB_BLOCK_ALIGN - 1) / CAMERA_SLAB_BLOCK_ALIGN * CAMERA_SLAB_BLOCK_ALIGN;
+        size_t share = remaining / (c + 1);
+        cls->blocks = share / cls->block_size > 0 ? share / cls->block_size : 1;
+        size_t used = cls->block_size * cls->blocks;
+        remaining = remaining > used ? remaining - used : 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_slab_init(camera_slab_t *slab, size_t max_frame_bytes, size_t budget)
+{
+    if (!slab || max_frame_bytes == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slab->initialized) {
+        return ESP_OK;
+    }
+
+    memset(slab, 0, sizeof(camera_slab_t));
+    portMUX_INITIALIZE(&slab->lock);
+    esp_err_t ret = camera_slab_layout(slab, max_frame_bytes, budget);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        slab->region_size += slab->classes[c].block_size * slab->classes[c].blocks;
+    }
+
+    // Un'unica allocazione per tutta la vita della camera
+    slab->region = (uint8_t *)heap_caps_aligned_alloc(16, slab->region_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!slab->region) {
+        ESP_LOGE(TAG, "Errore allocazione della regione dei frame (%zu bytes)", slab->region_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t *p = slab->region;
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        camera_slab_class_t *cls = &slab->classes[c];
+        cls->base = p;
+        snprintf(cls->name, sizeof(cls->name), "slab_%uk_in_uso", (unsigned)(cls->block_size / 1024));
+        // Free list intrusiva: ogni blocco libero punta al successivo
+        for (uint32_t b = cls->blocks; b > 0; b--) {
+            void **block = (void **)(p + (size_t)(b - 1) * cls->block_size);
+            *block = cls->free_list;
+            cls->free_list = block;
+        }
+        p += cls->block_size * cls->blocks;
+    }
+
+    slab->initialized = true;
+    ESP_LOGI(TAG, "Slab dei frame: %zu KB in %d classi (frame massimo %zu KB)", slab->region_size / 1024,
+             CAMERA_SLAB_CLASSES, max_frame_bytes / 1024);
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        ESP_LOGI(TAG, "  %lu blocchi da %zu KB", slab->classes[c].blocks, slab->classes[c].block_size / 1024);
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_slab_deinit(camera_slab_t *slab)
+{
+    if (!slab || !slab->initialized) {
+        return ESP_OK;
+    }
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        if (slab->classes[c].in_use != 0) {
+            ESP_LOGW(TAG, "%lu blocchi da %zu KB ancora in uso: regione non liberata",
+                     slab->classes[c].in_use, slab->classes[c].block_size / 1024);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    heap_caps_free(slab->region);
+    slab->region = NULL;
+    slab->initialized = false;
+    return ESP_OK;
+}
+
+void* camera_slab_alloc(camera_slab_t *slab, size_t size, size_t *capacity)
+{
+    if (!slab || !slab->initialized || size == 0) {
+        return NULL;
+    }
+    uint32_t start = esp_cpu_get_cycle_count();
+    void *block = NULL;
+
+    taskENTER_CRITICAL(&slab->lock);
+    bool fits = false;
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        camera_slab_class_t *cls = &slab->classes[c];
+        if (cls->block_size < size) {
+            continue;
+        }
+        if (!cls->free_list) {
+            fits = true;
+            continue;
+        }
+        block = cls->free_list;
+        cls->free_list = *(void **)block;
+        cls->in_use++;
+        cls->allocs++;
+        if (fits) {
+            cls->spills++;
+        }
+        if (cls->in_use > cls->peak_in_use) {
+            cls->peak_in_use = cls->in_use;
+        }
+        slab->stats.requested_in_use += size;
+        slab->stats.block_bytes_in_use += cls->block_size;
+        if (capacity) {
+            *capacity = cls->block_size;
+        }
+        fits = true;
+        break;
+    }
+    if (block) {
+        slab->stats.allocs++;
+    } else if (fits) {
+        slab->stats.failures++;
+    } else {
+        slab->stats.oversize++;
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    slab->stats.alloc_cycles += cycles;
+    if (cycles > slab->stats.max_alloc_cycles) {
+        slab->stats.max_alloc_cycles = cycles;
+    }
+    taskEXIT_CRITICAL(&slab->lock);
+    return block;
+}
+
+void camera_slab_free(camera_slab_t *slab, void *ptr, size_t size)
+{
+    if (!slab || !ptr) {
+        return;
+    }
+    uint8_t *p = (uint8_t *)ptr;
+    taskENTER_CRITICAL(&slab->lock);
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        camera_slab_class_t *cls = &slab->classes[c];
+        if (p < cls->base || p >= cls->base + cls->block_size * cls->blocks) {
+            continue;
+        }
+        *(void **)p = cls->free_list;
+        cls->free_list = p;
+        cls->in_use--;
+        slab->stats.frees++;
+        slab->stats.requested_in_use -= size;
+        slab->stats.block_bytes_in_use -= cls->block_size;
+        break;
+    }
+    taskEXIT_CRITICAL(&slab->lock);
+}
+
+void camera_slab_get_stats(camera_slab_t *slab, camera_slab_stats_t *stats, camera_slab_class_t *classes)
+{
+    if (!slab || !stats) {
+        return;
+    }
+    taskENTER_CRITICAL(&slab->lock);
+    memcpy(stats, &slab->stats, sizeof(camera_slab_stats_t));
+    if (classes) {
+        memcpy(classes, slab->classes, sizeof(slab->classes));
+    }
+    taskEXIT_CRITICAL(&slab->lock);
+}
+
+// Metriche per il monitor: contatori globali, frammentazione interna e occupazione per classe
+static size_t camera_slab_collect(void *ctx, monitor_metric_t *metrics, size_t max_metrics)
+{
+    camera_slab_t *slab = (camera_slab_t *)ctx;
+    camera_slab_stats_t stats;
+    camera_slab_class_t classes[CAMERA_SLAB_CLASSES];
+    camera_slab_get_stats(slab, &stats, classes);
+
+    size_t n = 0;
+#define SLAB_METRIC(metric_name, metric_value)          \
+    if (n < max_metrics) {                              \
+        metrics[n].name = metric_name;                  \
+        metrics[n].value = (uint32_t)(metric_value);    \
+        n++;                                            \
+    }
+    SLAB_METRIC("slab_allocazioni", stats.allocs);
+    SLAB_METRIC("slab_fallimenti", stats.failures + stats.oversize);
+    SLAB_METRIC("slab_cicli_alloc_medi", stats.allocs ? stats.alloc_cycles / stats.allocs : 0);
+    SLAB_METRIC("slab_cicli_alloc_max", stats.max_alloc_cycles);
+    SLAB_METRIC("slab_bytes_in_uso", stats.block_bytes_in_use);
+    // Percentuale dei blocchi in uso non occupata dai frame (classe più grande del necessario)
+    SLAB_METRIC("slab_spreco_interno_pct", stats.block_bytes_in_use
+        ? 100 - (uint32_t)((uint64_t)stats.requested_in_use * 100 / stats.block_bytes_in_use) : 0);
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        SLAB_METRIC(slab->classes[c].name, classes[c].in_use);
+    }
+    uint32_t spills = 0;
+    uint32_t peak_pct = 0;
+    for (int c = 0; c < CAMERA_SLAB_CLASSES; c++) {
+        spills += classes[c].spills;
+        uint32_t pct = classes[c].peak_in_use * 100 / classes[c].blocks;
+        if (pct > peak_pct) {
+            peak_pct = pct;
+        }
+    }
+    SLAB_METRIC("slab_richieste_su_classe_superiore", spills);
+    SLAB_METRIC("slab_occupazione_picco_pct", peak_pct);
+#undef SLAB_METRIC
+    return n;
+}
+
+void camera_slab_register_monitor(camera_slab_t *slab, const char *name)
+{
+    if (slab && name) {
+        monitor_register_provider(name, camera_slab_collect, slab);
+    }
+}
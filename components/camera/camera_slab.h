@@ -0,0 +1,108 @@
+#ifndef CAMERA_SLAB_H
+#define CAMERA_SLAB_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAMERA_SLAB_CLASSES 6 //classi di dimensione (vedi camera_slab_layout in camera_slab.cpp)
+#define CAMERA_SLAB_MAX_FRAME_BLOCKS 3 //blocchi della classe più grande: ultimo frame, nuovo frame e un consumatore
+#define CAMERA_SLAB_BLOCK_ALIGN 1024 //le dimensioni dei blocchi sono multipli di 1 KB (nomi delle metriche in KB)
+#define CAMERA_SLAB_PSRAM_BUDGET (2 * 1024 * 1024) //PSRAM riservata ai frame, accanto a modello, buffer del driver e arena
+
+// Classe di dimensione: blocchi uguali con free list intrusiva (il blocco libero contiene il puntatore al successivo)
+typedef struct {
+    size_t block_size;
+    uint32_t blocks;
+    uint32_t in_use;
+    uint32_t peak_in_use;       // occupazione massima dall'avvio
+    uint32_t allocs;
+    uint32_t spills;            // richieste servite da questa classe perché quella giusta era piena
+    uint8_t *base;
+    void *free_list;
+    char name[24];              // nome della metrica di occupazione (es. "slab_64k_in_uso")
+} camera_slab_class_t;
+
+// Statistiche globali del slab
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;          // nessun blocco abbastanza grande libero
+    uint32_t oversize;          // richieste oltre il blocco più grande
+    uint64_t alloc_cycles;      // latenza totale di allocazione (cicli CPU)
+    uint32_t max_alloc_cycles;
+    size_t requested_in_use;    // byte richiesti dai blocchi in uso (frammentazione interna)
+    size_t block_bytes_in_use;  // byte dei blocchi in uso
+} camera_slab_stats_t;
+
+// Allocatore a classi di dimensione per i buffer dei frame: una sola regione PSRAM ritagliata all'init,
+// così le acquisizioni non frammentano l'heap generale
+typedef struct {
+    uint8_t *region;
+    size_t region_size;
+    camera_slab_class_t classes[CAMERA_SLAB_CLASSES];
+    camera_slab_stats_t stats;
+    portMUX_TYPE lock;          // alloc/free arrivano da capture task, executor e handler HTTP
+    bool initialized;
+} camera_slab_t;
+
+/**
+ * @brief Calcola le classi, ritaglia la regione PSRAM e costruisce le free list
+ * @param slab Puntatore al slab
+ * @param max_frame_bytes Frame più grande da accettare (dimensione della classe più grande)
+ * @param budget Byte di PSRAM da ritagliare al massimo
+ * @return ESP_OK se successo, ESP_ERR_INVALID_SIZE se il budget non contiene due frame massimi,
+ *         ESP_ERR_NO_MEM se la regione non può essere allocata
+ */
+esp_err_t camera_slab_init(camera_slab_t *slab, size_t max_frame_bytes, size_t budget);
+
+/**
+ * @brief Libera la regione (solo se nessun blocco è in uso)
+ * @param slab Puntatore al slab
+ * @return ESP_OK se liberata, ESP_ERR_INVALID_STATE se ci sono blocchi ancora in uso
+ */
+esp_err_t camera_slab_deinit(camera_slab_t *slab);
+
+/**
+ * @brief Alloca un blocco della classe più piccola che contiene size (o della successiva se piena)
+ * @param slab Puntatore al slab
+ * @param size Byte richiesti
+ * @param capacity Dimensione del blocco restituito (può essere NULL)
+ * @return Blocco, NULL se nessuna classe adatta ha blocchi liberi
+ */
+void* camera_slab_alloc(camera_slab_t *slab, size_t size, size_t *capacity);
+
+/**
+ * @brief Restituisce un blocco alla sua classe
+ * @param slab Puntatore al slab
+ * @param ptr Blocco (può essere NULL)
+ * @param size Byte richiesti all'allocazione (per la statistica di frammentazione)
+ */
+void camera_slab_free(camera_slab_t *slab, void *ptr, size_t size);
+
+/**
+ * @brief Copia le statistiche globali e delle classi
+ * @param slab Puntatore al slab
+ * @param stats Statistiche globali
+ * @param classes Copia delle classi (CAMERA_SLAB_CLASSES elementi, può essere NULL)
+ */
+void camera_slab_get_stats(camera_slab_t *slab, camera_slab_stats_t *stats, camera_slab_class_t *classes);
+
+/**
+ * @brief Registra il slab come provider di metriche del monitor
+ * @param slab Puntatore al slab
+ * @param name Nome del provider
+ */
+void camera_slab_register_monitor(camera_slab_t *slab, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAMERA_SLAB_H
@@ -0,0 +1,34 @@
+#ifndef CAMERA_SOURCE_H
+#define CAMERA_SOURCE_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sorgente dei frame sotto camera_t: il sensore reale (driver esp32-camera) oppure un replay di JPEG
+// registrati, così tutta la catena acquisizione -> inferenza -> HTTP gira anche senza hardware.
+// Le operazioni sono chiamate da camera.cpp con il mutex della camera acquisito
+typedef struct {
+    const char *name;
+    bool raw_formats;   // può produrre frame PIXFORMAT_RGB565 (doppio flusso)
+    esp_err_t (*init)(void *ctx, const camera_config_t *config);
+    esp_err_t (*deinit)(void *ctx);
+    camera_fb_t *(*fb_get)(void *ctx);
+    void (*fb_return)(void *ctx, camera_fb_t *fb);
+    bool (*set_framesize)(void *ctx, framesize_t framesize); // cambio al volo; false = serve reinizializzare
+} camera_source_t;
+
+/**
+ * @brief Sorgente del sensore reale (driver esp32-camera), usata di default da camera_init
+ */
+extern const camera_source_t camera_sensor_source;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAMERA_SOURCE_H
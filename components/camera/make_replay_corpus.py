@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""Crea un corpus di replay per la fotocamera simulata (formato descritto in camera_replay.h).
+
+Uso:
+    python make_replay_corpus.py frame_dir/ -o replay_corpus.bin
+
+Il file può essere:
+  - scritto nella partizione "frames":  parttool.py write_partition --partition-name frames --input replay_corpus.bin
+  - incorporato nel firmware copiandolo accanto a camera.cpp (replay_corpus.bin)
+"""
+import argparse
+import pathlib
+import struct
+import sys
+
+MAGIC = b"CRPL"
+PARTITION_SIZE = 0x1F0000  # dimensione della partizione "frames" in partitions.csv
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("inputs", nargs="+", type=pathlib.Path, help="file .jpg o cartelle che li contengono")
+    parser.add_argument("-o", "--output", type=pathlib.Path, default=pathlib.Path("replay_corpus.bin"))
+    args = parser.parse_args()
+
+    frames = []
+    for path in args.inputs:
+        files = sorted(path.glob("*.jp*g")) if path.is_dir() else [path]
+        frames.extend(f.read_bytes() for f in files)
+    if not frames:
+        sys.exit("nessun frame JPEG trovato")
+
+    out = bytearray(MAGIC + struct.pack("<I", len(frames)))
+    for data in frames:
+        if not data.startswith(b"\xff\xd8"):
+            sys.exit("file non JPEG nel corpus")
+        out += struct.pack("<I", len(data)) + data
+        out += b"\0" * (-len(data) % 4)  # ogni frame allineato a 4 byte
+
+    args.output.write_bytes(out)
+    note = "" if len(out) <= PARTITION_SIZE else " (oltre la partizione frames: usare il corpus incorporato)"
+    print(f"{len(frames)} frame, {len(out)} bytes -> {args.output}{note}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#include "unity.h"
+#include "camera_adapt.h"
+
+static const camera_adapt_config_t test_config = {
+    .latency_budget_ms = CAMERA_ADAPT_DEFAULT_LATENCY_BUDGET_MS,
+    .max_slab_failures = CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES,
+    .small_box_px = CAMERA_ADAPT_DEFAULT_SMALL_BOX_PX,
+    .large_box_px = CAMERA_ADAPT_DEFAULT_LARGE_BOX_PX,
+    .min_interval_ms = CAMERA_ADAPT_DEFAULT_MIN_INTERVAL_MS,
+    .memory_cooldown_windows = CAMERA_ADAPT_DEFAULT_MEMORY_COOLDOWN,
+};
+
+// Finestra completa con oggetti piccoli in ogni risultato e latenza ben sotto il budget
+static camera_adapt_window_t small_objects_window(uint32_t slab_failures)
+{
+    camera_adapt_window_t window = {};
+    window.num_samples = CAMERA_ADAPT_WINDOW;
+    window.latency_ms = CAMERA_ADAPT_DEFAULT_LATENCY_BUDGET_MS / 4;
+    window.box_px = CAMERA_ADAPT_DEFAULT_SMALL_BOX_PX / 2;
+    window.num_boxes = CAMERA_ADAPT_WINDOW;
+    window.slab_failures = slab_failures;
+    window.resolution_index = 3;
+    window.memory_limit_index = -1;
+    return window;
+}
+
+TEST_CASE("allocazioni fallite: si scende e si risale al limite solo dopo il cooldown", "[camera_adapt]")
+{
+    int direction;
+    // Alla risoluzione alta i frame non trovano blocchi liberi
+    camera_adapt_window_t window = small_objects_window(CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES);
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_MEMORY, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(-1, direction);
+
+    // Una voce più in basso le allocazioni riescono, ma la voce che le ha esaurite resta un limite
+    window = small_objects_window(0);
+    window.memory_limit_index = window.resolution_index;
+    window.resolution_index--;
+    window.clean_windows = 1;
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_HOLD, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(0, direction);
+    window.clean_windows = CAMERA_ADAPT_DEFAULT_MEMORY_COOLDOWN - 1;
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_HOLD, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(0, direction);
+
+    // Due voci sotto il limite la salita resta permessa
+    window.resolution_index--;
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_SMALL_OBJECTS, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(1, direction);
+
+    // Passato il cooldown si può tornare alla voce del limite
+    window.resolution_index++;
+    window.clean_windows = CAMERA_ADAPT_DEFAULT_MEMORY_COOLDOWN;
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_SMALL_OBJECTS, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(1, direction);
+}
+
+TEST_CASE("allocazioni fallite sotto la soglia: nessuna discesa ma nemmeno salita", "[camera_adapt]")
+{
+    int direction;
+    camera_adapt_window_t window = small_objects_window(CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES - 1);
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_HOLD, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(0, direction);
+}
+
+TEST_CASE("finestra incompleta: nessuna decisione", "[camera_adapt]")
+{
+    int direction;
+    camera_adapt_window_t window = small_objects_window(CAMERA_ADAPT_DEFAULT_MAX_SLAB_FAILURES);
+    window.num_samples = CAMERA_ADAPT_WINDOW - 1;
+    TEST_ASSERT_EQUAL(CAMERA_ADAPT_HOLD, camera_adapt_decide(&test_config, &window, &direction));
+    TEST_ASSERT_EQUAL(0, direction);
+}
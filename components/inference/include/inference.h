@@ -8,15 +8,48 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "dl_model_base.hpp"
+#include "inference_arena.h"
+#include "yolo_postprocess.h"
 
 
 #define MAX_FACES 5 //numero massimo di facce rilevabili in una foto
-#define MAX_YOLO_DETECTIONS 10 //numero massimo di detections YOLO
+#define MAX_YOLO_DETECTIONS 20 //capacità massima delle detections YOLO nel risultato
+#define YOLO_DEFAULT_TOP_K 10 //detections YOLO restituite di default (configurabile fino a MAX_YOLO_DETECTIONS)
+#define YOLO_NMS_THRESHOLD 0.5f //soglia IoU della NMS YOLO
+// Varianti del modello YOLO (stesso modello esportato con input diversi, es. 192/256/320), scelte a runtime
+#define INFERENCE_MAX_YOLO_VARIANTS 3
+#define INFERENCE_YOLO_LATENCY_WINDOW 32 //campioni di latenza conservati per variante (per il p95)
+#define INFERENCE_YOLO_DEFAULT_BUDGET_MS 2000 //latenza obiettivo per frame (0 = selezione adattiva disattivata)
+
+// Risoluzione massima dei frame da elaborare (allineata alla voce più grande di resolution_map in camera.cpp),
+// usata per dimensionare una sola volta l'arena dei buffer di inferenza
+#define INFERENCE_MAX_FRAME_WIDTH 1920
+#define INFERENCE_MAX_FRAME_HEIGHT 1080
+#define YOLO_INPUT_SIZE 320 //lato massimo dell'input del modello YOLO (dimensiona l'arena; la dimensione reale è letta dal modello)
+// Dimensione minima dell'immagine decodificata per la face detection (il JPEG viene decodificato
+// alla scala IDCT 1/2, 1/4 o 1/8 più piccola che la copre)
+#define FACE_DETECT_MIN_INPUT_WIDTH 320
+#define FACE_DETECT_MIN_INPUT_HEIGHT 240
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Formato dei pixel di un frame in ingresso
+typedef enum {
+    INFERENCE_PIXEL_JPEG = 0,   // JPEG compresso (decodificato in RGB888 nel preprocessing)
+    INFERENCE_PIXEL_RGB565,     // RGB565 grezzo del sensore, big-endian (nessuna decodifica)
+} inference_pixel_format_t;
+
+// Frame in ingresso all'inferenza
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    inference_pixel_format_t format;
+    int width;  // dimensioni dei formati grezzi (per il JPEG sono lette dal marker SOF)
+    int height;
+} inference_input_frame_t;
+
 // Struttura per i risultati dell'inferenza
 typedef struct {
     uint32_t bounding_boxes[4];
@@ -40,12 +73,23 @@ typedef struct {
     uint32_t processing_time_ms; //tempo di esecuzione singola inferenza
     uint32_t postprocessing_time_ms; //tempo di esecuzione postprocessing
     uint32_t full_inference_time_ms; //tempo di esecuzione totale inferenza (preprocessing + inferenza + postprocessing)
+    uint32_t decode_time_ms; //tempo di decodifica JPEG (parte del preprocessing)
+    uint32_t resize_time_ms; //tempo di resize + quantizzazione verso il tensore di input (parte del preprocessing)
     uint32_t num_faces; // Numero di facce rilevate
     face_t faces[MAX_FACES];
     // Campi per YOLO
     bool person_detected;
     uint32_t num_yolo_detections;
     yolo_detection_t yolo_detections[MAX_YOLO_DETECTIONS];
+    uint32_t yolo_anchors_scanned; // anchor esaminati dallo stadio di scansione degli score
+    uint32_t yolo_anchors_survived; // anchor sopra soglia (gli unici che arrivano al calcolo in float)
+    uint32_t yolo_variant; // indice della variante del modello usata per il frame
+    uint32_t yolo_input_size; // lato dell'input della variante usata
+    bool yolo_resize_skipped; // frame già alla dimensione dell'input del modello: solo quantizzazione
+    bool raw_input; // frame RGB565 grezzo del sensore (decodifica JPEG saltata)
+    uint32_t frame_width; // dimensioni del frame originale (coordinate dei box YOLO)
+    uint32_t frame_height;
+    uint32_t end_to_end_ms; // dall'acquisizione del frame al risultato (impostato dall'executor)
 } inference_result_t;
 
 // Struttura per le statistiche del sistema
@@ -54,15 +98,77 @@ typedef struct {
     uint32_t avg_inference_time_ms;
 } inference_stats_t;
 
+// Variante del modello YOLO con il proprio descrittore, decoder e finestra di latenze
+typedef struct {
+    const char* name;
+    dl::Model* model;
+    yolo_model_desc_t desc; // forme ed exponent di input/output letti dal modello all'init
+    int8_t input_lut[256]; // LUT di quantizzazione RGB -> int8 per l'exponent dell'input
+    yolo_decoder_t decoder; // decoder DFL + NMS (LUT costruite all'init sugli exponent del modello)
+    uint16_t latency_ms[INFERENCE_YOLO_LATENCY_WINDOW]; // finestra circolare delle ultime latenze
+    uint32_t latency_count; // campioni validi nella finestra
+    uint32_t latency_head; // prossima posizione da scrivere
+    uint32_t runs; // frame elaborati con questa variante
+    uint32_t last_ms; // latenza dell'ultimo frame
+    uint32_t p95_ms; // p95 della finestra
+} inference_yolo_variant_t;
+
+// Statistiche di una variante YOLO (per CLI/webserver)
+typedef struct {
+    const char* name;
+    int input_width;
+    int input_height;
+    uint32_t runs;
+    uint32_t last_ms;
+    uint32_t p95_ms;
+    bool active;
+} inference_yolo_variant_stats_t;
+
+// Frame YOLO in transito tra gli stadi preparazione (decodifica + preprocessing) -> modello -> postprocessing.
+// Contiene tutto ciò che serve dopo model->run(), così il modello può già eseguire il frame successivo
+typedef struct {
+    int8_t* input; // input quantizzato; NULL = scritto direttamente nel tensore di input della variante
+    uint32_t variant; // variante scelta alla preparazione
+    int src_width; // dimensioni del frame originale (per riportare i box)
+    int src_height;
+    int64_t start_us; // inizio dell'elaborazione del frame
+    uint32_t decode_time_ms;
+    uint32_t resize_time_ms;
+    uint32_t preprocessing_time_ms;
+    uint32_t processing_time_ms;
+    uint32_t scan_time_us; // scansione degli score (parte del postprocessing, eseguita accanto al modello)
+    bool resize_skipped; // il frame decodificato aveva già la dimensione dell'input
+    bool raw_input; // frame RGB565 grezzo: nessuna decodifica JPEG
+    bool gathered; // bin DFL copiati in bins (il tensore box può essere già stato sovrascritto)
+    size_t num_candidates;
+    yolo_scan_stats_t scan_stats;
+    yolo_candidate_t candidates[YOLO_MAX_CANDIDATES];
+    int8_t bins[YOLO_MAX_CANDIDATES * 4 * YOLO_MAX_REG];
+    yolo_box_t boxes[YOLO_MAX_CANDIDATES];
+    yolo_box_t detections[MAX_YOLO_DETECTIONS];
+} inference_yolo_frame_t;
+
 // Struttura per il sistema di inferenza (classe C-style)
 typedef struct {
     bool initialized;
     bool face_detector_initialized;
     inference_stats_t stats;
+    portMUX_TYPE stats_lock; // stats: YOLO aggiorna da yolo_post nella pipeline, i volti dall'executor
     void* face_detector; // Puntatore opaco al detector
     //campi per il modello YOLO
-    dl::Model* yolo_model;
     bool yolo_model_initialized;
+    inference_yolo_variant_t yolo_variants[INFERENCE_MAX_YOLO_VARIANTS]; // ordinate per input crescente (costo crescente)
+    uint32_t yolo_num_variants;
+    uint32_t yolo_active_variant; // variante usata per il prossimo frame
+    uint32_t yolo_latency_budget_ms; // latenza obiettivo per frame
+    uint32_t yolo_frames_since_switch;
+    uint32_t yolo_variant_switches;
+    portMUX_TYPE yolo_variant_lock; // stato delle varianti (selezione sull'executor, latenze da yolo_post), budget, backlog e yolo_scan_config scritti da CLI/HTTP
+    uint32_t yolo_backlog; // frame in coda in attesa dell'inferenza (segnalati dal chiamante)
+    yolo_scan_config_t yolo_scan_config; // soglia di score e maschera delle classi
+    uint32_t yolo_top_k; // numero massimo di detections restituite
+    //arena persistente per i buffer per-frame (decodifica JPEG, scratch di preprocessing)
+    inference_arena_t arena;
 } inference_t;
 
 /**
@@ -89,6 +195,15 @@ bool inference_face_detector_init(inference_t *inf);
  */
 bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t jpeg_size, inference_result_t* result);
 
+/**
+ * @brief Esegue la face detection su un frame JPEG o RGB565 grezzo
+ * @param inf Puntatore alla struttura inference
+ * @param input Frame in ingresso
+ * @param result Puntatore alla struttura risultato
+ * @return true se l'inferenza è riuscita, false altrimenti
+ */
+bool inference_face_detection_frame(inference_t *inf, const inference_input_frame_t* input, inference_result_t* result);
+
 /**
  * @brief Elabora un'immagine JPEG e esegue l'inferenza (versione legacy)
  * @param jpeg_data Puntatore ai dati JPEG
@@ -111,6 +226,19 @@ void inference_get_stats(inference_t *inf, inference_stats_t* stats);
  */
 void inference_get_stats_legacy(inference_stats_t* stats);
 
+/**
+ * @brief Ottiene le statistiche dell'arena dei buffer di inferenza (high-water, fallimenti)
+ * @param inf Puntatore alla struttura inference
+ * @param stats Puntatore alla struttura statistiche
+ */
+void inference_get_arena_stats(inference_t *inf, inference_arena_stats_t* stats);
+
+/**
+ * @brief Stampa le statistiche dell'arena dei buffer di inferenza
+ * @param inf Puntatore alla struttura inference
+ */
+void inference_print_arena_stats(inference_t *inf);
+
 /**
  * @brief Deinizializza il detector per face detection
  * @param inf Puntatore alla struttura inference
@@ -165,6 +293,99 @@ bool inference_process_image_yolo(const uint8_t* jpeg_data, size_t jpeg_size, in
  */
 bool inference_yolo_detection(inference_t *inf, const uint8_t* jpeg_data, size_t jpeg_size, inference_result_t* result);
 
+/**
+ * @brief Esegue la detection YOLO su un frame JPEG o RGB565 grezzo (i frame RGB565 non passano dalla decodifica)
+ * @param inf Puntatore alla struttura inference
+ * @param input Frame in ingresso
+ * @param result Puntatore alla struttura risultato
+ * @return true se l'inferenza è riuscita, false altrimenti
+ */
+bool inference_yolo_detection_frame(inference_t *inf, const inference_input_frame_t* input, inference_result_t* result);
+
+/**
+ * @brief Primo stadio YOLO: sceglie la variante, decodifica il JPEG (o legge direttamente i pixel RGB565)
+ *        e scrive l'input quantizzato (in frame->input, oppure nel tensore del modello se frame->input è NULL).
+ *        Il chiamante deve possedere l'arena (inference_arena_begin) per tutta la chiamata
+ * @param inf Puntatore alla struttura inference
+ * @param input Frame in ingresso (non più usato al ritorno)
+ * @param frame Frame da preparare
+ * @return true se il frame è pronto per inference_yolo_execute
+ */
+bool inference_yolo_prepare(inference_t *inf, const inference_input_frame_t* input, inference_yolo_frame_t* frame);
+
+/**
+ * @brief Secondo stadio YOLO: esegue il modello sul frame preparato e scansiona gli score.
+ *        Le chiamate devono essere serializzate (i tensori del modello sono condivisi)
+ * @param inf Puntatore alla struttura inference
+ * @param frame Frame preparato
+ * @param gather Copia i bin DFL dei candidati nel frame, liberando subito i tensori di output
+ * @return true se il modello è stato eseguito
+ */
+bool inference_yolo_execute(inference_t *inf, inference_yolo_frame_t* frame, bool gather);
+
+/**
+ * @brief Terzo stadio YOLO: decodifica DFL + NMS, riporta i box sul frame originale e aggiorna le statistiche
+ * @param inf Puntatore alla struttura inference
+ * @param frame Frame eseguito (senza bin copiati deve precedere il prossimo inference_yolo_execute)
+ * @param result Puntatore alla struttura risultato
+ */
+void inference_yolo_finish(inference_t *inf, inference_yolo_frame_t* frame, inference_result_t* result);
+
+/**
+ * @brief Limita la detection YOLO a un sottoinsieme di classi (es. solo "person")
+ * @param inf Puntatore alla struttura inference
+ * @param class_ids Indici delle classi abilitate
+ * @param num_classes Numero di classi nell'array (0 = tutte le classi abilitate)
+ * @return true se la maschera è stata applicata
+ */
+bool inference_yolo_set_class_filter(inference_t *inf, const uint32_t* class_ids, size_t num_classes);
+
+/**
+ * @brief Imposta la soglia di confidenza della detection YOLO
+ * @param inf Puntatore alla struttura inference
+ * @param score_threshold Soglia in (0,1)
+ * @return true se la soglia è valida
+ */
+bool inference_yolo_set_score_threshold(inference_t *inf, float score_threshold);
+
+/**
+ * @brief Imposta il numero massimo di detections YOLO restituite dopo la NMS
+ * @param inf Puntatore alla struttura inference
+ * @param top_k Numero di detections (1..MAX_YOLO_DETECTIONS)
+ * @return true se il valore è valido
+ */
+bool inference_yolo_set_top_k(inference_t *inf, uint32_t top_k);
+
+/**
+ * @brief Imposta la latenza obiettivo per frame della selezione adattiva delle varianti YOLO
+ * @param inf Puntatore alla struttura inference
+ * @param budget_ms Latenza obiettivo in ms (0 = usa sempre la variante più grande)
+ */
+void inference_yolo_set_latency_budget(inference_t *inf, uint32_t budget_ms);
+
+/**
+ * @brief Segnala quanti frame sono in coda in attesa dell'inferenza: con coda non vuota
+ *        la selezione scende alla variante più economica invece di accumulare ritardo
+ * @param inf Puntatore alla struttura inference
+ * @param pending Numero di frame in attesa
+ */
+void inference_yolo_note_backlog(inference_t *inf, uint32_t pending);
+
+/**
+ * @brief Ottiene le statistiche di latenza di una variante YOLO
+ * @param inf Puntatore alla struttura inference
+ * @param index Indice della variante (0 = più economica)
+ * @param stats Puntatore alla struttura statistiche
+ * @return true se la variante esiste
+ */
+bool inference_yolo_get_variant_stats(inference_t *inf, uint32_t index, inference_yolo_variant_stats_t* stats);
+
+/**
+ * @brief Stampa le statistiche delle varianti YOLO (latenze, p95, variante attiva)
+ * @param inf Puntatore alla struttura inference
+ */
+void inference_print_yolo_variants(inference_t *inf);
+
 /**
  * @brief Ottiene l'istanza globale del sistema di inferenza (per compatibilità)
  * @return Puntatore all'istanza globale
@@ -0,0 +1,98 @@
+#ifndef INFERENCE_ARENA_H
+#define INFERENCE_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Statistiche dell'arena (per dimensionarla sui deployment reali)
+typedef struct {
+    size_t capacity;          // dimensione totale dell'arena in byte
+    size_t high_water;        // massimo numero di byte usati in un singolo frame
+    size_t last_frame_used;   // byte usati nell'ultimo frame
+    uint32_t frames;          // numero di frame serviti
+    uint32_t alloc_failures;  // allocazioni fallite per spazio insufficiente
+    uint32_t lock_timeouts;   // frame scartati perché l'arena era occupata
+} inference_arena_stats_t;
+
+// Arena lineare persistente per i buffer di un frame (decodifica, scratch di preprocessing):
+// allocata una sola volta all'inizializzazione e azzerata alla fine di ogni frame
+typedef struct {
+    uint8_t *base;
+    size_t capacity;
+    size_t offset;
+    uint32_t caps;
+    SemaphoreHandle_t lock;   // un solo frame alla volta usa l'arena
+    inference_arena_stats_t stats;
+} inference_arena_t;
+
+/**
+ * @brief Garantisce che l'arena abbia almeno la capacità richiesta (alloca o rialloca solo in fase di init)
+ * @param arena Puntatore all'arena
+ * @param capacity Capacità minima in byte
+ * @param caps Capabilities heap_caps della memoria (es. MALLOC_CAP_SPIRAM)
+ * @return true se l'arena è pronta, false se l'allocazione è fallita
+ */
+bool inference_arena_reserve(inference_arena_t *arena, size_t capacity, uint32_t caps);
+
+/**
+ * @brief Inizia un frame: acquisisce l'arena per l'uso esclusivo del chiamante
+ * @param arena Puntatore all'arena
+ * @param timeout Tempo massimo di attesa
+ * @return true se l'arena è stata acquisita
+ */
+bool inference_arena_begin(inference_arena_t *arena, TickType_t timeout);
+
+/**
+ * @brief Alloca un blocco dall'arena (valido fino a inference_arena_end)
+ * @param arena Puntatore all'arena
+ * @param size Dimensione in byte
+ * @param align Allineamento (potenza di 2)
+ * @return Puntatore al blocco, NULL se lo spazio non basta
+ */
+void *inference_arena_alloc(inference_arena_t *arena, size_t size, size_t align);
+
+/**
+ * @brief Restituisce la posizione corrente dell'arena (per annullare allocazioni parziali)
+ * @param arena Puntatore all'arena
+ * @return Offset corrente
+ */
+size_t inference_arena_mark(inference_arena_t *arena);
+
+/**
+ * @brief Riporta l'arena a una posizione ottenuta con inference_arena_mark
+ * @param arena Puntatore all'arena
+ * @param mark Offset da ripristinare
+ */
+void inference_arena_rewind(inference_arena_t *arena, size_t mark);
+
+/**
+ * @brief Termina il frame: aggiorna le statistiche, azzera l'arena e la rilascia
+ * @param arena Puntatore all'arena
+ */
+void inference_arena_end(inference_arena_t *arena);
+
+/**
+ * @brief Copia le statistiche dell'arena
+ * @param arena Puntatore all'arena
+ * @param stats Puntatore alla struttura statistiche
+ */
+void inference_arena_get_stats(inference_arena_t *arena, inference_arena_stats_t *stats);
+
+/**
+ * @brief Libera la memoria dell'arena
+ * @param arena Puntatore all'arena
+ */
+void inference_arena_deinit(inference_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INFERENCE_ARENA_H
@@ -0,0 +1,267 @@
+#ifndef INFERENCE_EXECUTOR_H
+#define INFERENCE_EXECUTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "inference.h"
+#include "inference_pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INFERENCE_EXECUTOR_INTERACTIVE_DEPTH 2 //richieste HTTP in attesa
+#define INFERENCE_EXECUTOR_BACKGROUND_DEPTH 3 //frame periodici/CLI in attesa (il più vecchio viene scartato)
+#define INFERENCE_EXECUTOR_STACK_SIZE 32768
+#define INFERENCE_EXECUTOR_PRIORITY 1
+#define INFERENCE_EXECUTOR_CORE 0 //in modalità pipeline la task dell'executor è anche lo stadio di preparazione
+#define INFERENCE_EXECUTOR_MAX_FUTURES 6 //richieste asincrone in volo contemporaneamente
+#define INFERENCE_EXECUTOR_MAX_LISTENERS 4 //osservatori di tutti i risultati (es. push WebSocket)
+#define INFERENCE_EXECUTOR_STOP_TIMEOUT_MS 10000 //attesa del job in corso e dei frame nella pipeline all'arresto
+
+// Tipo di inferenza richiesta
+typedef enum {
+    INFERENCE_JOB_FACE = 0,
+    INFERENCE_JOB_YOLO,
+} inference_job_type_t;
+
+// Classe di priorità: le richieste interattive passano sempre davanti a quelle in background
+typedef enum {
+    INFERENCE_PRIORITY_INTERACTIVE = 0,
+    INFERENCE_PRIORITY_BACKGROUND,
+    INFERENCE_PRIORITY_COUNT
+} inference_priority_t;
+
+// Esito di un job
+typedef enum {
+    INFERENCE_JOB_DONE = 0,   // inferenza eseguita, risultato valido
+    INFERENCE_JOB_FAILED,     // errore durante l'inferenza
+    INFERENCE_JOB_EXPIRED,    // scadenza superata prima dell'esecuzione
+    INFERENCE_JOB_DROPPED,    // scartato dalla coda piena per far posto a un frame più recente
+} inference_job_status_t;
+
+// Notifica di completamento: il risultato è valido solo durante la chiamata (NULL se non DONE)
+typedef void (*inference_job_callback_t)(inference_job_status_t status, const inference_result_t *result, void *user_ctx);
+
+// Osservatore dei risultati: riceve ogni job completato con successo, qualunque sia il chiamante.
+// Eseguito nella task che completa il job (executor o postprocessing della pipeline): non deve bloccare
+typedef void (*inference_result_listener_t)(inference_job_type_t type, const inference_result_t *result, void *ctx);
+
+typedef struct {
+    inference_result_listener_t fn;
+    void *ctx;
+} inference_executor_listener_t;
+
+// Richiesta di inferenza su un frame (JPEG, oppure RGB565 grezzo nella modalità a doppio flusso)
+typedef struct {
+    inference_job_type_t type;
+    inference_priority_t priority;
+    uint8_t *jpeg_data;                  // dati del frame (nel formato indicato da format)
+    size_t jpeg_size;
+    inference_pixel_format_t format;     // INFERENCE_PIXEL_JPEG di default
+    int width;                           // dimensioni dei frame grezzi
+    int height;
+    void (*release)(uint8_t *jpeg_data, void *release_ctx); // libera il frame quando l'executor non lo usa più (può essere NULL)
+    void *release_ctx;                   // contesto di release (es. l'handle del frame della camera)
+    int64_t deadline_us;                 // esp_timer_get_time() oltre cui il frame è vecchio (0 = nessuna scadenza)
+    int64_t submit_time_us;              // impostato da inference_executor_submit
+    int64_t capture_time_us;             // acquisizione del frame, per la latenza end-to-end (0 = usa submit_time_us)
+    inference_job_callback_t on_complete;
+    void *user_ctx;
+} inference_job_t;
+
+// Stato di uno slot di risposta asincrona
+typedef enum {
+    INFERENCE_FUTURE_FREE = 0,
+    INFERENCE_FUTURE_PENDING,   // job in coda o in esecuzione
+    INFERENCE_FUTURE_READY,     // risultato disponibile, in attesa di inference_executor_release
+} inference_future_state_t;
+
+// Slot di risposta di un job asincrono (pool fisso, nessuna allocazione per richiesta)
+typedef struct {
+    inference_future_state_t state;
+    bool abandoned;                     // rilasciato prima del completamento: lo libera l'executor
+    bool notified;                      // notifica di completamento già consumata da chi attende
+    inference_job_status_t status;
+    inference_result_t result;
+    SemaphoreHandle_t done;
+    inference_job_callback_t on_complete; // notifica opzionale del chiamante
+    void *user_ctx;
+} inference_future_t;
+
+// Handle di una richiesta asincrona
+typedef inference_future_t* inference_handle_t;
+
+// Statistiche per classe di priorità
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t expired;
+    uint32_t dropped;
+    uint32_t rejected;      // coda piena oltre il timeout di invio
+    uint32_t max_wait_ms;   // attesa massima in coda
+} inference_executor_class_stats_t;
+
+// Executor unico: l'unica task che esegue i modelli di inference_t
+typedef struct {
+    inference_t *inf;
+    QueueHandle_t queues[INFERENCE_PRIORITY_COUNT];
+    TaskHandle_t task;
+    inference_result_t result; // risultato del job corrente (fuori dallo stack della task)
+    inference_executor_class_stats_t stats[INFERENCE_PRIORITY_COUNT];
+    portMUX_TYPE stats_lock; // le statistiche sono aggiornate sia dai produttori che dalla task
+    inference_future_t futures[INFERENCE_EXECUTOR_MAX_FUTURES];
+    portMUX_TYPE futures_lock;
+    inference_pipeline_t *pipeline; // pipeline YOLO (avviata alla prima attivazione)
+    bool pipelined;                 // job YOLO attraverso la pipeline invece che in sequenza
+    inference_job_t pipeline_jobs[INFERENCE_PIPELINE_FRAMES + 1]; // job in volo nella pipeline (completati in ordine)
+    uint32_t pipeline_head;
+    inference_executor_listener_t listeners[INFERENCE_EXECUTOR_MAX_LISTENERS];
+    portMUX_TYPE listeners_lock;
+    volatile bool busy;             // la task sta eseguendo (o preparando nella pipeline) un job
+    volatile bool running;          // false = arresto: la task scarta i job in coda ed esce
+} inference_executor_t;
+
+/**
+ * @brief Crea le code e avvia la task dell'executor
+ * @param exec Puntatore all'executor
+ * @param inf Sistema di inferenza i cui modelli vengono eseguiti dall'executor
+ * @return ESP_OK se l'executor è avviato
+ */
+esp_err_t inference_executor_start(inference_executor_t *exec, inference_t *inf);
+
+/**
+ * @brief Ferma l'executor: i nuovi job vengono rifiutati, quelli in coda scartati (DROPPED), il job in corso e
+ *        i frame nella pipeline completati; la pipeline viene fermata. Code, slot di risposta e osservatori
+ *        restano validi e inference_executor_start riavvia la task. Da chiamare prima di inference_deinit
+ * @param exec Puntatore all'executor
+ * @param timeout Attesa massima del job in corso e della pipeline
+ * @return ESP_OK se nessun modello è più in uso, ESP_ERR_TIMEOUT se un job o un frame è ancora in corso
+ */
+esp_err_t inference_executor_stop(inference_executor_t *exec, TickType_t timeout);
+
+/**
+ * @brief Attende che le code siano vuote, nessun job sia in esecuzione e la pipeline non abbia frame in volo
+ * @param exec Puntatore all'executor
+ * @param timeout Attesa massima
+ * @return true se l'executor è inattivo
+ */
+bool inference_executor_wait_idle(inference_executor_t *exec, TickType_t timeout);
+
+/**
+ * @brief Accoda un job. In background, con coda piena, il frame più vecchio viene scartato (DROPPED);
+ *        le richieste interattive attendono fino a timeout
+ * @param exec Puntatore all'executor
+ * @param job Job da accodare (copiato); in caso di errore il frame NON viene rilasciato
+ * @param timeout Attesa massima per lo spazio in coda (solo interattive)
+ * @return ESP_OK se accodato, ESP_ERR_TIMEOUT se la coda è piena, ESP_ERR_INVALID_STATE se non avviato
+ */
+esp_err_t inference_executor_submit(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout);
+
+/**
+ * @brief Accoda un job e restituisce un handle su cui attendere il risultato: più frame possono essere
+ *        in volo contemporaneamente. L'eventuale on_complete del job viene comunque notificato
+ * @param exec Puntatore all'executor
+ * @param job Job da accodare
+ * @param timeout Attesa massima per lo spazio in coda (solo interattive)
+ * @param handle Handle della richiesta (da rilasciare con inference_executor_release)
+ * @return ESP_OK se accodato, ESP_ERR_NO_MEM se tutti gli slot di risposta sono occupati
+ */
+esp_err_t inference_executor_submit_async(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout,
+                                          inference_handle_t *handle);
+
+/**
+ * @brief Attende il completamento di una richiesta asincrona
+ * @param exec Puntatore all'executor
+ * @param handle Handle restituito da inference_executor_submit_async
+ * @param timeout Attesa massima (in caso di timeout l'handle resta valido)
+ * @param result Risultato (valido se lo stato è INFERENCE_JOB_DONE, può essere NULL)
+ * @param status Esito del job (può essere NULL)
+ * @return ESP_OK se completata, ESP_ERR_TIMEOUT se ancora in corso
+ */
+esp_err_t inference_executor_wait(inference_executor_t *exec, inference_handle_t handle, TickType_t timeout,
+                                  inference_result_t *result, inference_job_status_t *status);
+
+/**
+ * @brief Rilascia l'handle; se il job è ancora in corso lo slot viene liberato al completamento
+ * @param exec Puntatore all'executor
+ * @param handle Handle da rilasciare
+ */
+void inference_executor_release(inference_executor_t *exec, inference_handle_t handle);
+
+/**
+ * @brief Esegue un job e attende il completamento (il job viene comunque completato o fatto scadere)
+ * @param exec Puntatore all'executor
+ * @param job Job da eseguire (l'eventuale on_complete viene comunque notificato)
+ * @param timeout Attesa massima per lo spazio in coda
+ * @param result Risultato (valido se ritorna INFERENCE_JOB_DONE)
+ * @param status Esito del job
+ * @return ESP_OK se il job è stato eseguito o scartato dall'executor, errore se non è stato accodato
+ */
+esp_err_t inference_executor_run_sync(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout,
+                                      inference_result_t *result, inference_job_status_t *status);
+
+/**
+ * @brief Attiva o disattiva la pipeline YOLO: decodifica/preprocessing del frame successivo sulla task
+ *        dell'executor mentre il modello esegue il frame corrente sull'altro core
+ * @param exec Puntatore all'executor
+ * @param enable true per far passare i job YOLO dalla pipeline
+ * @return ESP_OK se la modalità è applicata
+ */
+esp_err_t inference_executor_set_pipelined(inference_executor_t *exec, bool enable);
+
+/**
+ * @brief Registra un osservatore di tutti i risultati completati (dopo l'eventuale on_complete del job)
+ * @param exec Puntatore all'executor (già avviato)
+ * @param fn Funzione chiamata per ogni risultato, non deve bloccare
+ * @param ctx Contesto passato alla funzione
+ * @return ESP_OK, ESP_ERR_NO_MEM se tutti gli slot sono occupati, ESP_ERR_INVALID_STATE se non avviato
+ */
+esp_err_t inference_executor_add_listener(inference_executor_t *exec, inference_result_listener_t fn, void *ctx);
+
+/**
+ * @brief Rimuove un osservatore registrato con inference_executor_add_listener
+ * @param exec Puntatore all'executor
+ * @param fn Funzione registrata
+ * @param ctx Contesto registrato
+ */
+void inference_executor_remove_listener(inference_executor_t *exec, inference_result_listener_t fn, void *ctx);
+
+/**
+ * @brief Copia le statistiche di una classe di priorità
+ * @param exec Puntatore all'executor
+ * @param priority Classe di priorità
+ * @param stats Puntatore alla struttura statistiche
+ */
+void inference_executor_get_stats(inference_executor_t *exec, inference_priority_t priority,
+                                  inference_executor_class_stats_t *stats);
+
+/**
+ * @brief Stampa le statistiche dell'executor
+ * @param exec Puntatore all'executor
+ */
+void inference_executor_print_stats(inference_executor_t *exec);
+
+/**
+ * @brief Ottiene l'istanza globale dell'executor
+ * @return Puntatore all'istanza globale
+ */
+inference_executor_t* get_inference_executor_instance(void);
+
+/**
+ * @brief Variabile globale dell'executor
+ */
+extern inference_executor_t g_inference_executor;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INFERENCE_EXECUTOR_H
@@ -0,0 +1,106 @@
+#ifndef INFERENCE_JPEG_H
+#define INFERENCE_JPEG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "inference_arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INFERENCE_JPEG_MAX_SCALE_SHIFT 3 //scala IDCT minima supportata: 1/8
+
+// Immagine RGB888 decodificata (eventualmente in scala ridotta rispetto al JPEG originale)
+typedef struct {
+    uint8_t *data;
+    int width;          // larghezza decodificata
+    int height;         // altezza decodificata
+    int src_width;      // larghezza del JPEG originale
+    int src_height;     // altezza del JPEG originale
+    int scale_shift;    // 0 = 1/1, 1 = 1/2, 2 = 1/4, 3 = 1/8
+} inference_image_t;
+
+/**
+ * @brief Legge le dimensioni di un JPEG dal marker SOF senza decodificarlo
+ * @param jpeg_data Dati JPEG
+ * @param jpeg_size Dimensione dei dati
+ * @param width Larghezza letta
+ * @param height Altezza letta
+ * @return true se il marker SOF è stato trovato
+ */
+bool inference_jpeg_get_dimensions(const uint8_t *jpeg_data, size_t jpeg_size, int *width, int *height);
+
+/**
+ * @brief Sceglie la scala IDCT più piccola (1/2, 1/4, 1/8) che copre ancora l'input del modello
+ * @param width Larghezza del JPEG
+ * @param height Altezza del JPEG
+ * @param min_width Larghezza minima richiesta
+ * @param min_height Altezza minima richiesta
+ * @return Shift della scala (0..INFERENCE_JPEG_MAX_SCALE_SHIFT)
+ */
+int inference_jpeg_select_scale(int width, int height, int min_width, int min_height);
+
+/**
+ * @brief Byte necessari a decodificare un frame width x height alla scala scelta per min_width x min_height
+ * @return Dimensione del buffer di output in byte
+ */
+size_t inference_jpeg_decoded_size(int width, int height, int min_width, int min_height);
+
+/**
+ * @brief Byte del buffer di un blocco di righe MCU usato da inference_jpeg_decode_rows
+ * @return Limite superiore del blocco in byte (riga di MCU da 16 righe alla scala scelta)
+ */
+size_t inference_jpeg_block_size(int width, int height, int min_width, int min_height);
+
+/**
+ * @brief Callback per ogni blocco di righe decodificato
+ * @param ctx Contesto del chiamante
+ * @param img Dimensioni dell'immagine decodificata (data resta NULL)
+ * @param rows Prima riga del blocco (stride img->width * 3), valida solo durante la chiamata
+ * @param first_row Indice della prima riga del blocco
+ * @param num_rows Righe nel blocco
+ * @return false per interrompere la decodifica
+ */
+typedef bool (*inference_jpeg_rows_cb_t)(void *ctx, const inference_image_t *img,
+                                         const uint8_t *rows, int first_row, int num_rows);
+
+/**
+ * @brief Decodifica un JPEG in RGB888 alla scala IDCT più piccola che copre min_width x min_height,
+ *        a blocchi di righe MCU, direttamente in un buffer dell'arena
+ * @param arena Arena già acquisita con inference_arena_begin
+ * @param jpeg_data Dati JPEG
+ * @param jpeg_size Dimensione dei dati
+ * @param min_width Larghezza minima dell'immagine decodificata
+ * @param min_height Altezza minima dell'immagine decodificata
+ * @param img Immagine decodificata
+ * @return true se la decodifica è riuscita
+ */
+bool inference_jpeg_decode_scaled(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                                  int min_width, int min_height, inference_image_t *img);
+
+/**
+ * @brief Decodifica un JPEG in RGB888 alla scala IDCT più piccola che copre min_width x min_height
+ *        passando ogni blocco di righe MCU a rows_cb in un unico buffer dell'arena da un blocco,
+ *        senza mai tenere in memoria l'immagine intera. Se la scala ridotta fallisce la decodifica
+ *        riparte a piena risoluzione e rows_cb riceve di nuovo le righe da 0
+ * @param arena Arena già acquisita con inference_arena_begin
+ * @param jpeg_data Dati JPEG
+ * @param jpeg_size Dimensione dei dati
+ * @param min_width Larghezza minima dell'immagine decodificata
+ * @param min_height Altezza minima dell'immagine decodificata
+ * @param rows_cb Callback per ogni blocco di righe
+ * @param ctx Contesto passato a rows_cb
+ * @param img Dimensioni dell'immagine decodificata (data = NULL)
+ * @return true se la decodifica è riuscita
+ */
+bool inference_jpeg_decode_rows(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                                int min_width, int min_height, inference_jpeg_rows_cb_t rows_cb, void *ctx,
+                                inference_image_t *img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INFERENCE_JPEG_H
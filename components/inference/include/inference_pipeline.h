@@ -0,0 +1,141 @@
+#ifndef INFERENCE_PIPELINE_H
+#define INFERENCE_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "inference.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INFERENCE_PIPELINE_INPUT_SLOTS 2 //input quantizzati: uno in preparazione mentre l'altro entra nel modello
+#define INFERENCE_PIPELINE_FRAMES 3 //frame in volo: preparazione (N+1), modello (N), postprocessing (N-1)
+#define INFERENCE_PIPELINE_RUN_CORE 1 //model->run() su un core dedicato; la preparazione gira sull'executor (core 0)
+#define INFERENCE_PIPELINE_POST_CORE 0
+#define INFERENCE_PIPELINE_RUN_STACK_SIZE 32768
+#define INFERENCE_PIPELINE_POST_STACK_SIZE 8192
+#define INFERENCE_PIPELINE_PRIORITY 1
+
+// Stadi della pipeline YOLO
+typedef enum {
+    INFERENCE_STAGE_PREPARE = 0, // decodifica JPEG (o lettura RGB565) + resize/quantizzazione (task dell'executor)
+    INFERENCE_STAGE_RUN,         // model->run() + scansione degli score
+    INFERENCE_STAGE_POST,        // DFL + NMS + pubblicazione del risultato
+    INFERENCE_STAGE_COUNT
+} inference_pipeline_stage_t;
+
+// Notifica di fine frame (chiamata dalla task di postprocessing): result è NULL se il frame è fallito
+typedef void (*inference_pipeline_done_t)(const inference_result_t *result, void *user_ctx);
+
+// Statistiche di uno stadio
+typedef struct {
+    uint32_t frames;
+    uint64_t busy_us;     // tempo speso a lavorare (occupazione = busy / tempo dall'avvio)
+    uint64_t wait_us;     // attesa totale dei frame nella coda d'ingresso dello stadio
+    uint32_t max_wait_ms; // attesa massima di un frame nella coda d'ingresso
+} inference_pipeline_stage_stats_t;
+
+// Stato di un frame in volo
+typedef struct {
+    inference_yolo_frame_t *frame;
+    int input_slot;                // slot di input usato (-1 se già restituito)
+    int64_t enqueue_us;            // ingresso nella coda dello stadio corrente
+    bool ok;
+    inference_pipeline_done_t on_done;
+    void *user_ctx;
+} inference_pipeline_slot_t;
+
+// Pipeline a tre stadi su due core: la preparazione del frame N+1 si sovrappone a model->run() del frame N
+// e al postprocessing del frame N-1
+typedef struct {
+    inference_t *inf;
+    int8_t *inputs[INFERENCE_PIPELINE_INPUT_SLOTS];
+    size_t input_size;
+    inference_pipeline_slot_t slots[INFERENCE_PIPELINE_FRAMES];
+    QueueHandle_t free_inputs;  // indici degli input liberi
+    QueueHandle_t free_slots;   // indici dei frame liberi
+    QueueHandle_t run_queue;    // frame preparati, in attesa del modello
+    QueueHandle_t post_queue;   // frame eseguiti, in attesa del postprocessing
+    TaskHandle_t run_task;
+    TaskHandle_t post_task;
+    inference_result_t result;  // risultato del frame in pubblicazione
+    inference_pipeline_stage_stats_t stats[INFERENCE_STAGE_COUNT];
+    portMUX_TYPE stats_lock;
+    int64_t start_us;
+    bool running;
+} inference_pipeline_t;
+
+/**
+ * @brief Alloca input e frame (una sola volta) e avvia le task degli stadi modello e postprocessing
+ * @param pipe Puntatore alla pipeline
+ * @param inf Sistema di inferenza con il modello YOLO inizializzato
+ * @return ESP_OK se la pipeline è avviata
+ */
+esp_err_t inference_pipeline_start(inference_pipeline_t *pipe, inference_t *inf);
+
+/**
+ * @brief Primo stadio: prepara il frame nel contesto del chiamante e lo passa al modello.
+ *        Attende un input e un frame liberi (contropressione quando il modello è il collo di bottiglia)
+ * @param pipe Puntatore alla pipeline
+ * @param input Frame JPEG o RGB565 (può essere liberato al ritorno)
+ * @param on_done Notifica di fine frame (chiamata solo se ritorna ESP_OK)
+ * @param user_ctx Contesto della notifica
+ * @param timeout Attesa massima per uno slot libero e per l'arena
+ * @return ESP_OK se il frame è entrato nella pipeline, ESP_ERR_TIMEOUT/ESP_FAIL altrimenti
+ */
+esp_err_t inference_pipeline_submit(inference_pipeline_t *pipe, const inference_input_frame_t *input,
+                                    inference_pipeline_done_t on_done, void *user_ctx, TickType_t timeout);
+
+/**
+ * @brief Attende che tutti i frame in volo siano stati pubblicati
+ * @param pipe Puntatore alla pipeline
+ * @param timeout Attesa massima
+ * @return true se la pipeline è vuota
+ */
+bool inference_pipeline_wait_idle(inference_pipeline_t *pipe, TickType_t timeout);
+
+/**
+ * @brief Attende i frame in volo, poi ferma le task degli stadi e libera input e frame
+ * @param pipe Puntatore alla pipeline
+ * @param timeout Attesa massima dei frame in volo
+ * @return ESP_OK se la pipeline è ferma, ESP_ERR_TIMEOUT se ha ancora frame in volo (resta avviata)
+ */
+esp_err_t inference_pipeline_stop(inference_pipeline_t *pipe, TickType_t timeout);
+
+/**
+ * @brief Copia le statistiche di uno stadio
+ * @param pipe Puntatore alla pipeline
+ * @param stage Stadio
+ * @param stats Puntatore alla struttura statistiche
+ */
+void inference_pipeline_get_stats(inference_pipeline_t *pipe, inference_pipeline_stage_t stage,
+                                  inference_pipeline_stage_stats_t *stats);
+
+/**
+ * @brief Stampa occupazione e attese per stadio
+ * @param pipe Puntatore alla pipeline
+ */
+void inference_pipeline_print_stats(inference_pipeline_t *pipe);
+
+/**
+ * @brief Ottiene l'istanza globale della pipeline
+ * @return Puntatore all'istanza globale
+ */
+inference_pipeline_t* get_inference_pipeline_instance(void);
+
+/**
+ * @brief Variabile globale della pipeline
+ */
+extern inference_pipeline_t g_inference_pipeline;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INFERENCE_PIPELINE_H
@@ -0,0 +1,183 @@
+#ifndef YOLO_POSTPROCESS_H
+#define YOLO_POSTPROCESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YOLO_MAX_CLASSES 80      //numero massimo di classi supportate (COCO)
+#define YOLO_MAX_LEVELS 3        //numero massimo di livelli della piramide (stride 8/16/32)
+#define YOLO_MAX_CANDIDATES 128  //anchor sopravvissuti conservati per frame
+#define YOLO_MAX_REG 16          //bin DFL per lato del box (box_channels = 4 * reg_max)
+
+// Un livello di output del modello (coppia scoreN/boxN), layout NHWC
+typedef struct {
+    const int8_t *score;   // [grid_h, grid_w, num_classes], logit quantizzati
+    const int8_t *box;     // [grid_h, grid_w, box_channels], logit DFL quantizzati
+    int grid_w;
+    int grid_h;
+    int stride;
+    int score_exponent;
+    int box_exponent;
+} yolo_level_t;
+
+// Descrittore del modello, letto una volta dai tensori di input/output all'inizializzazione:
+// pre e post-processing sono parametrizzati da questi valori (input 224/256/320, export con meno classi, ...)
+typedef struct {
+    int8_t *input;         // tensore di input int8 [1, H, W, C]
+    int input_width;
+    int input_height;
+    int input_channels;
+    int input_exponent;
+    int num_classes;       // canali degli output scoreN
+    int reg_max;           // bin DFL per lato (canali degli output boxN / 4)
+    int num_levels;
+    yolo_level_t levels[YOLO_MAX_LEVELS];  // ordinati per stride crescente
+} yolo_model_desc_t;
+
+// Configurazione dello stadio di scansione degli score
+typedef struct {
+    float score_threshold;                 // soglia di confidenza (dopo sigmoid)
+    int num_classes;                       // canali di classe per anchor
+    uint8_t class_mask[YOLO_MAX_CLASSES];  // 0xFF = classe abilitata, 0x00 = ignorata
+} yolo_scan_config_t;
+
+// Anchor sopravvissuto alla scansione
+typedef struct {
+    uint16_t level;
+    uint16_t class_id;
+    uint16_t grid_x;
+    uint16_t grid_y;
+    int8_t score_q;        // logit quantizzato della classe migliore
+} yolo_candidate_t;
+
+// Statistiche della scansione
+typedef struct {
+    uint32_t anchors_scanned;
+    uint32_t anchors_survived;
+    uint32_t candidates_dropped;  // sopravvissuti scartati per buffer pieno (tenuti i migliori)
+} yolo_scan_stats_t;
+
+// Box decodificato, in pixel dell'input del modello
+typedef struct {
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+    float score;
+    uint16_t class_id;
+} yolo_box_t;
+
+// Decoder DFL + NMS riutilizzabile: le LUT di exp dipendono solo dagli exponent del modello
+typedef struct {
+    int num_levels;
+    int reg_max;
+    int box_exponent[YOLO_MAX_LEVELS];
+    float exp_lut[YOLO_MAX_LEVELS][256];  // exp(-d * 2^exponent), d = max_logit - logit
+    float nms_threshold;                  // IoU oltre cui un box della stessa classe viene soppresso
+    int top_k;                            // numero massimo di detection restituite
+} yolo_decoder_t;
+
+/**
+ * @brief Converte la soglia di score nel dominio dei logit int8 di un tensore
+ * @param score_threshold Soglia di confidenza in [0,1]
+ * @param exponent Exponent del tensore degli score
+ * @return Soglia quantizzata (un anchor passa se logit_q >= soglia); 128 se nessun valore può passare
+ */
+int yolo_postprocess_quantize_threshold(float score_threshold, int exponent);
+
+/**
+ * @brief Inizializza la configurazione di scansione (tutte le classi abilitate)
+ * @param config Configurazione da inizializzare
+ * @param score_threshold Soglia di confidenza
+ * @param num_classes Numero di classi del modello
+ */
+void yolo_postprocess_scan_config_init(yolo_scan_config_t *config, float score_threshold, int num_classes);
+
+/**
+ * @brief Scansiona gli score quantizzati di tutti i livelli: scarta gli anchor confrontando 4 classi
+ *        per parola contro la soglia int8, rispettando la maschera delle classi
+ * @param levels Livelli di output del modello
+ * @param num_levels Numero di livelli
+ * @param config Configurazione della scansione
+ * @param candidates Buffer dei candidati
+ * @param max_candidates Capacità del buffer
+ * @param stats Statistiche della scansione (può essere NULL)
+ * @return Numero di candidati scritti
+ */
+size_t yolo_postprocess_scan(const yolo_level_t *levels, int num_levels, const yolo_scan_config_t *config,
+                             yolo_candidate_t *candidates, size_t max_candidates, yolo_scan_stats_t *stats);
+
+/**
+ * @brief Prepara il decoder: costruisce le LUT di softmax per gli exponent dei tensori box
+ * @param decoder Decoder da inizializzare
+ * @param levels Livelli di output (servono solo stride/exponent)
+ * @param num_levels Numero di livelli
+ * @param reg_max Bin DFL per lato (tipicamente 16)
+ * @param nms_threshold Soglia IoU per la NMS
+ * @param top_k Numero massimo di detection
+ * @return true se la configurazione è supportata
+ */
+bool yolo_decoder_init(yolo_decoder_t *decoder, const yolo_level_t *levels, int num_levels,
+                       int reg_max, float nms_threshold, int top_k);
+
+/**
+ * @brief Decodifica (DFL) i soli candidati sopravvissuti ed esegue una NMS per classe con top-K
+ * @param decoder Decoder inizializzato
+ * @param levels Livelli di output del modello
+ * @param candidates Candidati prodotti da yolo_postprocess_scan
+ * @param num_candidates Numero di candidati
+ * @param boxes Buffer di lavoro di almeno num_candidates box
+ * @param out Detection finali, ordinate per score decrescente
+ * @param max_out Capacità di out
+ * @return Numero di detection scritte in out
+ */
+size_t yolo_decoder_run(const yolo_decoder_t *decoder, const yolo_level_t *levels,
+                        const yolo_candidate_t *candidates, size_t num_candidates,
+                        yolo_box_t *boxes, yolo_box_t *out, size_t max_out);
+
+/**
+ * @brief Copia i bin DFL dei candidati fuori dai tensori box, così il modello può eseguire il frame
+ *        successivo mentre questo viene decodificato
+ * @param levels Livelli di output del modello
+ * @param reg_max Bin DFL per lato
+ * @param candidates Candidati prodotti da yolo_postprocess_scan
+ * @param num_candidates Numero di candidati
+ * @param bins Buffer di almeno num_candidates * 4 * reg_max byte
+ */
+void yolo_postprocess_gather_bins(const yolo_level_t *levels, int reg_max,
+                                  const yolo_candidate_t *candidates, size_t num_candidates, int8_t *bins);
+
+/**
+ * @brief Come yolo_decoder_run, ma legge i bin dalla copia di yolo_postprocess_gather_bins
+ *        (i puntatori score/box dei livelli non vengono usati)
+ * @param decoder Decoder inizializzato
+ * @param levels Livelli di output del modello (servono solo stride/exponent)
+ * @param candidates Candidati
+ * @param bins Bin raccolti, nello stesso ordine dei candidati
+ * @param num_candidates Numero di candidati
+ * @param boxes Buffer di lavoro di almeno num_candidates box
+ * @param out Detection finali, ordinate per score decrescente
+ * @param max_out Capacità di out
+ * @return Numero di detection scritte in out
+ */
+size_t yolo_decoder_run_gathered(const yolo_decoder_t *decoder, const yolo_level_t *levels,
+                                 const yolo_candidate_t *candidates, const int8_t *bins, size_t num_candidates,
+                                 yolo_box_t *boxes, yolo_box_t *out, size_t max_out);
+
+/**
+ * @brief Nome COCO della classe
+ * @param class_id Indice della classe
+ * @return Nome della classe ("unknown" se fuori range)
+ */
+const char *yolo_postprocess_class_name(uint32_t class_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YOLO_POSTPROCESS_H
@@ -0,0 +1,151 @@
+#ifndef YOLO_PREPROCESS_H
+#define YOLO_PREPROCESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Costruisce la LUT di quantizzazione pixel -> int8 per l'input del modello
+ *        (normalizzazione [0,255] -> [0,1] e quantizzazione con l'exponent del tensore di input)
+ * @param exponent Exponent del tensore di input (es. -7 => scale 2^-7)
+ * @param lut Tabella di 256 elementi da riempire
+ */
+void yolo_preprocess_build_lut(int exponent, int8_t lut[256]);
+
+/**
+ * @brief Calcola la dimensione dello scratch necessario a yolo_preprocess_resize_quantize
+ * @param dst_w Larghezza dell'input del modello
+ * @return Dimensione in byte dello scratch
+ */
+size_t yolo_preprocess_scratch_size(int dst_w);
+
+/**
+ * @brief Indica se la sorgente ha già la dimensione dell'input del modello (nessun resize necessario)
+ * @param src_w Larghezza sorgente
+ * @param src_h Altezza sorgente
+ * @param dst_w Larghezza dell'input del modello
+ * @param dst_h Altezza dell'input del modello
+ * @return true se il resize può essere saltato
+ */
+bool yolo_preprocess_is_native(int src_w, int src_h, int dst_w, int dst_h);
+
+/**
+ * @brief Sola quantizzazione tramite LUT (percorso senza resize)
+ * @param src Canali RGB888 sorgente
+ * @param n Numero di canali (w * h * 3)
+ * @param dst Buffer int8 di destinazione
+ * @param lut LUT di quantizzazione
+ */
+void yolo_preprocess_quantize(const uint8_t *src, size_t n, int8_t *dst, const int8_t lut[256]);
+
+/**
+ * @brief Resize bilineare + quantizzazione fusi: da RGB888 direttamente al tensore int8 del modello
+ *        (sola quantizzazione se le dimensioni coincidono)
+ * @param src Pixel RGB888 sorgente
+ * @param src_w Larghezza sorgente
+ * @param src_h Altezza sorgente
+ * @param dst Buffer int8 di destinazione (layout HWC, dst_w * dst_h * 3)
+ * @param dst_w Larghezza destinazione
+ * @param dst_h Altezza destinazione
+ * @param lut LUT di quantizzazione (vedi yolo_preprocess_build_lut)
+ * @param scratch Buffer di lavoro (almeno yolo_preprocess_scratch_size(dst_w) byte, allineato a 4)
+ * @param scratch_size Dimensione dello scratch
+ * @return true se la conversione è riuscita, false altrimenti
+ */
+bool yolo_preprocess_resize_quantize(const uint8_t *src, int src_w, int src_h,
+                                     int8_t *dst, int dst_w, int dst_h,
+                                     const int8_t lut[256], void *scratch, size_t scratch_size);
+
+// Resize + quantizzazione di una sorgente RGB888 che arriva a bande di righe (es. i blocchi di righe MCU
+// del decoder JPEG): ogni riga del tensore viene prodotta appena le sue due righe sorgente sono disponibili,
+// e le righe già ridimensionate restano nello scratch da una banda alla successiva
+typedef struct {
+    int src_w;
+    int src_h;
+    int bpp;                    // byte per pixel della sorgente (3 = RGB888, 2 = RGB565)
+    int8_t *dst;
+    int dst_w;
+    int dst_h;
+    const int8_t *lut;
+    void *scratch;
+    size_t scratch_size;
+    uint8_t *row_a;             // righe sorgente ridimensionate in orizzontale (nello scratch)
+    uint8_t *row_b;
+    int cached_a;               // indici delle righe in row_a e row_b (-1 = nessuna)
+    int cached_b;
+    int next_dst_row;           // prossima riga del tensore da produrre
+    bool native;                // dimensioni già uguali all'input: sola quantizzazione
+} yolo_preprocess_stream_t;
+
+/**
+ * @brief Prepara il resize a bande di una sorgente RGB888 (tabelle orizzontali nello scratch)
+ * @param stream Stato del resize
+ * @param src_w Larghezza sorgente
+ * @param src_h Altezza sorgente
+ * @param dst Buffer int8 di destinazione (layout HWC, dst_w * dst_h * 3)
+ * @param dst_w Larghezza destinazione
+ * @param dst_h Altezza destinazione
+ * @param lut LUT di quantizzazione
+ * @param scratch Buffer di lavoro (almeno yolo_preprocess_scratch_size(dst_w) byte, allineato a 4),
+ *        da non toccare fino all'ultima banda
+ * @param scratch_size Dimensione dello scratch
+ * @return true se i parametri sono validi
+ */
+bool yolo_preprocess_stream_begin(yolo_preprocess_stream_t *stream, int src_w, int src_h,
+                                  int8_t *dst, int dst_w, int dst_h,
+                                  const int8_t lut[256], void *scratch, size_t scratch_size);
+
+/**
+ * @brief Consuma una banda di righe sorgente consecutive (in ordine, senza sovrapposizioni)
+ * @param stream Stato del resize
+ * @param rows Prima riga della banda (stride src_w * 3)
+ * @param first_row Indice della prima riga nella sorgente
+ * @param num_rows Righe nella banda
+ */
+void yolo_preprocess_stream_rows(yolo_preprocess_stream_t *stream, const uint8_t *rows, int first_row, int num_rows);
+
+/**
+ * @brief Indica se tutte le righe del tensore sono state prodotte
+ * @param stream Stato del resize
+ * @return true dopo l'ultima banda necessaria
+ */
+bool yolo_preprocess_stream_done(const yolo_preprocess_stream_t *stream);
+
+/**
+ * @brief Espansione RGB565 -> 8 bit per canale e quantizzazione tramite LUT in un solo passaggio
+ *        (percorso senza resize per i frame grezzi del sensore)
+ * @param src Pixel RGB565 big-endian (ordine del driver della fotocamera)
+ * @param pixels Numero di pixel (w * h)
+ * @param dst Buffer int8 di destinazione (pixels * 3)
+ * @param lut LUT di quantizzazione
+ */
+void yolo_preprocess_rgb565_quantize(const uint8_t *src, size_t pixels, int8_t *dst, const int8_t lut[256]);
+
+/**
+ * @brief Come yolo_preprocess_resize_quantize, ma da un frame RGB565 grezzo del sensore
+ *        (nessuna decodifica JPEG né buffer RGB888 intermedio)
+ * @param src Pixel RGB565 big-endian
+ * @param src_w Larghezza sorgente
+ * @param src_h Altezza sorgente
+ * @param dst Buffer int8 di destinazione (layout HWC, dst_w * dst_h * 3)
+ * @param dst_w Larghezza destinazione
+ * @param dst_h Altezza destinazione
+ * @param lut LUT di quantizzazione
+ * @param scratch Buffer di lavoro (almeno yolo_preprocess_scratch_size(dst_w) byte, allineato a 4)
+ * @param scratch_size Dimensione dello scratch
+ * @return true se la conversione è riuscita, false altrimenti
+ */
+bool yolo_preprocess_rgb565_resize_quantize(const uint8_t *src, int src_w, int src_h,
+                                            int8_t *dst, int dst_w, int dst_h,
+                                            const int8_t lut[256], void *scratch, size_t scratch_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YOLO_PREPROCESS_H
@@ -1,4 +1,5 @@
 #include "inference.h"
+#include "inference_pipeline.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
@@ -16,12 +17,17 @@
 #include "dl_tool.hpp" 
 #include "dl_model_base.hpp"
 #include "fbs_loader.hpp"
-#include "dl_detect_yolo11_postprocessor.hpp"
+#include "yolo_preprocess.h"
+#include "inference_jpeg.h"
+#include "yolo_postprocess.h"
 
 //#include "esp_dl_package.h"
 
 static const char* TAG = "INFERENCE";
 
+#define INFERENCE_YOLO_MIN_SAMPLES 8 //campioni minimi prima di valutare il p95 di una variante
+#define INFERENCE_YOLO_UPGRADE_FRAMES 16 //frame minimi su una variante prima di provare quella più grande
+
 //risorse e puntatori per il modello Yolo in tflite
 //extern const uint8_t yolo11n_float32_tflite_start[] asm("_binary_yolo11n_float32_tflite_start");
 //extern const uint8_t yolo11n_float32_tflite_end[] asm("_binary_yolo11n_float32_tflite_end");
@@ -50,6 +56,21 @@ inference_t* get_inference_instance(void) {
     return &g_inference;
 }
 
+// Dimensione dell'arena: il più grande tra il blocco di righe MCU della decodifica YOLO (resize a bande)
+// e il frame RGB888 decodificato in scala ridotta per la face detection (che vuole l'immagine intera)
+// + scratch del preprocessing YOLO + stato del frame YOLO (candidati, box decodificati, detections).
+// Non cresce più con la risoluzione del sensore oltre la scala IDCT scelta.
+static size_t inference_arena_required_size(int yolo_width, int yolo_height) {
+    size_t yolo_decoded = inference_jpeg_block_size(INFERENCE_MAX_FRAME_WIDTH, INFERENCE_MAX_FRAME_HEIGHT,
+                                                    yolo_width, yolo_height);
+    size_t face_decoded = inference_jpeg_decoded_size(INFERENCE_MAX_FRAME_WIDTH, INFERENCE_MAX_FRAME_HEIGHT,
+                                                      FACE_DETECT_MIN_INPUT_WIDTH, FACE_DETECT_MIN_INPUT_HEIGHT);
+    size_t decoded = yolo_decoded > face_decoded ? yolo_decoded : face_decoded;
+    size_t scratch = yolo_preprocess_scratch_size(yolo_width);
+    size_t postprocess = sizeof(inference_yolo_frame_t);
+    return ((decoded + 15) & ~(size_t)15) + ((scratch + 15) & ~(size_t)15) + postprocess + 64;
+}
+
 bool inference_init(inference_t *inf) {
     if (!inf) {
         ESP_LOGE(TAG, "Parametro inference non valido");
@@ -65,12 +86,166 @@ bool inference_init(inference_t *inf) {
     
     // Reset struttura
     memset(inf, 0, sizeof(inference_t));
+    portMUX_INITIALIZE(&inf->yolo_variant_lock);
+    portMUX_INITIALIZE(&inf->stats_lock);
     
     inf->initialized = true;
     ESP_LOGI(TAG, "Sistema di inferenza generale inizializzato con successo");
     return true;
 }
 
+// Legge dal modello forme ed exponent di input e output (scoreN/boxN) e costruisce il descrittore
+static bool inference_yolo_describe_model(dl::Model* model, yolo_model_desc_t* desc) {
+    memset(desc, 0, sizeof(yolo_model_desc_t));
+
+    auto inputs = model->get_inputs();
+    if (inputs.empty()) {
+        ESP_LOGE(TAG, "Nessun input trovato nel modello");
+        return false;
+    }
+    dl::TensorBase* input = inputs.begin()->second;
+    std::vector<int> in_shape = input->get_shape();
+    if (input->get_dtype() != dl::DATA_TYPE_INT8 || in_shape.size() != 4 || in_shape[3] != 3) {
+        ESP_LOGE(TAG, "Input del modello non supportato: %s, %zu dimensioni",
+                 input->get_dtype_string(), in_shape.size());
+        return false;
+    }
+    desc->input = input->get_element_ptr<int8_t>();
+    desc->input_height = in_shape[1];
+    desc->input_width = in_shape[2];
+    desc->input_channels = in_shape[3];
+    desc->input_exponent = input->get_exponent();
+    if (desc->input_width > YOLO_INPUT_SIZE || desc->input_height > YOLO_INPUT_SIZE) {
+        ESP_LOGE(TAG, "Input %dx%d oltre il massimo supportato (%d)", desc->input_width, desc->input_height, YOLO_INPUT_SIZE);
+        return false;
+    }
+
+    // Livelli scoreN/boxN: lo stride si ricava dal rapporto tra input e griglia
+    auto outputs = model->get_outputs();
+    for (int l = 0; l < YOLO_MAX_LEVELS; l++) {
+        auto score_it = outputs.find("score" + std::to_string(l));
+        auto box_it = outputs.find("box" + std::to_string(l));
+        if (score_it == outputs.end() || box_it == outputs.end()) {
+            break;
+        }
+        dl::TensorBase* score = score_it->second;
+        dl::TensorBase* box = box_it->second;
+        std::vector<int> score_shape = score->get_shape();
+        std::vector<int> box_shape = box->get_shape();
+        if (score->get_dtype() != dl::DATA_TYPE_INT8 || box->get_dtype() != dl::DATA_TYPE_INT8 ||
+            score_shape.size() != 4 || box_shape.size() != 4 ||
+            score_shape[1] != box_shape[1] || score_shape[2] != box_shape[2] || box_shape[3] % 4 != 0) {
+            ESP_LOGE(TAG, "Output score%d/box%d non compatibili", l, l);
+            return false;
+        }
+        if (l == 0) {
+            desc->num_classes = score_shape[3];
+            desc->reg_max = box_shape[3] / 4;
+        } else if (score_shape[3] != desc->num_classes || box_shape[3] / 4 != desc->reg_max) {
+            ESP_LOGE(TAG, "Canali di score%d/box%d diversi dal livello 0", l, l);
+            return false;
+        }
+
+        yolo_level_t* level = &desc->levels[l];
+        level->score = score->get_element_ptr<int8_t>();
+        level->box = box->get_element_ptr<int8_t>();
+        level->grid_h = score_shape[1];
+        level->grid_w = score_shape[2];
+        level->stride = desc->input_height / level->grid_h;
+        level->score_exponent = score->get_exponent();
+        level->box_exponent = box->get_exponent();
+        desc->num_levels++;
+    }
+
+    if (desc->num_levels == 0 || desc->num_classes <= 0 || desc->num_classes > YOLO_MAX_CLASSES ||
+        desc->reg_max > YOLO_MAX_REG) {
+        ESP_LOGE(TAG, "Output YOLO non supportati: %d livelli, %d classi, reg_max %d",
+                 desc->num_levels, desc->num_classes, desc->reg_max);
+        return false;
+    }
+
+    // Livelli ordinati per stride crescente (l'ordine dei nomi non è garantito dall'export)
+    for (int i = 1; i < desc->num_levels; i++) {
+        yolo_level_t key = desc->levels[i];
+        int j = i;
+        while (j > 0 && desc->levels[j - 1].stride > key.stride) {
+            desc->levels[j] = desc->levels[j - 1];
+            j--;
+        }
+        desc->levels[j] = key;
+    }
+
+    ESP_LOGI(TAG, "Modello YOLO: input %dx%dx%d (exp %d), %d classi, reg_max %d, %d livelli",
+             desc->input_width, desc->input_height, desc->input_channels, desc->input_exponent,
+             desc->num_classes, desc->reg_max, desc->num_levels);
+    for (int l = 0; l < desc->num_levels; l++) {
+        ESP_LOGI(TAG, "  livello %d: griglia %dx%d, stride %d, exp score %d, exp box %d", l,
+                 desc->levels[l].grid_w, desc->levels[l].grid_h, desc->levels[l].stride,
+                 desc->levels[l].score_exponent, desc->levels[l].box_exponent);
+    }
+    return true;
+}
+
+// Varianti del modello incorporate nel firmware, dalla più economica alla più costosa.
+// Le varianti opzionali vengono incorporate solo se il file .espdl è presente (vedi CMakeLists.txt)
+extern const uint8_t yolo11n[] asm("_binary_yolo11n_espdl_start");
+#ifdef INFERENCE_HAS_YOLO11N_192
+extern const uint8_t yolo11n_192[] asm("_binary_yolo11n_192_espdl_start");
+#endif
+#ifdef INFERENCE_HAS_YOLO11N_256
+extern const uint8_t yolo11n_256[] asm("_binary_yolo11n_256_espdl_start");
+#endif
+
+typedef struct {
+    const char* name;
+    const uint8_t* data;
+} yolo_embedded_model_t;
+
+static const yolo_embedded_model_t yolo_embedded_models[] = {
+#ifdef INFERENCE_HAS_YOLO11N_192
+    {"yolo11n_192", yolo11n_192},
+#endif
+#ifdef INFERENCE_HAS_YOLO11N_256
+    {"yolo11n_256", yolo11n_256},
+#endif
+    {"yolo11n", yolo11n},
+};
+
+static void inference_yolo_release_variant(inference_yolo_variant_t* variant) {
+    if (variant->model) {
+        delete variant->model;
+    }
+    memset(variant, 0, sizeof(inference_yolo_variant_t));
+}
+
+// Carica una variante: modello, descrittore, LUT di quantizzazione e decoder
+static bool inference_yolo_load_variant(inference_yolo_variant_t* variant, const yolo_embedded_model_t* embedded) {
+    memset(variant, 0, sizeof(inference_yolo_variant_t));
+    variant->name = embedded->name;
+
+    ESP_LOGI(TAG, "Caricamento variante %s (PSRAM libera: %d bytes)", embedded->name, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    variant->model = new dl::Model((const char *)embedded->data, fbs::MODEL_LOCATION_IN_FLASH_RODATA, 0,
+                                   dl::MEMORY_MANAGER_GREEDY, nullptr, false);
+    if (!variant->model) {
+        ESP_LOGE(TAG, "Impossibile creare modello ESP-DL %s", embedded->name);
+        return false;
+    }
+
+    // Forme ed exponent letti una volta dal modello: nessuna costante legata a un export specifico
+    yolo_model_desc_t* desc = &variant->desc;
+    if (!inference_yolo_describe_model(variant->model, desc) ||
+        !yolo_decoder_init(&variant->decoder, desc->levels, desc->num_levels, desc->reg_max,
+                           YOLO_NMS_THRESHOLD, YOLO_DEFAULT_TOP_K)) {
+        ESP_LOGE(TAG, "Variante %s non supportata", embedded->name);
+        inference_yolo_release_variant(variant);
+        return false;
+    }
+    yolo_preprocess_build_lut(desc->input_exponent, variant->input_lut);
+
+    ESP_LOGI(TAG, "Variante %s pronta (PSRAM libera: %d bytes)", embedded->name, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    return true;
+}
+
 //inizializza il modello Yolo in espdl
 bool inference_yolo_init(inference_t *inf) {
     if (!inf || !inf->initialized) {
@@ -84,359 +259,559 @@ bool inference_yolo_init(inference_t *inf) {
     }
     ESP_LOGI(TAG, "Inizializzazione sistema di inferenza YOLO con ESP-DL...");
 
-    extern const uint8_t yolo11n[] asm("_binary_yolo11n_espdl_start");
+    // Carica tutte le varianti incorporate; una variante non compatibile viene saltata
+    inf->yolo_num_variants = 0;
+    int max_width = 0, max_height = 0;
+    for (size_t i = 0; i < sizeof(yolo_embedded_models) / sizeof(yolo_embedded_models[0]); i++) {
+        inference_yolo_variant_t* variant = &inf->yolo_variants[inf->yolo_num_variants];
+        if (!inference_yolo_load_variant(variant, &yolo_embedded_models[i])) {
+            continue;
+        }
+        // Tutte le varianti condividono la configurazione di scansione: stesso numero di classi
+        if (inf->yolo_num_variants > 0 && variant->desc.num_classes != inf->yolo_variants[0].desc.num_classes) {
+            ESP_LOGE(TAG, "Variante %s con %d classi invece di %d, ignorata", variant->name,
+                     variant->desc.num_classes, inf->yolo_variants[0].desc.num_classes);
+            inference_yolo_release_variant(variant);
+            continue;
+        }
+        if (variant->desc.input_width > max_width) max_width = variant->desc.input_width;
+        if (variant->desc.input_height > max_height) max_height = variant->desc.input_height;
+        inf->yolo_num_variants++;
+    }
 
-    ESP_LOGI(TAG, "PSRAM libera prima di inizializzare il modello: %d bytes", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    if (inf->yolo_num_variants == 0) {
+        ESP_LOGE(TAG, "Nessuna variante del modello YOLO disponibile");
+        return false;
+    }
 
-    // Inizializza il modello ESP-DL
-    inf->yolo_model = new dl::Model((const char *)yolo11n, fbs::MODEL_LOCATION_IN_FLASH_RODATA, 0, dl::MEMORY_MANAGER_GREEDY, nullptr, false);
-    
-    ESP_LOGI(TAG, "PSRAM libera dopo aver inizializzato il modello: %d bytes", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-    
-    if (!inf->yolo_model) {
-        ESP_LOGE(TAG, "Impossibile creare modello ESP-DL");
+    // Arena dei buffer per-frame, dimensionata una volta sola sulla risoluzione massima e sull'input più grande
+    if (!inference_arena_reserve(&inf->arena, inference_arena_required_size(max_width, max_height), MALLOC_CAP_SPIRAM)) {
+        ESP_LOGE(TAG, "Impossibile allocare l'arena dei buffer di inferenza");
+        for (uint32_t i = 0; i < inf->yolo_num_variants; i++) {
+            inference_yolo_release_variant(&inf->yolo_variants[i]);
+        }
+        inf->yolo_num_variants = 0;
         return false;
     }
-    
+
+    // Configurazione di default della scansione: soglia 0.3, tutte le classi del modello
+    yolo_postprocess_scan_config_init(&inf->yolo_scan_config, 0.3f, inf->yolo_variants[0].desc.num_classes);
+    inf->yolo_top_k = YOLO_DEFAULT_TOP_K;
+
+    // Si parte dalla variante più accurata; la selezione adattiva scende se il p95 supera il budget
+    inf->yolo_active_variant = inf->yolo_num_variants - 1;
+    inf->yolo_latency_budget_ms = INFERENCE_YOLO_DEFAULT_BUDGET_MS;
+    inf->yolo_frames_since_switch = 0;
+    inf->yolo_variant_switches = 0;
+    inf->yolo_backlog = 0;
+
     inf->yolo_model_initialized = true;
     
-    ESP_LOGI(TAG, "Modello YOLO ESP-DL inizializzato con successo!");
+    ESP_LOGI(TAG, "Modello YOLO ESP-DL inizializzato con successo! (%lu varianti, attiva: %s)",
+             inf->yolo_num_variants, inf->yolo_variants[inf->yolo_active_variant].name);
     return true;
 
 }
 
-//inferenza con modello Yolo
-bool inference_yolo_detection(inference_t *inf, const uint8_t* jpeg_data, size_t jpeg_size, inference_result_t* result) {
-    
-    if (!inf || !inf->initialized || !inf->yolo_model) {
-        ESP_LOGE(TAG, "Sistema di inferenza non inizializzato");
-        return false;
+// Statistiche globali: con la pipeline YOLO (task yolo_post) e i volti (executor) aggiornate in parallelo
+static void inference_record_stats(inference_t *inf, uint32_t inference_time_ms) {
+    taskENTER_CRITICAL(&inf->stats_lock);
+    inf->stats.total_inferences++;
+    inf->stats.avg_inference_time_ms =
+        (inf->stats.avg_inference_time_ms * (inf->stats.total_inferences - 1) + inference_time_ms) /
+        inf->stats.total_inferences;
+    taskEXIT_CRITICAL(&inf->stats_lock);
+}
+
+// Registra la latenza di un frame nella finestra della variante e ricalcola il p95.
+// Chiamata da yolo_post nella pipeline mentre l'executor seleziona la variante: la finestra viene
+// aggiornata e copiata sotto yolo_variant_lock, l'ordinamento avviene sulla copia
+static void inference_yolo_record_latency(inference_t *inf, inference_yolo_variant_t* variant, uint32_t latency_ms) {
+    uint16_t sorted[INFERENCE_YOLO_LATENCY_WINDOW];
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    variant->runs++;
+    variant->last_ms = latency_ms;
+    variant->latency_ms[variant->latency_head] = latency_ms > UINT16_MAX ? UINT16_MAX : (uint16_t)latency_ms;
+    variant->latency_head = (variant->latency_head + 1) % INFERENCE_YOLO_LATENCY_WINDOW;
+    if (variant->latency_count < INFERENCE_YOLO_LATENCY_WINDOW) {
+        variant->latency_count++;
     }
-    
-    // Debug memoria
-    ESP_LOGI(TAG, "PSRAM libera: %d bytes", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-    ESP_LOGI(TAG, "Memoria interna libera: %d bytes", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    uint32_t n = variant->latency_count;
+    memcpy(sorted, variant->latency_ms, n * sizeof(uint16_t));
+    inf->yolo_frames_since_switch++;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+
+    for (uint32_t i = 1; i < n; i++) {
+        uint16_t key = sorted[i];
+        uint32_t j = i;
+        while (j > 0 && sorted[j - 1] > key) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = key;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    variant->p95_ms = sorted[(n * 95 + 99) / 100 - 1];
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+}
 
-    // Decodifica JPEG in RGB
-    dl::image::jpeg_img_t jpeg_img = {
-        .data = (void*)jpeg_data,
-        .data_len = jpeg_size
-    };
+// Da chiamare con yolo_variant_lock acquisito
+static void inference_yolo_switch_variant(inference_t *inf, uint32_t index) {
+    inference_yolo_variant_t* next = &inf->yolo_variants[index];
+    // la finestra della nuova variante riparte: le latenze vecchie riflettono un carico diverso
+    next->latency_count = 0;
+    next->latency_head = 0;
+    inf->yolo_active_variant = index;
+    inf->yolo_frames_since_switch = 0;
+    inf->yolo_variant_switches++;
+}
 
-    auto img = sw_decode_jpeg(jpeg_img, dl::image::DL_IMAGE_PIX_TYPE_RGB888);
-    if (!img.data) {
-        ESP_LOGE(TAG, "Errore decodifica JPEG");
-        return false;
+// Sceglie la variante per il prossimo frame: scende se c'è coda o se il p95 supera il budget,
+// sale solo se la stima della variante più grande resta sotto l'80% del budget.
+// Da chiamare con yolo_variant_lock acquisito; restituisce il motivo del cambio (NULL se nessun cambio)
+static const char* inference_yolo_select_variant(inference_t *inf) {
+    if (inf->yolo_num_variants <= 1) {
+        return NULL;
     }
-    
-    ESP_LOGI(TAG, "Immagine decodificata: %dx%d", img.width, img.height);
-
-    // Ridimensiona a 320x320 (dimensione input YOLO) PER TEST
-    dl::image::img_t resized_img;
-    resized_img.width = 320;
-    resized_img.height = 320;
-    resized_img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
-    resized_img.data = heap_caps_malloc(320 * 320 * 3, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    
-    if (!resized_img.data) {
-        ESP_LOGE(TAG, "Errore allocazione memoria per resize");
-        heap_caps_free(img.data);
-        return false;
+    if (inf->yolo_latency_budget_ms == 0) {
+        if (inf->yolo_active_variant != inf->yolo_num_variants - 1) {
+            inference_yolo_switch_variant(inf, inf->yolo_num_variants - 1);
+            return "selezione adattiva disattivata";
+        }
+        return NULL;
     }
-    
-    dl::image::resize(img, resized_img, dl::image::DL_IMAGE_INTERPOLATE_BILINEAR, 0, nullptr);
-    ESP_LOGI(TAG, "Immagine ridimensionata: %dx%d", resized_img.width, resized_img.height);
-
-    // Debug: stampa alcuni valori prima della normalizzazione
-    uint8_t* uint8_data = (uint8_t*)resized_img.data;
-    ESP_LOGI(TAG, "Primi 10 valori prima normalizzazione: %d, %d, %d, %d, %d, %d, %d, %d, %d, %d", 
-             uint8_data[0], uint8_data[1], uint8_data[2], uint8_data[3], uint8_data[4], 
-             uint8_data[5], uint8_data[6], uint8_data[7], uint8_data[8], uint8_data[9]);
-
-    // Alloca memoria separata per i dati float normalizzati
-    size_t float_size = 320 * 320 * 3 * sizeof(float);
-    ESP_LOGI(TAG, "Tentativo allocazione: %d bytes", float_size);
-    
-    float* float_data = (float*)heap_caps_malloc(float_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!float_data) {
-        ESP_LOGE(TAG, "Errore allocazione PSRAM, provo memoria interna");
-        float_data = (float*)heap_caps_malloc(float_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-        if (!float_data) {
-            ESP_LOGE(TAG, "Errore anche con memoria interna");
-            heap_caps_free(img.data);
-            heap_caps_free(resized_img.data);
+
+    uint32_t active = inf->yolo_active_variant;
+    const inference_yolo_variant_t* current = &inf->yolo_variants[active];
+    if (inf->yolo_backlog > 0 && active > 0) {
+        inference_yolo_switch_variant(inf, active - 1);
+        return "frame in coda";
+    }
+    if (current->latency_count < INFERENCE_YOLO_MIN_SAMPLES) {
+        return NULL;
+    }
+    if (current->p95_ms > inf->yolo_latency_budget_ms && active > 0) {
+        inference_yolo_switch_variant(inf, active - 1);
+        return "p95 oltre il budget";
+    }
+    if (active + 1 < inf->yolo_num_variants && inf->yolo_backlog == 0 &&
+        inf->yolo_frames_since_switch >= INFERENCE_YOLO_UPGRADE_FRAMES) {
+        // la latenza cresce circa con l'area dell'input
+        const yolo_model_desc_t* cur_desc = &current->desc;
+        const yolo_model_desc_t* next_desc = &inf->yolo_variants[active + 1].desc;
+        uint64_t estimate = (uint64_t)current->p95_ms * next_desc->input_width * next_desc->input_height /
+                            ((uint64_t)cur_desc->input_width * cur_desc->input_height);
+        if (estimate * 10 < (uint64_t)inf->yolo_latency_budget_ms * 8) {
+            inference_yolo_switch_variant(inf, active + 1);
+            return "margine sul budget";
+        }
+    }
+    return NULL;
+}
+
+// Stato del resize a bande durante la decodifica JPEG
+typedef struct {
+    yolo_preprocess_stream_t stream;
+    int8_t* dst;
+    int dst_width;
+    int dst_height;
+    const int8_t* lut;
+    void* scratch;
+    size_t scratch_size;
+    int64_t resize_us;      // tempo speso nel resize (il resto è decodifica)
+} inference_yolo_rows_ctx_t;
+
+static bool inference_yolo_rows_cb(void* ctx, const inference_image_t* img,
+                                   const uint8_t* rows, int first_row, int num_rows) {
+    inference_yolo_rows_ctx_t* rows_ctx = (inference_yolo_rows_ctx_t*)ctx;
+    int64_t t0 = esp_timer_get_time();
+    // Prima banda (anche quando il decoder riparte a piena risoluzione): dimensioni sorgente note solo ora
+    if (first_row == 0) {
+        rows_ctx->resize_us = 0;
+        if (!yolo_preprocess_stream_begin(&rows_ctx->stream, img->width, img->height, rows_ctx->dst,
+                                          rows_ctx->dst_width, rows_ctx->dst_height, rows_ctx->lut,
+                                          rows_ctx->scratch, rows_ctx->scratch_size)) {
+            ESP_LOGE(TAG, "Errore nel preprocessing dell'immagine");
             return false;
         }
     }
+    yolo_preprocess_stream_rows(&rows_ctx->stream, rows, first_row, num_rows);
+    rows_ctx->resize_us += esp_timer_get_time() - t0;
+    return true;
+}
 
-    // Normalizza i valori da [0,255] a [0,1] in float
-    for (int i = 0; i < 320 * 320 * 3; i++) {
-        float_data[i] = uint8_data[i] / 255.0f;
+bool inference_yolo_prepare(inference_t *inf, const inference_input_frame_t* input, inference_yolo_frame_t* frame) {
+    if (!inf || !inf->initialized || inf->yolo_num_variants == 0 || !input || !input->data || !frame) {
+        ESP_LOGE(TAG, "Sistema di inferenza non inizializzato");
+        return false;
     }
 
-    // Debug: stampa alcuni valori dopo la normalizzazione
-    ESP_LOGI(TAG, "Primi 10 valori dopo normalizzazione: %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f", 
-             float_data[0], float_data[1], float_data[2], float_data[3], float_data[4], 
-             float_data[5], float_data[6], float_data[7], float_data[8], float_data[9]);
+    int64_t start_us = esp_timer_get_time();
+    frame->start_us = start_us;
+    frame->gathered = false;
+    frame->num_candidates = 0;
+
+    // Variante del modello per questo frame (in base al p95 recente e alla coda)
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    uint32_t previous = inf->yolo_active_variant;
+    const char* reason = inference_yolo_select_variant(inf);
+    frame->variant = inf->yolo_active_variant;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    if (reason) {
+        ESP_LOGI(TAG, "Variante YOLO: %s -> %s (%s)", inf->yolo_variants[previous].name,
+                 inf->yolo_variants[frame->variant].name, reason);
+    }
+    inference_yolo_variant_t* variant = &inf->yolo_variants[frame->variant];
+    const yolo_model_desc_t* desc = &variant->desc;
+
+    // Resize + quantizzazione fusi: scrive direttamente nell'input int8 (HWC, dimensione letta dal modello)
+    // usando l'exponent dell'input, senza buffer RGB ridimensionato ne' buffer float intermedio
+    size_t scratch_size = yolo_preprocess_scratch_size(desc->input_width);
+    void* scratch = inference_arena_alloc(&inf->arena, scratch_size, 16);
+    if (!scratch) {
+        ESP_LOGE(TAG, "Errore allocazione memoria per preprocessing");
+        return false;
+    }
+    int8_t* dst = frame->input ? frame->input : desc->input;
+
+    // Frame RGB565 grezzo del sensore: nessuna decodifica, il kernel di conversione legge direttamente i pixel.
+    // Frame JPEG: decodifica alla scala IDCT più piccola che copre l'input del modello, un blocco di righe MCU
+    // alla volta in un unico buffer dell'arena, ridimensionando ogni blocco appena decodificato
+    inference_image_t img = {};
+    int64_t resize_us = 0;
+    frame->raw_input = input->format == INFERENCE_PIXEL_RGB565;
+    if (frame->raw_input) {
+        if (input->width <= 0 || input->height <= 0 || input->size < (size_t)input->width * input->height * 2) {
+            ESP_LOGE(TAG, "Frame RGB565 non valido: %dx%d, %zu bytes", input->width, input->height, input->size);
+            return false;
+        }
+        img.width = img.src_width = input->width;
+        img.height = img.src_height = input->height;
+        int64_t resize_start_us = esp_timer_get_time();
+        if (!yolo_preprocess_rgb565_resize_quantize(input->data, img.width, img.height, dst,
+                                                    desc->input_width, desc->input_height,
+                                                    variant->input_lut, scratch, scratch_size)) {
+            ESP_LOGE(TAG, "Errore nel preprocessing dell'immagine");
+            return false;
+        }
+        resize_us = esp_timer_get_time() - resize_start_us;
+    } else {
+        inference_yolo_rows_ctx_t rows_ctx = {};
+        rows_ctx.dst = dst;
+        rows_ctx.dst_width = desc->input_width;
+        rows_ctx.dst_height = desc->input_height;
+        rows_ctx.lut = variant->input_lut;
+        rows_ctx.scratch = scratch;
+        rows_ctx.scratch_size = scratch_size;
+        if (!inference_jpeg_decode_rows(&inf->arena, input->data, input->size, desc->input_width, desc->input_height,
+                                        inference_yolo_rows_cb, &rows_ctx, &img)) {
+            return false;
+        }
+        if (!yolo_preprocess_stream_done(&rows_ctx.stream)) {
+            ESP_LOGE(TAG, "Errore nel preprocessing dell'immagine");
+            return false;
+        }
+        resize_us = rows_ctx.resize_us;
+        ESP_LOGI(TAG, "Immagine decodificata: %dx%d (originale %dx%d, scala 1/%d)",
+                 img.width, img.height, img.src_width, img.src_height, 1 << img.scale_shift);
+    }
+    frame->src_width = img.src_width;
+    frame->src_height = img.src_height;
+    // Con la finestra del sensore allineata al modello il frame decodificato ha già la dimensione giusta
+    frame->resize_skipped = yolo_preprocess_is_native(img.width, img.height, desc->input_width, desc->input_height);
+
+    // Decodifica e resize sono interlacciati: il tempo del resize è quello speso nei blocchi di righe
+    int64_t end_us = esp_timer_get_time();
+    frame->decode_time_ms = (uint32_t)((end_us - start_us - resize_us) / 1000);
+    frame->resize_time_ms = (uint32_t)(resize_us / 1000);
+    frame->preprocessing_time_ms = (uint32_t)((end_us - start_us) / 1000);
+    ESP_LOGI(TAG, "Immagine preprocessata per inferenza (%dx%d, exponent input: %d)",
+             desc->input_width, desc->input_height, desc->input_exponent);
+    return true;
+}
 
-    ESP_LOGI(TAG, "Immagine preprocessata per inferenza");
+bool inference_yolo_execute(inference_t *inf, inference_yolo_frame_t* frame, bool gather) {
+    if (!inf || !frame || frame->variant >= inf->yolo_num_variants) {
+        return false;
+    }
+    inference_yolo_variant_t* variant = &inf->yolo_variants[frame->variant];
+    const yolo_model_desc_t* desc = &variant->desc;
 
     // Esegui inferenza
     ESP_LOGI(TAG, "Avvio inferenza YOLO...");
-    dl::Model* model = static_cast<dl::Model*>(inf->yolo_model);
-        /*
-        // === DEBUG MODELLO ===
-        ESP_LOGI(TAG, "=== INFO MODELLO ===");
-        model->print();
-        
-        ESP_LOGI(TAG, "=== INFO MEMORIA ===");
-        model->profile_memory();
-        
-        ESP_LOGI(TAG, "=== INFO MODULI ===");
-        auto module_info = model->get_module_info();
-        model->print_module_info(module_info);
-        */
-    ESP_LOGI(TAG, "=== INFO INPUT/OUTPUT ===");
-    auto inputs = model->get_inputs();
-    for (auto& input : inputs) {
-        auto shape = input.second->get_shape();
-        ESP_LOGI(TAG, "Input: %s, shape: [%d, %d, %d, %d]", 
-                 input.first.c_str(), 
-                 shape[0], shape[1], shape[2], shape[3]);
+    int64_t start_us = esp_timer_get_time();
+    if (frame->input) {
+        memcpy(desc->input, frame->input, (size_t)desc->input_width * desc->input_height * desc->input_channels);
     }
-    
-    auto outputs = model->get_outputs();
-    for (auto& output : outputs) {
-        auto shape = output.second->get_shape();
-        ESP_LOGI(TAG, "Output: %s, shape: [%d, %d, %d, %d]", 
-                 output.first.c_str(), 
-                 shape[0], shape[1], shape[2], shape[3]);
+    variant->model->run();
+    int64_t run_end_us = esp_timer_get_time();
+    frame->processing_time_ms = (uint32_t)((run_end_us - start_us) / 1000);
+
+    // Scansione degli score nel dominio int8: la maggior parte degli anchor viene scartata senza calcoli float.
+    // Soglia e maschera delle classi possono cambiare da CLI/HTTP: si usa una copia presa sotto yolo_variant_lock
+    yolo_scan_config_t scan_config;
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    scan_config = inf->yolo_scan_config;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    memset(&frame->scan_stats, 0, sizeof(frame->scan_stats));
+    frame->num_candidates = yolo_postprocess_scan(desc->levels, desc->num_levels, &scan_config,
+                                                  frame->candidates, YOLO_MAX_CANDIDATES, &frame->scan_stats);
+    frame->gathered = gather;
+    if (gather && frame->num_candidates > 0) {
+        yolo_postprocess_gather_bins(desc->levels, desc->reg_max, frame->candidates, frame->num_candidates, frame->bins);
     }
-    
-    // Prova con il metodo corretto per passare input
-    if (!inputs.empty()) {
-        auto input_tensor = inputs.begin()->second;
-        ESP_LOGI(TAG, "Input tensor: %s", inputs.begin()->first.c_str());
-        
-        // Assegna i dati usando l'API corretta di ESP-DL
-        std::vector<int> shape = {1, 320, 320, 3};  // batch, height, width, channels
-        bool success = input_tensor->assign(shape, float_data, 0, dl::DATA_TYPE_FLOAT);
-        
-        if (success) {
-            ESP_LOGI(TAG, "Dati assegnati con successo al tensore");
-            // Esegui inferenza
-            model->run();
-            
-            // Post-processing: estrai i risultati
-            ESP_LOGI(TAG, "=== POST-PROCESSING ===");
-            auto outputs = model->get_outputs();
-            
-            for (auto& output : outputs) { 
-                auto shape = output.second->get_shape();
-                ESP_LOGI(TAG, "Output: %s, shape: [%d, %d, %d, %d]", 
-                         output.first.c_str(), 
-                         shape[0], shape[1], shape[2], shape[3]);
-                
-                // Estrai alcuni valori di esempio
-                if (output.first.find("score") != std::string::npos) {
-                    ESP_LOGI(TAG, "Analizzando score tensor: %s", output.first.c_str());
-                    ESP_LOGI(TAG, "Tipo dati tensore: %s", output.second->get_dtype_string());
-                    
-                    // Parametri di dequantizzazione (da yolo11n.info)
-                    // Gli output hanno exponent: -2, quindi scale = 2^(-2) = 0.25
-                    float scale = 0.25f;        // Scale corretto dal file .info
-                    int zero_point = 0;         // Zero point per quantizzazione simmetrica INT8
-                    
-                    if (output.second->get_dtype() == dl::DATA_TYPE_INT8) {
-                        int8_t* data = output.second->get_element_ptr<int8_t>();
-                        
-                        // Dequantizza e cerca confidence massima
-                        float max_confidence = -999999.0f;
-                        int max_idx = -1;
-                        ESP_LOGI(TAG, "Dequantizzando e cercando confidence massima...");
-                        
-                        for (int i = 0; i < output.second->get_size(); i++) {
-                            // Dequantizza: (int8 - zero_point) * scale
-                            float dequantized = (data[i] - zero_point) * scale;
-                            
-                            if (dequantized > max_confidence) {
-                                max_confidence = dequantized;
-                                max_idx = i;
-                            }
-                        }
-                        
-                        ESP_LOGI(TAG, "Confidence massima dequantizzata in %s: %.6f (indice %d)", 
-                                 output.first.c_str(), max_confidence, max_idx);
-                        
-                        // Cerca specificamente la classe "person" (indice 0)
-                        float person_confidence = 0.0f;
-                        int person_x = -1, person_y = -1;
-                        
-                        // Per ogni posizione nel tensore
-                        auto shape = output.second->get_shape();
-                        int height = shape[1];  // 40, 20, o 10
-                        int width = shape[2];   // 40, 20, o 10
-                        
-                        for (int y = 0; y < height; y++) {
-                            for (int x = 0; x < width; x++) {
-                                int base_idx = (y * width + x) * 80;  // 80 classi per posizione
-                                float dequantized = (data[base_idx] - zero_point) * scale;  // Classe 0 (person)
-                                
-                                if (dequantized > person_confidence) {
-                                    person_confidence = dequantized;
-                                    person_x = x;
-                                    person_y = y;
-                                }
-                            }
-                        }
-                        
-                        ESP_LOGI(TAG, "Classe 'person' in %s: confidence=%.6f, pos=(%d,%d)", 
-                                 output.first.c_str(), person_confidence, person_x, person_y);
-                        
-                        // Se troviamo una persona con confidence alta, estrai bounding box
-                        if (person_confidence > 0.3f) {
-                            ESP_LOGI(TAG, "PERSONA RILEVATA in %s!", output.first.c_str());
-                            
-                            // Cerca il tensore box corrispondente
-                            std::string box_name = output.first;
-                            box_name.replace(box_name.find("score"), 5, "box");
-                            
-                            auto box_output = outputs.find(box_name);
-                            if (box_output != outputs.end()) {
-                                ESP_LOGI(TAG, "Trovato tensore box corrispondente: %s", box_name.c_str());
-                                
-                                // Estrai bounding box dalla posizione (person_x, person_y)
-                                auto box_shape = box_output->second->get_shape();
-                                int box_height = box_shape[1];
-                                int box_width = box_shape[2];
-                                
-                                if (person_x < box_width && person_y < box_height) {
-                                    int8_t* box_data = box_output->second->get_element_ptr<int8_t>();
-                                    int box_base_idx = (person_y * box_width + person_x) * 64;  // 64 valori per box
-                                    
-                                    // Debug: stampa i primi valori del box
-                                    ESP_LOGI(TAG, "Primi 10 valori del box: %d, %d, %d, %d, %d, %d, %d, %d, %d, %d",
-                                             box_data[box_base_idx + 0], box_data[box_base_idx + 1], 
-                                             box_data[box_base_idx + 2], box_data[box_base_idx + 3],
-                                             box_data[box_base_idx + 4], box_data[box_base_idx + 5],
-                                             box_data[box_base_idx + 6], box_data[box_base_idx + 7],
-                                             box_data[box_base_idx + 8], box_data[box_base_idx + 9]);
-                                    
-                                    // Prova scale diversi per le bounding boxes
-                                    // Le bounding boxes potrebbero avere scale diverso dagli score
-                                    float box_scale = 0.25f;  // Prova prima con lo stesso scale
-                                    
-                                    // Dequantizza i primi 4 valori [x, y, w, h]
-                                    float box_x = (box_data[box_base_idx + 0] - 0) * box_scale;
-                                    float box_y = (box_data[box_base_idx + 1] - 0) * box_scale;
-                                    float box_w = (box_data[box_base_idx + 2] - 0) * box_scale;
-                                    float box_h = (box_data[box_base_idx + 3] - 0) * box_scale;
-                                    
-                                    ESP_LOGI(TAG, "Bounding Box (normalizzato): x=%.3f, y=%.3f, w=%.3f, h=%.3f", 
-                                             box_x, box_y, box_w, box_h);
-                                    
-                                    // Verifica che i valori siano nel range [0,1]
-                                    if (box_x >= 0.0f && box_x <= 1.0f && 
-                                        box_y >= 0.0f && box_y <= 1.0f &&
-                                        box_w >= 0.0f && box_w <= 1.0f &&
-                                        box_h >= 0.0f && box_h <= 1.0f) {
-                                        
-                                        // Converti in coordinate pixel (320x320)
-                                        int pixel_x = (int)(box_x * 320);
-                                        int pixel_y = (int)(box_y * 320);
-                                        int pixel_w = (int)(box_w * 320);
-                                        int pixel_h = (int)(box_h * 320);
-                                        
-                                        ESP_LOGI(TAG, "Bounding Box (pixel): x=%d, y=%d, w=%d, h=%d", 
-                                                 pixel_x, pixel_y, pixel_w, pixel_h);
-                                        
-                                        // Verifica che sia dentro l'immagine
-                                        if (pixel_x >= 0 && pixel_x < 320 && 
-                                            pixel_y >= 0 && pixel_y < 320 &&
-                                            pixel_w > 0 && pixel_w <= 320 &&
-                                            pixel_h > 0 && pixel_h <= 320) {
-                                            ESP_LOGI(TAG, "Bounding Box VALIDA!");
-                                        } else {
-                                            ESP_LOGW(TAG, "Bounding Box fuori range!");
-                                        }
-                                    } else {
-                                        ESP_LOGW(TAG, "Bounding Box valori normalizzati fuori range [0,1]!");
-                                        
-                                        // Prova con scale diverso
-                                        box_scale = 0.1f;  // Prova scale più piccolo
-                                        box_x = (box_data[box_base_idx + 0] - 0) * box_scale;
-                                        box_y = (box_data[box_base_idx + 1] - 0) * box_scale;
-                                        box_w = (box_data[box_base_idx + 2] - 0) * box_scale;
-                                        box_h = (box_data[box_base_idx + 3] - 0) * box_scale;
-                                        
-                                        ESP_LOGI(TAG, "Bounding Box (scale=0.1): x=%.3f, y=%.3f, w=%.3f, h=%.3f", 
-                                                 box_x, box_y, box_w, box_h);
-                                    }
-                                }
-                            }
-                        }
-                        ESP_LOGI(TAG, "Confidence massima per classe 'person' in %s: %.6f", 
-                                 output.first.c_str(), person_confidence);
-                        
-                    } else {
-                        float* data = output.second->get_element_ptr<float>();
-                        ESP_LOGI(TAG, "Primi 10 valori FLOAT di %s:", output.first.c_str());
-                        for (int i = 0; i < 10 && i < output.second->get_size(); i++) {
-                            ESP_LOGI(TAG, "  [%d]: %.6f", i, data[i]);
-                        }
-                    }
-                }
+    frame->scan_time_us = (uint32_t)(esp_timer_get_time() - run_end_us);
+    ESP_LOGI(TAG, "Anchor scansionati: %lu, sopravvissuti: %lu (scartati per buffer pieno: %lu)",
+             frame->scan_stats.anchors_scanned, frame->scan_stats.anchors_survived,
+             frame->scan_stats.candidates_dropped);
+    return true;
+}
+
+void inference_yolo_finish(inference_t *inf, inference_yolo_frame_t* frame, inference_result_t* result) {
+    if (!inf || !frame || !result || frame->variant >= inf->yolo_num_variants) {
+        return;
+    }
+    int64_t start_us = esp_timer_get_time();
+    inference_yolo_variant_t* variant = &inf->yolo_variants[frame->variant];
+    const yolo_model_desc_t* desc = &variant->desc;
+
+    memset(result, 0, sizeof(inference_result_t));
+    result->yolo_variant = frame->variant;
+    result->yolo_input_size = desc->input_width;
+    result->yolo_anchors_scanned = frame->scan_stats.anchors_scanned;
+    result->yolo_anchors_survived = frame->scan_stats.anchors_survived;
+    result->yolo_resize_skipped = frame->resize_skipped;
+    result->raw_input = frame->raw_input;
+    result->frame_width = frame->src_width;
+    result->frame_height = frame->src_height;
+
+    // Post-processing: decodifica DFL + NMS per classe sui soli candidati
+    ESP_LOGI(TAG, "=== POST-PROCESSING ===");
+    if (frame->num_candidates > 0) {
+        size_t num_detections = frame->gathered
+            ? yolo_decoder_run_gathered(&variant->decoder, desc->levels, frame->candidates, frame->bins,
+                                        frame->num_candidates, frame->boxes, frame->detections, MAX_YOLO_DETECTIONS)
+            : yolo_decoder_run(&variant->decoder, desc->levels, frame->candidates, frame->num_candidates,
+                               frame->boxes, frame->detections, MAX_YOLO_DETECTIONS);
+
+        // Riporta i box dalle coordinate dell'input del modello a quelle del frame originale
+        const float in_w = (float)desc->input_width;
+        const float in_h = (float)desc->input_height;
+        const float scale_x = (float)frame->src_width / in_w;
+        const float scale_y = (float)frame->src_height / in_h;
+        for (size_t i = 0; i < num_detections; i++) {
+            const yolo_box_t* b = &frame->detections[i];
+            float x1 = b->x1 < 0.0f ? 0.0f : b->x1;
+            float y1 = b->y1 < 0.0f ? 0.0f : b->y1;
+            float x2 = b->x2 > in_w ? in_w : b->x2;
+            float y2 = b->y2 > in_h ? in_h : b->y2;
+
+            yolo_detection_t* det = &result->yolo_detections[i];
+            det->score = b->score;
+            det->class_id = b->class_id;
+            det->box[0] = (uint32_t)(x1 * scale_x);
+            det->box[1] = (uint32_t)(y1 * scale_y);
+            det->box[2] = x2 > x1 ? (uint32_t)((x2 - x1) * scale_x) : 0;
+            det->box[3] = y2 > y1 ? (uint32_t)((y2 - y1) * scale_y) : 0;
+            strncpy(det->class_name, yolo_postprocess_class_name(b->class_id), sizeof(det->class_name) - 1);
+            if (b->class_id == 0) {
+                result->person_detected = true;
             }
-        } else {
-            ESP_LOGE(TAG, "Errore nell'assegnazione dei dati al tensore");
+            ESP_LOGI(TAG, "Detection: %s score=%.3f box=[%lu,%lu,%lu,%lu]", det->class_name, det->score,
+                     det->box[0], det->box[1], det->box[2], det->box[3]);
         }
+        result->num_yolo_detections = num_detections;
+    }
+
+    int64_t end_us = esp_timer_get_time();
+
+    // Popola i tempi del risultato (il totale include le eventuali attese tra gli stadi della pipeline)
+    result->decode_time_ms = frame->decode_time_ms;
+    result->resize_time_ms = frame->resize_time_ms;
+    result->preprocessing_time_ms = frame->preprocessing_time_ms;
+    result->processing_time_ms = frame->processing_time_ms;
+    result->postprocessing_time_ms = (uint32_t)((frame->scan_time_us + (end_us - start_us)) / 1000);
+    result->full_inference_time_ms = (uint32_t)((end_us - frame->start_us) / 1000);
+
+    // Aggiorna statistiche
+    inference_record_stats(inf, result->full_inference_time_ms);
+    inference_yolo_record_latency(inf, variant, result->full_inference_time_ms);
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    uint32_t p95_ms = variant->p95_ms;
+    uint32_t budget_ms = inf->yolo_latency_budget_ms;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+
+    // Stampa i tempi per stadio per CLI
+    printf("=== TEMPI INFERENZA YOLO ===\n");
+    printf("Variante: %s (input %dx%d, p95 %lu ms, budget %lu ms)\n", variant->name, desc->input_width,
+           desc->input_height, p95_ms, budget_ms);
+    if (result->raw_input) {
+        printf("Frame RGB565 dal sensore: decodifica JPEG saltata\n");
     } else {
-        ESP_LOGE(TAG, "Nessun input trovato nel modello");
-    } 
+        printf("Tempo decodifica JPEG: %lu ms\n", result->decode_time_ms);
+    }
+    printf("Tempo resize + quantizzazione: %lu ms%s\n", result->resize_time_ms,
+           result->yolo_resize_skipped ? " (resize saltato: frame già alla dimensione del modello)" : "");
+    printf("Tempo preprocessing: %lu ms\n", result->preprocessing_time_ms);
+    printf("Tempo processing inferenza: %lu ms\n", result->processing_time_ms);
+    printf("Tempo postprocessing: %lu ms\n", result->postprocessing_time_ms);
+    printf("Tempo inferenza totale: %lu ms\n", result->full_inference_time_ms);
+    printf("Anchor scansionati: %lu, sopravvissuti: %lu\n", result->yolo_anchors_scanned, result->yolo_anchors_survived);
+    printf("Detections: %lu (persona: %s)\n", result->num_yolo_detections, result->person_detected ? "SI" : "NO");
+    printf("===========================\n");
 
-    ESP_LOGI(TAG, "Inferenza completata!");    
+    ESP_LOGI(TAG, "Inferenza YOLO completata!");
+}
 
-    // Dopo i nostri log manuali
-    ESP_LOGI(TAG, "=== TESTING ESP-DL POSTPROCESSOR ===");
+bool inference_yolo_detection(inference_t *inf, const uint8_t* jpeg_data, size_t jpeg_size, inference_result_t* result) {
+    inference_input_frame_t input = {};
+    input.data = jpeg_data;
+    input.size = jpeg_size;
+    input.format = INFERENCE_PIXEL_JPEG;
+    return inference_yolo_detection_frame(inf, &input, result);
+}
 
-    // Parametri per il postprocessor
-    float score_threshold = 0.3f;
-    float nms_threshold = 0.5f;
-    int resize_scale_x = 320;  // Dimensione input
+//inferenza con modello Yolo (i tre stadi in sequenza, senza pipeline)
+bool inference_yolo_detection_frame(inference_t *inf, const inference_input_frame_t* input, inference_result_t* result) {
+    
+    if (!inf || !inf->initialized || inf->yolo_num_variants == 0 || !input || !input->data || !result) {
+        ESP_LOGE(TAG, "Sistema di inferenza non inizializzato");
+        return false;
+    }
 
-    // Crea le stages per YOLO11 (3 scale: 40x40, 20x20, 10x10)
-    std::vector<dl::detect::anchor_point_stage_t> stages = {
-        {8, 8, 0, 0},   // score0/box0: 40x40, stride 8
-        {16, 16, 0, 0}, // score1/box1: 20x20, stride 16  
-        {32, 32, 0, 0}  // score2/box2: 10x10, stride 32
-    };
+    // Debug memoria
+    ESP_LOGI(TAG, "PSRAM libera: %d bytes", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    ESP_LOGI(TAG, "Memoria interna libera: %d bytes", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+
+    // Acquisisce l'arena per tutta la durata del frame (serializza anche l'accesso al tensore di input)
+    if (!inference_arena_begin(&inf->arena, pdMS_TO_TICKS(5000))) {
+        ESP_LOGE(TAG, "Arena dei buffer di inferenza non disponibile");
+        return false;
+    }
+
+    // Stato del frame nell'arena; l'input viene scritto direttamente nel tensore del modello
+    inference_yolo_frame_t* frame = (inference_yolo_frame_t*)inference_arena_alloc(&inf->arena,
+                                                                                   sizeof(inference_yolo_frame_t), 4);
+    if (!frame) {
+        inference_arena_end(&inf->arena);
+        return false;
+    }
+    frame->input = NULL;
 
-    // Crea il postprocessor
-    dl::detect::yolo11PostProcessor postprocessor(model, score_threshold, nms_threshold, resize_scale_x, stages);
+    bool ok = inference_yolo_prepare(inf, input, frame) &&
+              inference_yolo_execute(inf, frame, false);
+    if (ok) {
+        inference_yolo_finish(inf, frame, result);
+    }
 
-    // Esegui postprocessing
-    postprocessor.postprocess();
+    inference_arena_end(&inf->arena);
+    return ok;
+}
 
-    // Ottieni i risultati (metodo corretto)
-    auto results = postprocessor.get_result(320, 320);  // width=320, height=320
+bool inference_yolo_set_class_filter(inference_t *inf, const uint32_t* class_ids, size_t num_classes) {
+    if (!inf || (num_classes > 0 && !class_ids)) {
+        return false;
+    }
 
-    // Stampa i risultati
-    ESP_LOGI(TAG, "Risultati ESP-DL postprocessor: %d detection", results.size());
-    for (const auto& result : results) {
-        ESP_LOGI(TAG, "Risultato: score=%.6f, box: [%d,%d,%d,%d]", 
-                 result.score, result.box[0], result.box[1], result.box[2], result.box[3]);
+    yolo_scan_config_t* config = &inf->yolo_scan_config;
+    uint8_t mask[YOLO_MAX_CLASSES];
+    memset(mask, num_classes == 0 ? 0xFF : 0x00, sizeof(mask));
+    for (size_t i = 0; i < num_classes; i++) {
+        if (class_ids[i] >= (uint32_t)config->num_classes) {
+            ESP_LOGE(TAG, "Classe YOLO non valida: %lu", class_ids[i]);
+            return false;
+        }
+        mask[class_ids[i]] = 0xFF;
+    }
+    // La scansione sulla task di inferenza copia la configurazione sotto lo stesso lock
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    memcpy(config->class_mask, mask, sizeof(mask));
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    if (num_classes == 0) {
+        ESP_LOGI(TAG, "Filtro classi YOLO disattivato (tutte le classi abilitate)");
+    } else {
+        ESP_LOGI(TAG, "Filtro classi YOLO impostato (%zu classi abilitate)", num_classes);
     }
+    return true;
+}
 
-    // Libera memoria
-    heap_caps_free(img.data);
-    heap_caps_free(resized_img.data);
-    heap_caps_free(float_data);
+bool inference_yolo_set_score_threshold(inference_t *inf, float score_threshold) {
+    if (!inf || score_threshold <= 0.0f || score_threshold >= 1.0f) {
+        return false;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    inf->yolo_scan_config.score_threshold = score_threshold;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    return true;
+}
 
-    ESP_LOGI(TAG, "Inferenza YOLO completata!");
+bool inference_yolo_set_top_k(inference_t *inf, uint32_t top_k) {
+    if (!inf || top_k == 0 || top_k > MAX_YOLO_DETECTIONS) {
+        return false;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    inf->yolo_top_k = top_k;
+    for (uint32_t i = 0; i < inf->yolo_num_variants; i++) {
+        inf->yolo_variants[i].decoder.top_k = (int)top_k;
+    }
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    return true;
+}
+
+void inference_yolo_set_latency_budget(inference_t *inf, uint32_t budget_ms) {
+    if (!inf) {
+        return;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    inf->yolo_latency_budget_ms = budget_ms;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    ESP_LOGI(TAG, "Budget di latenza YOLO: %lu ms%s", budget_ms, budget_ms == 0 ? " (selezione adattiva disattivata)" : "");
+}
 
+void inference_yolo_note_backlog(inference_t *inf, uint32_t pending) {
+    if (!inf) {
+        return;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    inf->yolo_backlog = pending;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+}
+
+bool inference_yolo_get_variant_stats(inference_t *inf, uint32_t index, inference_yolo_variant_stats_t* stats) {
+    if (!inf || !stats || index >= inf->yolo_num_variants) {
+        return false;
+    }
+    const inference_yolo_variant_t* variant = &inf->yolo_variants[index];
+    stats->name = variant->name;
+    stats->input_width = variant->desc.input_width;
+    stats->input_height = variant->desc.input_height;
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    stats->runs = variant->runs;
+    stats->last_ms = variant->last_ms;
+    stats->p95_ms = variant->p95_ms;
+    stats->active = index == inf->yolo_active_variant;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
     return true;
 }
 
+void inference_print_yolo_variants(inference_t *inf) {
+    if (!inf) {
+        return;
+    }
+    taskENTER_CRITICAL(&inf->yolo_variant_lock);
+    uint32_t budget_ms = inf->yolo_latency_budget_ms;
+    uint32_t switches = inf->yolo_variant_switches;
+    taskEXIT_CRITICAL(&inf->yolo_variant_lock);
+    printf("\n=== VARIANTI YOLO ===\n");
+    printf("Budget latenza: %lu ms, cambi di variante: %lu\n", budget_ms, switches);
+    inference_yolo_variant_stats_t stats;
+    for (uint32_t i = 0; inference_yolo_get_variant_stats(inf, i, &stats); i++) {
+        printf("%c %s: input %dx%d, frame %lu, ultimo %lu ms, p95 %lu ms\n", stats.active ? '*' : ' ',
+               stats.name, stats.input_width, stats.input_height, stats.runs, stats.last_ms, stats.p95_ms);
+    }
+    printf("=====================\n\n");
+}
+
 bool inference_face_detector_init(inference_t *inf) {
     
     if (!inf || !inf->initialized) {
@@ -451,6 +826,13 @@ bool inference_face_detector_init(inference_t *inf) {
     
     ESP_LOGI(TAG, "Inizializzazione face detector HumanFaceDetect...");
 
+    // Arena dei buffer per-frame, dimensionata una volta sola sulla risoluzione massima
+    if (!inference_arena_reserve(&inf->arena, inference_arena_required_size(YOLO_INPUT_SIZE, YOLO_INPUT_SIZE),
+                                 MALLOC_CAP_SPIRAM)) {
+        ESP_LOGE(TAG, "Impossibile allocare l'arena dei buffer di inferenza");
+        return false;
+    }
+
     // Stampa task corrente
     TaskHandle_t current_task = xTaskGetCurrentTaskHandle();
     const char* task_name = pcTaskGetName(current_task);
@@ -485,8 +867,57 @@ bool inference_face_detector_init(inference_t *inf) {
     return true;
 }
 
+// Converte un frame RGB565 grezzo in RGB888 nell'arena, sottocampionato di 2^shift come la scala IDCT
+// del JPEG (la più piccola che copre min_width x min_height)
+static bool inference_rgb565_to_rgb888(inference_arena_t* arena, const inference_input_frame_t* input,
+                                       int min_width, int min_height, inference_image_t* img) {
+    if (input->width <= 0 || input->height <= 0 || input->size < (size_t)input->width * input->height * 2) {
+        ESP_LOGE(TAG, "Frame RGB565 non valido: %dx%d, %zu bytes", input->width, input->height, input->size);
+        return false;
+    }
+    int shift = inference_jpeg_select_scale(input->width, input->height, min_width, min_height);
+    int width = input->width >> shift;
+    int height = input->height >> shift;
+    uint8_t* out = (uint8_t*)inference_arena_alloc(arena, (size_t)width * height * 3, 16);
+    if (!out) {
+        ESP_LOGE(TAG, "Errore allocazione memoria per conversione RGB565");
+        return false;
+    }
+
+    const int step = 1 << shift;
+    uint8_t* dst = out;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = input->data + (size_t)(y << shift) * input->width * 2;
+        for (int x = 0; x < width; x++) {
+            const uint8_t* p = row + (size_t)x * step * 2;
+            uint32_t v = ((uint32_t)p[0] << 8) | p[1];
+            uint32_t r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+            dst[0] = (uint8_t)((r << 3) | (r >> 2));
+            dst[1] = (uint8_t)((g << 2) | (g >> 4));
+            dst[2] = (uint8_t)((b << 3) | (b >> 2));
+            dst += 3;
+        }
+    }
+
+    img->data = out;
+    img->width = width;
+    img->height = height;
+    img->src_width = input->width;
+    img->src_height = input->height;
+    img->scale_shift = shift;
+    return true;
+}
+
 bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t jpeg_size, inference_result_t* result) {
-    if (!inf || !inf->initialized || !inf->face_detector_initialized || !jpeg_data || !result || !inf->face_detector) {
+    inference_input_frame_t input = {};
+    input.data = jpeg_data;
+    input.size = jpeg_size;
+    input.format = INFERENCE_PIXEL_JPEG;
+    return inference_face_detection_frame(inf, &input, result);
+}
+
+bool inference_face_detection_frame(inference_t *inf, const inference_input_frame_t* input, inference_result_t* result) {
+    if (!inf || !inf->initialized || !inf->face_detector_initialized || !input || !input->data || !result || !inf->face_detector) {
         ESP_LOGE(TAG, "Parametri non validi o sistema non inizializzato");
         return false;
     }
@@ -496,18 +927,29 @@ bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t
     //Preprocessing
     start_time_preprocessing = esp_timer_get_time() / 1000;  //inizia a contare tempo preprocessing
     
-    // Prepara struttura JPEG interpretabile dal decoder JPEG di ESP-DL
-    dl::image::jpeg_img_t jpeg_img = {
-        .data = (void*)jpeg_data,
-        .data_len = jpeg_size
-    };
+    // Acquisisce l'arena per tutta la durata del frame
+    if (!inference_arena_begin(&inf->arena, pdMS_TO_TICKS(5000))) {
+        ESP_LOGE(TAG, "Arena dei buffer di inferenza non disponibile");
+        return false;
+    }
     
-    // Decodifica JPEG grezzo della fotocamera in un formato RGB888 comprensibile con il modello
-    auto img = sw_decode_jpeg(jpeg_img, dl::image::DL_IMAGE_PIX_TYPE_RGB888);
-    if (!img.data) {
-        ESP_LOGE(TAG, "Errore decodifica JPEG");
+    // Decodifica JPEG grezzo della fotocamera in RGB888, alla scala IDCT più piccola utile al detector
+    // (i frame RGB565 vengono solo convertiti, con lo stesso sottocampionamento)
+    inference_image_t decoded = {};
+    bool converted = input->format == INFERENCE_PIXEL_RGB565
+        ? inference_rgb565_to_rgb888(&inf->arena, input, FACE_DETECT_MIN_INPUT_WIDTH, FACE_DETECT_MIN_INPUT_HEIGHT, &decoded)
+        : inference_jpeg_decode_scaled(&inf->arena, input->data, input->size,
+                                       FACE_DETECT_MIN_INPUT_WIDTH, FACE_DETECT_MIN_INPUT_HEIGHT, &decoded);
+    if (!converted) {
+        inference_arena_end(&inf->arena);
         return false;
     }
+    dl::image::img_t img = {};
+    img.data = decoded.data;
+    img.width = decoded.width;
+    img.height = decoded.height;
+    img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    const int shift = decoded.scale_shift; // coordinate riportate alla risoluzione del frame originale
     end_time_preprocessing = esp_timer_get_time() / 1000; //smetti di contare tempo preprocessing
 
     bool face_detected = false;
@@ -539,13 +981,13 @@ bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t
             
             //popola le bounding boxes
             for (int j = 0; j < 4; j++) {
-                result->faces[face_index].bounding_boxes[j] = res.box[j];
+                result->faces[face_index].bounding_boxes[j] = res.box[j] * (1 << shift);
             }
 
             //popola le keypoints con ciclo
-            result->faces[face_index].num_keypoints = res.keypoint.size();
-            for (size_t k = 0; k < res.keypoint.size(); k++) {
-                result->faces[face_index].keypoints[k] = res.keypoint[k];
+            result->faces[face_index].num_keypoints = res.keypoint.size() < 10 ? res.keypoint.size() : 10;
+            for (size_t k = 0; k < result->faces[face_index].num_keypoints; k++) {
+                result->faces[face_index].keypoints[k] = res.keypoint[k] * (1 << shift);
             }
 
             result->faces[face_index].confidence = res.score;
@@ -569,14 +1011,8 @@ bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t
     }
 
 
-    // Libera memoria immagine
-    heap_caps_free(img.data);
-    
-    // Aggiorna statistiche
-    inf->stats.total_inferences++;
-    inf->stats.avg_inference_time_ms = 
-        (inf->stats.avg_inference_time_ms * (inf->stats.total_inferences - 1) + result->full_inference_time_ms) / 
-        inf->stats.total_inferences;
+    // Rilascia l'arena (il buffer dell'immagine verrà riusato dal prossimo frame)
+    inference_arena_end(&inf->arena);
 
     end_time_postprocessing = esp_timer_get_time() / 1000; //smetti di contare tempo postprocessing
     end_time_full_inference = esp_timer_get_time() / 1000; //smetti di contare tempo inferenza totale
@@ -587,7 +1023,9 @@ bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t
     result->preprocessing_time_ms = end_time_preprocessing - start_time_preprocessing;
     result->postprocessing_time_ms = end_time_postprocessing - start_time_postprocessing;
     result->full_inference_time_ms = end_time_full_inference - start_time_full_inference;
-  
+
+    // Aggiorna statistiche
+    inference_record_stats(inf, result->full_inference_time_ms);
 
 
     // Stampa i risultati per CLI
@@ -620,10 +1058,36 @@ bool inference_face_detection(inference_t *inf, const uint8_t* jpeg_data, size_t
 
 void inference_get_stats(inference_t *inf, inference_stats_t* result_stats) {
     if (result_stats && inf) {
+        taskENTER_CRITICAL(&inf->stats_lock);
         memcpy(result_stats, &inf->stats, sizeof(inference_stats_t));
+        taskEXIT_CRITICAL(&inf->stats_lock);
     }
 }
 
+void inference_get_arena_stats(inference_t *inf, inference_arena_stats_t* stats) {
+    if (inf && stats) {
+        inference_arena_get_stats(&inf->arena, stats);
+    }
+}
+
+void inference_print_arena_stats(inference_t *inf) {
+    inference_arena_stats_t stats;
+    if (!inf) {
+        return;
+    }
+    inference_arena_get_stats(&inf->arena, &stats);
+
+    printf("\n=== ARENA BUFFER INFERENZA ===\n");
+    printf("Capacità: %zu bytes (%.1f MB)\n", stats.capacity, (float)stats.capacity / 1024 / 1024);
+    printf("High-water: %zu bytes (%.1f%%)\n", stats.high_water,
+           stats.capacity ? (float)stats.high_water / stats.capacity * 100 : 0.0f);
+    printf("Ultimo frame: %zu bytes\n", stats.last_frame_used);
+    printf("Frame serviti: %lu\n", stats.frames);
+    printf("Allocazioni fallite: %lu\n", stats.alloc_failures);
+    printf("Timeout acquisizione: %lu\n", stats.lock_timeouts);
+    printf("==============================\n\n");
+}
+
 void inference_face_detector_deinit(inference_t *inf) {
     if (!inf || !inf->face_detector_initialized) {
         return;
@@ -646,10 +1110,27 @@ void inference_deinit(inference_t *inf) {
         return;
     }
     
+    // Le task della pipeline usano varianti e arena anche dopo il rilascio del frame della camera:
+    // va fermata prima (inference_executor_stop)
+    if (get_inference_pipeline_instance()->running) {
+        ESP_LOGE(TAG, "Pipeline YOLO ancora avviata: deinizializzazione annullata");
+        return;
+    }
+
     ESP_LOGI(TAG, "Deinizializzazione sistema di inferenza...");
     
     // Deinizializza prima il face detector
     inference_face_detector_deinit(inf);
+
+    // Libera le varianti del modello YOLO
+    for (uint32_t i = 0; i < inf->yolo_num_variants; i++) {
+        inference_yolo_release_variant(&inf->yolo_variants[i]);
+    }
+    inf->yolo_num_variants = 0;
+    inf->yolo_model_initialized = false;
+
+    // Libera l'arena dei buffer per-frame
+    inference_arena_deinit(&inf->arena);
     
     inf->initialized = false;
     ESP_LOGI(TAG, "Sistema di inferenza deinizializzato");
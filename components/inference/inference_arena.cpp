@@ -0,0 +1,150 @@
+#include "inference_arena.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char* TAG = "INFERENCE_ARENA";
+
+bool inference_arena_reserve(inference_arena_t *arena, size_t capacity, uint32_t caps)
+{
+    if (!arena) {
+        return false;
+    }
+
+    if (!arena->lock) {
+        arena->lock = xSemaphoreCreateMutex();
+        if (!arena->lock) {
+            ESP_LOGE(TAG, "Errore creazione mutex arena");
+            return false;
+        }
+    }
+
+    if (arena->base && arena->capacity >= capacity) {
+        return true;
+    }
+
+    xSemaphoreTake(arena->lock, portMAX_DELAY);
+
+    if (arena->base) {
+        ESP_LOGI(TAG, "Ridimensionamento arena: %zu -> %zu bytes", arena->capacity, capacity);
+        heap_caps_free(arena->base);
+        arena->base = NULL;
+        arena->capacity = 0;
+    }
+
+    arena->base = (uint8_t *)heap_caps_aligned_alloc(16, capacity, caps | MALLOC_CAP_8BIT);
+    if (!arena->base) {
+        ESP_LOGE(TAG, "Errore allocazione arena di %zu bytes (blocco libero max: %zu bytes)",
+                 capacity, heap_caps_get_largest_free_block(caps | MALLOC_CAP_8BIT));
+        xSemaphoreGive(arena->lock);
+        return false;
+    }
+
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->caps = caps;
+    arena->stats.capacity = capacity;
+    ESP_LOGI(TAG, "Arena allocata: %zu bytes", capacity);
+
+    xSemaphoreGive(arena->lock);
+    return true;
+}
+
+bool inference_arena_begin(inference_arena_t *arena, TickType_t timeout)
+{
+    if (!arena || !arena->base || !arena->lock) {
+        return false;
+    }
+
+    if (xSemaphoreTake(arena->lock, timeout) != pdTRUE) {
+        arena->stats.lock_timeouts++;
+        ESP_LOGW(TAG, "Timeout acquisizione arena");
+        return false;
+    }
+
+    arena->offset = 0;
+    return true;
+}
+
+void *inference_arena_alloc(inference_arena_t *arena, size_t size, size_t align)
+{
+    if (!arena || !arena->base || size == 0) {
+        return NULL;
+    }
+
+    if (align < 4) {
+        align = 4;
+    }
+
+    size_t start = (arena->offset + align - 1) & ~(align - 1);
+    if (start + size > arena->capacity) {
+        arena->stats.alloc_failures++;
+        ESP_LOGE(TAG, "Arena esaurita: richiesti %zu bytes, liberi %zu bytes",
+                 size, arena->capacity - arena->offset);
+        return NULL;
+    }
+
+    arena->offset = start + size;
+    return arena->base + start;
+}
+
+size_t inference_arena_mark(inference_arena_t *arena)
+{
+    return arena ? arena->offset : 0;
+}
+
+void inference_arena_rewind(inference_arena_t *arena, size_t mark)
+{
+    if (arena && mark <= arena->offset) {
+        // conserva il picco raggiunto prima del rewind
+        if (arena->offset > arena->stats.high_water) {
+            arena->stats.high_water = arena->offset;
+        }
+        arena->offset = mark;
+    }
+}
+
+void inference_arena_end(inference_arena_t *arena)
+{
+    if (!arena || !arena->lock) {
+        return;
+    }
+
+    arena->stats.frames++;
+    arena->stats.last_frame_used = arena->offset;
+    if (arena->offset > arena->stats.high_water) {
+        arena->stats.high_water = arena->offset;
+    }
+    arena->offset = 0;
+
+    xSemaphoreGive(arena->lock);
+}
+
+void inference_arena_get_stats(inference_arena_t *arena, inference_arena_stats_t *stats)
+{
+    if (arena && stats) {
+        memcpy(stats, &arena->stats, sizeof(inference_arena_stats_t));
+    }
+}
+
+void inference_arena_deinit(inference_arena_t *arena)
+{
+    if (!arena) {
+        return;
+    }
+
+    if (arena->lock) {
+        xSemaphoreTake(arena->lock, portMAX_DELAY);
+    }
+
+    if (arena->base) {
+        heap_caps_free(arena->base);
+    }
+
+    if (arena->lock) {
+        xSemaphoreGive(arena->lock);
+        vSemaphoreDelete(arena->lock);
+    }
+
+    memset(arena, 0, sizeof(inference_arena_t));
+}
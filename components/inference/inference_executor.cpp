@@ -0,0 +1,575 @@
+#include "inference_executor.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char* TAG = "INFERENCE_EXECUTOR";
+
+// Variabile globale dell'executor (singleton come g_inference)
+inference_executor_t g_inference_executor;
+
+inference_executor_t* get_inference_executor_instance(void) {
+    return &g_inference_executor;
+}
+
+static void executor_finish(inference_executor_t *exec, inference_job_t *job, inference_job_status_t status,
+                            inference_result_t *result) {
+    if (result) {
+        int64_t start_us = job->capture_time_us ? job->capture_time_us : job->submit_time_us;
+        result->end_to_end_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    }
+    if (job->release && job->jpeg_data) {
+        job->release(job->jpeg_data, job->release_ctx);
+    }
+    if (job->on_complete) {
+        job->on_complete(status, status == INFERENCE_JOB_DONE ? result : NULL, job->user_ctx);
+    }
+    if (status != INFERENCE_JOB_DONE || !result) {
+        return;
+    }
+    // Copia degli osservatori: la chiamata avviene fuori dalla sezione critica
+    inference_executor_listener_t listeners[INFERENCE_EXECUTOR_MAX_LISTENERS];
+    taskENTER_CRITICAL(&exec->listeners_lock);
+    memcpy(listeners, exec->listeners, sizeof(listeners));
+    taskEXIT_CRITICAL(&exec->listeners_lock);
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_LISTENERS; i++) {
+        if (listeners[i].fn) {
+            listeners[i].fn(job->type, result, listeners[i].ctx);
+        }
+    }
+}
+
+static inference_input_frame_t executor_job_input(const inference_job_t *job) {
+    inference_input_frame_t input = {};
+    input.data = job->jpeg_data;
+    input.size = job->jpeg_size;
+    input.format = job->format;
+    input.width = job->width;
+    input.height = job->height;
+    return input;
+}
+
+static void executor_account(inference_executor_t *exec, inference_priority_t priority, bool ok, uint32_t wait_ms) {
+    inference_executor_class_stats_t *stats = &exec->stats[priority];
+    taskENTER_CRITICAL(&exec->stats_lock);
+    if (ok) {
+        stats->completed++;
+    } else {
+        stats->failed++;
+    }
+    if (wait_ms > stats->max_wait_ms) {
+        stats->max_wait_ms = wait_ms;
+    }
+    taskEXIT_CRITICAL(&exec->stats_lock);
+}
+
+// Fine di un frame nella pipeline (task di postprocessing): il frame JPEG è già stato rilasciato
+static void executor_pipeline_done(const inference_result_t *result, void *user_ctx) {
+    inference_job_t *job = (inference_job_t *)user_ctx;
+    inference_executor_t *exec = get_inference_executor_instance();
+    executor_account(exec, job->priority, result != NULL, 0);
+    // Il risultato appartiene alla pipeline, che lo riusa solo dopo il ritorno della notifica
+    executor_finish(exec, job, result ? INFERENCE_JOB_DONE : INFERENCE_JOB_FAILED, (inference_result_t *)result);
+}
+
+static void executor_run_pipelined(inference_executor_t *exec, inference_job_t *job, uint32_t wait_ms) {
+    // Con al massimo INFERENCE_PIPELINE_FRAMES frame in volo, completati in ordine, la voce successiva è sempre libera
+    inference_job_t *inflight = &exec->pipeline_jobs[exec->pipeline_head % (INFERENCE_PIPELINE_FRAMES + 1)];
+    *inflight = *job;
+    inflight->jpeg_data = NULL;
+
+    inference_input_frame_t input = executor_job_input(job);
+    esp_err_t ret = inference_pipeline_submit(exec->pipeline, &input, executor_pipeline_done, inflight,
+                                              pdMS_TO_TICKS(5000));
+    // Il frame è già nell'input quantizzato: si libera subito, senza attendere modello e postprocessing
+    if (job->release && job->jpeg_data) {
+        job->release(job->jpeg_data, job->release_ctx);
+    }
+    if (ret != ESP_OK) {
+        executor_account(exec, job->priority, false, wait_ms);
+        executor_finish(exec, inflight, INFERENCE_JOB_FAILED, NULL);
+        return;
+    }
+    exec->pipeline_head++;
+
+    taskENTER_CRITICAL(&exec->stats_lock);
+    if (wait_ms > exec->stats[job->priority].max_wait_ms) {
+        exec->stats[job->priority].max_wait_ms = wait_ms;
+    }
+    taskEXIT_CRITICAL(&exec->stats_lock);
+}
+
+static void executor_run_job(inference_executor_t *exec, inference_job_t *job) {
+    inference_executor_class_stats_t *stats = &exec->stats[job->priority];
+    int64_t now = esp_timer_get_time();
+    uint32_t wait_ms = (uint32_t)((now - job->submit_time_us) / 1000);
+
+    // Frame vecchio: non ha senso spendere un'inferenza su di esso
+    if (job->deadline_us != 0 && now > job->deadline_us) {
+        ESP_LOGW(TAG, "Job %s scaduto dopo %lu ms in coda",
+                 job->priority == INFERENCE_PRIORITY_INTERACTIVE ? "interattivo" : "background", wait_ms);
+        taskENTER_CRITICAL(&exec->stats_lock);
+        stats->expired++;
+        taskEXIT_CRITICAL(&exec->stats_lock);
+        executor_finish(exec, job, INFERENCE_JOB_EXPIRED, NULL);
+        return;
+    }
+
+    bool ok = false;
+    inference_input_frame_t input = executor_job_input(job);
+    if (job->type == INFERENCE_JOB_YOLO) {
+        // Frame background ancora in coda: la selezione delle varianti scende al modello più economico
+        inference_yolo_note_backlog(exec->inf, uxQueueMessagesWaiting(exec->queues[INFERENCE_PRIORITY_BACKGROUND]));
+        if (exec->pipelined) {
+            executor_run_pipelined(exec, job, wait_ms);
+            return;
+        }
+        // Frame ancora in volo da una precedente attivazione della pipeline: usano gli stessi tensori
+        inference_pipeline_wait_idle(exec->pipeline, portMAX_DELAY);
+        ok = inference_yolo_detection_frame(exec->inf, &input, &exec->result);
+    } else {
+        ok = inference_face_detection_frame(exec->inf, &input, &exec->result);
+    }
+
+    executor_account(exec, job->priority, ok, wait_ms);
+    executor_finish(exec, job, ok ? INFERENCE_JOB_DONE : INFERENCE_JOB_FAILED, &exec->result);
+}
+
+static void executor_task(void *pvParameters) {
+    inference_executor_t *exec = (inference_executor_t *)pvParameters;
+    ESP_LOGI(TAG, "Executor avviato - in attesa di job...");
+
+    inference_job_t job;
+    while (true) {
+        // Una notifica per ogni job accodato (e una per l'arresto); le interattive vengono sempre servite per prime
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+        if (!exec->running) {
+            break;
+        }
+        exec->busy = true;
+        if (xQueueReceive(exec->queues[INFERENCE_PRIORITY_INTERACTIVE], &job, 0) == pdTRUE ||
+            xQueueReceive(exec->queues[INFERENCE_PRIORITY_BACKGROUND], &job, 0) == pdTRUE) {
+            executor_run_job(exec, &job);
+        }
+        exec->busy = false;
+    }
+
+    ESP_LOGI(TAG, "Executor fermato");
+    exec->task = NULL;
+    vTaskDelete(NULL);
+}
+
+// Job rimasti in coda all'arresto: completati come scartati (frame rilasciati, chi attende viene svegliato)
+static void executor_drop_queued(inference_executor_t *exec) {
+    inference_job_t job;
+    for (int p = 0; p < INFERENCE_PRIORITY_COUNT; p++) {
+        while (exec->queues[p] && xQueueReceive(exec->queues[p], &job, 0) == pdTRUE) {
+            taskENTER_CRITICAL(&exec->stats_lock);
+            exec->stats[p].dropped++;
+            taskEXIT_CRITICAL(&exec->stats_lock);
+            executor_finish(exec, &job, INFERENCE_JOB_DROPPED, NULL);
+        }
+    }
+}
+
+// Libera ciò che un avvio non riuscito ha già creato (la task dell'executor è l'ultima a partire,
+// quindi nessuno attende ancora su code e semafori)
+static void executor_release(inference_executor_t *exec) {
+    for (int i = 0; i < INFERENCE_PRIORITY_COUNT; i++) {
+        if (exec->queues[i]) {
+            vQueueDelete(exec->queues[i]);
+        }
+    }
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_FUTURES; i++) {
+        if (exec->futures[i].done) {
+            vSemaphoreDelete(exec->futures[i].done);
+        }
+    }
+    memset(exec, 0, sizeof(inference_executor_t));
+}
+
+esp_err_t inference_executor_start(inference_executor_t *exec, inference_t *inf) {
+    if (!exec || !inf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (exec->running) {
+        ESP_LOGW(TAG, "Executor già avviato");
+        return ESP_OK;
+    }
+    if (exec->task) {
+        ESP_LOGE(TAG, "Arresto dell'executor non ancora completato");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Riavvio dopo inference_executor_stop: code, slot di risposta, osservatori e statistiche restano
+    if (exec->queues[INFERENCE_PRIORITY_INTERACTIVE]) {
+        exec->inf = inf;
+        exec->running = true;
+        if (xTaskCreatePinnedToCore(executor_task, "inference_exec", INFERENCE_EXECUTOR_STACK_SIZE, exec,
+                                    INFERENCE_EXECUTOR_PRIORITY, &exec->task, INFERENCE_EXECUTOR_CORE) != pdPASS) {
+            exec->task = NULL;
+            exec->running = false;
+            ESP_LOGE(TAG, "Errore creazione task dell'executor");
+            return ESP_ERR_NO_MEM;
+        }
+        ESP_LOGI(TAG, "Executor riavviato");
+        return ESP_OK;
+    }
+
+    memset(exec, 0, sizeof(inference_executor_t));
+    exec->inf = inf;
+    portMUX_INITIALIZE(&exec->stats_lock);
+    portMUX_INITIALIZE(&exec->futures_lock);
+    portMUX_INITIALIZE(&exec->listeners_lock);
+
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_FUTURES; i++) {
+        exec->futures[i].done = xSemaphoreCreateBinary();
+        if (!exec->futures[i].done) {
+            ESP_LOGE(TAG, "Errore creazione semafori di risposta");
+            executor_release(exec);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    exec->queues[INFERENCE_PRIORITY_INTERACTIVE] = xQueueCreate(INFERENCE_EXECUTOR_INTERACTIVE_DEPTH, sizeof(inference_job_t));
+    exec->queues[INFERENCE_PRIORITY_BACKGROUND] = xQueueCreate(INFERENCE_EXECUTOR_BACKGROUND_DEPTH, sizeof(inference_job_t));
+    if (!exec->queues[INFERENCE_PRIORITY_INTERACTIVE] || !exec->queues[INFERENCE_PRIORITY_BACKGROUND]) {
+        ESP_LOGE(TAG, "Errore creazione code dell'executor");
+        executor_release(exec);
+        return ESP_ERR_NO_MEM;
+    }
+
+    exec->running = true;
+    if (xTaskCreatePinnedToCore(executor_task, "inference_exec", INFERENCE_EXECUTOR_STACK_SIZE, exec,
+                                INFERENCE_EXECUTOR_PRIORITY, &exec->task, INFERENCE_EXECUTOR_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Errore creazione task dell'executor");
+        executor_release(exec);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Executor avviato (code: %d interattive, %d background)",
+             INFERENCE_EXECUTOR_INTERACTIVE_DEPTH, INFERENCE_EXECUTOR_BACKGROUND_DEPTH);
+    return ESP_OK;
+}
+
+esp_err_t inference_executor_stop(inference_executor_t *exec, TickType_t timeout) {
+    if (!exec) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    TickType_t start = xTaskGetTickCount();
+    // Nessun nuovo job; la task termina il job in corso ed esce alla notifica successiva
+    exec->running = false;
+    if (exec->task) {
+        xTaskNotifyGive(exec->task);
+    }
+    while (exec->task) {
+        if (xTaskGetTickCount() - start >= timeout) {
+            ESP_LOGW(TAG, "Job ancora in esecuzione: executor non fermato");
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    // Con la task uscita nessuno legge più le code: i job rimasti vengono scartati qui
+    executor_drop_queued(exec);
+
+    // I frame già preparati usano ancora modelli e tensori sugli altri stadi
+    if (exec->pipeline) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        esp_err_t ret = inference_pipeline_stop(exec->pipeline, elapsed < timeout ? timeout - elapsed : 0);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        exec->pipeline = NULL;
+    }
+    exec->pipelined = false;
+    ESP_LOGI(TAG, "Executor fermato: nessun modello in uso");
+    return ESP_OK;
+}
+
+bool inference_executor_wait_idle(inference_executor_t *exec, TickType_t timeout) {
+    if (!exec) {
+        return true;
+    }
+    TickType_t start = xTaskGetTickCount();
+    while (exec->busy ||
+           (exec->queues[INFERENCE_PRIORITY_INTERACTIVE] && uxQueueMessagesWaiting(exec->queues[INFERENCE_PRIORITY_INTERACTIVE]) > 0) ||
+           (exec->queues[INFERENCE_PRIORITY_BACKGROUND] && uxQueueMessagesWaiting(exec->queues[INFERENCE_PRIORITY_BACKGROUND]) > 0)) {
+        if (xTaskGetTickCount() - start >= timeout) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    return inference_pipeline_wait_idle(exec->pipeline, elapsed < timeout ? timeout - elapsed : 0);
+}
+
+esp_err_t inference_executor_submit(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout) {
+    if (!exec || !job || !job->jpeg_data || job->priority >= INFERENCE_PRIORITY_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!exec->running) {
+        ESP_LOGE(TAG, "Executor non avviato");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    inference_job_t queued = *job;
+    queued.submit_time_us = esp_timer_get_time();
+    QueueHandle_t queue = exec->queues[job->priority];
+    inference_executor_class_stats_t *stats = &exec->stats[job->priority];
+
+    if (job->priority == INFERENCE_PRIORITY_BACKGROUND) {
+        // Coda piena: scarta il frame più vecchio invece di accumulare ritardo
+        while (xQueueSend(queue, &queued, 0) != pdTRUE) {
+            inference_job_t oldest;
+            if (xQueueReceive(queue, &oldest, 0) == pdTRUE) {
+                taskENTER_CRITICAL(&exec->stats_lock);
+                stats->dropped++;
+                taskEXIT_CRITICAL(&exec->stats_lock);
+                executor_finish(exec, &oldest, INFERENCE_JOB_DROPPED, NULL);
+            }
+        }
+    } else if (xQueueSend(queue, &queued, timeout) != pdTRUE) {
+        taskENTER_CRITICAL(&exec->stats_lock);
+        stats->rejected++;
+        taskEXIT_CRITICAL(&exec->stats_lock);
+        ESP_LOGW(TAG, "Coda interattiva piena, richiesta rifiutata");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    taskENTER_CRITICAL(&exec->stats_lock);
+    stats->submitted++;
+    taskEXIT_CRITICAL(&exec->stats_lock);
+    xTaskNotifyGive(exec->task);
+    return ESP_OK;
+}
+
+// Completamento di un job asincrono: copia il risultato nello slot e sveglia chi attende
+static void executor_future_complete(inference_job_status_t status, const inference_result_t *result, void *user_ctx) {
+    inference_future_t *future = (inference_future_t *)user_ctx;
+    inference_executor_t *exec = get_inference_executor_instance();
+
+    if (future->on_complete) {
+        future->on_complete(status, result, future->user_ctx);
+    }
+
+    if (result) {
+        memcpy(&future->result, result, sizeof(inference_result_t));
+    }
+    future->status = status;
+
+    bool notify = false;
+    taskENTER_CRITICAL(&exec->futures_lock);
+    if (future->abandoned) {
+        future->state = INFERENCE_FUTURE_FREE;
+    } else {
+        future->state = INFERENCE_FUTURE_READY;
+        notify = true;
+    }
+    taskEXIT_CRITICAL(&exec->futures_lock);
+
+    if (notify) {
+        xSemaphoreGive(future->done);
+    }
+}
+
+esp_err_t inference_executor_submit_async(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout,
+                                          inference_handle_t *handle) {
+    if (!exec || !job || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!exec->running) {
+        ESP_LOGE(TAG, "Executor non avviato");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    inference_future_t *future = NULL;
+    taskENTER_CRITICAL(&exec->futures_lock);
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_FUTURES; i++) {
+        if (exec->futures[i].state == INFERENCE_FUTURE_FREE) {
+            future = &exec->futures[i];
+            future->state = INFERENCE_FUTURE_PENDING;
+            future->abandoned = false;
+            future->notified = false;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&exec->futures_lock);
+
+    if (!future) {
+        ESP_LOGW(TAG, "Nessuno slot di risposta libero (%d richieste in volo)", INFERENCE_EXECUTOR_MAX_FUTURES);
+        return ESP_ERR_NO_MEM;
+    }
+
+    future->status = INFERENCE_JOB_FAILED;
+    future->on_complete = job->on_complete;
+    future->user_ctx = job->user_ctx;
+
+    inference_job_t async_job = *job;
+    async_job.on_complete = executor_future_complete;
+    async_job.user_ctx = future;
+
+    esp_err_t ret = inference_executor_submit(exec, &async_job, timeout);
+    if (ret != ESP_OK) {
+        taskENTER_CRITICAL(&exec->futures_lock);
+        future->state = INFERENCE_FUTURE_FREE;
+        taskEXIT_CRITICAL(&exec->futures_lock);
+        return ret;
+    }
+
+    *handle = future;
+    return ESP_OK;
+}
+
+esp_err_t inference_executor_wait(inference_executor_t *exec, inference_handle_t handle, TickType_t timeout,
+                                  inference_result_t *result, inference_job_status_t *status) {
+    if (!exec || !handle || handle->state == INFERENCE_FUTURE_FREE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Il semaforo viene dato una sola volta: una seconda attesa sullo stesso handle non blocca
+    if (!handle->notified) {
+        if (xSemaphoreTake(handle->done, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        handle->notified = true;
+    }
+
+    if (status) {
+        *status = handle->status;
+    }
+    if (result && handle->status == INFERENCE_JOB_DONE) {
+        memcpy(result, &handle->result, sizeof(inference_result_t));
+    }
+    return ESP_OK;
+}
+
+void inference_executor_release(inference_executor_t *exec, inference_handle_t handle) {
+    if (!exec || !handle) {
+        return;
+    }
+
+    bool ready = false;
+    taskENTER_CRITICAL(&exec->futures_lock);
+    if (handle->state == INFERENCE_FUTURE_READY) {
+        ready = true;
+    } else if (handle->state == INFERENCE_FUTURE_PENDING) {
+        handle->abandoned = true;
+    }
+    taskEXIT_CRITICAL(&exec->futures_lock);
+
+    if (ready) {
+        // Consuma la notifica (data subito dopo il passaggio a READY) prima di riusare lo slot
+        if (!handle->notified) {
+            xSemaphoreTake(handle->done, portMAX_DELAY);
+        }
+        taskENTER_CRITICAL(&exec->futures_lock);
+        handle->state = INFERENCE_FUTURE_FREE;
+        taskEXIT_CRITICAL(&exec->futures_lock);
+    }
+}
+
+esp_err_t inference_executor_run_sync(inference_executor_t *exec, const inference_job_t *job, TickType_t timeout,
+                                      inference_result_t *result, inference_job_status_t *status) {
+    inference_handle_t handle = NULL;
+    esp_err_t ret = inference_executor_submit_async(exec, job, timeout, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Una volta accodato il job viene sempre completato (eseguito, scaduto o scartato):
+    // l'attesa è limitata dalla scadenza del job e dalla durata di un'inferenza
+    ret = inference_executor_wait(exec, handle, portMAX_DELAY, result, status);
+    inference_executor_release(exec, handle);
+    return ret;
+}
+
+esp_err_t inference_executor_set_pipelined(inference_executor_t *exec, bool enable) {
+    if (!exec || !exec->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (enable && !exec->pipeline) {
+        inference_pipeline_t *pipe = get_inference_pipeline_instance();
+        esp_err_t ret = inference_pipeline_start(pipe, exec->inf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Impossibile avviare la pipeline YOLO: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        exec->pipeline = pipe;
+    }
+    exec->pipelined = enable;
+    ESP_LOGI(TAG, "Job YOLO %s", enable ? "in pipeline su due core" : "in sequenza");
+    return ESP_OK;
+}
+
+esp_err_t inference_executor_add_listener(inference_executor_t *exec, inference_result_listener_t fn, void *ctx) {
+    if (!exec || !fn) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!exec->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int free_slot = -1;
+    bool registered = false;
+    taskENTER_CRITICAL(&exec->listeners_lock);
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_LISTENERS; i++) {
+        if (exec->listeners[i].fn == fn && exec->listeners[i].ctx == ctx) {
+            registered = true;
+        } else if (!exec->listeners[i].fn && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (!registered && free_slot >= 0) {
+        exec->listeners[free_slot].fn = fn;
+        exec->listeners[free_slot].ctx = ctx;
+    }
+    taskEXIT_CRITICAL(&exec->listeners_lock);
+    esp_err_t ret = registered || free_slot >= 0 ? ESP_OK : ESP_ERR_NO_MEM;
+    return ret;
+}
+
+void inference_executor_remove_listener(inference_executor_t *exec, inference_result_listener_t fn, void *ctx) {
+    // Gli osservatori restano registrati anche con l'executor fermato
+    if (!exec) {
+        return;
+    }
+    taskENTER_CRITICAL(&exec->listeners_lock);
+    for (int i = 0; i < INFERENCE_EXECUTOR_MAX_LISTENERS; i++) {
+        if (exec->listeners[i].fn == fn && exec->listeners[i].ctx == ctx) {
+            exec->listeners[i].fn = NULL;
+            exec->listeners[i].ctx = NULL;
+        }
+    }
+    taskEXIT_CRITICAL(&exec->listeners_lock);
+}
+
+void inference_executor_get_stats(inference_executor_t *exec, inference_priority_t priority,
+                                  inference_executor_class_stats_t *stats) {
+    if (!exec || !stats || priority >= INFERENCE_PRIORITY_COUNT) {
+        return;
+    }
+    taskENTER_CRITICAL(&exec->stats_lock);
+    memcpy(stats, &exec->stats[priority], sizeof(inference_executor_class_stats_t));
+    taskEXIT_CRITICAL(&exec->stats_lock);
+}
+
+void inference_executor_print_stats(inference_executor_t *exec) {
+    if (!exec) {
+        return;
+    }
+    static const char *names[INFERENCE_PRIORITY_COUNT] = {"Interattive", "Background"};
+
+    printf("\n=== EXECUTOR INFERENZA ===\n");
+    for (int p = 0; p < INFERENCE_PRIORITY_COUNT; p++) {
+        inference_executor_class_stats_t stats;
+        inference_executor_get_stats(exec, (inference_priority_t)p, &stats);
+        printf("%s: inviate %lu, completate %lu, fallite %lu, scadute %lu, scartate %lu, rifiutate %lu, attesa max %lu ms, in coda %u\n",
+               names[p], stats.submitted, stats.completed, stats.failed, stats.expired, stats.dropped,
+               stats.rejected, stats.max_wait_ms,
+               exec->queues[p] ? (unsigned)uxQueueMessagesWaiting(exec->queues[p]) : 0);
+    }
+    printf("Modalità YOLO: %s\n", exec->pipelined ? "pipeline" : "sequenziale");
+    printf("==========================\n\n");
+    if (exec->pipeline) {
+        inference_pipeline_print_stats(exec->pipeline);
+    }
+}
@@ -0,0 +1,202 @@
+#include "inference_jpeg.h"
+#include "esp_log.h"
+#include "esp_jpeg_dec.h"
+#include <string.h>
+
+static const char* TAG = "INFERENCE_JPEG";
+
+bool inference_jpeg_get_dimensions(const uint8_t *jpeg_data, size_t jpeg_size, int *width, int *height)
+{
+    if (!jpeg_data || jpeg_size < 4 || jpeg_data[0] != 0xFF || jpeg_data[1] != 0xD8) {
+        return false;
+    }
+
+    // Scorre i segmenti fino al primo SOF (baseline, progressive, ...)
+    size_t i = 2;
+    while (i + 4 <= jpeg_size) {
+        if (jpeg_data[i] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpeg_data[i + 1];
+        if (marker == 0xFF) { // byte di riempimento
+            i++;
+            continue;
+        }
+        size_t seg_len = ((size_t)jpeg_data[i + 2] << 8) | jpeg_data[i + 3];
+        bool is_sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (is_sof) {
+            if (i + 9 > jpeg_size) {
+                return false;
+            }
+            *height = (jpeg_data[i + 5] << 8) | jpeg_data[i + 6];
+            *width = (jpeg_data[i + 7] << 8) | jpeg_data[i + 8];
+            return *width > 0 && *height > 0;
+        }
+        if (marker == 0xDA) { // inizio dei dati senza SOF
+            return false;
+        }
+        i += 2 + seg_len;
+    }
+    return false;
+}
+
+int inference_jpeg_select_scale(int width, int height, int min_width, int min_height)
+{
+    for (int shift = INFERENCE_JPEG_MAX_SCALE_SHIFT; shift > 0; shift--) {
+        // Il decoder accetta solo dimensioni esatte 1/2^n
+        if ((width & ((1 << shift) - 1)) || (height & ((1 << shift) - 1))) {
+            continue;
+        }
+        if ((width >> shift) >= min_width && (height >> shift) >= min_height) {
+            return shift;
+        }
+    }
+    return 0;
+}
+
+size_t inference_jpeg_decoded_size(int width, int height, int min_width, int min_height)
+{
+    int shift = inference_jpeg_select_scale(width, height, min_width, min_height);
+    // margine per l'ultimo blocco di righe MCU (fino a 16 righe)
+    size_t w = (size_t)(width >> shift);
+    size_t h = (size_t)(((height >> shift) + 15) & ~15);
+    return w * h * 3;
+}
+
+size_t inference_jpeg_block_size(int width, int height, int min_width, int min_height)
+{
+    int shift = inference_jpeg_select_scale(width, height, min_width, min_height);
+    // un blocco è al massimo una riga di MCU da 16 righe
+    return (size_t)(width >> shift) * 16 * 3;
+}
+
+// Con rows_cb i blocchi di righe MCU passano tutti per un unico buffer da block_len byte,
+// altrimenti ogni blocco viene decodificato direttamente nella sua posizione nell'immagine intera
+static bool decode_blocks(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                          int src_width, int src_height, int shift,
+                          inference_jpeg_rows_cb_t rows_cb, void *ctx, inference_image_t *img)
+{
+    jpeg_dec_config_t config = DEFAULT_JPEG_DEC_CONFIG();
+    config.output_type = JPEG_PIXEL_FORMAT_RGB888;
+    config.block_enable = true;
+    if (shift > 0) {
+        config.scale.width = src_width >> shift;
+        config.scale.height = src_height >> shift;
+    }
+
+    jpeg_dec_handle_t decoder = NULL;
+    if (jpeg_dec_open(&config, &decoder) != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "Errore apertura decoder JPEG");
+        return false;
+    }
+
+    jpeg_dec_io_t io = {};
+    jpeg_dec_header_info_t header = {};
+    io.inbuf = (uint8_t *)jpeg_data;
+    io.inbuf_len = jpeg_size;
+
+    bool ok = false;
+    int block_len = 0;
+    int process_count = 0;
+    if (jpeg_dec_parse_header(decoder, &io, &header) != JPEG_ERR_OK ||
+        jpeg_dec_get_outbuf_len(decoder, &block_len) != JPEG_ERR_OK ||
+        jpeg_dec_get_process_count(decoder, &process_count) != JPEG_ERR_OK ||
+        block_len <= 0 || process_count <= 0) {
+        ESP_LOGE(TAG, "Header JPEG non valido");
+        jpeg_dec_close(decoder);
+        return false;
+    }
+
+    img->data = NULL;
+    img->width = src_width >> shift;
+    img->height = src_height >> shift;
+    img->src_width = src_width;
+    img->src_height = src_height;
+    img->scale_shift = shift;
+
+    size_t row_bytes = (size_t)img->width * 3;
+    int block_rows = (int)((size_t)block_len / row_bytes);
+    if (rows_cb && (block_rows <= 0 || (size_t)block_len % row_bytes != 0)) {
+        ESP_LOGE(TAG, "Blocco di %d byte non allineato alle righe (%u byte)", block_len, (unsigned)row_bytes);
+        jpeg_dec_close(decoder);
+        return false;
+    }
+
+    size_t total = rows_cb ? (size_t)block_len : (size_t)block_len * process_count;
+    uint8_t *out = (uint8_t *)inference_arena_alloc(arena, total, 16);
+    if (!out) {
+        ESP_LOGE(TAG, "Frame %dx%d (scala 1/%d) troppo grande per l'arena", src_width, src_height, 1 << shift);
+    } else {
+        ok = true;
+        for (int block = 0; block < process_count; block++) {
+            io.outbuf = rows_cb ? out : out + (size_t)block * block_len;
+            if (jpeg_dec_process(decoder, &io) != JPEG_ERR_OK) {
+                ESP_LOGE(TAG, "Errore decodifica blocco %d/%d", block + 1, process_count);
+                ok = false;
+                break;
+            }
+            if (!rows_cb) {
+                continue;
+            }
+            // L'ultimo blocco può contenere righe di riempimento oltre l'altezza dell'immagine
+            int first_row = block * block_rows;
+            int num_rows = img->height - first_row < block_rows ? img->height - first_row : block_rows;
+            if (num_rows > 0 && !rows_cb(ctx, img, out, first_row, num_rows)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (ok && !rows_cb) {
+        img->data = out;
+    }
+
+    jpeg_dec_close(decoder);
+    return ok;
+}
+
+static bool decode_with_fallback(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                                 int min_width, int min_height,
+                                 inference_jpeg_rows_cb_t rows_cb, void *ctx, inference_image_t *img)
+{
+    int width = 0, height = 0;
+    if (!inference_jpeg_get_dimensions(jpeg_data, jpeg_size, &width, &height)) {
+        ESP_LOGE(TAG, "JPEG non valido: marker SOF non trovato");
+        return false;
+    }
+
+    int shift = inference_jpeg_select_scale(width, height, min_width, min_height);
+    size_t mark = inference_arena_mark(arena);
+    if (decode_blocks(arena, jpeg_data, jpeg_size, width, height, shift, rows_cb, ctx, img)) {
+        return true;
+    }
+
+    // Se il decoder rifiuta la scala ridotta, riprova a piena risoluzione
+    // (con rows_cb le righe ripartono da 0)
+    if (shift > 0) {
+        ESP_LOGW(TAG, "Decodifica in scala 1/%d fallita, riprovo a piena risoluzione", 1 << shift);
+        inference_arena_rewind(arena, mark);
+        return decode_blocks(arena, jpeg_data, jpeg_size, width, height, 0, rows_cb, ctx, img);
+    }
+    return false;
+}
+
+bool inference_jpeg_decode_scaled(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                                  int min_width, int min_height, inference_image_t *img)
+{
+    if (!arena || !jpeg_data || !img) {
+        return false;
+    }
+    return decode_with_fallback(arena, jpeg_data, jpeg_size, min_width, min_height, NULL, NULL, img);
+}
+
+bool inference_jpeg_decode_rows(inference_arena_t *arena, const uint8_t *jpeg_data, size_t jpeg_size,
+                                int min_width, int min_height, inference_jpeg_rows_cb_t rows_cb, void *ctx,
+                                inference_image_t *img)
+{
+    if (!arena || !jpeg_data || !rows_cb || !img) {
+        return false;
+    }
+    return decode_with_fallback(arena, jpeg_data, jpeg_size, min_width, min_height, rows_cb, ctx, img);
+}
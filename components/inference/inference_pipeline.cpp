@@ -0,0 +1,285 @@
+#include "inference_pipeline.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char* TAG = "INFERENCE_PIPELINE";
+
+// Variabile globale della pipeline (singleton come g_inference)
+inference_pipeline_t g_inference_pipeline;
+
+inference_pipeline_t* get_inference_pipeline_instance(void) {
+    return &g_inference_pipeline;
+}
+
+static void pipeline_account(inference_pipeline_t *pipe, inference_pipeline_stage_t stage, int64_t wait_us, int64_t busy_us) {
+    inference_pipeline_stage_stats_t *stats = &pipe->stats[stage];
+    uint32_t wait_ms = (uint32_t)(wait_us / 1000);
+    taskENTER_CRITICAL(&pipe->stats_lock);
+    stats->frames++;
+    stats->wait_us += (uint64_t)wait_us;
+    stats->busy_us += (uint64_t)busy_us;
+    if (wait_ms > stats->max_wait_ms) {
+        stats->max_wait_ms = wait_ms;
+    }
+    taskEXIT_CRITICAL(&pipe->stats_lock);
+}
+
+// Secondo stadio: il modello esegue un frame alla volta; i bin dei candidati vengono copiati nel frame
+// così il tensore di output è subito libero per il frame successivo
+static void pipeline_run_task(void *pvParameters) {
+    inference_pipeline_t *pipe = (inference_pipeline_t *)pvParameters;
+    uint8_t index;
+    while (true) {
+        xQueueReceive(pipe->run_queue, &index, portMAX_DELAY);
+        inference_pipeline_slot_t *slot = &pipe->slots[index];
+        int64_t start_us = esp_timer_get_time();
+
+        slot->ok = inference_yolo_execute(pipe->inf, slot->frame, true);
+
+        // L'input è già stato copiato nel tensore: torna disponibile per la preparazione
+        uint8_t input = (uint8_t)slot->input_slot;
+        slot->input_slot = -1;
+        slot->frame->input = NULL;
+        xQueueSend(pipe->free_inputs, &input, portMAX_DELAY);
+
+        int64_t end_us = esp_timer_get_time();
+        pipeline_account(pipe, INFERENCE_STAGE_RUN, start_us - slot->enqueue_us, end_us - start_us);
+        slot->enqueue_us = end_us;
+        xQueueSend(pipe->post_queue, &index, portMAX_DELAY);
+    }
+}
+
+// Terzo stadio: decodifica, NMS e pubblicazione, nello stesso ordine di arrivo dei frame
+static void pipeline_post_task(void *pvParameters) {
+    inference_pipeline_t *pipe = (inference_pipeline_t *)pvParameters;
+    uint8_t index;
+    while (true) {
+        xQueueReceive(pipe->post_queue, &index, portMAX_DELAY);
+        inference_pipeline_slot_t *slot = &pipe->slots[index];
+        int64_t start_us = esp_timer_get_time();
+
+        if (slot->ok) {
+            inference_yolo_finish(pipe->inf, slot->frame, &pipe->result);
+        }
+        if (slot->on_done) {
+            slot->on_done(slot->ok ? &pipe->result : NULL, slot->user_ctx);
+        }
+
+        int64_t end_us = esp_timer_get_time();
+        pipeline_account(pipe, INFERENCE_STAGE_POST, start_us - slot->enqueue_us, end_us - start_us);
+        slot->on_done = NULL;
+        slot->user_ctx = NULL;
+        xQueueSend(pipe->free_slots, &index, portMAX_DELAY);
+    }
+}
+
+// Libera ciò che un avvio non riuscito ha già creato: le task sono ancora ferme sulle code vuote,
+// quindi vengono eliminate prima delle code che attendono
+static void pipeline_release(inference_pipeline_t *pipe) {
+    if (pipe->run_task) {
+        vTaskDelete(pipe->run_task);
+    }
+    if (pipe->post_task) {
+        vTaskDelete(pipe->post_task);
+    }
+    QueueHandle_t queues[] = {pipe->free_inputs, pipe->free_slots, pipe->run_queue, pipe->post_queue};
+    for (size_t i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+        if (queues[i]) {
+            vQueueDelete(queues[i]);
+        }
+    }
+    for (uint8_t i = 0; i < INFERENCE_PIPELINE_INPUT_SLOTS; i++) {
+        heap_caps_free(pipe->inputs[i]);
+    }
+    for (uint8_t i = 0; i < INFERENCE_PIPELINE_FRAMES; i++) {
+        heap_caps_free(pipe->slots[i].frame);
+    }
+    memset(pipe, 0, sizeof(inference_pipeline_t));
+}
+
+esp_err_t inference_pipeline_start(inference_pipeline_t *pipe, inference_t *inf) {
+    if (!pipe || !inf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pipe->running) {
+        return ESP_OK;
+    }
+    if (!inf->yolo_model_initialized || inf->yolo_num_variants == 0) {
+        ESP_LOGE(TAG, "Modello YOLO non inizializzato");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(pipe, 0, sizeof(inference_pipeline_t));
+    pipe->inf = inf;
+    portMUX_INITIALIZE(&pipe->stats_lock);
+
+    // Input dimensionati sulla variante più grande: la variante può cambiare da un frame all'altro
+    for (uint32_t i = 0; i < inf->yolo_num_variants; i++) {
+        const yolo_model_desc_t *desc = &inf->yolo_variants[i].desc;
+        size_t size = (size_t)desc->input_width * desc->input_height * desc->input_channels;
+        if (size > pipe->input_size) {
+            pipe->input_size = size;
+        }
+    }
+
+    pipe->free_inputs = xQueueCreate(INFERENCE_PIPELINE_INPUT_SLOTS, sizeof(uint8_t));
+    pipe->free_slots = xQueueCreate(INFERENCE_PIPELINE_FRAMES, sizeof(uint8_t));
+    pipe->run_queue = xQueueCreate(INFERENCE_PIPELINE_FRAMES, sizeof(uint8_t));
+    pipe->post_queue = xQueueCreate(INFERENCE_PIPELINE_FRAMES, sizeof(uint8_t));
+    if (!pipe->free_inputs || !pipe->free_slots || !pipe->run_queue || !pipe->post_queue) {
+        ESP_LOGE(TAG, "Errore creazione code della pipeline");
+        pipeline_release(pipe);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < INFERENCE_PIPELINE_INPUT_SLOTS; i++) {
+        pipe->inputs[i] = (int8_t *)heap_caps_aligned_alloc(16, pipe->input_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!pipe->inputs[i]) {
+            ESP_LOGE(TAG, "Errore allocazione input %d (%zu bytes)", i, pipe->input_size);
+            pipeline_release(pipe);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(pipe->free_inputs, &i, 0);
+    }
+    for (uint8_t i = 0; i < INFERENCE_PIPELINE_FRAMES; i++) {
+        pipe->slots[i].frame = (inference_yolo_frame_t *)heap_caps_malloc(sizeof(inference_yolo_frame_t),
+                                                                          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!pipe->slots[i].frame) {
+            ESP_LOGE(TAG, "Errore allocazione frame %d", i);
+            pipeline_release(pipe);
+            return ESP_ERR_NO_MEM;
+        }
+        pipe->slots[i].input_slot = -1;
+        xQueueSend(pipe->free_slots, &i, 0);
+    }
+
+    if (xTaskCreatePinnedToCore(pipeline_run_task, "yolo_run", INFERENCE_PIPELINE_RUN_STACK_SIZE, pipe,
+                                INFERENCE_PIPELINE_PRIORITY, &pipe->run_task, INFERENCE_PIPELINE_RUN_CORE) != pdPASS ||
+        xTaskCreatePinnedToCore(pipeline_post_task, "yolo_post", INFERENCE_PIPELINE_POST_STACK_SIZE, pipe,
+                                INFERENCE_PIPELINE_PRIORITY, &pipe->post_task, INFERENCE_PIPELINE_POST_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Errore creazione task della pipeline");
+        pipeline_release(pipe);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pipe->start_us = esp_timer_get_time();
+    pipe->running = true;
+    ESP_LOGI(TAG, "Pipeline avviata (%d input da %zu bytes, %d frame in volo, modello sul core %d)",
+             INFERENCE_PIPELINE_INPUT_SLOTS, pipe->input_size, INFERENCE_PIPELINE_FRAMES, INFERENCE_PIPELINE_RUN_CORE);
+    return ESP_OK;
+}
+
+esp_err_t inference_pipeline_submit(inference_pipeline_t *pipe, const inference_input_frame_t *input,
+                                    inference_pipeline_done_t on_done, void *user_ctx, TickType_t timeout) {
+    if (!pipe || !input || !input->data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!pipe->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Contropressione: con tutti i frame in volo si attende che il postprocessing ne liberi uno
+    int64_t wait_start_us = esp_timer_get_time();
+    uint8_t index, input;
+    if (xQueueReceive(pipe->free_slots, &index, timeout) != pdTRUE) {
+        ESP_LOGW(TAG, "Nessun frame libero nella pipeline");
+        return ESP_ERR_TIMEOUT;
+    }
+    if (xQueueReceive(pipe->free_inputs, &input, timeout) != pdTRUE) {
+        xQueueSend(pipe->free_slots, &index, 0);
+        ESP_LOGW(TAG, "Nessun input libero nella pipeline");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    inference_pipeline_slot_t *slot = &pipe->slots[index];
+    slot->input_slot = input;
+    slot->frame->input = pipe->inputs[input];
+
+    // Primo stadio: l'arena serve solo per decodifica e scratch, il risultato resta nell'input dello slot
+    int64_t start_us = esp_timer_get_time();
+    bool ok = false;
+    if (inference_arena_begin(&pipe->inf->arena, timeout)) {
+        ok = inference_yolo_prepare(pipe->inf, input, slot->frame);
+        inference_arena_end(&pipe->inf->arena);
+    }
+    int64_t end_us = esp_timer_get_time();
+    pipeline_account(pipe, INFERENCE_STAGE_PREPARE, start_us - wait_start_us, end_us - start_us);
+
+    if (!ok) {
+        slot->input_slot = -1;
+        slot->frame->input = NULL;
+        xQueueSend(pipe->free_inputs, &input, 0);
+        xQueueSend(pipe->free_slots, &index, 0);
+        return ESP_FAIL;
+    }
+
+    slot->on_done = on_done;
+    slot->user_ctx = user_ctx;
+    slot->enqueue_us = end_us;
+    xQueueSend(pipe->run_queue, &index, portMAX_DELAY);
+    return ESP_OK;
+}
+
+bool inference_pipeline_wait_idle(inference_pipeline_t *pipe, TickType_t timeout) {
+    if (!pipe || !pipe->running) {
+        return true;
+    }
+    TickType_t start = xTaskGetTickCount();
+    while (uxQueueMessagesWaiting(pipe->free_slots) < INFERENCE_PIPELINE_FRAMES) {
+        if (xTaskGetTickCount() - start >= timeout) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+esp_err_t inference_pipeline_stop(inference_pipeline_t *pipe, TickType_t timeout) {
+    if (!pipe || !pipe->running) {
+        return ESP_OK;
+    }
+    if (!inference_pipeline_wait_idle(pipe, timeout)) {
+        ESP_LOGW(TAG, "Frame ancora in volo: pipeline non fermata");
+        return ESP_ERR_TIMEOUT;
+    }
+    // Tutti i frame sono tornati liberi: le task degli stadi sono ferme sulle code vuote
+    pipeline_release(pipe);
+    ESP_LOGI(TAG, "Pipeline fermata");
+    return ESP_OK;
+}
+
+void inference_pipeline_get_stats(inference_pipeline_t *pipe, inference_pipeline_stage_t stage,
+                                  inference_pipeline_stage_stats_t *stats) {
+    if (!pipe || !stats || stage >= INFERENCE_STAGE_COUNT) {
+        return;
+    }
+    taskENTER_CRITICAL(&pipe->stats_lock);
+    memcpy(stats, &pipe->stats[stage], sizeof(inference_pipeline_stage_stats_t));
+    taskEXIT_CRITICAL(&pipe->stats_lock);
+}
+
+void inference_pipeline_print_stats(inference_pipeline_t *pipe) {
+    if (!pipe || !pipe->running) {
+        printf("Pipeline YOLO non avviata\n");
+        return;
+    }
+    static const char *names[INFERENCE_STAGE_COUNT] = {"Preparazione", "Modello", "Postprocessing"};
+    uint64_t elapsed_us = (uint64_t)(esp_timer_get_time() - pipe->start_us);
+
+    printf("\n=== PIPELINE YOLO ===\n");
+    for (int s = 0; s < INFERENCE_STAGE_COUNT; s++) {
+        inference_pipeline_stage_stats_t stats;
+        inference_pipeline_get_stats(pipe, (inference_pipeline_stage_t)s, &stats);
+        uint32_t occupancy = elapsed_us ? (uint32_t)(stats.busy_us * 100 / elapsed_us) : 0;
+        uint32_t avg_busy_ms = stats.frames ? (uint32_t)(stats.busy_us / stats.frames / 1000) : 0;
+        uint32_t avg_wait_ms = stats.frames ? (uint32_t)(stats.wait_us / stats.frames / 1000) : 0;
+        printf("%s: frame %lu, occupazione %lu%%, lavoro medio %lu ms, attesa in coda media %lu ms (max %lu ms)\n",
+               names[s], stats.frames, occupancy, avg_busy_ms, avg_wait_ms, stats.max_wait_ms);
+    }
+    printf("Frame liberi: %u/%d, input liberi: %u/%d\n",
+           (unsigned)uxQueueMessagesWaiting(pipe->free_slots), INFERENCE_PIPELINE_FRAMES,
+           (unsigned)uxQueueMessagesWaiting(pipe->free_inputs), INFERENCE_PIPELINE_INPUT_SLOTS);
+    printf("=====================\n\n");
+}
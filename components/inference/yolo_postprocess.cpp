@@ -0,0 +1,330 @@
+#include "yolo_postprocess.h"
+#include <string.h>
+#include <math.h>
+
+// Postprocessing YOLO nel dominio quantizzato: la soglia di score viene convertita una volta
+// in logit int8 e gli anchor vengono scartati con confronti su parole da 32 bit (4 classi alla volta),
+// senza mai dequantizzare gli score degli anchor scartati.
+
+#define BYTES_0x01 0x01010101u
+#define BYTES_0x7F 0x7F7F7F7Fu
+#define BYTES_0x80 0x80808080u
+
+int yolo_postprocess_quantize_threshold(float score_threshold, int exponent)
+{
+    if (score_threshold <= 0.0f) {
+        return -128;
+    }
+    if (score_threshold >= 1.0f) {
+        return 128;
+    }
+    // sigmoid(q * 2^e) >= t  <=>  q >= logit(t) / 2^e
+    float logit = logf(score_threshold / (1.0f - score_threshold));
+    float q = ceilf(ldexpf(logit, -exponent));
+    if (q < -128.0f) return -128;
+    if (q > 128.0f) return 128;
+    return (int)q;
+}
+
+void yolo_postprocess_scan_config_init(yolo_scan_config_t *config, float score_threshold, int num_classes)
+{
+    if (!config) {
+        return;
+    }
+    config->score_threshold = score_threshold;
+    config->num_classes = num_classes > YOLO_MAX_CLASSES ? YOLO_MAX_CLASSES : num_classes;
+    memset(config->class_mask, 0xFF, sizeof(config->class_mask));
+}
+
+// Per ogni byte (senza segno, <= 127) imposta il bit 7 se il byte è > n (0 <= n <= 127)
+static inline uint32_t bytes_greater(uint32_t x, uint32_t n)
+{
+    return ((x + BYTES_0x01 * (127 - n)) | x) & BYTES_0x80;
+}
+
+// true se almeno un byte (valori int8 traslati a uint8 con XOR 0x80) è >= t (1 <= t <= 255)
+static inline bool any_byte_ge(uint32_t u, uint32_t t)
+{
+    uint32_t low = u & BYTES_0x7F;
+    uint32_t high = u & BYTES_0x80;
+    if (t <= 128) {
+        return high != 0 || bytes_greater(low, t - 1) != 0;
+    }
+    return (bytes_greater(low, t - 129) & high) != 0;
+}
+
+static inline uint32_t load_word(const void *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Inserisce un candidato; se il buffer è pieno sostituisce il peggiore (se il nuovo è migliore)
+static bool push_candidate(yolo_candidate_t *candidates, size_t *count, size_t max_candidates,
+                           const yolo_candidate_t *c)
+{
+    if (*count < max_candidates) {
+        candidates[(*count)++] = *c;
+        return true;
+    }
+    size_t worst = 0;
+    for (size_t i = 1; i < max_candidates; i++) {
+        if (candidates[i].score_q < candidates[worst].score_q) {
+            worst = i;
+        }
+    }
+    if (c->score_q > candidates[worst].score_q) {
+        candidates[worst] = *c;
+    }
+    return false;
+}
+
+size_t yolo_postprocess_scan(const yolo_level_t *levels, int num_levels, const yolo_scan_config_t *config,
+                             yolo_candidate_t *candidates, size_t max_candidates, yolo_scan_stats_t *stats)
+{
+    if (!levels || !config || !candidates || max_candidates == 0) {
+        return 0;
+    }
+
+    const int num_classes = config->num_classes;
+    const int words = num_classes / 4;
+    size_t count = 0;
+    uint32_t scanned = 0, survived = 0, dropped = 0;
+
+    for (int l = 0; l < num_levels; l++) {
+        const yolo_level_t *level = &levels[l];
+        if (!level->score) {
+            continue;
+        }
+
+        int q_thr = yolo_postprocess_quantize_threshold(config->score_threshold, level->score_exponent);
+        const int anchors = level->grid_w * level->grid_h;
+        scanned += anchors;
+        if (q_thr > 127) {
+            continue; // nessun logit rappresentabile supera la soglia
+        }
+        // soglia nel dominio traslato (int8 ^ 0x80); -128 non passa mai, così le classi mascherate (0) restano fuori
+        uint32_t t = (uint32_t)(q_thr + 128);
+        if (t < 1) t = 1;
+        const int8_t thr_s8 = (int8_t)(t - 128);
+
+        for (int a = 0; a < anchors; a++) {
+            const int8_t *row = level->score + (size_t)a * num_classes;
+
+            // Rifiuto anticipato: 4 classi per parola
+            bool hit = false;
+            for (int w = 0; w < words && !hit; w++) {
+                uint32_t u = load_word(row + w * 4) ^ BYTES_0x80;
+                u &= load_word(config->class_mask + w * 4);
+                hit = any_byte_ge(u, t);
+            }
+            for (int c = words * 4; c < num_classes && !hit; c++) {
+                hit = config->class_mask[c] && row[c] >= thr_s8;
+            }
+            if (!hit) {
+                continue;
+            }
+
+            // Anchor sopravvissuto: classe migliore tra quelle abilitate
+            int best_class = -1;
+            int8_t best_q = -128;
+            for (int c = 0; c < num_classes; c++) {
+                if (config->class_mask[c] && (best_class < 0 || row[c] > best_q)) {
+                    best_q = row[c];
+                    best_class = c;
+                }
+            }
+
+            survived++;
+            yolo_candidate_t cand;
+            cand.level = (uint16_t)l;
+            cand.class_id = (uint16_t)best_class;
+            cand.grid_x = (uint16_t)(a % level->grid_w);
+            cand.grid_y = (uint16_t)(a / level->grid_w);
+            cand.score_q = best_q;
+            if (!push_candidate(candidates, &count, max_candidates, &cand)) {
+                dropped++;
+            }
+        }
+    }
+
+    if (stats) {
+        stats->anchors_scanned = scanned;
+        stats->anchors_survived = survived;
+        stats->candidates_dropped = dropped;
+    }
+    return count;
+}
+
+// ===== DECODER DFL + NMS =====
+
+static const char *const coco_class_names[YOLO_MAX_CLASSES] = {
+    "person", "bicycle", "car", "motorcycle", "airplane", "bus", "train", "truck", "boat",
+    "traffic light", "fire hydrant", "stop sign", "parking meter", "bench", "bird", "cat", "dog",
+    "horse", "sheep", "cow", "elephant", "bear", "zebra", "giraffe", "backpack", "umbrella",
+    "handbag", "tie", "suitcase", "frisbee", "skis", "snowboard", "sports ball", "kite",
+    "baseball bat", "baseball glove", "skateboard", "surfboard", "tennis racket", "bottle",
+    "wine glass", "cup", "fork", "knife", "spoon", "bowl", "banana", "apple", "sandwich", "orange",
+    "broccoli", "carrot", "hot dog", "pizza", "donut", "cake", "chair", "couch", "potted plant",
+    "bed", "dining table", "toilet", "tv", "laptop", "mouse", "remote", "keyboard", "cell phone",
+    "microwave", "oven", "toaster", "sink", "refrigerator", "book", "clock", "vase", "scissors",
+    "teddy bear", "hair drier", "toothbrush"
+};
+
+const char *yolo_postprocess_class_name(uint32_t class_id)
+{
+    return class_id < YOLO_MAX_CLASSES ? coco_class_names[class_id] : "unknown";
+}
+
+bool yolo_decoder_init(yolo_decoder_t *decoder, const yolo_level_t *levels, int num_levels,
+                       int reg_max, float nms_threshold, int top_k)
+{
+    if (!decoder || !levels || num_levels <= 0 || num_levels > YOLO_MAX_LEVELS ||
+        reg_max <= 0 || reg_max > YOLO_MAX_REG || top_k <= 0) {
+        return false;
+    }
+
+    decoder->num_levels = num_levels;
+    decoder->reg_max = reg_max;
+    decoder->nms_threshold = nms_threshold;
+    decoder->top_k = top_k;
+
+    // softmax(x_i) = exp(x_i - x_max) / sum: con logit int8 la differenza x_max - x_i è in [0, 255]
+    for (int l = 0; l < num_levels; l++) {
+        decoder->box_exponent[l] = levels[l].box_exponent;
+        float scale = ldexpf(1.0f, levels[l].box_exponent);
+        for (int d = 0; d < 256; d++) {
+            decoder->exp_lut[l][d] = expf(-d * scale);
+        }
+    }
+    return true;
+}
+
+// Distanza attesa (in celle della griglia) per un lato: media dei bin pesata dalla softmax
+static float dfl_side(const int8_t *bins, int reg_max, const float *exp_lut)
+{
+    int8_t max_q = bins[0];
+    for (int i = 1; i < reg_max; i++) {
+        if (bins[i] > max_q) max_q = bins[i];
+    }
+    float sum = 0.0f, weighted = 0.0f;
+    for (int i = 0; i < reg_max; i++) {
+        float e = exp_lut[max_q - bins[i]];
+        sum += e;
+        weighted += e * i;
+    }
+    return weighted / sum;
+}
+
+static float box_iou(const yolo_box_t *a, const yolo_box_t *b)
+{
+    float ix1 = a->x1 > b->x1 ? a->x1 : b->x1;
+    float iy1 = a->y1 > b->y1 ? a->y1 : b->y1;
+    float ix2 = a->x2 < b->x2 ? a->x2 : b->x2;
+    float iy2 = a->y2 < b->y2 ? a->y2 : b->y2;
+    float iw = ix2 - ix1, ih = iy2 - iy1;
+    if (iw <= 0.0f || ih <= 0.0f) {
+        return 0.0f;
+    }
+    float inter = iw * ih;
+    float area_a = (a->x2 - a->x1) * (a->y2 - a->y1);
+    float area_b = (b->x2 - b->x1) * (b->y2 - b->y1);
+    return inter / (area_a + area_b - inter);
+}
+
+void yolo_postprocess_gather_bins(const yolo_level_t *levels, int reg_max,
+                                  const yolo_candidate_t *candidates, size_t num_candidates, int8_t *bins)
+{
+    if (!levels || !candidates || !bins) {
+        return;
+    }
+    const size_t box_channels = 4 * (size_t)reg_max;
+    for (size_t i = 0; i < num_candidates; i++) {
+        const yolo_candidate_t *c = &candidates[i];
+        const yolo_level_t *level = &levels[c->level];
+        memcpy(bins + i * box_channels,
+               level->box + ((size_t)c->grid_y * level->grid_w + c->grid_x) * box_channels, box_channels);
+    }
+}
+
+// DFL dei candidati + NMS. bins == NULL: i bin sono letti dai tensori box dei livelli,
+// altrimenti dalla copia raccolta con yolo_postprocess_gather_bins (stesso ordine dei candidati)
+static size_t decode_candidates(const yolo_decoder_t *decoder, const yolo_level_t *levels,
+                                const yolo_candidate_t *candidates, const int8_t *gathered, size_t num_candidates,
+                                yolo_box_t *boxes, yolo_box_t *out, size_t max_out)
+{
+    const int reg_max = decoder->reg_max;
+    const int box_channels = 4 * reg_max;
+    for (size_t i = 0; i < num_candidates; i++) {
+        const yolo_candidate_t *c = &candidates[i];
+        const yolo_level_t *level = &levels[c->level];
+        const int8_t *bins = gathered ? gathered + i * box_channels
+                                      : level->box + ((size_t)c->grid_y * level->grid_w + c->grid_x) * box_channels;
+        const float *lut = decoder->exp_lut[c->level];
+
+        // Ordine dei lati: left, top, right, bottom
+        float l = dfl_side(bins, reg_max, lut);
+        float t = dfl_side(bins + reg_max, reg_max, lut);
+        float r = dfl_side(bins + 2 * reg_max, reg_max, lut);
+        float b = dfl_side(bins + 3 * reg_max, reg_max, lut);
+        float cx = c->grid_x + 0.5f;
+        float cy = c->grid_y + 0.5f;
+
+        yolo_box_t *box = &boxes[i];
+        box->x1 = (cx - l) * level->stride;
+        box->y1 = (cy - t) * level->stride;
+        box->x2 = (cx + r) * level->stride;
+        box->y2 = (cy + b) * level->stride;
+        box->score = 1.0f / (1.0f + expf(-ldexpf((float)c->score_q, level->score_exponent)));
+        box->class_id = c->class_id;
+    }
+
+    // Ordina i box per score decrescente (insertion sort: al massimo YOLO_MAX_CANDIDATES elementi)
+    for (size_t i = 1; i < num_candidates; i++) {
+        yolo_box_t key = boxes[i];
+        size_t j = i;
+        while (j > 0 && boxes[j - 1].score < key.score) {
+            boxes[j] = boxes[j - 1];
+            j--;
+        }
+        boxes[j] = key;
+    }
+
+    // NMS greedy per classe, interrotta al top-K
+    size_t limit = (size_t)decoder->top_k < max_out ? (size_t)decoder->top_k : max_out;
+    size_t kept = 0;
+    for (size_t i = 0; i < num_candidates && kept < limit; i++) {
+        bool suppressed = false;
+        for (size_t k = 0; k < kept; k++) {
+            if (out[k].class_id == boxes[i].class_id && box_iou(&out[k], &boxes[i]) > decoder->nms_threshold) {
+                suppressed = true;
+                break;
+            }
+        }
+        if (!suppressed) {
+            out[kept++] = boxes[i];
+        }
+    }
+    return kept;
+}
+
+size_t yolo_decoder_run(const yolo_decoder_t *decoder, const yolo_level_t *levels,
+                        const yolo_candidate_t *candidates, size_t num_candidates,
+                        yolo_box_t *boxes, yolo_box_t *out, size_t max_out)
+{
+    if (!decoder || !levels || !candidates || !boxes || !out || num_candidates == 0 || max_out == 0) {
+        return 0;
+    }
+    return decode_candidates(decoder, levels, candidates, NULL, num_candidates, boxes, out, max_out);
+}
+
+size_t yolo_decoder_run_gathered(const yolo_decoder_t *decoder, const yolo_level_t *levels,
+                                 const yolo_candidate_t *candidates, const int8_t *bins, size_t num_candidates,
+                                 yolo_box_t *boxes, yolo_box_t *out, size_t max_out)
+{
+    if (!decoder || !levels || !candidates || !bins || !boxes || !out || num_candidates == 0 || max_out == 0) {
+        return 0;
+    }
+    return decode_candidates(decoder, levels, candidates, bins, num_candidates, boxes, out, max_out);
+}
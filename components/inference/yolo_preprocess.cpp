@@ -0,0 +1,394 @@
+#include "yolo_preprocess.h"
+#include <string.h>
+#include <math.h>
+
+// Preprocessing fuso per YOLO: resize bilineare in fixed-point + quantizzazione int8 tramite LUT.
+// Evita il buffer RGB888 ridimensionato e il buffer float intermedio: ogni riga del tensore
+// di input viene prodotta a partire da due righe della sorgente ridimensionate in orizzontale,
+// tenute in una piccola cache nello scratch.
+// La sorgente può essere RGB888 (JPEG decodificato) o RGB565 grezzo del sensore: in quel caso
+// l'espansione a 8 bit per canale avviene durante il resize orizzontale, senza un buffer RGB888.
+
+#define YOLO_PREPROCESS_ALIGN4(x) (((x) + 3) & ~((size_t)3))
+
+// Layout dello scratch
+typedef struct {
+    int32_t *x_offset0;   // offset in byte del pixel sinistro per ogni colonna di destinazione
+    int32_t *x_offset1;   // offset in byte del pixel destro
+    uint8_t *x_weight;    // peso (0..255) del pixel destro
+    uint8_t *row_a;       // riga sorgente y0 ridimensionata in orizzontale
+    uint8_t *row_b;       // riga sorgente y1 ridimensionata in orizzontale
+} yolo_preprocess_scratch_t;
+
+void yolo_preprocess_build_lut(int exponent, int8_t lut[256])
+{
+    // q = round((v / 255) * 2^-exponent), saturato a [-128, 127]
+    float inv_scale = ldexpf(1.0f, -exponent);
+    for (int v = 0; v < 256; v++) {
+        int q = (int)lroundf((v / 255.0f) * inv_scale);
+        if (q > 127) q = 127;
+        if (q < -128) q = -128;
+        lut[v] = (int8_t)q;
+    }
+}
+
+size_t yolo_preprocess_scratch_size(int dst_w)
+{
+    size_t row = YOLO_PREPROCESS_ALIGN4((size_t)dst_w * 3);
+    return (size_t)dst_w * sizeof(int32_t) * 2 + YOLO_PREPROCESS_ALIGN4((size_t)dst_w) + row * 2;
+}
+
+static bool scratch_layout(void *scratch, size_t scratch_size, int dst_w, yolo_preprocess_scratch_t *out)
+{
+    if (!scratch || ((uintptr_t)scratch & 3) || scratch_size < yolo_preprocess_scratch_size(dst_w)) {
+        return false;
+    }
+    uint8_t *p = (uint8_t *)scratch;
+    out->x_offset0 = (int32_t *)p;
+    p += (size_t)dst_w * sizeof(int32_t);
+    out->x_offset1 = (int32_t *)p;
+    p += (size_t)dst_w * sizeof(int32_t);
+    out->x_weight = p;
+    p += YOLO_PREPROCESS_ALIGN4((size_t)dst_w);
+    out->row_a = p;
+    p += YOLO_PREPROCESS_ALIGN4((size_t)dst_w * 3);
+    out->row_b = p;
+    return true;
+}
+
+// Coordinata sorgente in fixed-point 16.16 con allineamento dei centri dei pixel
+static inline int32_t src_coord_q16(int dst, int src_len, int dst_len)
+{
+    int32_t c = (int32_t)((((int64_t)(2 * dst + 1) * src_len << 16) / (2 * dst_len)) - (1 << 15));
+    return c < 0 ? 0 : c;
+}
+
+// Resize orizzontale di una riga RGB888 sorgente
+static void resize_row_h(const uint8_t *src_row, const yolo_preprocess_scratch_t *s, int dst_w, uint8_t *out)
+{
+    for (int x = 0; x < dst_w; x++) {
+        const uint8_t *p0 = src_row + s->x_offset0[x];
+        const uint8_t *p1 = src_row + s->x_offset1[x];
+        uint32_t w1 = s->x_weight[x];
+        uint32_t w0 = 256 - w1;
+        out[0] = (uint8_t)((p0[0] * w0 + p1[0] * w1 + 128) >> 8);
+        out[1] = (uint8_t)((p0[1] * w0 + p1[1] * w1 + 128) >> 8);
+        out[2] = (uint8_t)((p0[2] * w0 + p1[2] * w1 + 128) >> 8);
+        out += 3;
+    }
+}
+
+// Pixel RGB565 big-endian (ordine dei byte del driver esp32-camera)
+static inline uint32_t rgb565_load(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+// Espansione 5/6 bit -> 8 bit con replica dei bit alti (0 -> 0, massimo -> 255)
+static inline uint32_t rgb565_r8(uint32_t v) { uint32_t r = v >> 11; return (r << 3) | (r >> 2); }
+static inline uint32_t rgb565_g8(uint32_t v) { uint32_t g = (v >> 5) & 0x3F; return (g << 2) | (g >> 4); }
+static inline uint32_t rgb565_b8(uint32_t v) { uint32_t b = v & 0x1F; return (b << 3) | (b >> 2); }
+
+// Resize orizzontale di una riga RGB565 sorgente, con uscita RGB888
+static void resize_row_h_rgb565(const uint8_t *src_row, const yolo_preprocess_scratch_t *s, int dst_w, uint8_t *out)
+{
+    for (int x = 0; x < dst_w; x++) {
+        uint32_t v0 = rgb565_load(src_row + s->x_offset0[x]);
+        uint32_t v1 = rgb565_load(src_row + s->x_offset1[x]);
+        uint32_t w1 = s->x_weight[x];
+        uint32_t w0 = 256 - w1;
+        out[0] = (uint8_t)((rgb565_r8(v0) * w0 + rgb565_r8(v1) * w1 + 128) >> 8);
+        out[1] = (uint8_t)((rgb565_g8(v0) * w0 + rgb565_g8(v1) * w1 + 128) >> 8);
+        out[2] = (uint8_t)((rgb565_b8(v0) * w0 + rgb565_b8(v1) * w1 + 128) >> 8);
+        out += 3;
+    }
+}
+
+typedef void (*resize_row_fn)(const uint8_t *src_row, const yolo_preprocess_scratch_t *s, int dst_w, uint8_t *out);
+
+// Blend verticale + quantizzazione, versione scalare (usata per la coda e come riferimento)
+static inline void blend_quantize_scalar(const uint8_t *a, const uint8_t *b, uint32_t wb, size_t n,
+                                         const int8_t *lut, int8_t *dst)
+{
+    uint32_t wa = 256 - wb;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = lut[(a[i] * wa + b[i] * wb + 128) >> 8];
+    }
+}
+
+// Blend verticale + quantizzazione su 4 canali per iterazione (SWAR su registri a 32 bit):
+// i byte pari e dispari vengono separati in due lane da 16 bit, pesati e ricombinati
+// con due sole moltiplicazioni per parola.
+static void blend_quantize_row(const uint8_t *a, const uint8_t *b, uint32_t wb, size_t n,
+                               const int8_t *lut, int8_t *dst)
+{
+    if (wb == 0) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = lut[a[i]];
+        }
+        return;
+    }
+
+    uint32_t wa = 256 - wb;
+    size_t words = n / 4;
+    const uint32_t *wa_ptr = (const uint32_t *)a;
+    const uint32_t *wb_ptr = (const uint32_t *)b;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t va = wa_ptr[i];
+        uint32_t vb = wb_ptr[i];
+        uint32_t even = ((va & 0x00FF00FFu) * wa + (vb & 0x00FF00FFu) * wb + 0x00800080u) >> 8;
+        uint32_t odd = (((va >> 8) & 0x00FF00FFu) * wa + ((vb >> 8) & 0x00FF00FFu) * wb + 0x00800080u);
+        uint32_t v = (even & 0x00FF00FFu) | (odd & 0xFF00FF00u);
+        int8_t *d = dst + i * 4;
+        d[0] = lut[v & 0xFF];
+        d[1] = lut[(v >> 8) & 0xFF];
+        d[2] = lut[(v >> 16) & 0xFF];
+        d[3] = lut[v >> 24];
+    }
+
+    size_t done = words * 4;
+    blend_quantize_scalar(a + done, b + done, wb, n - done, lut, dst + done);
+}
+
+bool yolo_preprocess_is_native(int src_w, int src_h, int dst_w, int dst_h)
+{
+    return src_w == dst_w && src_h == dst_h;
+}
+
+void yolo_preprocess_quantize(const uint8_t *src, size_t n, int8_t *dst, const int8_t lut[256])
+{
+    // 4 canali per iterazione: una lettura a 32 bit e quattro accessi alla LUT
+    size_t words = ((uintptr_t)src & 3) == 0 ? n / 4 : 0;
+    const uint32_t *src_words = (const uint32_t *)src;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t v = src_words[i];
+        int8_t *d = dst + i * 4;
+        d[0] = lut[v & 0xFF];
+        d[1] = lut[(v >> 8) & 0xFF];
+        d[2] = lut[(v >> 16) & 0xFF];
+        d[3] = lut[v >> 24];
+    }
+    for (size_t i = words * 4; i < n; i++) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+void yolo_preprocess_rgb565_quantize(const uint8_t *src, size_t pixels, int8_t *dst, const int8_t lut[256])
+{
+    // Espansione e quantizzazione fuse in tre tabelle per canale (32 + 64 + 32 voci)
+    int8_t r_lut[32], g_lut[64], b_lut[32];
+    for (uint32_t i = 0; i < 32; i++) {
+        r_lut[i] = lut[(i << 3) | (i >> 2)];
+        b_lut[i] = r_lut[i];
+    }
+    for (uint32_t i = 0; i < 64; i++) {
+        g_lut[i] = lut[(i << 2) | (i >> 4)];
+    }
+
+    // 2 pixel per iterazione: una lettura a 32 bit e sei accessi alle tabelle
+    size_t words = ((uintptr_t)src & 3) == 0 ? pixels / 2 : 0;
+    const uint32_t *src_words = (const uint32_t *)src;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t v = src_words[i];
+        uint32_t p0 = ((v & 0xFF) << 8) | ((v >> 8) & 0xFF);
+        uint32_t p1 = ((v >> 8) & 0xFF00) | (v >> 24);
+        int8_t *d = dst + i * 6;
+        d[0] = r_lut[p0 >> 11];
+        d[1] = g_lut[(p0 >> 5) & 0x3F];
+        d[2] = b_lut[p0 & 0x1F];
+        d[3] = r_lut[p1 >> 11];
+        d[4] = g_lut[(p1 >> 5) & 0x3F];
+        d[5] = b_lut[p1 & 0x1F];
+    }
+    for (size_t i = words * 2; i < pixels; i++) {
+        uint32_t p = rgb565_load(src + i * 2);
+        dst[i * 3] = r_lut[p >> 11];
+        dst[i * 3 + 1] = g_lut[(p >> 5) & 0x3F];
+        dst[i * 3 + 2] = b_lut[p & 0x1F];
+    }
+}
+
+static bool stream_init(yolo_preprocess_stream_t *stream, int src_w, int src_h, int bpp,
+                        int8_t *dst, int dst_w, int dst_h,
+                        const int8_t lut[256], void *scratch, size_t scratch_size)
+{
+    memset(stream, 0, sizeof(yolo_preprocess_stream_t));
+    stream->src_w = src_w;
+    stream->src_h = src_h;
+    stream->bpp = bpp;
+    stream->dst = dst;
+    stream->dst_w = dst_w;
+    stream->dst_h = dst_h;
+    stream->lut = lut;
+    stream->native = yolo_preprocess_is_native(src_w, src_h, dst_w, dst_h);
+    stream->cached_a = -1;
+    stream->cached_b = -1;
+    if (stream->native) {
+        return true;
+    }
+
+    yolo_preprocess_scratch_t s;
+    if (!scratch_layout(scratch, scratch_size, dst_w, &s)) {
+        return false;
+    }
+    // Tabelle orizzontali (calcolate una volta per frame, dst_w elementi)
+    for (int x = 0; x < dst_w; x++) {
+        int32_t sx = src_coord_q16(x, src_w, dst_w);
+        int x0 = sx >> 16;
+        if (x0 > src_w - 1) x0 = src_w - 1;
+        int x1 = x0 < src_w - 1 ? x0 + 1 : x0;
+        s.x_offset0[x] = x0 * bpp;
+        s.x_offset1[x] = x1 * bpp;
+        s.x_weight[x] = (uint8_t)((sx >> 8) & 0xFF);
+    }
+    stream->scratch = scratch;
+    stream->scratch_size = scratch_size;
+    stream->row_a = s.row_a;
+    stream->row_b = s.row_b;
+    return true;
+}
+
+// Resize bilineare + quantizzazione riga per riga, indipendente dal formato della sorgente
+// (bpp byte per pixel, righe convertite in RGB888 dal resize orizzontale). Produce ogni riga del tensore
+// le cui due righe sorgente sono nella banda o già ridimensionate nello scratch; prima di uscire mette in
+// cache la riga della banda che servirà alla prossima riga del tensore
+static void stream_rows(yolo_preprocess_stream_t *stream, const uint8_t *rows, int first_row, int num_rows)
+{
+    const int dst_w = stream->dst_w;
+    const size_t src_stride = (size_t)stream->src_w * stream->bpp;
+    const size_t dst_stride = (size_t)dst_w * 3;
+
+    if (stream->native) {
+        int8_t *dst = stream->dst + (size_t)first_row * dst_stride;
+        if (stream->bpp == 3) {
+            yolo_preprocess_quantize(rows, (size_t)num_rows * dst_stride, dst, stream->lut);
+        } else {
+            yolo_preprocess_rgb565_quantize(rows, (size_t)num_rows * dst_w, dst, stream->lut);
+        }
+        stream->next_dst_row = first_row + num_rows;
+        return;
+    }
+
+    yolo_preprocess_scratch_t s;
+    scratch_layout(stream->scratch, stream->scratch_size, dst_w, &s);
+    s.row_a = stream->row_a;
+    s.row_b = stream->row_b;
+    resize_row_fn resize_row = stream->bpp == 3 ? resize_row_h : resize_row_h_rgb565;
+    const int band_end = first_row + num_rows;
+
+    while (stream->next_dst_row < stream->dst_h) {
+        int y = stream->next_dst_row;
+        int32_t sy = src_coord_q16(y, stream->src_h, stream->dst_h);
+        int y0 = sy >> 16;
+        if (y0 > stream->src_h - 1) y0 = stream->src_h - 1;
+        int y1 = y0 < stream->src_h - 1 ? y0 + 1 : y0;
+        uint32_t wy = (sy >> 8) & 0xFF;
+
+        bool y0_in_band = y0 >= first_row && y0 < band_end;
+        bool y1_in_band = y1 >= first_row && y1 < band_end;
+        bool y0_ready = y0_in_band || y0 == stream->cached_a || y0 == stream->cached_b;
+        bool y1_ready = wy == 0 || y1_in_band || y1 == stream->cached_b;
+        if (!y0_ready || !y1_ready) {
+            // La riga y1 arriverà con la banda successiva: y0 resta nello scratch
+            if (y0_in_band && y0 != stream->cached_a && y0 != stream->cached_b) {
+                resize_row(rows + (size_t)(y0 - first_row) * src_stride, &s, dst_w, s.row_a);
+                stream->cached_a = y0;
+            }
+            break;
+        }
+
+        // Riusa le righe già ridimensionate quando possibile (upscale o righe consecutive)
+        if (y0 != stream->cached_a) {
+            if (y0 == stream->cached_b) {
+                uint8_t *tmp = s.row_a;
+                s.row_a = s.row_b;
+                s.row_b = tmp;
+                stream->cached_a = stream->cached_b;
+                stream->cached_b = -1;
+            } else {
+                resize_row(rows + (size_t)(y0 - first_row) * src_stride, &s, dst_w, s.row_a);
+                stream->cached_a = y0;
+            }
+        }
+        if (wy != 0 && y1 != stream->cached_b) {
+            resize_row(rows + (size_t)(y1 - first_row) * src_stride, &s, dst_w, s.row_b);
+            stream->cached_b = y1;
+        }
+
+        blend_quantize_row(s.row_a, s.row_b, wy, dst_stride, stream->lut, stream->dst + (size_t)y * dst_stride);
+        stream->next_dst_row++;
+    }
+
+    stream->row_a = s.row_a;
+    stream->row_b = s.row_b;
+}
+
+bool yolo_preprocess_stream_begin(yolo_preprocess_stream_t *stream, int src_w, int src_h,
+                                  int8_t *dst, int dst_w, int dst_h,
+                                  const int8_t lut[256], void *scratch, size_t scratch_size)
+{
+    if (!stream || !dst || !lut || src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        return false;
+    }
+    return stream_init(stream, src_w, src_h, 3, dst, dst_w, dst_h, lut, scratch, scratch_size);
+}
+
+void yolo_preprocess_stream_rows(yolo_preprocess_stream_t *stream, const uint8_t *rows, int first_row, int num_rows)
+{
+    if (!stream || !rows || num_rows <= 0) {
+        return;
+    }
+    stream_rows(stream, rows, first_row, num_rows);
+}
+
+bool yolo_preprocess_stream_done(const yolo_preprocess_stream_t *stream)
+{
+    return stream && stream->next_dst_row >= stream->dst_h;
+}
+
+// Frame intero in memoria: una sola banda con tutte le righe
+static bool resize_quantize_rows(const uint8_t *src, int src_w, int src_h, int bpp,
+                                 int8_t *dst, int dst_w, int dst_h,
+                                 const int8_t lut[256], void *scratch, size_t scratch_size)
+{
+    yolo_preprocess_stream_t stream;
+    if (!stream_init(&stream, src_w, src_h, bpp, dst, dst_w, dst_h, lut, scratch, scratch_size)) {
+        return false;
+    }
+    stream_rows(&stream, src, 0, src_h);
+    return yolo_preprocess_stream_done(&stream);
+}
+
+bool yolo_preprocess_resize_quantize(const uint8_t *src, int src_w, int src_h,
+                                     int8_t *dst, int dst_w, int dst_h,
+                                     const int8_t lut[256], void *scratch, size_t scratch_size)
+{
+    if (!src || !dst || !lut || src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        return false;
+    }
+
+    // Frame già alla dimensione del modello (finestra del sensore allineata): solo quantizzazione
+    if (yolo_preprocess_is_native(src_w, src_h, dst_w, dst_h)) {
+        yolo_preprocess_quantize(src, (size_t)dst_w * dst_h * 3, dst, lut);
+        return true;
+    }
+
+    return resize_quantize_rows(src, src_w, src_h, 3, dst, dst_w, dst_h, lut, scratch, scratch_size);
+}
+
+bool yolo_preprocess_rgb565_resize_quantize(const uint8_t *src, int src_w, int src_h,
+                                            int8_t *dst, int dst_w, int dst_h,
+                                            const int8_t lut[256], void *scratch, size_t scratch_size)
+{
+    if (!src || !dst || !lut || src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        return false;
+    }
+
+    // Frame RGB565 già alla dimensione del modello: espansione + quantizzazione in un solo passaggio
+    if (yolo_preprocess_is_native(src_w, src_h, dst_w, dst_h)) {
+        yolo_preprocess_rgb565_quantize(src, (size_t)dst_w * dst_h, dst, lut);
+        return true;
+    }
+
+    return resize_quantize_rows(src, src_w, src_h, 2, dst, dst_w, dst_h, lut, scratch, scratch_size);
+}
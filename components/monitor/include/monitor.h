@@ -77,6 +77,18 @@ typedef struct {
     bool encrypted;
 } partition_info_t;
 
+#define MONITOR_MAX_PROVIDERS 8 //componenti che esportano metriche al monitor
+#define MONITOR_MAX_METRICS 32 //metriche raccolte al massimo da un provider
+
+// Metrica esportata da un provider (il nome deve vivere quanto il provider)
+typedef struct {
+    const char* name;
+    uint32_t value;
+} monitor_metric_t;
+
+// Raccolta delle metriche di un componente: riempie metrics e ritorna quante ne ha scritte
+typedef size_t (*monitor_collect_t)(void* ctx, monitor_metric_t* metrics, size_t max_metrics);
+
 // Inizializzazione del sistema di monitoraggio
 esp_err_t monitor_init(void);
 
@@ -118,6 +130,13 @@ void monitor_print_flash_info(void);
 void monitor_print_partitions_info(void);
 void monitor_print_storage_summary(void);
 
+// Funzioni per le metriche esportate dai componenti (camera, inferenza, ...)
+esp_err_t monitor_register_provider(const char* name, monitor_collect_t collect, void* ctx);
+void monitor_unregister_provider(const char* name);
+size_t monitor_get_provider_count(void);
+size_t monitor_collect_provider(size_t index, const char** name, monitor_metric_t* metrics, size_t max_metrics);
+void monitor_print_providers(void);
+
 // Funzioni di utilità
 uint32_t monitor_get_free_heap_size(void);
 uint32_t monitor_get_min_free_heap_size(void);
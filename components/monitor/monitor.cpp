@@ -32,6 +32,16 @@ static inference_monitor_t g_inference_monitor = {
 static uint32_t g_min_free_heap = UINT32_MAX;
 static uint32_t g_max_alloc_heap = 0;
 
+// Provider di metriche registrati dai componenti
+typedef struct {
+    const char* name;
+    monitor_collect_t collect;
+    void* ctx;
+} monitor_provider_t;
+static monitor_provider_t g_providers[MONITOR_MAX_PROVIDERS];
+static size_t g_num_providers = 0;
+static portMUX_TYPE g_providers_lock = portMUX_INITIALIZER_UNLOCKED;
+
 // Task per il monitoraggio continuo
 static void monitor_task(void* pvParameters) {
     printf(TAG, "Task di monitoraggio avviato");
@@ -495,6 +505,88 @@ void monitor_print_performance_summary(void) {
     printf("===========================\n\n");
 }
 
+esp_err_t monitor_register_provider(const char* name, monitor_collect_t collect, void* ctx) {
+    if (!name || !collect) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    taskENTER_CRITICAL(&g_providers_lock);
+    // Una nuova registrazione con lo stesso nome sostituisce la precedente (es. dopo una reinizializzazione)
+    size_t index = g_num_providers;
+    for (size_t i = 0; i < g_num_providers; i++) {
+        if (strcmp(g_providers[i].name, name) == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index < MONITOR_MAX_PROVIDERS) {
+        g_providers[index].name = name;
+        g_providers[index].collect = collect;
+        g_providers[index].ctx = ctx;
+        if (index == g_num_providers) {
+            g_num_providers++;
+        }
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&g_providers_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Troppi provider di metriche, %s non registrato", name);
+    }
+    return ret;
+}
+
+void monitor_unregister_provider(const char* name) {
+    if (!name) {
+        return;
+    }
+    taskENTER_CRITICAL(&g_providers_lock);
+    for (size_t i = 0; i < g_num_providers; i++) {
+        if (strcmp(g_providers[i].name, name) == 0) {
+            g_providers[i] = g_providers[--g_num_providers];
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&g_providers_lock);
+}
+
+size_t monitor_get_provider_count(void) {
+    return g_num_providers;
+}
+
+size_t monitor_collect_provider(size_t index, const char** name, monitor_metric_t* metrics, size_t max_metrics) {
+    taskENTER_CRITICAL(&g_providers_lock);
+    monitor_provider_t provider = {};
+    if (index < g_num_providers) {
+        provider = g_providers[index];
+    }
+    taskEXIT_CRITICAL(&g_providers_lock);
+    if (!provider.collect) {
+        return 0;
+    }
+    if (name) {
+        *name = provider.name;
+    }
+    // La raccolta avviene fuori dalla sezione critica: i provider possono prendere i propri lock
+    return provider.collect(provider.ctx, metrics, max_metrics);
+}
+
+void monitor_print_providers(void) {
+    monitor_metric_t metrics[MONITOR_MAX_METRICS];
+    size_t count = monitor_get_provider_count();
+    for (size_t i = 0; i < count; i++) {
+        const char* name = NULL;
+        size_t num_metrics = monitor_collect_provider(i, &name, metrics, MONITOR_MAX_METRICS);
+        if (!name) {
+            continue;
+        }
+        printf("\n=== METRICHE %s ===\n", name);
+        for (size_t m = 0; m < num_metrics; m++) {
+            printf("%s: %lu\n", metrics[m].name, metrics[m].value);
+        }
+    }
+    printf("\n");
+}
+
 // Funzioni di utilità
 uint32_t monitor_get_free_heap_size(void) {
     return esp_get_free_heap_size();
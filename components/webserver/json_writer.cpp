@@ -0,0 +1,216 @@
+#include "json_writer.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const uint32_t json_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+static void json_flush(json_writer_t *w)
+{
+    if (w->len == 0 || w->error != ESP_OK) {
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    w->error = w->sink(w->ctx, w->buffer, w->len);
+    w->sink_us += esp_timer_get_time() - start;
+    w->total += w->len;
+    w->len = 0;
+}
+
+static void json_raw(json_writer_t *w, const char *data, size_t len)
+{
+    while (len > 0 && w->error == ESP_OK) {
+        size_t room = JSON_WRITER_BUFFER_SIZE - w->len;
+        size_t n = len < room ? len : room;
+        memcpy(w->buffer + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+        if (w->len == JSON_WRITER_BUFFER_SIZE) {
+            json_flush(w);
+        }
+    }
+}
+
+static void json_char(json_writer_t *w, char c)
+{
+    if (w->len == JSON_WRITER_BUFFER_SIZE) {
+        json_flush(w);
+    }
+    if (w->error == ESP_OK) {
+        w->buffer[w->len++] = c;
+    }
+}
+
+// Virgola tra gli elementi dello stesso livello
+static void json_separator(json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    uint32_t bit = 1u << w->depth;
+    if (w->has_items & bit) {
+        json_char(w, ',');
+    }
+    w->has_items |= bit;
+}
+
+// Intero senza segno in decimale, cifre scritte da destra in un buffer locale
+static void json_digits(json_writer_t *w, uint64_t value, uint32_t min_digits)
+{
+    char digits[20];
+    uint32_t n = 0;
+    do {
+        digits[sizeof(digits) - 1 - n] = (char)('0' + value % 10);
+        value /= 10;
+        n++;
+    } while ((value > 0 || n < min_digits) && n < sizeof(digits));
+    json_raw(w, digits + sizeof(digits) - n, n);
+}
+
+void json_writer_init(json_writer_t *w, json_writer_sink_t sink, void *ctx)
+{
+    w->len = 0;
+    w->sink = sink;
+    w->ctx = ctx;
+    w->error = ESP_OK;
+    w->depth = 0;
+    w->has_items = 0;
+    w->after_key = false;
+    w->total = 0;
+    w->sink_us = 0;
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->error == ESP_OK && w->depth != 0) {
+        w->error = ESP_ERR_INVALID_STATE;
+    }
+    json_flush(w);
+    return w->error;
+}
+
+static void json_begin(json_writer_t *w, char c)
+{
+    json_separator(w);
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        w->error = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    json_char(w, c);
+    w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void json_end(json_writer_t *w, char c)
+{
+    if (w->depth == 0) {
+        w->error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    json_char(w, c);
+}
+
+void json_begin_object(json_writer_t *w)
+{
+    json_begin(w, '{');
+}
+
+void json_end_object(json_writer_t *w)
+{
+    json_end(w, '}');
+}
+
+void json_begin_array(json_writer_t *w)
+{
+    json_begin(w, '[');
+}
+
+void json_end_array(json_writer_t *w)
+{
+    json_end(w, ']');
+}
+
+void json_key(json_writer_t *w, const char *key)
+{
+    json_separator(w);
+    json_char(w, '"');
+    json_raw(w, key, strlen(key));
+    json_raw(w, "\":", 2);
+    w->after_key = true;
+}
+
+void json_string(json_writer_t *w, const char *value)
+{
+    static const char hex[] = "0123456789abcdef";
+    json_separator(w);
+    json_char(w, '"');
+    for (const char *p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            json_char(w, '\\');
+            json_char(w, (char)c);
+        } else if (c < 0x20) {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            json_raw(w, escape, sizeof(escape));
+        } else {
+            json_char(w, (char)c);
+        }
+    }
+    json_char(w, '"');
+}
+
+void json_bool(json_writer_t *w, bool value)
+{
+    json_separator(w);
+    if (value) {
+        json_raw(w, "true", 4);
+    } else {
+        json_raw(w, "false", 5);
+    }
+}
+
+void json_uint(json_writer_t *w, uint32_t value)
+{
+    json_separator(w);
+    json_digits(w, value, 1);
+}
+
+void json_int64(json_writer_t *w, int64_t value)
+{
+    json_separator(w);
+    if (value < 0) {
+        json_char(w, '-');
+        json_digits(w, (uint64_t)(-(value + 1)) + 1, 1);
+    } else {
+        json_digits(w, (uint64_t)value, 1);
+    }
+}
+
+void json_fixed(json_writer_t *w, float value, uint32_t decimals)
+{
+    json_separator(w);
+    if (decimals > 6) {
+        decimals = 6;
+    }
+    // NaN e infiniti non sono JSON valido
+    if (value != value || value > 1e12f || value < -1e12f) {
+        json_raw(w, "null", 4);
+        return;
+    }
+    bool negative = value < 0;
+    if (negative) {
+        value = -value;
+    }
+    // Arrotondamento sull'ultimo decimale, poi parte intera e parte frazionaria come interi
+    uint64_t scaled = (uint64_t)(value * json_pow10[decimals] + 0.5f);
+    if (negative && scaled > 0) {
+        json_char(w, '-');
+    }
+    json_digits(w, scaled / json_pow10[decimals], 1);
+    if (decimals > 0) {
+        json_char(w, '.');
+        json_digits(w, scaled % json_pow10[decimals], decimals);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_WRITER_BUFFER_SIZE 512 //byte accumulati prima di ogni scrittura sul sink (un chunk HTTP)
+#define JSON_WRITER_MAX_DEPTH 16 //annidamento massimo di oggetti e array
+
+// Destinazione dei byte serializzati (es. httpd_resp_send_chunk): chiamata a buffer pieno e in chiusura
+typedef esp_err_t (*json_writer_sink_t)(void *ctx, const char *data, size_t len);
+
+// Writer JSON in streaming: nessuna allocazione, il documento passa dal buffer fisso al sink man mano
+// che viene scritto, quindi la dimensione della risposta non è limitata dal buffer
+typedef struct {
+    char buffer[JSON_WRITER_BUFFER_SIZE];
+    size_t len;
+    json_writer_sink_t sink;
+    void *ctx;
+    esp_err_t error;            // primo errore del sink o di struttura: le scritture successive sono ignorate
+    uint32_t depth;
+    uint32_t has_items;         // bit per livello: il livello contiene già un elemento (serve la virgola)
+    bool after_key;             // il prossimo valore segue una chiave (nessuna virgola)
+    size_t total;               // byte emessi
+    int64_t sink_us;            // tempo passato nel sink (rete), escluso dal tempo di serializzazione
+} json_writer_t;
+
+/**
+ * @brief Inizializza il writer
+ * @param w Puntatore al writer
+ * @param sink Destinazione dei byte
+ * @param ctx Contesto del sink
+ */
+void json_writer_init(json_writer_t *w, json_writer_sink_t sink, void *ctx);
+
+/**
+ * @brief Svuota il buffer sul sink
+ * @param w Puntatore al writer
+ * @return ESP_OK, o il primo errore incontrato durante la scrittura
+ */
+esp_err_t json_writer_finish(json_writer_t *w);
+
+void json_begin_object(json_writer_t *w);
+void json_end_object(json_writer_t *w);
+void json_begin_array(json_writer_t *w);
+void json_end_array(json_writer_t *w);
+
+/**
+ * @brief Scrive la chiave del prossimo valore (il nome non viene sottoposto a escape: solo costanti)
+ * @param w Puntatore al writer
+ * @param key Nome del campo
+ */
+void json_key(json_writer_t *w, const char *key);
+
+void json_string(json_writer_t *w, const char *value);
+void json_bool(json_writer_t *w, bool value);
+void json_uint(json_writer_t *w, uint32_t value);
+void json_int64(json_writer_t *w, int64_t value);
+
+/**
+ * @brief Scrive un numero con un numero fisso di decimali (virgola fissa, senza printf)
+ * @param w Puntatore al writer
+ * @param value Valore
+ * @param decimals Decimali (al massimo 6)
+ */
+void json_fixed(json_writer_t *w, float value, uint32_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_WRITER_H
@@ -1,17 +1,39 @@
 #include "webserver.h"
 #include "inference.h"
 #include "camera.h"
+#include "camera_ring.h"
+#include "inference_executor.h"
+#include "monitor.h"
+#include "json_writer.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "lwip/sockets.h"
 #include <fstream>
 #include <sstream>
 
 static const char *TAG = "WEBSERVER";
 
-// Dichiarazioni delle funzioni statiche
-static esp_err_t inference_post_handler(httpd_req_t *req);
+// Scadenza delle richieste di inferenza dal browser (attesa in coda compresa)
+#define WEBSERVER_INFERENCE_DEADLINE_MS 10000
+#define WEBSERVER_INFERENCE_STACK_SIZE 8192 //come la task dell'httpd che eseguiva le inferenze prima dei worker
+#define WEBSERVER_INFERENCE_PRIORITY 4 //sotto l'httpd (5): le richieste leggere hanno sempre la precedenza
+#define WEBSERVER_INFERENCE_MONITOR_NAME "webserver_inference"
+#define WEBSERVER_CLIP_BOUNDARY "clipframe" //separatore delle parti della clip MJPEG
+#define WEBSERVER_CLIP_MAX_GAP_MS 1000 //pausa massima tra due frame della clip durante l'invio
+#define WEBSERVER_STREAM_BOUNDARY "streamframe" //separatore delle parti dello stream MJPEG
+#define WEBSERVER_STREAM_STACK_SIZE 4096
+#define WEBSERVER_STREAM_PRIORITY 1 //sotto l'httpd e l'acquisizione: lo stream usa solo il tempo libero
+#define WEBSERVER_STREAM_WAIT_MS 1000 //attesa massima di un frame (controllo periodico dell'arresto)
+#define WEBSERVER_STREAM_STOP_TIMEOUT_MS 8000 //attesa dell'uscita delle task dello stream: oltre il timeout di invio dell'httpd (5 s)
+#define WEBSERVER_HTTP_SOCKETS 4 //socket per le richieste brevi (/, /photo, /inference) oltre a quelli di stream e WebSocket
+#define WEBSERVER_WS_PAYLOAD_SIZE (512 + MAX_YOLO_DETECTIONS * 200) //risultato serializzato in JSON (detections e persons)
+#define WEBSERVER_WS_GRID_PX 32 //spostamenti dei box sotto questa griglia non cambiano la firma delle detections
+#define WEBSERVER_WS_STACK_SIZE 4096
+#define WEBSERVER_WS_PRIORITY 1 //come lo stream: l'invio bloccato verso un client lento non toglie tempo all'httpd
 
 // Variabile globale per il webserver (singleton per compatibilità)
 static webserver_t g_webserver;
@@ -34,7 +56,7 @@ static esp_err_t get_current_resolution(httpd_req_t *req)
 {
     webserver_t *ws = get_webserver_instance();
     int width, height;
-    camera_get_current_resolution(&ws->camera, &width, &height);
+    camera_get_current_resolution(ws->camera, &width, &height);
 
     // Invia risposta JSON
     char response[128];
@@ -62,7 +84,7 @@ static esp_err_t increment_resolution(httpd_req_t *req)
     }
 
     // Cambia la risoluzione usando la classe Camera
-    esp_err_t ret = camera_change_resolution(&ws->camera, direction);
+    esp_err_t ret = camera_change_resolution(ws->camera, direction);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Errore cambio risoluzione: %s", esp_err_to_name(ret));
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore cambio risoluzione");
@@ -71,7 +93,7 @@ static esp_err_t increment_resolution(httpd_req_t *req)
 
     // Ottieni dimensioni della risoluzione corrente
     int width, height;
-    camera_get_current_resolution(&ws->camera, &width, &height);
+    camera_get_current_resolution(ws->camera, &width, &height);
     ESP_LOGI(TAG, "Risoluzione impostata: %dx%d", width, height);
 
     // Invia risposta JSON
@@ -114,7 +136,7 @@ static esp_err_t capture_get_handler(httpd_req_t *req)
         ESP_LOGI(TAG, "Richiesta scatto foto");
 
         // Scatta la foto usando la classe Camera
-        esp_err_t ret = camera_capture_photo(&ws->camera);
+        esp_err_t ret = camera_capture_photo(ws->camera);
         if (ret != ESP_OK)
         {
             ESP_LOGE(TAG, "Errore scatto foto: %s", esp_err_to_name(ret));
@@ -137,16 +159,23 @@ static esp_err_t photo_get_handler(httpd_req_t *req)
         webserver_t *ws = get_webserver_instance();
         ESP_LOGI(TAG, "Richiesta visualizzazione foto");
 
-    uint8_t *buffer;
-    size_t size;
-
-    esp_err_t ret = camera_get_last_photo(&ws->camera, &buffer, &size);
-    if (ret != ESP_OK)
+    // Riferimento all'ultima foto: resta valida anche se nel frattempo viene scattata un'altra foto
+    camera_frame_t *frame = camera_get_last_frame(ws->camera);
+    if (!frame)
     {
-        ESP_LOGE(TAG, "Nessuna foto disponibile: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Nessuna foto disponibile");
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Nessuna foto disponibile");
         return ESP_FAIL;
     }
+    // In modalità doppio flusso il frame è grezzo: il JPEG viene prodotto qui, solo per questo client
+    const uint8_t *buffer = NULL;
+    size_t size = 0;
+    if (camera_frame_get_jpeg(ws->camera, frame, &buffer, &size) != ESP_OK)
+    {
+        camera_frame_release(frame);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore codifica JPEG");
+        return ESP_FAIL;
+    }
 
     ESP_LOGI(TAG, "Invio foto: %d bytes", size);
 
@@ -158,7 +187,8 @@ static esp_err_t photo_get_handler(httpd_req_t *req)
     httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
 
     // Invia la foto al browser per visualizzarla
-    ret = httpd_resp_send(req, (const char *)buffer, size);
+    esp_err_t ret = httpd_resp_send(req, (const char *)buffer, size);
+    camera_frame_release(frame);
 
     if (ret == ESP_OK)
     {
@@ -172,95 +202,1098 @@ static esp_err_t photo_get_handler(httpd_req_t *req)
     return ret;
 }
 
-// Handler per inferenza
-static esp_err_t inference_post_handler(httpd_req_t *req)
+// Task di invio di una clip: MJPEG (multipart/x-mixed-replace) con transfer chunked, inviato al ritmo
+// di acquisizione così che il browser la riproduca. Le pause tra i frame non bloccano l'httpd
+static void clip_client_task(void *arg)
 {
+    webserver_clip_client_t *client = (webserver_clip_client_t *)arg;
     webserver_t *ws = get_webserver_instance();
-    ESP_LOGI(TAG, "Richiesta inferenza ricevuta");
-    
-    // Scatta una nuova foto
-    if (camera_capture_photo(&ws->camera) != ESP_OK) {
-        ESP_LOGE(TAG, "Errore durante lo scatto della foto");
+    httpd_req_t *req = client->req;
+    camera_frame_t **frames = client->frames;
+
+    httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=" WEBSERVER_CLIP_BOUNDARY);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    esp_err_t ret = ESP_OK;
+    char part[160];
+    for (uint32_t i = 0; i < client->count && ret == ESP_OK && ws->stream_running; i++) {
+        const uint8_t *jpeg = NULL;
+        size_t jpeg_len = 0;
+        if (camera_frame_get_jpeg(ws->camera, frames[i], &jpeg, &jpeg_len) != ESP_OK) {
+            continue;
+        }
+        if (i > 0) {
+            int64_t gap_ms = (frames[i]->timestamp_us - frames[i - 1]->timestamp_us) / 1000;
+            if (gap_ms > 0) {
+                vTaskDelay(pdMS_TO_TICKS(gap_ms < WEBSERVER_CLIP_MAX_GAP_MS ? gap_ms : WEBSERVER_CLIP_MAX_GAP_MS));
+            }
+        }
+        int len = snprintf(part, sizeof(part),
+                           "--" WEBSERVER_CLIP_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                           "X-Timestamp-Us: %lld\r\n\r\n",
+                           (unsigned)jpeg_len, (long long)frames[i]->timestamp_us);
+        ret = httpd_resp_send_chunk(req, part, len);
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, (const char *)jpeg, jpeg_len);
+        }
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, "\r\n", 2);
+        }
+    }
+    if (ret == ESP_OK) {
+        httpd_resp_send_chunk(req, "--" WEBSERVER_CLIP_BOUNDARY "--\r\n", HTTPD_RESP_USE_STRLEN);
+        httpd_resp_send_chunk(req, NULL, 0);
+    } else {
+        ESP_LOGW(TAG, "Invio clip interrotto: %s", esp_err_to_name(ret));
+    }
+
+    for (uint32_t i = 0; i < client->count; i++) {
+        camera_frame_release(frames[i]);
+    }
+    // Come per lo stream: la richiesta esce dal client prima di essere liberata
+    taskENTER_CRITICAL(&ws->stream_lock);
+    client->req = NULL;
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    httpd_req_async_handler_complete(req);
+
+    taskENTER_CRITICAL(&ws->stream_lock);
+    client->count = 0;
+    client->task = NULL;
+    client->active = false;
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    vTaskDelete(NULL);
+}
+
+// Handler per la clip dell'ultimo evento: i frame vengono presi dall'anello e la richiesta passa a una
+// task dedicata (httpd_req_async_handler_begin), come per /stream
+static esp_err_t clip_get_handler(httpd_req_t *req)
+{
+    webserver_t *ws = get_webserver_instance();
+    webserver_clip_client_t *client = NULL;
+    taskENTER_CRITICAL(&ws->stream_lock);
+    for (int i = 0; i < WEBSERVER_CLIP_MAX_CLIENTS && ws->stream_running; i++) {
+        if (!ws->clip_clients[i].active) {
+            client = &ws->clip_clients[i];
+            memset(client, 0, sizeof(webserver_clip_client_t));
+            client->active = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    if (!client) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Troppe clip in invio", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (camera_ring_get_clip(get_camera_ring_instance(), client->frames, &client->count) != ESP_OK ||
+        client->count == 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Nessuna clip disponibile");
+        ret = ESP_FAIL;
+    } else {
+        ESP_LOGI(TAG, "Invio clip: %lu frame", client->count);
+        httpd_req_t *async_req = NULL;
+        ret = httpd_req_async_handler_begin(req, &async_req);
+        if (ret == ESP_OK) {
+            client->req = async_req;
+            if (xTaskCreate(clip_client_task, "ws_clip", WEBSERVER_STREAM_STACK_SIZE, client,
+                            WEBSERVER_STREAM_PRIORITY, &client->task) != pdPASS) {
+                httpd_resp_send_err(async_req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore creazione task");
+                httpd_req_async_handler_complete(async_req);
+                ret = ESP_ERR_NO_MEM;
+            }
+        } else {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore avvio clip");
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Errore avvio clip: %s", esp_err_to_name(ret));
+        }
+    }
+    if (ret != ESP_OK) {
+        for (uint32_t i = 0; i < client->count; i++) {
+            camera_frame_release(client->frames[i]);
+        }
+        taskENTER_CRITICAL(&ws->stream_lock);
+        client->req = NULL;
+        client->count = 0;
+        client->active = false;
+        taskEXIT_CRITICAL(&ws->stream_lock);
+        return ESP_FAIL;
+    }
+
+    // Da qui i frame e la richiesta appartengono alla task della clip
+    return ESP_OK;
+}
+
+// Invia una parte dello stream MJPEG (intestazione, JPEG, terminatore)
+static esp_err_t stream_send_part(httpd_req_t *req, const camera_frame_t *frame, const uint8_t *jpeg, size_t jpeg_len)
+{
+    char part[160];
+    int len = snprintf(part, sizeof(part),
+                       "--" WEBSERVER_STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                       "X-Timestamp-Us: %lld\r\n\r\n",
+                       (unsigned)jpeg_len, (long long)frame->timestamp_us);
+    esp_err_t ret = httpd_resp_send_chunk(req, part, len);
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, (const char *)jpeg, jpeg_len);
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, "\r\n", 2);
+    }
+    return ret;
+}
+
+// Task di un client /stream: attende il frame più recente dopo il proprio cursore e lo invia. Mentre il
+// client è lento l'acquisizione prosegue; al frame successivo il cursore salta all'ultimo frame disponibile
+static void stream_client_task(void *arg)
+{
+    webserver_stream_client_t *client = (webserver_stream_client_t *)arg;
+    webserver_t *ws = get_webserver_instance();
+    httpd_req_t *req = client->req;
+
+    httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=" WEBSERVER_STREAM_BOUNDARY);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    esp_err_t ret = ESP_OK;
+    while (ws->stream_running && ret == ESP_OK) {
+        camera_frame_t *frame = NULL;
+        esp_err_t wait = camera_wait_frame(ws->camera, client->last_sequence, pdMS_TO_TICKS(WEBSERVER_STREAM_WAIT_MS), &frame);
+        if (wait == ESP_ERR_INVALID_STATE) {
+            // Acquisizione continua fermata (CLI) o camera reinizializzata: si riprova più tardi
+            vTaskDelay(pdMS_TO_TICKS(200));
+            continue;
+        }
+        if (wait != ESP_OK) {
+            continue;
+        }
+
+        const uint8_t *jpeg = NULL;
+        size_t jpeg_len = 0;
+        if (camera_frame_get_jpeg(ws->camera, frame, &jpeg, &jpeg_len) != ESP_OK) {
+            camera_frame_release(frame);
+            continue;
+        }
+        ret = stream_send_part(req, frame, jpeg, jpeg_len);
+        uint32_t sequence = frame->sequence;
+        camera_frame_release(frame);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        int64_t now = esp_timer_get_time();
+        taskENTER_CRITICAL(&ws->stream_lock);
+        // Frame acquisiti dopo quello inviato in precedenza e mai visti da questo client
+        if (client->last_sequence != 0 && sequence > client->last_sequence + 1) {
+            client->frames_skipped += sequence - client->last_sequence - 1;
+        }
+        client->last_sequence = sequence;
+        client->frames_sent++;
+        client->bytes_sent += jpeg_len;
+        client->fps_window_frames++;
+        if (now - client->fps_window_us >= 1000000) {
+            client->fps = client->fps_window_frames * 1000000.0f / (now - client->fps_window_us);
+            client->fps_window_us = now;
+            client->fps_window_frames = 0;
+        }
+        taskEXIT_CRITICAL(&ws->stream_lock);
+    }
+
+    if (ret == ESP_OK) {
+        httpd_resp_send_chunk(req, "--" WEBSERVER_STREAM_BOUNDARY "--\r\n", HTTPD_RESP_USE_STRLEN);
+        httpd_resp_send_chunk(req, NULL, 0);
+    }
+    // La richiesta esce dal client prima di essere liberata: webserver_stop legge il socket sotto il lock
+    taskENTER_CRITICAL(&ws->stream_lock);
+    client->req = NULL;
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    httpd_req_async_handler_complete(req);
+
+    int64_t duration_ms = (esp_timer_get_time() - client->started_us) / 1000;
+    ESP_LOGI(TAG, "Stream %lu chiuso (%s): %lu frame inviati, %lu saltati, %llu KB in %lld ms",
+             client->id, ret == ESP_OK ? "arresto" : esp_err_to_name(ret), client->frames_sent,
+             client->frames_skipped, client->bytes_sent / 1024, duration_ms);
+
+    taskENTER_CRITICAL(&ws->stream_lock);
+    client->task = NULL;
+    client->active = false;
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    vTaskDelete(NULL);
+}
+
+// Handler per lo stream MJPEG dal vivo: la richiesta passa a una task dedicata al client
+// (httpd_req_async_handler_begin), così l'httpd resta libero per le altre richieste
+static esp_err_t stream_get_handler(httpd_req_t *req)
+{
+    webserver_t *ws = get_webserver_instance();
+
+    // Lo stream legge i frame dell'acquisizione continua, condivisa con l'anello dei frame recenti
+    esp_err_t ret = camera_start_capture(ws->camera);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Errore avvio acquisizione continua: %s", esp_err_to_name(ret));
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore camera");
         return ESP_FAIL;
     }
-    
-    // Ottieni i dati della foto
-    uint8_t *photo_buffer;
-    size_t photo_size;
-    if (camera_get_last_photo(&ws->camera, &photo_buffer, &photo_size) != ESP_OK) {
-        ESP_LOGE(TAG, "Nessuna foto disponibile per l'inferenza");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Nessuna foto");
+
+    webserver_stream_client_t *client = NULL;
+    taskENTER_CRITICAL(&ws->stream_lock);
+    for (int i = 0; i < WEBSERVER_STREAM_MAX_CLIENTS && ws->stream_running; i++) {
+        if (!ws->stream_clients[i].active) {
+            client = &ws->stream_clients[i];
+            memset(client, 0, sizeof(webserver_stream_client_t));
+            client->active = true;
+            client->id = ++ws->stream_next_id;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    if (!client) {
+        ESP_LOGW(TAG, "Stream rifiutato: %d client già connessi", WEBSERVER_STREAM_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Troppi client sullo stream", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    uint32_t id = client->id;
+    client->started_us = esp_timer_get_time();
+    client->fps_window_us = client->started_us;
+
+    httpd_req_t *async_req = NULL;
+    ret = httpd_req_async_handler_begin(req, &async_req);
+    if (ret == ESP_OK) {
+        client->req = async_req;
+        if (xTaskCreate(stream_client_task, "ws_stream", WEBSERVER_STREAM_STACK_SIZE, client,
+                        WEBSERVER_STREAM_PRIORITY, &client->task) != pdPASS) {
+            httpd_resp_send_err(async_req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore creazione task");
+            httpd_req_async_handler_complete(async_req);
+            ret = ESP_ERR_NO_MEM;
+        }
+    } else {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore avvio stream");
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Errore avvio stream: %s", esp_err_to_name(ret));
+        taskENTER_CRITICAL(&ws->stream_lock);
+        client->req = NULL;
+        client->active = false;
+        taskEXIT_CRITICAL(&ws->stream_lock);
         return ESP_FAIL;
     }
+
+    // Da qui il client appartiene alla sua task
+    ESP_LOGI(TAG, "Stream %lu avviato", id);
+    return ESP_OK;
+}
+
+// Copia dei client /stream connessi (fps dell'ultima finestra, azzerati se il client è fermo da più di 2 s)
+static uint32_t stream_get_clients(webserver_t *ws, webserver_stream_client_t *clients)
+{
+    uint32_t count = 0;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&ws->stream_lock);
+    for (int i = 0; i < WEBSERVER_STREAM_MAX_CLIENTS; i++) {
+        if (ws->stream_clients[i].active) {
+            clients[count] = ws->stream_clients[i];
+            if (now - clients[count].fps_window_us > 2000000) {
+                clients[count].fps = 0;
+            }
+            count++;
+        }
+    }
+    taskEXIT_CRITICAL(&ws->stream_lock);
+    return count;
+}
+
+// Handler per le statistiche dello stream: fps inviati e frame saltati per ogni client
+static esp_err_t stream_stats_get_handler(httpd_req_t *req)
+{
+    webserver_t *ws = get_webserver_instance();
+    webserver_stream_client_t clients[WEBSERVER_STREAM_MAX_CLIENTS];
+    uint32_t count = stream_get_clients(ws, clients);
+
+    char response[160 + WEBSERVER_STREAM_MAX_CLIENTS * 192];
+    int64_t now = esp_timer_get_time();
+    int len = snprintf(response, sizeof(response), "{\"max_clients\":%d,\"num_clients\":%lu,\"clients\":[",
+                       WEBSERVER_STREAM_MAX_CLIENTS, count);
+    for (uint32_t i = 0; i < count; i++) {
+        len += snprintf(response + len, sizeof(response) - len,
+            "%s{\"id\":%lu,\"connected_ms\":%lld,\"fps\":%.1f,\"frames_sent\":%lu,\"frames_dropped\":%lu,\"bytes_sent\":%llu}",
+            i > 0 ? "," : "", clients[i].id, (now - clients[i].started_us) / 1000, clients[i].fps,
+            clients[i].frames_sent, clients[i].frames_skipped, clients[i].bytes_sent);
+    }
+    len += snprintf(response + len, sizeof(response) - len, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, response, len);
+}
+
+// Sink del writer JSON verso una risposta HTTP chunked
+static esp_err_t json_sink_httpd(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// Sink del writer JSON verso un buffer in memoria (messaggi WebSocket)
+typedef struct {
+    char *data;
+    size_t size;
+    size_t len;
+} json_memory_sink_t;
+
+static esp_err_t json_sink_memory(void *ctx, const char *data, size_t len)
+{
+    json_memory_sink_t *sink = (json_memory_sink_t *)ctx;
+    if (sink->len + len > sink->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    return ESP_OK;
+}
+
+static void write_box(json_writer_t *w, const uint32_t box[4])
+{
+    json_begin_array(w);
+    for (int k = 0; k < 4; k++) {
+        json_uint(w, box[k]);
+    }
+    json_end_array(w);
+}
+
+// Campi di un risultato (YOLO o facce), condivisi dalle risposte HTTP e dai messaggi WebSocket
+static void write_result_fields(json_writer_t *w, inference_job_type_t type, const inference_result_t *result)
+{
+    json_key(w, "inference_time_ms");
+    json_uint(w, result->full_inference_time_ms);
+    json_key(w, "end_to_end_ms");
+    json_uint(w, result->end_to_end_ms);
+    json_key(w, "frame_width");
+    json_uint(w, result->frame_width);
+    json_key(w, "frame_height");
+    json_uint(w, result->frame_height);
+
+    if (type == INFERENCE_JOB_YOLO) {
+        uint32_t count = result->num_yolo_detections < MAX_YOLO_DETECTIONS ? result->num_yolo_detections : MAX_YOLO_DETECTIONS;
+        json_key(w, "person_detected");
+        json_bool(w, result->person_detected);
+        json_key(w, "input_size");
+        json_uint(w, result->yolo_input_size);
+        json_key(w, "num_detections");
+        json_uint(w, count);
+        json_key(w, "detections");
+        json_begin_array(w);
+        for (uint32_t i = 0; i < count; i++) {
+            const yolo_detection_t *det = &result->yolo_detections[i];
+            json_begin_object(w);
+            json_key(w, "class_id");
+            json_uint(w, det->class_id);
+            json_key(w, "class_name");
+            json_string(w, det->class_name);
+            json_key(w, "score");
+            json_fixed(w, det->score, 3);
+            json_key(w, "box");
+            write_box(w, det->box);
+            json_end_object(w);
+        }
+        json_end_array(w);
+        // Campi letti dalla pagina web: solo le detections della classe "person"
+        uint32_t num_persons = 0;
+        json_key(w, "persons");
+        json_begin_array(w);
+        for (uint32_t i = 0; i < count; i++) {
+            const yolo_detection_t *det = &result->yolo_detections[i];
+            if (det->class_id != 0) {
+                continue;
+            }
+            json_begin_object(w);
+            json_key(w, "confidence");
+            json_fixed(w, det->score, 3);
+            json_key(w, "bounding_box");
+            write_box(w, det->box);
+            json_end_object(w);
+            num_persons++;
+        }
+        json_end_array(w);
+        json_key(w, "num_persons");
+        json_uint(w, num_persons);
+    } else {
+        uint32_t count = result->num_faces < MAX_FACES ? result->num_faces : MAX_FACES;
+        json_key(w, "face_detected");
+        json_bool(w, result->face_detected);
+        json_key(w, "num_faces");
+        json_uint(w, count);
+        json_key(w, "faces");
+        json_begin_array(w);
+        for (uint32_t i = 0; i < count; i++) {
+            const face_t *face = &result->faces[i];
+            const uint32_t max_keypoints = sizeof(face->keypoints) / sizeof(face->keypoints[0]);
+            uint32_t num_keypoints = face->num_keypoints < max_keypoints ? face->num_keypoints : max_keypoints;
+            json_begin_object(w);
+            json_key(w, "confidence");
+            json_fixed(w, face->confidence, 3);
+            json_key(w, "bounding_box");
+            write_box(w, face->bounding_boxes);
+            json_key(w, "keypoints");
+            json_begin_array(w);
+            for (uint32_t k = 0; k < num_keypoints; k++) {
+                json_uint(w, face->keypoints[k]);
+            }
+            json_end_array(w);
+            json_key(w, "num_keypoints");
+            json_uint(w, num_keypoints);
+            json_key(w, "category");
+            json_uint(w, face->category);
+            json_end_object(w);
+        }
+        json_end_array(w);
+    }
+}
+
+// Firma delle detections (FNV-1a su classi e box quantizzati): uguale se gli oggetti sono gli stessi
+// e si sono spostati di meno di WEBSERVER_WS_GRID_PX
+static uint32_t ws_result_signature(inference_job_type_t type, const inference_result_t *result)
+{
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 16777619u;
+    };
+    mix(type);
+    if (type == INFERENCE_JOB_YOLO) {
+        mix(result->num_yolo_detections);
+        for (uint32_t i = 0; i < result->num_yolo_detections && i < MAX_YOLO_DETECTIONS; i++) {
+            const yolo_detection_t *det = &result->yolo_detections[i];
+            mix(det->class_id);
+            for (int k = 0; k < 4; k++) {
+                mix(det->box[k] / WEBSERVER_WS_GRID_PX);
+            }
+        }
+    } else {
+        mix(result->num_faces);
+        for (uint32_t i = 0; i < result->num_faces && i < MAX_FACES; i++) {
+            for (int k = 0; k < 4; k++) {
+                mix(result->faces[i].bounding_boxes[k] / WEBSERVER_WS_GRID_PX);
+            }
+        }
+    }
+    return hash;
+}
+
+// Serializza un risultato nel messaggio inviato agli iscritti (stessi campi delle risposte HTTP)
+static int ws_result_to_json(inference_job_type_t type, const inference_result_t *result, char *out, size_t size)
+{
+    json_memory_sink_t sink = {out, size, 0};
+    json_writer_t writer;
+    json_writer_init(&writer, json_sink_memory, &sink);
+    json_begin_object(&writer);
+    json_key(&writer, "type");
+    json_string(&writer, type == INFERENCE_JOB_YOLO ? "yolo" : "face");
+    json_key(&writer, "timestamp_us");
+    json_int64(&writer, esp_timer_get_time());
+    write_result_fields(&writer, type, result);
+    json_end_object(&writer);
+    // Messaggio troncato: meglio non inviarlo che inviare JSON non valido
+    return json_writer_finish(&writer) == ESP_OK ? (int)sink.len : -1;
+}
+
+// Invio dell'ultimo risultato a tutti gli iscritti (sulla task di invio: httpd_ws_send_frame_async
+// blocca fino al timeout di invio verso un client che non legge)
+static void ws_broadcast(webserver_t *ws)
+{
+    xSemaphoreTake(ws->ws_mutex, portMAX_DELAY);
+    if (!ws->ws_pending || !ws->ws_sending || !ws->ws_has_pending) {
+        xSemaphoreGive(ws->ws_mutex);
+        return;
+    }
+    char *payload = ws->ws_sending;
+    memcpy(payload, ws->ws_pending, ws->ws_pending_len);
+    size_t len = ws->ws_pending_len;
+    uint32_t signature = ws->ws_pending_signature;
+    ws->ws_has_pending = false;
+    xSemaphoreGive(ws->ws_mutex);
+
+    webserver_ws_subscriber_t subscribers[WEBSERVER_WS_MAX_SUBSCRIBERS];
+    taskENTER_CRITICAL(&ws->ws_lock);
+    memcpy(subscribers, ws->ws_subscribers, sizeof(subscribers));
+    taskEXIT_CRITICAL(&ws->ws_lock);
+
+    httpd_ws_frame_t frame = {};
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.final = true;
+    frame.payload = (uint8_t *)payload;
+    frame.len = len;
+    for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+        int fd = subscribers[i].fd;
+        if (fd < 0) {
+            continue;
+        }
+        bool send = !subscribers[i].changes_only || subscribers[i].last_signature != signature;
+        esp_err_t ret = ESP_OK;
+        if (send) {
+            ret = httpd_ws_get_fd_info(ws->server, fd) == HTTPD_WS_CLIENT_WEBSOCKET
+                ? httpd_ws_send_frame_async(ws->server, fd, &frame) : ESP_ERR_INVALID_STATE;
+        }
+        taskENTER_CRITICAL(&ws->ws_lock);
+        webserver_ws_subscriber_t *sub = &ws->ws_subscribers[i];
+        if (sub->fd == fd) {
+            if (ret != ESP_OK) {
+                sub->fd = -1;
+                ws->ws_send_errors++;
+            } else if (send) {
+                sub->sent++;
+                sub->last_signature = signature;
+            } else {
+                sub->unchanged++;
+            }
+        }
+        taskEXIT_CRITICAL(&ws->ws_lock);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Iscritto /ws/detections (socket %d) rimosso: %s", fd, esp_err_to_name(ret));
+        }
+    }
+}
+
+// Task di invio di /ws/detections: svegliata dall'osservatore dei risultati
+static void ws_push_task(void *arg)
+{
+    webserver_t *ws = (webserver_t *)arg;
+    while (ws->ws_running) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WEBSERVER_STREAM_WAIT_MS));
+        if (ws->ws_running) {
+            ws_broadcast(ws);
+        }
+    }
+    ws->ws_task = NULL;
+    vTaskDelete(NULL);
+}
+
+// Osservatore dei risultati dell'executor: un'inferenza serve tutti gli iscritti, qualunque sia il chiamante
+static void ws_result_listener(inference_job_type_t type, const inference_result_t *result, void *ctx)
+{
+    webserver_t *ws = (webserver_t *)ctx;
+
+    bool subscribed = false;
+    taskENTER_CRITICAL(&ws->ws_lock);
+    for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+        subscribed |= ws->ws_subscribers[i].fd >= 0;
+    }
+    taskEXIT_CRITICAL(&ws->ws_lock);
+    if (!subscribed) {
+        return;
+    }
+
+    // Non blocca l'executor: se il buffer è occupato a lungo il risultato viene saltato
+    if (xSemaphoreTake(ws->ws_mutex, pdMS_TO_TICKS(20)) != pdTRUE) {
+        taskENTER_CRITICAL(&ws->ws_lock);
+        ws->ws_coalesced++;
+        taskEXIT_CRITICAL(&ws->ws_lock);
+        return;
+    }
+    if (!ws->ws_pending) {
+        xSemaphoreGive(ws->ws_mutex);
+        return;
+    }
+    int len = ws_result_to_json(type, result, ws->ws_pending, WEBSERVER_WS_PAYLOAD_SIZE);
+    if (len < 0) {
+        xSemaphoreGive(ws->ws_mutex);
+        return;
+    }
+    // Contatori letti da webserver_print_ws_stats sotto ws_lock
+    taskENTER_CRITICAL(&ws->ws_lock);
+    if (ws->ws_has_pending) {
+        ws->ws_coalesced++;
+    }
+    ws->ws_results++;
+    taskEXIT_CRITICAL(&ws->ws_lock);
+    ws->ws_pending_len = len;
+    ws->ws_pending_signature = ws_result_signature(type, result);
+    ws->ws_has_pending = true;
+    if (ws->ws_task) {
+        xTaskNotifyGive(ws->ws_task);
+    }
+    xSemaphoreGive(ws->ws_mutex);
+}
+
+// Handler di /ws/detections: all'handshake il client diventa un iscritto (?changes=1 per ricevere solo i
+// cambiamenti); i messaggi di testo "changes" e "all" cambiano la modalità
+static esp_err_t ws_detections_handler(httpd_req_t *req)
+{
+    webserver_t *ws = get_webserver_instance();
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        bool changes_only = false;
+        char query[32];
+        char value[8];
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+            httpd_query_key_value(query, "changes", value, sizeof(value)) == ESP_OK) {
+            changes_only = atoi(value) != 0;
+        }
+        int slot = -1;
+        taskENTER_CRITICAL(&ws->ws_lock);
+        for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS && slot < 0; i++) {
+            if (ws->ws_subscribers[i].fd < 0) {
+                slot = i;
+                memset(&ws->ws_subscribers[i], 0, sizeof(webserver_ws_subscriber_t));
+                ws->ws_subscribers[i].fd = fd;
+                ws->ws_subscribers[i].changes_only = changes_only;
+            }
+        }
+        taskEXIT_CRITICAL(&ws->ws_lock);
+        if (slot < 0) {
+            // Handshake già completato: il client viene chiuso subito
+            ESP_LOGW(TAG, "Iscrizione /ws/detections rifiutata: %d iscritti", WEBSERVER_WS_MAX_SUBSCRIBERS);
+            httpd_sess_trigger_close(req->handle, fd);
+            return ESP_OK;
+        }
+        ESP_LOGI(TAG, "Nuovo iscritto /ws/detections (socket %d%s)", fd, changes_only ? ", solo cambiamenti" : "");
+        return ESP_OK;
+    }
+
+    // Lunghezza del messaggio, poi il contenuto (i messaggi lunghi vengono letti e ignorati)
+    char text[16] = {};
+    httpd_ws_frame_t frame = {};
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK || frame.len == 0) {
+        return ret;
+    }
+    uint8_t *payload = frame.len < sizeof(text) ? (uint8_t *)text : (uint8_t *)heap_caps_malloc(frame.len, MALLOC_CAP_8BIT);
+    if (!payload) {
+        return ESP_ERR_NO_MEM;
+    }
+    frame.payload = payload;
+    ret = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (payload != (uint8_t *)text) {
+        heap_caps_free(payload);
+        return ret;
+    }
+    if (ret == ESP_OK && frame.type == HTTPD_WS_TYPE_TEXT) {
+        bool changes = strcmp(text, "changes") == 0;
+        if (changes || strcmp(text, "all") == 0) {
+            taskENTER_CRITICAL(&ws->ws_lock);
+            for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+                if (ws->ws_subscribers[i].fd == fd) {
+                    ws->ws_subscribers[i].changes_only = changes;
+                }
+            }
+            taskEXIT_CRITICAL(&ws->ws_lock);
+        }
+    }
+    return ret;
+}
+
+// Chiusura di un socket dell'httpd: l'eventuale iscritto viene rimosso prima che il descrittore sia riusato
+static void webserver_close_fn(httpd_handle_t hd, int sockfd)
+{
+    webserver_t *ws = get_webserver_instance();
+    taskENTER_CRITICAL(&ws->ws_lock);
+    for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+        if (ws->ws_subscribers[i].fd == sockfd) {
+            ws->ws_subscribers[i].fd = -1;
+        }
+    }
+    taskEXIT_CRITICAL(&ws->ws_lock);
+    close(sockfd);
+}
+
+// Attesa residua prima della scadenza di una richiesta di inferenza (attesa in coda compresa)
+static TickType_t webserver_inference_remaining(int64_t deadline_us)
+{
+    int64_t remaining_ms = (deadline_us - esp_timer_get_time()) / 1000;
+    return remaining_ms > 0 ? pdMS_TO_TICKS(remaining_ms) : 0;
+}
+
+// Risposta a una richiesta di inferenza, condivisa da tutte le richieste dello stesso volo
+typedef struct {
+    const char *status;
+    const char *type;
+    const char *message;            // corpo delle risposte di errore
+    inference_result_t *result;     // risultato (heap) serializzato per ogni richiesta, NULL in caso di errore
+    inference_job_type_t job_type;
+} webserver_inference_response_t;
+
+static void inference_response_error(webserver_inference_response_t *response, const char *status, const char *message)
+{
+    response->status = status;
+    response->type = HTTPD_TYPE_TEXT;
+    response->message = message;
+    response->result = NULL;
+}
+
+static void inference_response_send(webserver_t *ws, httpd_req_t *req, const webserver_inference_response_t *response)
+{
+    httpd_resp_set_status(req, response->status);
+    httpd_resp_set_type(req, response->type);
+    esp_err_t ret;
+    if (!response->result) {
+        ret = httpd_resp_send(req, response->message, HTTPD_RESP_USE_STRLEN);
+    } else {
+        // JSON scritto direttamente nei chunk della risposta: nessun buffer della dimensione del documento
+        int64_t start = esp_timer_get_time();
+        json_writer_t writer;
+        json_writer_init(&writer, json_sink_httpd, req);
+        json_begin_object(&writer);
+        write_result_fields(&writer, response->job_type, response->result);
+        uint32_t serialize_us = (uint32_t)(esp_timer_get_time() - start - writer.sink_us);
+        json_key(&writer, "serialize_us");
+        json_uint(&writer, serialize_us);
+        json_key(&writer, "success");
+        json_bool(&writer, true);
+        json_end_object(&writer);
+        ret = json_writer_finish(&writer);
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, NULL, 0);
+        }
+        taskENTER_CRITICAL(&ws->inference_lock);
+        ws->inference_stats.serialized++;
+        ws->inference_stats.serialize_us_total += serialize_us;
+        if (serialize_us > ws->inference_stats.serialize_us_max) {
+            ws->inference_stats.serialize_us_max = serialize_us;
+        }
+        if (writer.total > ws->inference_stats.response_bytes_max) {
+            ws->inference_stats.response_bytes_max = writer.total;
+        }
+        taskEXIT_CRITICAL(&ws->inference_lock);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Errore invio risposta di inferenza: %s", esp_err_to_name(ret));
+    }
+    httpd_req_async_handler_complete(req);
+}
+
+// Aggancia una richiesta al volo in corso dello stesso tipo, se è partito da meno della finestra di
+// coalescenza: la richiesta riceverà la stessa risposta senza un'altra acquisizione e inferenza.
+// Da chiamare con inference_lock acquisito
+static bool inference_flight_try_join(webserver_t *ws, inference_job_type_t type, httpd_req_t *req, int64_t received_us)
+{
+    webserver_inference_flight_t *flight = &ws->inference_flights[type];
+    if (flight->active && ws->coalesce_window_ms > 0 &&
+        received_us - flight->started_us <= ws->coalesce_window_ms * 1000LL &&
+        flight->num_followers < WEBSERVER_INFERENCE_MAX_SHARED) {
+        flight->followers[flight->num_followers++] = req;
+        ws->inference_stats.coalesced++;
+        return true;
+    }
+    return false;
+}
+
+// Indica se una richiesta ricevuta ora verrebbe agganciata al volo in corso (senza agganciarla)
+static bool inference_flight_joinable(webserver_t *ws, inference_job_type_t type, int64_t received_us)
+{
+    taskENTER_CRITICAL(&ws->inference_lock);
+    webserver_inference_flight_t *flight = &ws->inference_flights[type];
+    bool joinable = flight->active && ws->coalesce_window_ms > 0 &&
+                    received_us - flight->started_us <= ws->coalesce_window_ms * 1000LL &&
+                    flight->num_followers < WEBSERVER_INFERENCE_MAX_SHARED;
+    taskEXIT_CRITICAL(&ws->inference_lock);
+    return joinable;
+}
+
+static bool inference_flight_join(webserver_t *ws, inference_job_type_t type, httpd_req_t *req, int64_t received_us)
+{
+    taskENTER_CRITICAL(&ws->inference_lock);
+    bool joined = inference_flight_try_join(ws, type, req, received_us);
+    taskEXIT_CRITICAL(&ws->inference_lock);
+    return joined;
+}
+
+// Face detection per una richiesta HTTP (worker delle inferenze): la risposta viene preparata una volta
+// e inviata a tutte le richieste che condividono l'inferenza
+static void inference_face_run(webserver_t *ws, int64_t deadline_us, webserver_inference_response_t *response)
+{
+    ESP_LOGI(TAG, "Richiesta inferenza ricevuta");
     
-    // Esegui inferenza
+    // Scatta una nuova foto: il frame viene condiviso con l'executor senza copie
+    camera_frame_t *frame = NULL;
+    if (camera_capture_frame(ws->camera, &frame) != ESP_OK) {
+        ESP_LOGE(TAG, "Errore durante lo scatto della foto");
+        inference_response_error(response, "500 Internal Server Error", "Errore camera");
+        return;
+    }
+    size_t photo_size = frame->len;
+
+    // Esegui inferenza tramite l'executor, in classe interattiva (passa davanti ai frame in background)
     ESP_LOGI(TAG, "Avvio inferenza su immagine di %zu bytes", photo_size);
-    inference_result_t result;
-    if (!inference_process_image(photo_buffer, photo_size, &result)) {
-        ESP_LOGE(TAG, "Errore durante l'inferenza - photo_size: %zu bytes, photo_buffer: %p", 
-                 photo_size, (void*)photo_buffer);
+    inference_job_t job = {};
+    job.type = INFERENCE_JOB_FACE;
+    job.priority = INFERENCE_PRIORITY_INTERACTIVE;
+    camera_frame_attach_job(frame, &job);
+    job.deadline_us = deadline_us;
+
+    // Risultato fuori dallo stack del worker
+    inference_result_t *result = (inference_result_t *)heap_caps_malloc(sizeof(inference_result_t), MALLOC_CAP_8BIT);
+    if (!result) {
+        camera_frame_release(frame);
+        inference_response_error(response, "500 Internal Server Error", "Memoria insufficiente");
+        return;
+    }
+    inference_job_status_t status = INFERENCE_JOB_FAILED;
+    esp_err_t ret = inference_executor_run_sync(get_inference_executor_instance(), &job,
+                                                webserver_inference_remaining(deadline_us), result, &status);
+    if (ret != ESP_OK) {
+        heap_caps_free(result);
+        camera_frame_release(frame);
+        ESP_LOGE(TAG, "Executor di inferenza occupato: %s", esp_err_to_name(ret));
+        inference_response_error(response, "503 Service Unavailable", "Inferenza occupata");
+        return;
+    }
+    if (status != INFERENCE_JOB_DONE) {
+        heap_caps_free(result);
+        ESP_LOGE(TAG, "Errore durante l'inferenza (esito %d) - photo_size: %zu bytes", status, photo_size);
         ESP_LOGE(TAG, "Da controllare: 1) Sistema inferenza inizializzato 2) Dati JPEG validi 3) Memoria disponibile");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore inferenza");
-        return ESP_FAIL;
+        inference_response_error(response, status == INFERENCE_JOB_EXPIRED ? "504 Gateway Timeout" :
+                                 "500 Internal Server Error", "Errore inferenza");
+        return;
     }
     
-    // Prepara risposta JSON
-    char response[2048]; // Aumentato per supportare multiple facce
-    
-    // Costruisci array JSON per tutte le facce
-    char faces_array[1024] = "[";
-    for (uint32_t i = 0; i < result.num_faces && i < MAX_FACES; i++) {
-        // Costruisci array keypoints per questa faccia
-        char keypoints_str[256] = "[";
-        if (result.faces[i].num_keypoints > 0) {
-            for (size_t k = 0; k < result.faces[i].num_keypoints; k++) {
-                char temp[16];
-                snprintf(temp, sizeof(temp), "%lu", result.faces[i].keypoints[k]);
-                strcat(keypoints_str, temp);
-                if (k < result.faces[i].num_keypoints - 1) strcat(keypoints_str, ",");
+    // La risposta JSON viene scritta in streaming da inference_response_send
+    response->status = HTTPD_200;
+    response->type = "application/json";
+    response->result = result;
+    response->job_type = INFERENCE_JOB_FACE;
+}
+
+// Inferenza YOLO per una richiesta HTTP (worker delle inferenze): attende il risultato dall'executor,
+// le detections vengono scritte in JSON all'invio
+static void inference_yolo_run(webserver_t *ws, int64_t deadline_us, webserver_inference_response_t *response)
+{
+    ESP_LOGI(TAG, "Richiesta inferenza YOLO ricevuta");
+
+    // Scatta una nuova foto, condivisa con l'executor senza copie
+    camera_frame_t *frame = NULL;
+    if (camera_capture_frame(ws->camera, &frame) != ESP_OK) {
+        ESP_LOGE(TAG, "Errore durante lo scatto della foto");
+        inference_response_error(response, "500 Internal Server Error", "Errore acquisizione foto");
+        return;
+    }
+
+    inference_job_t job = {};
+    job.type = INFERENCE_JOB_YOLO;
+    job.priority = INFERENCE_PRIORITY_INTERACTIVE;
+    camera_frame_attach_job(frame, &job);
+    job.deadline_us = deadline_us;
+    // Clip su persona rilevata e controllo adattivo della risoluzione
+    job.on_complete = camera_job_complete;
+    job.user_ctx = ws->camera;
+
+    inference_executor_t *exec = get_inference_executor_instance();
+    inference_handle_t handle = NULL;
+    esp_err_t ret = inference_executor_submit_async(exec, &job, webserver_inference_remaining(deadline_us), &handle);
+    if (ret != ESP_OK) {
+        camera_frame_release(frame);
+        ESP_LOGE(TAG, "Executor di inferenza occupato: %s", esp_err_to_name(ret));
+        inference_response_error(response, "503 Service Unavailable", "Inferenza occupata");
+        return;
+    }
+
+    // Risultato fuori dallo stack del worker (inference_result_t contiene fino a MAX_YOLO_DETECTIONS detections)
+    inference_result_t *result = (inference_result_t *)heap_caps_malloc(sizeof(inference_result_t), MALLOC_CAP_8BIT);
+    inference_job_status_t status = INFERENCE_JOB_FAILED;
+    ret = result ? inference_executor_wait(exec, handle, webserver_inference_remaining(deadline_us), result, &status)
+                 : ESP_ERR_NO_MEM;
+    // Se l'attesa scade lo slot viene liberato dall'executor al completamento del job
+    inference_executor_release(exec, handle);
+    if (ret != ESP_OK || status != INFERENCE_JOB_DONE) {
+        heap_caps_free(result);
+        ESP_LOGE(TAG, "Inferenza YOLO non completata: %s, esito %d", esp_err_to_name(ret), status);
+        inference_response_error(response, ret == ESP_ERR_TIMEOUT || status == INFERENCE_JOB_EXPIRED ?
+                                 "504 Gateway Timeout" : "500 Internal Server Error", "Errore inferenza YOLO");
+        return;
+    }
+
+    // La risposta JSON viene scritta in streaming da inference_response_send
+    response->status = HTTPD_200;
+    response->type = "application/json";
+    response->result = result;
+    response->job_type = INFERENCE_JOB_YOLO;
+    ESP_LOGI(TAG, "Inferenza YOLO completata con successo");
+}
+
+// Worker delle inferenze HTTP: completano le richieste asincrone accodate dagli handler, così la task
+// dell'httpd resta libera per /, /photo e /resolution/current mentre il modello è in esecuzione.
+// Il worker che esegue l'inferenza apre un volo: le richieste dello stesso tipo arrivate nella finestra
+// di coalescenza si agganciano e ricevono la stessa risposta
+static void inference_worker_task(void *arg)
+{
+    webserver_t *ws = (webserver_t *)arg;
+    webserver_inference_request_t request;
+    while (xQueueReceive(ws->inference_queue, &request, portMAX_DELAY) == pdTRUE) {
+        if (!request.req) {
+            break;
+        }
+        int64_t now = esp_timer_get_time();
+        uint32_t wait_ms = (uint32_t)((now - request.received_us) / 1000);
+        int64_t deadline_us = request.received_us + WEBSERVER_INFERENCE_DEADLINE_MS * 1000LL;
+        taskENTER_CRITICAL(&ws->inference_lock);
+        if (wait_ms > ws->inference_stats.max_queue_wait_ms) {
+            ws->inference_stats.max_queue_wait_ms = wait_ms;
+        }
+        taskEXIT_CRITICAL(&ws->inference_lock);
+
+        // Arrivata mentre l'altro worker eseguiva la stessa inferenza: si aggancia al suo volo.
+        // Altrimenti il worker apre un volo solo se nessuno è in corso per questo tipo; se quello
+        // dell'altro worker è fuori finestra o pieno, l'inferenza viene eseguita senza volo
+        webserver_inference_flight_t *flight = NULL;
+        bool joined = false;
+        taskENTER_CRITICAL(&ws->inference_lock);
+        if (ws->inference_running) {
+            joined = inference_flight_try_join(ws, request.type, request.req, request.received_us);
+        }
+        if (!joined) {
+            if (!ws->inference_flights[request.type].active) {
+                flight = &ws->inference_flights[request.type];
+                flight->active = true;
+                flight->started_us = now;
+                flight->num_followers = 0;
             }
+            ws->inference_stats.executions++;
         }
-        strcat(keypoints_str, "]");
-        
-        // Aggiungi questa faccia all'array
-        char face_json[512];
-        snprintf(face_json, sizeof(face_json),
-            "{\"confidence\":%.3f,\"bounding_box\":[%lu,%lu,%lu,%lu],\"keypoints\":%s,\"num_keypoints\":%lu,\"category\":%lu}",
-            result.faces[i].confidence,
-            result.faces[i].bounding_boxes[0],
-            result.faces[i].bounding_boxes[1],
-            result.faces[i].bounding_boxes[2],
-            result.faces[i].bounding_boxes[3],
-            keypoints_str,
-            result.faces[i].num_keypoints,
-            result.faces[i].category);
-        
-        strcat(faces_array, face_json);
-        if (i < result.num_faces - 1 && i < MAX_FACES - 1) strcat(faces_array, ",");
-    }
-    strcat(faces_array, "]");
-    
-    snprintf(response, sizeof(response), 
-        "{\"face_detected\":%s,\"inference_time_ms\":%lu,\"num_faces\":%lu,\"faces\":%s,\"success\":true}",
-        result.face_detected ? "true" : "false",
-        result.full_inference_time_ms,
-        result.num_faces,
-        faces_array);
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    
+        taskEXIT_CRITICAL(&ws->inference_lock);
+        if (joined) {
+            continue;
+        }
+
+        webserver_inference_response_t response = {};
+        if (!ws->inference_running) {
+            inference_response_error(&response, "503 Service Unavailable", "Webserver in arresto");
+        } else if (request.type == INFERENCE_JOB_YOLO) {
+            inference_yolo_run(ws, deadline_us, &response);
+        } else {
+            inference_face_run(ws, deadline_us, &response);
+        }
+
+        // Chiusura del volo: da qui le nuove richieste aprono un'altra inferenza
+        // (solo il volo aperto da questo worker: quello dell'altro worker resta suo)
+        httpd_req_t *followers[WEBSERVER_INFERENCE_MAX_SHARED];
+        uint32_t num_followers = 0;
+        if (flight) {
+            taskENTER_CRITICAL(&ws->inference_lock);
+            flight->active = false;
+            num_followers = flight->num_followers;
+            memcpy(followers, flight->followers, sizeof(followers));
+            flight->num_followers = 0;
+            taskEXIT_CRITICAL(&ws->inference_lock);
+        }
+
+        inference_response_send(ws, request.req, &response);
+        for (uint32_t i = 0; i < num_followers; i++) {
+            inference_response_send(ws, followers[i], &response);
+        }
+        if (num_followers > 0) {
+            ESP_LOGI(TAG, "Risposta di inferenza condivisa con %lu richieste", num_followers);
+        }
+        heap_caps_free(response.result);
+
+        taskENTER_CRITICAL(&ws->inference_lock);
+        ws->inference_stats.completed += 1 + num_followers;
+        taskEXIT_CRITICAL(&ws->inference_lock);
+    }
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    taskENTER_CRITICAL(&ws->inference_lock);
+    for (int i = 0; i < WEBSERVER_INFERENCE_WORKERS; i++) {
+        if (ws->inference_workers[i] == self) {
+            ws->inference_workers[i] = NULL;
+        }
+    }
+    taskEXIT_CRITICAL(&ws->inference_lock);
+    vTaskDelete(NULL);
+}
+
+// Passa una richiesta di inferenza al volo in corso dello stesso tipo o a un worker; con la coda piena
+// risponde subito 503 dalla task dell'httpd, prima di staccare la richiesta
+static esp_err_t inference_enqueue(httpd_req_t *req, inference_job_type_t type)
+{
+    webserver_t *ws = get_webserver_instance();
+    if (!ws->inference_queue || !ws->inference_running) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Inferenza non disponibile");
+        return ESP_FAIL;
+    }
+
+    webserver_inference_request_t request = {};
+    request.type = type;
+    request.received_us = esp_timer_get_time();
+    if (uxQueueSpacesAvailable(ws->inference_queue) == 0 &&
+        !inference_flight_joinable(ws, type, request.received_us)) {
+        taskENTER_CRITICAL(&ws->inference_lock);
+        ws->inference_stats.rejected++;
+        taskEXIT_CRITICAL(&ws->inference_lock);
+        ESP_LOGW(TAG, "Richiesta di inferenza rifiutata: coda piena");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+        httpd_resp_send(req, "Inferenza occupata", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    if (httpd_req_async_handler_begin(req, &request.req) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore richiesta asincrona");
+        return ESP_FAIL;
+    }
+    if (inference_flight_join(ws, type, request.req, request.received_us)) {
+        taskENTER_CRITICAL(&ws->inference_lock);
+        ws->inference_stats.accepted++;
+        taskEXIT_CRITICAL(&ws->inference_lock);
+        return ESP_OK;
+    }
+    if (xQueueSend(ws->inference_queue, &request, 0) != pdTRUE) {
+        taskENTER_CRITICAL(&ws->inference_lock);
+        ws->inference_stats.rejected++;
+        taskEXIT_CRITICAL(&ws->inference_lock);
+        // La coda si è riempita dopo il controllo: la richiesta è già staccata, il 503 parte da qui
+        ESP_LOGW(TAG, "Richiesta di inferenza rifiutata: coda piena");
+        webserver_inference_response_t response = {};
+        inference_response_error(&response, "503 Service Unavailable", "Inferenza occupata");
+        inference_response_send(ws, request.req, &response);
+        return ESP_OK;
+    }
+
+    UBaseType_t queued = uxQueueMessagesWaiting(ws->inference_queue);
+    taskENTER_CRITICAL(&ws->inference_lock);
+    ws->inference_stats.accepted++;
+    if (queued > ws->inference_stats.max_queued) {
+        ws->inference_stats.max_queued = queued;
+    }
+    taskEXIT_CRITICAL(&ws->inference_lock);
     return ESP_OK;
 }
 
+// Metriche per il monitor: lavoro risparmiato dalla coalescenza delle richieste concorrenti
+static size_t inference_requests_collect(void *ctx, monitor_metric_t *metrics, size_t max_metrics)
+{
+    webserver_t *ws = (webserver_t *)ctx;
+    taskENTER_CRITICAL(&ws->inference_lock);
+    webserver_inference_stats_t stats = ws->inference_stats;
+    taskEXIT_CRITICAL(&ws->inference_lock);
+
+    const monitor_metric_t values[] = {
+        {"http_inferenze_accettate", stats.accepted},
+        {"http_inferenze_rifiutate", stats.rejected},
+        {"http_inferenze_eseguite", stats.executions},
+        {"http_inferenze_condivise", stats.coalesced},
+        // Richieste servite per ogni acquisizione + inferenza, x100 (100 = nessuna condivisione)
+        {"http_richieste_per_inferenza_x100", stats.executions ? (stats.executions + stats.coalesced) * 100 / stats.executions : 0},
+        {"http_coda_picco", stats.max_queued},
+        {"http_attesa_coda_max_ms", stats.max_queue_wait_ms},
+        {"http_json_serializzazione_media_us", stats.serialized ? stats.serialize_us_total / stats.serialized : 0},
+        {"http_json_serializzazione_max_us", stats.serialize_us_max},
+        {"http_json_risposta_max_bytes", stats.response_bytes_max},
+    };
+    size_t n = sizeof(values) / sizeof(values[0]);
+    if (n > max_metrics) {
+        n = max_metrics;
+    }
+    memcpy(metrics, values, n * sizeof(monitor_metric_t));
+    return n;
+}
+
+// Handler per inferenza (face detection)
+static esp_err_t inference_post_handler(httpd_req_t *req)
+{
+    return inference_enqueue(req, INFERENCE_JOB_FACE);
+}
+
 // Handler per inferenza YOLO
 static esp_err_t yolo_inference_post_handler(httpd_req_t *req)
 {
-    webserver_t *ws = get_webserver_instance();
-    ESP_LOGI(TAG, "Richiesta inferenza YOLO ricevuta");
-    
-    // Controlla se il sistema di inferenza è inizializzato
+    // Controlla se il sistema di inferenza è inizializzato (prima di occupare un posto in coda)
     extern inference_t g_inference;
     if (!g_inference.initialized) {
         ESP_LOGE(TAG, "Sistema di inferenza non inizializzato");
@@ -273,20 +1306,7 @@ static esp_err_t yolo_inference_post_handler(httpd_req_t *req)
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Modello YOLO non inizializzato");
         return ESP_FAIL;
     }
-    
-    // Usa lo stesso flusso del CLI: camera_capture_and_inference
-    inference_result_t result;
-    esp_err_t ret = camera_capture_and_inference(&ws->camera, &result);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Errore durante camera_capture_and_inference");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Errore acquisizione foto");
-        return ESP_FAIL;
-    }
-    
-    ESP_LOGI(TAG, "Inferenza YOLO completata con successo");
-    
-
-    return ESP_OK;
+    return inference_enqueue(req, INFERENCE_JOB_YOLO);
 }
 
 // Tabella degli URI handler
@@ -295,7 +1315,7 @@ static const httpd_uri_t uri_handlers[] = {
      .method = HTTP_GET,
      .handler = root_get_handler,
      .user_ctx = NULL},
-    {.uri = "/capture", //salva la foto nel buffer della fotocamera, in last_photo_buffer
+    {.uri = "/capture", //scatta una foto e la rende l'ultima foto della camera (servita da /photo)
      .method = HTTP_GET,
      .handler = capture_get_handler,
      .user_ctx = NULL},
@@ -303,6 +1323,23 @@ static const httpd_uri_t uri_handlers[] = {
      .method = HTTP_GET,
      .handler = photo_get_handler,
      .user_ctx = NULL},
+    {.uri = "/clip", //clip MJPEG dell'ultimo evento (persona rilevata) dall'anello dei frame recenti
+     .method = HTTP_GET,
+     .handler = clip_get_handler,
+     .user_ctx = NULL},
+    {.uri = "/stream", //stream MJPEG dal vivo dall'acquisizione continua (un cursore per client)
+     .method = HTTP_GET,
+     .handler = stream_get_handler,
+     .user_ctx = NULL},
+    {.uri = "/stream/stats", //fps inviati e frame saltati per ogni client dello stream
+     .method = HTTP_GET,
+     .handler = stream_stats_get_handler,
+     .user_ctx = NULL},
+    {.uri = "/ws/detections", //WebSocket: ogni risultato dell'executor inviato a tutti gli iscritti
+     .method = HTTP_GET,
+     .handler = ws_detections_handler,
+     .user_ctx = NULL,
+     .is_websocket = true},
     {.uri = "/change_resolution",
      .method = HTTP_POST,
      .handler = increment_resolution,
@@ -324,22 +1361,31 @@ static const httpd_uri_t uri_handlers[] = {
 
 //Funzioni per la classe C-style del webserver
 
-//chiamata da main.cpp, avvia una task che lancia il webserver, inizializza la fotocamera e un suo
-//relativo mutex, poi registra tutti le route con relativi handlers
+//chiamata da main.cpp, avvia il server HTTP e registra tutte le route con relativi handlers
 esp_err_t webserver_start_legacy(void)
 {
     return webserver_start_instance(&g_webserver);
 }
 
+esp_err_t webserver_stop_legacy(void)
+{
+    return webserver_stop(&g_webserver);
+}
+
+bool webserver_is_running_legacy(void)
+{
+    return webserver_is_running(&g_webserver);
+}
+
 // Funzione wrapper per compatibilità (versione legacy senza parametri)
 esp_err_t webserver_init_legacy(void)
 {
-    return webserver_init(&g_webserver);
+    return webserver_init(&g_webserver, get_camera_instance());
 }
 
-esp_err_t webserver_init(webserver_t *ws)
+esp_err_t webserver_init(webserver_t *ws, camera_t *camera)
 {
-    if (!ws) {
+    if (!ws || !camera) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -348,10 +1394,18 @@ esp_err_t webserver_init(webserver_t *ws)
     // Inizializza struttura
     memset(ws, 0, sizeof(webserver_t));
     strcpy(ws->current_ip, "0.0.0.0");
+    ws->camera = camera;
+    portMUX_INITIALIZE(&ws->stream_lock);
+    portMUX_INITIALIZE(&ws->ws_lock);
+    portMUX_INITIALIZE(&ws->inference_lock);
+    ws->coalesce_window_ms = WEBSERVER_INFERENCE_COALESCE_WINDOW_MS;
+    for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+        ws->ws_subscribers[i].fd = -1;
+    }
     ws->initialized = true;
 
-    // Inizializza fotocamera
-    esp_err_t ret = camera_init(&ws->camera);
+    // La fotocamera è condivisa con CLI ed executor: viene inizializzata solo se nessuno l'ha già fatto
+    esp_err_t ret = camera_init(ws->camera);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Errore inizializzazione fotocamera");
         return ret;
@@ -375,8 +1429,15 @@ esp_err_t webserver_start_instance(webserver_t *ws)
     config.max_uri_handlers = 16;
     config.stack_size = 8192;
     config.core_id = tskNO_AFFINITY;
+    config.close_fn = webserver_close_fn;
+    // Stream e iscritti WebSocket tengono il socket aperto: con i loro massimi resta spazio per le altre
+    // richieste, e a socket esauriti l'httpd chiude la sessione usata meno di recente invece di rifiutare.
+    // L'httpd usa 3 socket interni: CONFIG_LWIP_MAX_SOCKETS deve essere almeno max_open_sockets + 3
+    config.max_open_sockets = WEBSERVER_STREAM_MAX_CLIENTS + WEBSERVER_WS_MAX_SUBSCRIBERS + WEBSERVER_HTTP_SOCKETS;
+    config.lru_purge_enable = true;
 
     // Avvia server HTTP
+    ws->stream_running = true;
     esp_err_t ret = httpd_start(&ws->server, &config);
     if (ret != ESP_OK)
     {
@@ -397,6 +1458,38 @@ esp_err_t webserver_start_instance(webserver_t *ws)
         }
     }
 
+    // Worker delle richieste di inferenza (la coda limita le richieste in attesa)
+    if (!ws->inference_queue) {
+        ws->inference_queue = xQueueCreate(WEBSERVER_INFERENCE_QUEUE_DEPTH, sizeof(webserver_inference_request_t));
+    }
+    ws->inference_running = ws->inference_queue != NULL;
+    for (int i = 0; i < WEBSERVER_INFERENCE_WORKERS && ws->inference_running; i++) {
+        if (xTaskCreate(inference_worker_task, "ws_inference", WEBSERVER_INFERENCE_STACK_SIZE, ws,
+                        WEBSERVER_INFERENCE_PRIORITY, &ws->inference_workers[i]) != pdPASS) {
+            ESP_LOGW(TAG, "Worker di inferenza %d non creato", i);
+            ws->inference_workers[i] = NULL;
+        }
+    }
+
+    monitor_register_provider(WEBSERVER_INFERENCE_MONITOR_NAME, inference_requests_collect, ws);
+
+    // Push dei risultati su /ws/detections (l'executor è avviato da app_main)
+    if (!ws->ws_mutex) {
+        ws->ws_mutex = xSemaphoreCreateMutex();
+    }
+    ws->ws_pending = (char *)heap_caps_malloc(WEBSERVER_WS_PAYLOAD_SIZE, MALLOC_CAP_8BIT);
+    ws->ws_sending = (char *)heap_caps_malloc(WEBSERVER_WS_PAYLOAD_SIZE, MALLOC_CAP_8BIT);
+    ws->ws_running = ws->ws_mutex && ws->ws_pending && ws->ws_sending;
+    if (ws->ws_running && xTaskCreate(ws_push_task, "ws_push", WEBSERVER_WS_STACK_SIZE, ws,
+                                      WEBSERVER_WS_PRIORITY, &ws->ws_task) != pdPASS) {
+        ws->ws_task = NULL;
+        ws->ws_running = false;
+    }
+    if (!ws->ws_running ||
+        inference_executor_add_listener(get_inference_executor_instance(), ws_result_listener, ws) != ESP_OK) {
+        ESP_LOGW(TAG, "Push dei risultati su /ws/detections non disponibile");
+    }
+
     ws->running = true;
     printf("===========================\n");
     printf("Webserver avviato con successo\n");
@@ -413,8 +1506,121 @@ esp_err_t webserver_stop(webserver_t *ws)
 
     if (ws->running && ws->server) {
         ESP_LOGI(TAG, "Arresto webserver...");
+        // Le task di stream e clip usano le richieste asincrone: vanno chiuse prima di fermare l'httpd.
+        // La chiusura dei socket sblocca le task ferme in httpd_resp_send_chunk verso un client lento
+        ws->stream_running = false;
+        int stream_fds[WEBSERVER_STREAM_MAX_CLIENTS + WEBSERVER_CLIP_MAX_CLIENTS];
+        int num_stream_fds = 0;
+        taskENTER_CRITICAL(&ws->stream_lock);
+        for (int i = 0; i < WEBSERVER_STREAM_MAX_CLIENTS; i++) {
+            if (ws->stream_clients[i].active && ws->stream_clients[i].req) {
+                stream_fds[num_stream_fds++] = httpd_req_to_sockfd(ws->stream_clients[i].req);
+            }
+        }
+        for (int i = 0; i < WEBSERVER_CLIP_MAX_CLIENTS; i++) {
+            if (ws->clip_clients[i].active && ws->clip_clients[i].req) {
+                stream_fds[num_stream_fds++] = httpd_req_to_sockfd(ws->clip_clients[i].req);
+            }
+        }
+        taskEXIT_CRITICAL(&ws->stream_lock);
+        for (int i = 0; i < num_stream_fds; i++) {
+            httpd_sess_trigger_close(ws->server, stream_fds[i]);
+        }
+        // Nessun nuovo risultato verso gli iscritti; la chiusura dei loro socket sblocca un invio in corso
+        inference_executor_remove_listener(get_inference_executor_instance(), ws_result_listener, ws);
+        ws->ws_running = false;
+        int ws_fds[WEBSERVER_WS_MAX_SUBSCRIBERS];
+        int num_ws_fds = 0;
+        taskENTER_CRITICAL(&ws->ws_lock);
+        for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+            if (ws->ws_subscribers[i].fd >= 0) {
+                ws_fds[num_ws_fds++] = ws->ws_subscribers[i].fd;
+            }
+        }
+        taskEXIT_CRITICAL(&ws->ws_lock);
+        for (int i = 0; i < num_ws_fds; i++) {
+            httpd_sess_trigger_close(ws->server, ws_fds[i]);
+        }
+        if (ws->ws_task) {
+            xTaskNotifyGive(ws->ws_task);
+        }
+        bool stream_active = true;
+        for (int waited = 0; stream_active && waited < WEBSERVER_STREAM_STOP_TIMEOUT_MS; waited += 50) {
+            stream_active = false;
+            taskENTER_CRITICAL(&ws->stream_lock);
+            for (int i = 0; i < WEBSERVER_STREAM_MAX_CLIENTS; i++) {
+                stream_active |= ws->stream_clients[i].active;
+            }
+            for (int i = 0; i < WEBSERVER_CLIP_MAX_CLIENTS; i++) {
+                stream_active |= ws->clip_clients[i].active;
+            }
+            taskEXIT_CRITICAL(&ws->stream_lock);
+            stream_active |= ws->ws_task != NULL;
+            if (stream_active) {
+                vTaskDelay(pdMS_TO_TICKS(50));
+            }
+        }
+        if (stream_active) {
+            // httpd_stop libererebbe le richieste ancora in uso: il server resta attivo, l'arresto si può ripetere
+            ESP_LOGE(TAG, "Task di stream, clip o WebSocket ancora attive dopo %d ms: arresto annullato",
+                     WEBSERVER_STREAM_STOP_TIMEOUT_MS);
+            return ESP_ERR_TIMEOUT;
+        }
+        // I worker rispondono 503 alle richieste ancora in coda ed escono dopo l'inferenza in corso
+        monitor_unregister_provider(WEBSERVER_INFERENCE_MONITOR_NAME);
+        ws->inference_running = false;
+        for (int i = 0; i < WEBSERVER_INFERENCE_WORKERS; i++) {
+            webserver_inference_request_t stop = {};
+            if (ws->inference_workers[i]) {
+                xQueueSend(ws->inference_queue, &stop, pdMS_TO_TICKS(WEBSERVER_INFERENCE_DEADLINE_MS));
+            }
+        }
+        int workers_active = 0;
+        for (int waited = 0; waited < WEBSERVER_INFERENCE_DEADLINE_MS; waited += 50) {
+            workers_active = 0;
+            taskENTER_CRITICAL(&ws->inference_lock);
+            for (int i = 0; i < WEBSERVER_INFERENCE_WORKERS; i++) {
+                workers_active += ws->inference_workers[i] != NULL ? 1 : 0;
+            }
+            taskEXIT_CRITICAL(&ws->inference_lock);
+            if (workers_active == 0) {
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(50));
+        }
+        // Una richiesta che ha superato il controllo di inference_running può essere finita in coda dietro
+        // i segnali di arresto: nessun worker la leggerà, il 503 parte da qui prima di httpd_stop
+        webserver_inference_request_t leftover;
+        while (ws->inference_queue && xQueueReceive(ws->inference_queue, &leftover, 0) == pdTRUE) {
+            if (!leftover.req) {
+                continue;
+            }
+            webserver_inference_response_t response = {};
+            inference_response_error(&response, "503 Service Unavailable", "Webserver in arresto");
+            inference_response_send(ws, leftover.req, &response);
+        }
+        // I segnali di arresto dei worker ancora nell'inferenza in corso sono stati svuotati con la coda
+        for (int i = 0; i < workers_active; i++) {
+            webserver_inference_request_t stop = {};
+            xQueueSend(ws->inference_queue, &stop, 0);
+        }
+
+        // La task di invio è uscita; il mutex esclude un osservatore ancora in corso sui buffer
+        char *ws_pending = ws->ws_pending;
+        char *ws_sending = ws->ws_sending;
+        if (ws->ws_mutex) {
+            xSemaphoreTake(ws->ws_mutex, portMAX_DELAY);
+        }
+        ws->ws_pending = NULL;
+        ws->ws_sending = NULL;
+        ws->ws_has_pending = false;
+        if (ws->ws_mutex) {
+            xSemaphoreGive(ws->ws_mutex);
+        }
         esp_err_t ret = httpd_stop(ws->server);
         if (ret == ESP_OK) {
+            heap_caps_free(ws_pending);
+            heap_caps_free(ws_sending);
             ws->running = false;
             ws->server = NULL;
             ESP_LOGI(TAG, "Webserver arrestato con successo");
@@ -433,12 +1639,13 @@ esp_err_t webserver_deinit(webserver_t *ws)
 
     ESP_LOGI(TAG, "Deinizializzazione webserver...");
 
-    // Ferma il server se in esecuzione
-    webserver_stop(ws);
-
-    // Deinizializza fotocamera
-    camera_deinit(&ws->camera);
+    // Ferma il server se in esecuzione (la fotocamera condivisa resta attiva)
+    esp_err_t ret = webserver_stop(ws);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
+    ws->camera = NULL;
     ws->initialized = false;
     ESP_LOGI(TAG, "Webserver deinizializzato");
 
@@ -465,6 +1672,108 @@ bool webserver_is_running(webserver_t *ws)
 
 //Funzioni helper
 
+void webserver_print_stream_stats(webserver_t *ws)
+{
+    if (!ws) {
+        return;
+    }
+    webserver_stream_client_t clients[WEBSERVER_STREAM_MAX_CLIENTS];
+    uint32_t count = stream_get_clients(ws, clients);
+    int64_t now = esp_timer_get_time();
+
+    printf("=== Client /stream: %lu/%d ===\n", count, WEBSERVER_STREAM_MAX_CLIENTS);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t seen = clients[i].frames_sent + clients[i].frames_skipped;
+        printf("Client %lu: connesso da %lld s, %.1f fps, %lu frame inviati, %lu saltati (%lu%%), %llu KB\n",
+               clients[i].id, (now - clients[i].started_us) / 1000000, clients[i].fps, clients[i].frames_sent,
+               clients[i].frames_skipped, seen ? clients[i].frames_skipped * 100 / seen : 0,
+               clients[i].bytes_sent / 1024);
+    }
+    printf("==============================\n");
+}
+
+// Funzione wrapper per compatibilità (versione legacy senza parametri)
+void webserver_print_stream_stats_legacy(void)
+{
+    webserver_print_stream_stats(&g_webserver);
+}
+
+void webserver_print_ws_stats(webserver_t *ws)
+{
+    if (!ws) {
+        return;
+    }
+    webserver_ws_subscriber_t subscribers[WEBSERVER_WS_MAX_SUBSCRIBERS];
+    taskENTER_CRITICAL(&ws->ws_lock);
+    memcpy(subscribers, ws->ws_subscribers, sizeof(subscribers));
+    uint32_t results = ws->ws_results;
+    uint32_t coalesced = ws->ws_coalesced;
+    uint32_t errors = ws->ws_send_errors;
+    taskEXIT_CRITICAL(&ws->ws_lock);
+
+    printf("=== Iscritti /ws/detections ===\n");
+    printf("Risultati serializzati: %lu, sostituiti prima dell'invio: %lu, errori di invio: %lu\n",
+           results, coalesced, errors);
+    for (int i = 0; i < WEBSERVER_WS_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].fd >= 0) {
+            printf("Socket %d: %s, %lu inviati, %lu filtrati perché invariati\n", subscribers[i].fd,
+                   subscribers[i].changes_only ? "solo cambiamenti" : "tutti i risultati",
+                   subscribers[i].sent, subscribers[i].unchanged);
+        }
+    }
+    printf("===============================\n");
+}
+
+// Funzione wrapper per compatibilità (versione legacy senza parametri)
+void webserver_print_ws_stats_legacy(void)
+{
+    webserver_print_ws_stats(&g_webserver);
+}
+
+void webserver_print_inference_stats(webserver_t *ws)
+{
+    if (!ws) {
+        return;
+    }
+    webserver_inference_stats_t stats;
+    taskENTER_CRITICAL(&ws->inference_lock);
+    stats = ws->inference_stats;
+    taskEXIT_CRITICAL(&ws->inference_lock);
+    uint32_t queued = ws->inference_queue ? uxQueueMessagesWaiting(ws->inference_queue) : 0;
+
+    printf("=== Richieste di inferenza HTTP ===\n");
+    printf("Worker: %d, coda: %lu/%d (picco %lu)\n", WEBSERVER_INFERENCE_WORKERS, queued,
+           WEBSERVER_INFERENCE_QUEUE_DEPTH, stats.max_queued);
+    printf("Accettate: %lu, completate: %lu, rifiutate (503): %lu, attesa massima in coda: %lu ms\n",
+           stats.accepted, stats.completed, stats.rejected, stats.max_queue_wait_ms);
+    printf("Coalescenza (finestra %lu ms): %lu inferenze eseguite, %lu richieste servite da un'inferenza già in corso\n",
+           ws->coalesce_window_ms, stats.executions, stats.coalesced);
+    printf("JSON in streaming: %lu risposte, serializzazione media %lu us (max %lu us), risposta più grande %lu bytes\n",
+           stats.serialized, stats.serialized ? stats.serialize_us_total / stats.serialized : 0,
+           stats.serialize_us_max, stats.response_bytes_max);
+    printf("===================================\n");
+}
+
+// Funzione wrapper per compatibilità (versione legacy senza parametri)
+void webserver_print_inference_stats_legacy(void)
+{
+    webserver_print_inference_stats(&g_webserver);
+}
+
+void webserver_set_coalesce_window(webserver_t *ws, uint32_t window_ms)
+{
+    if (ws) {
+        ws->coalesce_window_ms = window_ms;
+        ESP_LOGI(TAG, "Finestra di coalescenza delle inferenze: %lu ms", window_ms);
+    }
+}
+
+// Funzione wrapper per compatibilità (versione legacy senza parametri)
+void webserver_set_coalesce_window_legacy(uint32_t window_ms)
+{
+    webserver_set_coalesce_window(&g_webserver, window_ms);
+}
+
 // Funzione per impostare l'IP del webserver (versione legacy per compatibilità)
 void webserver_set_ip(const char* ip_address)
 {
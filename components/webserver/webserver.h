@@ -3,30 +3,148 @@
 
 #include "esp_err.h"
 #include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "camera.h"
+#include "camera_ring.h"
+#include "inference_executor.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define WEBSERVER_STREAM_MAX_CLIENTS 3 //client /stream contemporanei (ognuno occupa un socket, una task e un frame del pool)
+
+// Client dello stream MJPEG: ogni client ha il proprio cursore (ultimo frame inviato), così un client lento
+// salta direttamente all'ultimo frame acquisito senza rallentare l'acquisizione o gli altri client
+typedef struct {
+    httpd_req_t *req;           // copia asincrona della richiesta, usata dalla task del client
+    TaskHandle_t task;
+    uint32_t id;
+    int64_t started_us;
+    uint32_t last_sequence;     // cursore: sequenza dell'ultimo frame inviato
+    uint32_t frames_sent;
+    uint32_t frames_skipped;    // frame acquisiti mentre il client era ancora impegnato nell'invio precedente
+    uint64_t bytes_sent;
+    int64_t fps_window_us;      // inizio della finestra di un secondo per il calcolo degli fps
+    uint32_t fps_window_frames;
+    float fps;                  // fps inviati nell'ultima finestra completa
+    bool active;
+} webserver_stream_client_t;
+
+#define WEBSERVER_CLIP_MAX_CLIENTS 2 //invii di /clip contemporanei (ognuno occupa un socket e una task)
+
+// Invio di una clip: la riproduzione al ritmo di acquisizione avviene su una task dedicata, non sull'httpd
+typedef struct {
+    httpd_req_t *req;           // copia asincrona della richiesta, usata dalla task della clip
+    TaskHandle_t task;
+    camera_frame_t *frames[CAMERA_RING_CLIP_MAX_FRAMES];   // riferimenti trattenuti fino alla fine dell'invio
+    uint32_t count;
+    bool active;
+} webserver_clip_client_t;
+
+#define WEBSERVER_WS_MAX_SUBSCRIBERS 4 //client /ws/detections contemporanei
+
+// Client WebSocket dei risultati: riceve ogni risultato dell'executor, o solo quelli con detections
+// diverse dall'ultimo ricevuto (changes_only)
+typedef struct {
+    int fd;                     // socket del client (-1 = slot libero)
+    bool changes_only;
+    uint32_t last_signature;    // firma delle detections dell'ultimo risultato inviato
+    uint32_t sent;
+    uint32_t unchanged;         // risultati non inviati perché uguali al precedente
+} webserver_ws_subscriber_t;
+
+#define WEBSERVER_INFERENCE_WORKERS 2 //richieste di inferenza HTTP servite in parallelo (frame in volo nell'executor)
+#define WEBSERVER_INFERENCE_QUEUE_DEPTH 2 //richieste in attesa di un worker, oltre cui si risponde 503
+#define WEBSERVER_INFERENCE_JOB_TYPES 2 //tipi di inferenza HTTP (face, YOLO): un volo per tipo
+#define WEBSERVER_INFERENCE_MAX_SHARED 6 //richieste agganciate al massimo a un'inferenza già in corso
+#define WEBSERVER_INFERENCE_COALESCE_WINDOW_MS 500 //ritardo massimo dall'inizio del volo per agganciarsi (0 = disattivato)
+
+// Richiesta di inferenza staccata dall'httpd (httpd_req_async_handler_begin) e completata da un worker
+typedef struct {
+    httpd_req_t *req;           // copia asincrona della richiesta (NULL = arresto del worker)
+    inference_job_type_t type;
+    int64_t received_us;        // arrivo all'httpd: la scadenza comprende l'attesa in coda
+} webserver_inference_request_t;
+
+// Inferenza in corso per un tipo di richiesta: le richieste arrivate entro la finestra di coalescenza
+// ricevono la risposta del worker che la esegue invece di un'altra acquisizione e inferenza
+typedef struct {
+    bool active;
+    int64_t started_us;
+    httpd_req_t *followers[WEBSERVER_INFERENCE_MAX_SHARED];
+    uint32_t num_followers;
+} webserver_inference_flight_t;
+
+// Statistiche delle richieste di inferenza HTTP
+typedef struct {
+    uint32_t accepted;
+    uint32_t rejected;          // coda piena: risposta 503 immediata
+    uint32_t completed;         // risposte inviate (comprese quelle condivise)
+    uint32_t executions;        // acquisizioni + inferenze eseguite per le richieste HTTP
+    uint32_t coalesced;         // richieste servite dall'inferenza di un'altra richiesta
+    uint32_t serialized;        // risposte JSON scritte in streaming
+    uint32_t serialize_us_total; // tempo di serializzazione (senza l'invio sulla rete)
+    uint32_t serialize_us_max;
+    uint32_t response_bytes_max;
+    uint32_t max_queued;
+    uint32_t max_queue_wait_ms;
+} webserver_inference_stats_t;
+
 // Struttura per il webserver (classe C-style)
 typedef struct {
     httpd_handle_t server;
-    camera_t camera;
+    camera_t *camera;       // istanza condivisa (get_camera_instance), non posseduta dal webserver
     char current_ip[16];
     bool initialized;
     bool running;
+
+    // Client di /stream (letti da /stream/stats e dalla CLI, aggiornati dalle task dei client)
+    webserver_stream_client_t stream_clients[WEBSERVER_STREAM_MAX_CLIENTS];
+    uint32_t stream_next_id;
+    webserver_clip_client_t clip_clients[WEBSERVER_CLIP_MAX_CLIENTS];  // protetti anch'essi da stream_lock
+    portMUX_TYPE stream_lock;
+    volatile bool stream_running;   // false = arresto: le task di stream e clip escono
+
+    // Push dei risultati su /ws/detections: l'osservatore dell'executor serializza l'ultimo risultato in
+    // ws_pending e sveglia la task di invio; i risultati arrivati nel frattempo lo sostituiscono
+    webserver_ws_subscriber_t ws_subscribers[WEBSERVER_WS_MAX_SUBSCRIBERS];
+    portMUX_TYPE ws_lock;           // iscritti
+    SemaphoreHandle_t ws_mutex;     // buffer dei risultati
+    char *ws_pending;
+    size_t ws_pending_len;
+    uint32_t ws_pending_signature;
+    bool ws_has_pending;
+    char *ws_sending;               // copia usata dalla task di invio
+    TaskHandle_t ws_task;           // invio agli iscritti (un client lento non ferma l'httpd)
+    volatile bool ws_running;       // false = arresto: la task di invio esce
+    uint32_t ws_results;            // risultati serializzati
+    uint32_t ws_coalesced;          // risultati sostituiti da uno più recente prima dell'invio
+    uint32_t ws_send_errors;
+
+    // Richieste di inferenza in attesa dei worker
+    QueueHandle_t inference_queue;
+    TaskHandle_t inference_workers[WEBSERVER_INFERENCE_WORKERS];
+    webserver_inference_flight_t inference_flights[WEBSERVER_INFERENCE_JOB_TYPES];
+    uint32_t coalesce_window_ms;
+    webserver_inference_stats_t inference_stats;
+    portMUX_TYPE inference_lock;
+    volatile bool inference_running;
 } webserver_t;
 
 /**
  * @brief Inizializza il webserver
  * @param ws Puntatore alla struttura webserver
+ * @param camera Fotocamera condivisa (inizializzata qui se non lo è già)
  * @return ESP_OK se l'inizializzazione è riuscita
  */
-esp_err_t webserver_init(webserver_t *ws);
+esp_err_t webserver_init(webserver_t *ws, camera_t *camera);
 
 /**
- * @brief Inizializza il webserver (versione legacy senza parametri)
+ * @brief Inizializza il webserver sulla fotocamera globale (versione legacy senza parametri)
  * @return ESP_OK se l'inizializzazione è riuscita
  */
 esp_err_t webserver_init_legacy(void);
@@ -52,12 +170,19 @@ esp_err_t webserver_start_instance(webserver_t *ws);
 esp_err_t webserver_start_legacy(void);
 
 /**
- * @brief Ferma il webserver HTTP
+ * @brief Ferma il webserver HTTP (chiude i client dello stream e attende l'uscita delle loro task)
  * @param ws Puntatore alla struttura webserver
- * @return ESP_OK se l'arresto è riuscito
+ * @return ESP_OK se l'arresto è riuscito, ESP_ERR_TIMEOUT se una task dello stream non è uscita
+ *         (il server resta attivo e l'arresto può essere ripetuto)
  */
 esp_err_t webserver_stop(webserver_t *ws);
 
+/**
+ * @brief Ferma il webserver HTTP (versione legacy senza parametri)
+ * @return ESP_OK se l'arresto è riuscito, ESP_ERR_TIMEOUT se una task dello stream non è uscita
+ */
+esp_err_t webserver_stop_legacy(void);
+
 /**
  * @brief Deinizializza il webserver
  * @param ws Puntatore alla struttura webserver
@@ -99,6 +224,58 @@ const char* webserver_get_ip(webserver_t *ws);
  */
 bool webserver_is_running(webserver_t *ws);
 
+/**
+ * @brief Controlla se il webserver è in esecuzione (versione legacy senza parametri)
+ * @return true se il webserver è in esecuzione
+ */
+bool webserver_is_running_legacy(void);
+
+/**
+ * @brief Stampa i client connessi a /stream con fps inviati e frame saltati
+ * @param ws Puntatore alla struttura webserver
+ */
+void webserver_print_stream_stats(webserver_t *ws);
+
+/**
+ * @brief Stampa i client connessi a /stream (versione legacy senza parametri)
+ */
+void webserver_print_stream_stats_legacy(void);
+
+/**
+ * @brief Stampa gli iscritti a /ws/detections con risultati inviati e filtrati
+ * @param ws Puntatore alla struttura webserver
+ */
+void webserver_print_ws_stats(webserver_t *ws);
+
+/**
+ * @brief Stampa gli iscritti a /ws/detections (versione legacy senza parametri)
+ */
+void webserver_print_ws_stats_legacy(void);
+
+/**
+ * @brief Imposta la finestra di coalescenza delle richieste di inferenza concorrenti
+ * @param ws Puntatore alla struttura webserver
+ * @param window_ms Ritardo massimo dall'inizio di un'inferenza in corso per condividerne la risposta (0 = disattivata)
+ */
+void webserver_set_coalesce_window(webserver_t *ws, uint32_t window_ms);
+
+/**
+ * @brief Imposta la finestra di coalescenza (versione legacy senza parametri)
+ * @param window_ms Finestra in millisecondi (0 = disattivata)
+ */
+void webserver_set_coalesce_window_legacy(uint32_t window_ms);
+
+/**
+ * @brief Stampa la coda delle richieste di inferenza HTTP (accettate, rifiutate, attesa massima)
+ * @param ws Puntatore alla struttura webserver
+ */
+void webserver_print_inference_stats(webserver_t *ws);
+
+/**
+ * @brief Stampa la coda delle richieste di inferenza HTTP (versione legacy senza parametri)
+ */
+void webserver_print_inference_stats_legacy(void);
+
 #ifdef __cplusplus
 }
 #endif
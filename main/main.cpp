@@ -12,7 +12,11 @@
 #include "nvs_flash.h"
 #include "webserver.h"
 #include "inference.h"
+#include "inference_executor.h"
 #include "camera.h"
+#include "camera_replay.h"
+#include "camera_ring.h"
+#include "camera_adapt.h"
 #include "monitor.h"
 
 #define WIFI_SSID "Iphone di Prato"
@@ -20,12 +24,6 @@
 
 static const char *TAG = "MAIN";
 
-// Inizializza la fotocamera globalmente
-camera_t g_camera;
-
-// Queue per comunicazione tra CLI e AI task
-static QueueHandle_t ai_task_queue = NULL;
-
 // "ESP_ERROR_CHECK(x)" = esegui x normalmente, e se fallisce, riavvia l'esp32
 
 // Un "event group" è un oggetto di FreeRTOS, che gestisce la comunicazione tra task
@@ -153,6 +151,37 @@ static void start_webserver(){
 }
 
 
+// Ferma i consumatori dei frame (controllo adattivo, ring, stream, clip e inferenze HTTP) prima di
+// camera_deinit, che elimina gli eventi e i mutex che usano, e l'executor prima di inference_deinit:
+// nella pipeline il frame della camera è rilasciato dopo la decodifica, mentre modelli e arena sono
+// ancora in uso sugli altri stadi. false se il webserver o l'executor non si sono fermati
+static bool camera_stop_consumers(bool *webserver_stopped)
+{
+    camera_adapt_stop(get_camera_adapt_instance());
+    camera_ring_stop(get_camera_ring_instance());
+    *webserver_stopped = false;
+    if (webserver_is_running_legacy()) {
+        if (webserver_stop_legacy() != ESP_OK) {
+            return false;
+        }
+        *webserver_stopped = true;
+    }
+    return inference_executor_stop(get_inference_executor_instance(),
+                                   pdMS_TO_TICKS(INFERENCE_EXECUTOR_STOP_TIMEOUT_MS)) == ESP_OK;
+}
+
+// Riavvia ciò che camera_stop_consumers ha fermato (l'executor prima del webserver, che vi registra il push)
+static void camera_restart_consumers(bool webserver_stopped)
+{
+    esp_err_t ret = inference_executor_start(get_inference_executor_instance(), get_inference_instance());
+    if (ret != ESP_OK) {
+        printf("Impossibile riavviare l'executor di inferenza: %s\n", esp_err_to_name(ret));
+    }
+    if (webserver_stopped) {
+        webserver_start_legacy();
+    }
+}
+
 static void cli_task(void *pvParameters){
     printf("===========================\n");
     printf("INTERFACCIA A RIGA DI COMANDO\n"); 
@@ -165,6 +194,16 @@ static void cli_task(void *pvParameters){
     printf("w: Avvia il webserver per web UI\n");
     printf("s: Scatta foto ed esegui inferenza\n");
     printf("f: Inizializza il modello di inferenza Yolo esterno\n");
+    printf("k: Attiva/disattiva il filtro YOLO solo persone\n");
+    printf("j: Attiva/disattiva la pipeline YOLO su due core\n");
+    printf("c: Attiva/disattiva l'acquisizione continua della fotocamera\n");
+    printf("o: Alterna la sorgente dei frame (sensore / replay dalla partizione frames)\n");
+    printf("n: Attiva/disattiva la finestra del sensore allineata al modello YOLO\n");
+    printf("u: Attiva/disattiva il doppio flusso (RGB565 per l'inferenza, JPEG su richiesta)\n");
+    printf("R: Attiva/disattiva l'anello dei frame recenti (clip su persona rilevata, GET /clip)\n");
+    printf("T: Congela una clip dall'anello dei frame recenti\n");
+    printf("A: Attiva/disattiva il controllo adattivo della risoluzione (detections, latenza, buffer dei frame)\n");
+    printf("S: Mostra stream MJPEG, iscritti a /ws/detections e coda delle inferenze HTTP\n");
     printf("e: Esci\n");
     printf("===========================\n");
     printf("COMANDI DI MONITORAGGIO\n"); 
@@ -178,6 +217,10 @@ static void cli_task(void *pvParameters){
     printf("m: Mostra statistiche di monitoraggio\n");
     printf("t: Mostra statistiche task\n");
     printf("r: Mostra statistiche RAM\n");
+    printf("a: Mostra statistiche arena inferenza\n");
+    printf("y: Mostra latenze delle varianti YOLO\n");
+    printf("x: Mostra statistiche executor inferenza\n");
+    printf("g: Mostra statistiche acquisizione fotocamera\n");
     printf("===========================\n");
     printf("Inserisci un comando:\n");
     int command;
@@ -194,6 +237,7 @@ static void cli_task(void *pvParameters){
         else if (command == 'i'){
             printf("Inizializza il sistema di inferenza e la fotocamera...\n");
             inference_init_legacy();
+            inference_executor_start(get_inference_executor_instance(), get_inference_instance());
             camera_init(&g_camera);
             int width, height;
             camera_get_current_resolution(&g_camera, &width, &height);
@@ -206,10 +250,133 @@ static void cli_task(void *pvParameters){
             //inizializza modello Yolov11n
             inference_yolo_init_legacy();
         }
+        else if (command == 'k') {
+            // classe 0 del dataset COCO = "person"
+            static bool person_only = false;
+            static const uint32_t person_class[] = {0};
+            person_only = !person_only;
+            inference_yolo_set_class_filter(get_inference_instance(), person_class, person_only ? 1 : 0);
+            printf("Filtro YOLO solo persone: %s\n", person_only ? "attivo" : "disattivo");
+        }
+        else if (command == 'j') {
+            inference_executor_t *exec = get_inference_executor_instance();
+            if (inference_executor_set_pipelined(exec, !exec->pipelined) == ESP_OK) {
+                printf("Pipeline YOLO: %s\n", exec->pipelined ? "attiva" : "disattiva");
+            } else {
+                printf("Impossibile cambiare modalità (executor o modello YOLO non inizializzati)\n");
+            }
+        }
+        else if (command == 'c') {
+            if (g_camera.capture_task) {
+                if (camera_stop_capture(&g_camera) == ESP_OK) {
+                    printf("Acquisizione continua: disattiva\n");
+                } else {
+                    printf("La task di acquisizione non è ancora uscita (driver bloccato)\n");
+                }
+            } else if (camera_start_capture(&g_camera) == ESP_OK) {
+                printf("Acquisizione continua: attiva\n");
+            } else {
+                printf("Impossibile avviare l'acquisizione continua (fotocamera non inizializzata)\n");
+            }
+        }
+        else if (command == 'o') {
+            // Sorgente dei frame: sensore reale oppure replay dei JPEG registrati (partizione "frames")
+            bool replay = g_camera.source != &camera_replay_source;
+            bool webserver_stopped = false;
+            esp_err_t ret = ESP_OK;
+            if (!camera_stop_consumers(&webserver_stopped)) {
+                printf("Impossibile fermare il webserver o l'executor: sorgente invariata\n");
+            } else if (g_camera.initialized && (ret = camera_deinit(&g_camera)) != ESP_OK) {
+                printf("Impossibile deinizializzare la sorgente attuale: %s\n", esp_err_to_name(ret));
+            } else {
+                ret = replay ? camera_init_with_source(&g_camera, &camera_replay_source, get_camera_replay_instance())
+                             : camera_init_with_source(&g_camera, &camera_sensor_source, NULL);
+                if (ret == ESP_OK) {
+                    printf("Sorgente dei frame: %s\n", g_camera.source->name);
+                } else {
+                    printf("Impossibile inizializzare la sorgente %s: %s\n", replay ? "replay" : "sensore", esp_err_to_name(ret));
+                }
+            }
+            camera_restart_consumers(webserver_stopped);
+        }
+        else if (command == 'n') {
+            if (g_camera.model_window) {
+                camera_clear_model_window(&g_camera);
+                printf("Finestra allineata al modello: disattiva\n");
+            } else {
+                // Dimensione dell'input della variante YOLO attiva
+                inference_t *inf = get_inference_instance();
+                int width = YOLO_INPUT_SIZE, height = YOLO_INPUT_SIZE;
+                if (inf->yolo_num_variants > 0) {
+                    width = inf->yolo_variants[inf->yolo_active_variant].desc.input_width;
+                    height = inf->yolo_variants[inf->yolo_active_variant].desc.input_height;
+                }
+                if (camera_set_model_window(&g_camera, width, height) == ESP_OK) {
+                    printf("Finestra allineata al modello: %dx%d\n", width, height);
+                } else {
+                    printf("Nessuna finestra del sensore %dx%d disponibile\n", width, height);
+                }
+            }
+        }
+        else if (command == 'u') {
+            // Doppio flusso: RGB565 dal sensore per l'inferenza, JPEG solo quando un client HTTP lo chiede
+            pixformat_t format = g_camera.pixel_format == PIXFORMAT_JPEG ? PIXFORMAT_RGB565 : PIXFORMAT_JPEG;
+            if (camera_set_pixel_format(&g_camera, format) == ESP_OK) {
+                printf("Formato del sensore: %s\n", format == PIXFORMAT_JPEG ? "JPEG" : "RGB565 (doppio flusso)");
+            } else {
+                printf("Impossibile cambiare il formato del sensore\n");
+            }
+        }
+        else if (command == 'R') {
+            // Storia recente in PSRAM (handle dei frame, nessuna copia) entro il budget di byte
+            camera_ring_t *ring = get_camera_ring_instance();
+            if (ring->task) {
+                camera_ring_print_stats(ring);
+                camera_ring_stop(ring);
+                printf("Anello dei frame recenti: disattivo\n");
+            } else if (camera_ring_start(ring, &g_camera, NULL) == ESP_OK) {
+                printf("Anello dei frame recenti: attivo (clip su GET /clip)\n");
+            } else {
+                printf("Impossibile avviare l'anello (fotocamera non inizializzata)\n");
+            }
+        }
+        else if (command == 'T') {
+            if (camera_ring_trigger(get_camera_ring_instance()) == ESP_OK) {
+                printf("Clip in registrazione\n");
+            } else {
+                printf("Anello non attivo o clip già in registrazione\n");
+            }
+        }
+        else if (command == 'A') {
+            camera_adapt_t *ctl = get_camera_adapt_instance();
+            if (ctl->task) {
+                camera_adapt_stop(ctl);
+                camera_adapt_print_stats(ctl);
+                printf("Controllo adattivo della risoluzione: disattivo\n");
+            } else if (camera_adapt_start(ctl, &g_camera, NULL) == ESP_OK) {
+                printf("Controllo adattivo della risoluzione: attivo (decisioni con 'm')\n");
+            } else {
+                printf("Impossibile avviare il controllo adattivo (fotocamera non inizializzata)\n");
+            }
+        }
+        else if (command == 'S') {
+            webserver_print_stream_stats_legacy();
+            webserver_print_ws_stats_legacy();
+            webserver_print_inference_stats_legacy();
+        }
         else if (command == 'd') {
             printf("Deinizializza la fotocamera e il sistema di inferenza...\n");
-            camera_deinit(&g_camera);
-            inference_deinit_legacy();
+            bool webserver_stopped = false;
+            if (!camera_stop_consumers(&webserver_stopped)) {
+                printf("Impossibile fermare il webserver o l'executor: deinizializzazione annullata\n");
+                camera_restart_consumers(webserver_stopped);
+            } else if (camera_deinit(&g_camera) != ESP_OK) {
+                printf("Fotocamera ancora in uso: deinizializzazione annullata\n");
+                camera_restart_consumers(webserver_stopped);
+            } else {
+                // L'executor resta fermo fino alla prossima 'i': nessun modello è più in esecuzione
+                inference_deinit_legacy();
+            }
         }
         else if (command == '+') {
             printf("Aumenta risoluzione fotocamera...\n");
@@ -222,6 +389,7 @@ static void cli_task(void *pvParameters){
         else if (command == 'm') {
             printf("Mostro statistiche di monitoraggio...\n");
             monitor_print_system_stats();
+            monitor_print_providers();
         }
         else if (command == 't') {
             printf("Mostro statistiche task...\n");
@@ -233,6 +401,22 @@ static void cli_task(void *pvParameters){
             monitor_print_ram_stats();
             monitor_memory_region_details();
         }
+        else if (command == 'a') {
+            printf("Mostro statistiche arena inferenza...\n");
+            inference_print_arena_stats(get_inference_instance());
+        }
+        else if (command == 'y') {
+            printf("Mostro latenze delle varianti YOLO...\n");
+            inference_print_yolo_variants(get_inference_instance());
+        }
+        else if (command == 'x') {
+            printf("Mostro statistiche executor inferenza...\n");
+            inference_executor_print_stats(get_inference_executor_instance());
+        }
+        else if (command == 'g') {
+            printf("Mostro statistiche acquisizione fotocamera...\n");
+            camera_print_capture_stats(&g_camera);
+        }
         else if (command == 'p') {
             printf("Avvio monitoraggio continuo...\n");
             monitor_start_continuous_monitoring();
@@ -270,6 +454,16 @@ static void cli_task(void *pvParameters){
             printf("w: Avvia il webserver per web UI\n");
             printf("s: Scatta foto ed esegui inferenza\n");
             printf("f: Inizializza il modello di inferenza Yolo esterno\n");
+            printf("k: Attiva/disattiva il filtro YOLO solo persone\n");
+            printf("j: Attiva/disattiva la pipeline YOLO su due core\n");
+            printf("c: Attiva/disattiva l'acquisizione continua della fotocamera\n");
+            printf("o: Alterna la sorgente dei frame (sensore / replay dalla partizione frames)\n");
+            printf("n: Attiva/disattiva la finestra del sensore allineata al modello YOLO\n");
+            printf("u: Attiva/disattiva il doppio flusso (RGB565 per l'inferenza, JPEG su richiesta)\n");
+            printf("R: Attiva/disattiva l'anello dei frame recenti (clip su persona rilevata, GET /clip)\n");
+            printf("T: Congela una clip dall'anello dei frame recenti\n");
+            printf("A: Attiva/disattiva il controllo adattivo della risoluzione (detections, latenza, buffer dei frame)\n");
+            printf("S: Mostra stream MJPEG, iscritti a /ws/detections e coda delle inferenze HTTP\n");
             printf("e: Esci\n");
             printf("===========================\n");
             printf("COMANDI DI MONITORAGGIO\n"); 
@@ -283,6 +477,10 @@ static void cli_task(void *pvParameters){
             printf("m: Mostra statistiche di monitoraggio\n");
             printf("t: Mostra statistiche task\n");
             printf("r: Mostra statistiche RAM\n");
+            printf("a: Mostra statistiche arena inferenza\n");
+            printf("y: Mostra latenze delle varianti YOLO\n");
+            printf("x: Mostra statistiche executor inferenza\n");
+            printf("g: Mostra statistiche acquisizione fotocamera\n");
             printf("===========================\n");
             printf("Inserisci un comando:\n");
         }
@@ -296,35 +494,6 @@ static void cli_task(void *pvParameters){
 
 }
 
-// Task AI dedicata all'inferenza
-static void ai_task(void *pvParameters)
-{
-    ESP_LOGI(TAG, "AI Task avviata - in attesa di frame per inferenza...");
-    
-    ai_task_message_t message;
-    
-    while (true) {
-        // Aspetta un messaggio dalla main task (CLI per ora), si blocca finchè non riceve un frame sui cui fare inference
-        if (xQueueReceive(ai_task_queue, &message, portMAX_DELAY) == pdTRUE) {
-
-            inference_result_t result;
-            //Inference face detection o Yolo
-            //if (inference_process_image(message.image_buffer, message.image_size, &result)) {
-            if (inference_process_image_yolo(message.image_buffer, message.image_size, &result)) {
-                ESP_LOGI(TAG, "AI Task: Inferenza completata con successo");
-            } else {
-                ESP_LOGE(TAG, "AI Task: Errore durante l'inferenza");
-            }
-            
-            // Libera la memoria del frame (allocata dalla CLI task)
-            if (message.image_buffer) {
-                free(message.image_buffer);
-                message.image_buffer = NULL;
-            }
-        }
-    }
-}
-
 //inizio dell'applicazione
 extern "C" void app_main(void)
 {
@@ -342,18 +511,19 @@ extern "C" void app_main(void)
     // Inizializza il sistema di monitoraggio
     ESP_ERROR_CHECK(monitor_init());
 
-    // Inizializza la queue per la comunicazione con la AI task
-    ESP_ERROR_CHECK(camera_init_ai_queue());
-    
-    // Ottieni l'handle della queue e passalo alla AI task
-    ai_task_queue = camera_get_ai_queue();
+    // Avvia l'executor di inferenza: l'unica task che esegue i modelli (richieste HTTP e frame della CLI)
+    ESP_ERROR_CHECK(inference_executor_start(get_inference_executor_instance(), get_inference_instance()));
+
+    // Servizio fotocamera: un'unica istanza condivisa da CLI, executor e webserver.
+    // Senza sensore il sistema parte comunque ('i' o 'o' per riprovare)
+    ret = camera_init(get_camera_instance());
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Fotocamera non disponibile all'avvio: %s", esp_err_to_name(ret));
+    }
 
     //Crea task per la CLI, main_task termina
     xTaskCreatePinnedToCore(cli_task, "cli_task", 4096, NULL, 1, NULL, 0);
 
-    //Crea task per AI con xTaskCreate e basta
-    xTaskCreate(ai_task, "ai_task", 32768, NULL, 1, NULL);
-
     ESP_LOGI(TAG, "Sistema avviato. Usa 'h' per vedere i comandi disponibili.");
 }
 